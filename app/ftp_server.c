@@ -6,27 +6,51 @@
  * - 控制连接（端口 21）管理
  * - 被动模式（PASV）数据连接
  * - 基本 FTP 命令：USER, PASS, SYST, PWD, CWD, LIST, RETR, STOR, TYPE, PASV, QUIT
+ * - 断点续传与增量同步（RFC 3659）：REST, APPE, SIZE, MDTM
+ * - 机器可读的目录列表（RFC 3659）：MLSD, MLST
  *
  */
 
 #include "driver.h"
+#include "ip.h"
+#include "map.h"
 #include "net.h"
 #include "tcp.h"
 
 #include <dirent.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <sys/stat.h>
 #include <time.h>
 #include <unistd.h>
 
 /* ========================= FTP 配置常量 ========================= */
 #define FTP_CTRL_PORT 21           // FTP 控制连接端口
-#define FTP_DATA_PORT_BASE 20000   // 被动模式数据端口起始值
+#ifndef FTP_PASV_PORT_MIN
+#define FTP_PASV_PORT_MIN 20000    // 被动模式数据端口范围下限
+#endif
+#ifndef FTP_PASV_PORT_MAX
+#define FTP_PASV_PORT_MAX 20999    // 被动模式数据端口范围上限（含）
+#endif
+#define FTP_PASV_PORT_COUNT (FTP_PASV_PORT_MAX - FTP_PASV_PORT_MIN + 1)
 #define FTP_MAX_PATH_LENGTH 512    // 最大路径长度
 #define FTP_MAX_CMD_LENGTH 256     // 最大命令长度
 #define FTP_MAX_RESPONSE_LENGTH 1024  // 最大响应长度
 #define FTP_BUFFER_SIZE 4096       // 数据传输缓冲区大小
-#define FTP_MAX_SESSIONS 16        // 最大同时会话数
+#ifndef FTP_MAX_SESSIONS
+#define FTP_MAX_SESSIONS 1024      // 最大同时会话数
+#endif
+#ifndef FTP_SESSION_IDLE_TIMEOUT
+#define FTP_SESSION_IDLE_TIMEOUT 300  // 控制连接空闲超时时间（秒），超时后关闭会话
+#endif
+#define FTP_SESSION_BUCKETS 64     // 会话散列表的初始桶数，须为2的幂，会话数超过桶数时加倍
+#define FTP_STAT_CACHE_SIZE 64     // 文件属性缓存的最大条目数
+#define FTP_STAT_CACHE_TTL 2       // 文件属性缓存的有效期（秒），过期后重新 stat
+#define FTP_LIST_CACHE_SIZE 32     // 缓存的目录列表数
+#define FTP_DATA_MSS (ETHERNET_MAX_TRANSPORT_UNIT - sizeof(ip_hdr_t) - sizeof(tcp_hdr_t))  // 数据连接报文段的最大负载，避免 IP 分片
+#define FTP_SCHED_QUANTUM 16384    // 每轮主循环每个会话至多发送的字节数
+#define FTP_DATA_TIMEOUT 30        // 数据传输无进展（未收到新的确认或数据）的超时时间（秒）
+#define FTP_STOR_BUFFER_SIZE (64 * 1024)  // STOR 写缓冲区大小，攒满后一次写入文件
 
 /* ========================= FTP 响应码 ========================= */
 #define FTP_RESP_READY           "220"
@@ -51,6 +75,8 @@
 #define FTP_RESP_BAD_SEQUENCE    "503"
 #define FTP_RESP_NOT_LOGGED_IN   "530"
 #define FTP_RESP_FILE_NOT_FOUND  "550"
+#define FTP_RESP_FILE_STATUS     "213"
+#define FTP_RESP_BAD_REST        "554"
 #define FTP_RESP_TYPE_OK         "200"
 #define FTP_RESP_SYST_OK         "215"
 
@@ -73,13 +99,34 @@ typedef enum {
 typedef enum {
     FTP_DATA_OP_NONE,        // 无操作
     FTP_DATA_OP_LIST,        // 目录列表
+    FTP_DATA_OP_MLSD,        // 机器可读的目录列表
     FTP_DATA_OP_RETR,        // 下载文件
     FTP_DATA_OP_STOR         // 上传文件
 } ftp_data_op_t;
 
+/* ========================= 目录列表缓存 ========================= */
+/**
+ * @brief 渲染好的目录列表，由缓存与正在发送它的会话共享，引用计数归零时释放
+ */
+typedef struct ftp_listing {
+    int refs;      // 引用计数
+    size_t len;    // 列表长度
+    size_t cap;    // 缓冲区容量
+    char *data;    // 列表内容
+} ftp_listing_t;
+
+typedef struct ftp_list_key {
+    char path[FTP_MAX_PATH_LENGTH];  // 目录的文件系统路径
+    int mlsd;                        // 是否为 MLSD 格式
+} ftp_list_key_t;
+
+typedef struct ftp_list_entry {
+    ftp_listing_t *listing;          // 渲染好的列表
+    struct timespec mtime;           // 渲染时目录的修改时间
+} ftp_list_entry_t;
+
 /* ========================= FTP 会话结构 ========================= */
-typedef struct {
-    uint8_t active;                          // 会话是否活跃
+typedef struct ftp_session {
     uint8_t client_ip[NET_IP_LEN];          // 客户端 IP
     uint16_t client_port;                    // 客户端端口
     ftp_state_t state;                       // 会话状态
@@ -89,12 +136,37 @@ typedef struct {
     uint16_t data_port;                      // 被动模式数据端口
     ftp_data_op_t pending_op;                // 待处理的数据操作
     char pending_path[FTP_MAX_PATH_LENGTH];  // 待处理的文件路径
+    off_t rest_offset;                       // REST 设置的重新开始位置，由下一次 RETR/STOR 使用
+    off_t transfer_offset;                   // 本次 RETR/STOR 在文件中的起始位置
     tcp_conn_t *ctrl_conn;                   // 控制连接
+    tcp_conn_t *data_conn;                   // 已建立的数据连接，未建立为 NULL
+    uint8_t data_ip[NET_IP_LEN];             // 数据连接的对端 IP
+    uint16_t data_remote_port;               // 数据连接的对端端口
+    FILE *retr_file;                         // RETR 正在发送的文件
+    ftp_listing_t *listing;                  // LIST/MLSD 正在发送的目录列表
+    size_t listing_offset;                   // 目录列表已发送的长度
+    int stor_fd;                             // STOR 正在写入的文件，未打开为 -1
+    uint8_t *stor_buf;                       // STOR 写缓冲区
+    size_t stor_len;                         // 写缓冲区中的数据长度
+    off_t stor_offset;                       // 写缓冲区数据在文件中的起始偏移
+    uint8_t data_done;                       // 数据已全部发出，等待对端确认后回复 226
+    uint32_t data_acked;                     // 上次检查时对端已确认的序列号
+    time_t data_last_active;                 // 数据传输最近一次有进展的时刻
+    time_t last_active;                      // 最近一次收到命令或数据传输有进展的时刻
+    struct ftp_session *ctrl_next;           // 同一控制连接散列桶中的下一个会话
+    struct ftp_session *data_next;           // 同一数据端口散列桶中的下一个会话
 } ftp_session_t;
 
 /* ========================= 全局变量 ========================= */
-static ftp_session_t ftp_sessions[FTP_MAX_SESSIONS];
-static uint16_t next_data_port = FTP_DATA_PORT_BASE;
+static ftp_session_t **ftp_ctrl_buckets;  // 按控制连接（客户端 IP 与端口）散列的会话链表
+static ftp_session_t **ftp_data_buckets;  // 按数据端口散列的会话链表
+static size_t ftp_bucket_count;           // 散列桶数，为2的幂
+static size_t ftp_session_count;          // 当前会话数
+static uint64_t ftp_port_bitmap[(FTP_PASV_PORT_COUNT + 63) / 64];  // 被动模式端口池，置位表示已分配
+static size_t ftp_port_cursor;            // 下次分配从此处开始查找
+static size_t ftp_ports_in_use;           // 已分配的端口数
+static map_t ftp_stat_cache;              // 文件路径 -> ftp_stat
+static map_t ftp_list_cache;              // ftp_list_key -> ftp_list_entry
 
 /* ========================= 工具函数 ========================= */
 
@@ -120,57 +192,202 @@ static void ftp_get_real_path(ftp_session_t *session, const char *path, char *ou
     }
 }
 
+/* ========================= 被动模式端口池 ========================= */
+
 /**
- * @brief 查找或创建 FTP 会话
+ * @brief 从端口池分配一个数据端口
+ *
+ * 从上次分配的位置之后开始查找，刚释放的端口要等一轮之后才会被再次分配，
+ * 上一次传输迟到的报文段因此不会落到新的数据连接上。
+ *
+ * @return uint16_t 端口号，端口池耗尽为0
  */
-static ftp_session_t *ftp_get_session(uint8_t *client_ip, uint16_t client_port, int create) {
-    ftp_session_t *free_session = NULL;
-
-    for (int i = 0; i < FTP_MAX_SESSIONS; i++) {
-        if (ftp_sessions[i].active &&
-            memcmp(ftp_sessions[i].client_ip, client_ip, NET_IP_LEN) == 0 &&
-            ftp_sessions[i].client_port == client_port) {
-            return &ftp_sessions[i];
+static uint16_t ftp_port_alloc() {
+    if (ftp_ports_in_use == FTP_PASV_PORT_COUNT) {
+        return 0;
+    }
+    size_t i = ftp_port_cursor;
+    while (1) {
+        uint64_t word = ftp_port_bitmap[i / 64];
+        if (word == UINT64_MAX) {
+            i = (i / 64 + 1) * 64;  // 整字已满，跳到下一个字
+        } else if (!(word >> (i % 64) & 1)) {
+            break;
+        } else {
+            i++;
+        }
+        if (i >= FTP_PASV_PORT_COUNT) {
+            i = 0;
         }
-        if (!ftp_sessions[i].active && !free_session) {
-            free_session = &ftp_sessions[i];
+    }
+    ftp_port_bitmap[i / 64] |= (uint64_t)1 << (i % 64);
+    ftp_ports_in_use++;
+    ftp_port_cursor = (i + 1) % FTP_PASV_PORT_COUNT;
+    return FTP_PASV_PORT_MIN + i;
+}
+
+/**
+ * @brief 将数据端口归还端口池
+ */
+static void ftp_port_release(uint16_t port) {
+    size_t i = port - FTP_PASV_PORT_MIN;
+    if (port < FTP_PASV_PORT_MIN || i >= FTP_PASV_PORT_COUNT) {
+        return;
+    }
+    if (ftp_port_bitmap[i / 64] >> (i % 64) & 1) {
+        ftp_port_bitmap[i / 64] &= ~((uint64_t)1 << (i % 64));
+        ftp_ports_in_use--;
+    }
+}
+
+/* ========================= 会话表 ========================= */
+
+/**
+ * @brief 控制连接所在的散列桶
+ */
+static inline size_t ftp_ctrl_hash(const uint8_t *client_ip, uint16_t client_port) {
+    uint32_t h = (uint32_t)client_ip[0] << 24 | client_ip[1] << 16 | client_ip[2] << 8 | client_ip[3];
+    h = (h ^ client_port) * 2654435761u;  // 乘法散列
+    return (h ^ (h >> 16)) & (ftp_bucket_count - 1);
+}
+
+/**
+ * @brief 数据端口所在的散列桶
+ */
+static inline size_t ftp_data_hash(uint16_t data_port) {
+    return ((uint32_t)data_port * 2654435761u >> 16) & (ftp_bucket_count - 1);
+}
+
+/**
+ * @brief 初始化会话表
+ *
+ * @return int 成功为0，内存不足为-1
+ */
+static int ftp_session_table_init() {
+    ftp_bucket_count = FTP_SESSION_BUCKETS;
+    ftp_ctrl_buckets = calloc(ftp_bucket_count, sizeof(ftp_session_t *));
+    ftp_data_buckets = calloc(ftp_bucket_count, sizeof(ftp_session_t *));
+    ftp_session_count = 0;
+    return ftp_ctrl_buckets && ftp_data_buckets ? 0 : -1;
+}
+
+/**
+ * @brief 会话数超过桶数时将散列表扩大一倍，失败时保持原表
+ */
+static void ftp_session_table_grow() {
+    size_t count = ftp_bucket_count * 2;
+    ftp_session_t **ctrl = calloc(count, sizeof(ftp_session_t *));
+    ftp_session_t **data = calloc(count, sizeof(ftp_session_t *));
+    if (!ctrl || !data) {
+        free(ctrl);
+        free(data);
+        return;
+    }
+
+    ftp_session_t **old_ctrl = ftp_ctrl_buckets, **old_data = ftp_data_buckets;
+    size_t old_count = ftp_bucket_count;
+    ftp_ctrl_buckets = ctrl;
+    ftp_data_buckets = data;
+    ftp_bucket_count = count;
+    for (size_t i = 0; i < old_count; i++) {
+        ftp_session_t *session = old_ctrl[i];
+        while (session) {
+            ftp_session_t *next = session->ctrl_next;
+            size_t h = ftp_ctrl_hash(session->client_ip, session->client_port);
+            session->ctrl_next = ctrl[h];
+            ctrl[h] = session;
+            if (session->data_port > 0) {
+                h = ftp_data_hash(session->data_port);
+                session->data_next = data[h];
+                data[h] = session;
+            }
+            session = next;
         }
     }
+    free(old_ctrl);
+    free(old_data);
+}
 
-    if (create && free_session) {
-        memset(free_session, 0, sizeof(ftp_session_t));
-        free_session->active = 1;
-        memcpy(free_session->client_ip, client_ip, NET_IP_LEN);
-        free_session->client_port = client_port;
-        free_session->state = FTP_STATE_CONNECTED;
-        free_session->transfer_type = FTP_TYPE_ASCII;
-        strcpy(free_session->current_dir, "/");
-        return free_session;
+/**
+ * @brief 查找或创建 FTP 会话
+ */
+static ftp_session_t *ftp_get_session(uint8_t *client_ip, uint16_t client_port, int create) {
+    ftp_session_t *session = ftp_ctrl_buckets[ftp_ctrl_hash(client_ip, client_port)];
+    for (; session; session = session->ctrl_next) {
+        if (session->client_port == client_port && memcmp(session->client_ip, client_ip, NET_IP_LEN) == 0) {
+            return session;
+        }
     }
 
-    return NULL;
+    if (!create || ftp_session_count >= FTP_MAX_SESSIONS) {
+        return NULL;
+    }
+    session = calloc(1, sizeof(ftp_session_t));
+    if (!session) {
+        return NULL;
+    }
+    memcpy(session->client_ip, client_ip, NET_IP_LEN);
+    session->client_port = client_port;
+    session->state = FTP_STATE_CONNECTED;
+    session->stor_fd = -1;
+    session->transfer_type = FTP_TYPE_ASCII;
+    session->last_active = net_time();
+    strcpy(session->current_dir, "/");
+
+    if (++ftp_session_count > ftp_bucket_count) {
+        ftp_session_table_grow();
+    }
+    size_t h = ftp_ctrl_hash(client_ip, client_port);
+    session->ctrl_next = ftp_ctrl_buckets[h];
+    ftp_ctrl_buckets[h] = session;
+    return session;
 }
 
 /**
  * @brief 通过数据端口查找 FTP 会话
  */
 static ftp_session_t *ftp_get_session_by_data_port(uint16_t data_port) {
-    for (int i = 0; i < FTP_MAX_SESSIONS; i++) {
-        if (ftp_sessions[i].active && ftp_sessions[i].data_port == data_port) {
-            return &ftp_sessions[i];
+    ftp_session_t *session = ftp_data_buckets[ftp_data_hash(data_port)];
+    while (session && session->data_port != data_port) {
+        session = session->data_next;
+    }
+    return session;
+}
+
+/**
+ * @brief 设置会话的数据端口并更新数据端口索引，0 表示无数据端口
+ */
+static void ftp_set_data_port(ftp_session_t *session, uint16_t data_port) {
+    if (session->data_port > 0) {
+        ftp_session_t **p = &ftp_data_buckets[ftp_data_hash(session->data_port)];
+        while (*p != session) {
+            p = &(*p)->data_next;
         }
+        *p = session->data_next;
+    }
+    session->data_port = data_port;
+    if (data_port > 0) {
+        size_t h = ftp_data_hash(data_port);
+        session->data_next = ftp_data_buckets[h];
+        ftp_data_buckets[h] = session;
     }
-    return NULL;
 }
 
+static void ftp_data_finish(ftp_session_t *session, const char *code, const char *message);
+
 /**
- * @brief 关闭 FTP 会话
+ * @brief 关闭 FTP 会话：中止未完成的数据传输并释放会话
  */
 static void ftp_close_session(ftp_session_t *session) {
-    if (session->data_port > 0) {
-        tcp_close(session->data_port);
+    ftp_data_finish(session, NULL, NULL);
+
+    ftp_session_t **p = &ftp_ctrl_buckets[ftp_ctrl_hash(session->client_ip, session->client_port)];
+    while (*p != session) {
+        p = &(*p)->ctrl_next;
     }
-    session->active = 0;
+    *p = session->ctrl_next;
+    ftp_session_count--;
+    free(session);
 }
 
 /**
@@ -196,6 +413,262 @@ static int ftp_check_file_readable(const char *path) {
     return 0;
 }
 
+/**
+ * @brief 缓存的文件属性
+ */
+typedef struct ftp_stat {
+    off_t size;      // 文件大小
+    time_t mtime;    // 修改时间
+    mode_t mode;     // 文件类型与权限
+    time_t checked;  // 调用 stat 的时刻
+} ftp_stat_t;
+
+static _Thread_local time_t stat_evict_now;
+static void ftp_stat_evict_fn(void *key, void *value, time_t *timestamp) {
+    if (stat_evict_now - ((ftp_stat_t *)value)->checked >= FTP_STAT_CACHE_TTL) {
+        map_delete(&ftp_stat_cache, key);
+    }
+}
+
+/**
+ * @brief 获取文件属性，FTP_STAT_CACHE_TTL 秒内重复查询同一路径时直接返回缓存
+ *
+ * @param path 文件系统路径
+ * @param out  输出的文件属性
+ * @return int 成功为0，文件不存在等错误为-1
+ */
+static int ftp_stat_cached(const char *path, ftp_stat_t *out) {
+    char key[FTP_MAX_PATH_LENGTH] = {0};
+    strncpy(key, path, sizeof(key) - 1);
+    time_t now = net_time();
+
+    ftp_stat_t *cached = map_get(&ftp_stat_cache, key);
+    if (cached && now - cached->checked < FTP_STAT_CACHE_TTL) {
+        *out = *cached;
+        return 0;
+    }
+
+    struct stat st;
+    if (stat(path, &st) != 0) {
+        map_delete(&ftp_stat_cache, key);
+        return -1;
+    }
+    out->size = st.st_size;
+    out->mtime = st.st_mtime;
+    out->mode = st.st_mode;
+    out->checked = now;
+    if (map_set(&ftp_stat_cache, key, out) != 0) {
+        // 缓存已满：淘汰过期的条目后重试，仍满则不缓存
+        stat_evict_now = now;
+        map_foreach(&ftp_stat_cache, ftp_stat_evict_fn);
+        map_set(&ftp_stat_cache, key, out);
+    }
+    return 0;
+}
+
+/**
+ * @brief 文件被修改后使其缓存的属性失效
+ */
+static void ftp_stat_invalidate(const char *path) {
+    char key[FTP_MAX_PATH_LENGTH] = {0};
+    strncpy(key, path, sizeof(key) - 1);
+    map_delete(&ftp_stat_cache, key);
+}
+
+/**
+ * @brief 释放对目录列表的一个引用
+ */
+static void ftp_listing_release(ftp_listing_t *listing) {
+    if (listing && --listing->refs == 0) {
+        free(listing->data);
+        free(listing);
+    }
+}
+
+/**
+ * @brief 格式化目录中的一项
+ *
+ * @param out     输出缓冲区
+ * @param out_len 缓冲区长度
+ * @param name    显示的名称
+ * @param st      文件属性
+ * @param mlsd    为1时使用 MLSD/MLST 的事实格式（RFC 3659），否则为 ls -l 格式
+ * @return int    格式化后的长度
+ */
+static int ftp_list_format_entry(char *out, size_t out_len, const char *name, const ftp_stat_t *st, int mlsd) {
+    char time_str[32];
+    struct tm tm;
+
+    if (mlsd) {
+        gmtime_r(&st->mtime, &tm);
+        strftime(time_str, sizeof(time_str), "%Y%m%d%H%M%S", &tm);
+        return snprintf(out, out_len, "type=%s;size=%lld;modify=%s;UNIX.mode=0%03o; %s\r\n",
+                        S_ISDIR(st->mode) ? "dir" : "file", (long long)st->size, time_str,
+                        (unsigned)(st->mode & 0777), name);
+    }
+
+    char perms[11] = "----------";
+    perms[0] = S_ISDIR(st->mode) ? 'd' : '-';
+    perms[1] = (st->mode & S_IRUSR) ? 'r' : '-';
+    perms[2] = (st->mode & S_IWUSR) ? 'w' : '-';
+    perms[3] = (st->mode & S_IXUSR) ? 'x' : '-';
+    perms[4] = (st->mode & S_IRGRP) ? 'r' : '-';
+    perms[5] = (st->mode & S_IWGRP) ? 'w' : '-';
+    perms[6] = (st->mode & S_IXGRP) ? 'x' : '-';
+    perms[7] = (st->mode & S_IROTH) ? 'r' : '-';
+    perms[8] = (st->mode & S_IWOTH) ? 'w' : '-';
+    perms[9] = (st->mode & S_IXOTH) ? 'x' : '-';
+
+    localtime_r(&st->mtime, &tm);
+    strftime(time_str, sizeof(time_str), "%b %d %H:%M", &tm);
+    return snprintf(out, out_len, "%s 1 ftp ftp %8ld %s %s\r\n",
+                    perms, (long)st->size, time_str, name);
+}
+
+/**
+ * @brief 读取目录并将全部条目渲染到一块连续的缓冲区
+ *
+ * @return ftp_listing_t* 引用计数为1的列表，目录无法打开或内存不足为 NULL
+ */
+static ftp_listing_t *ftp_list_render(const char *path, int mlsd) {
+    DIR *dir = opendir(path);
+    if (!dir) {
+        printf("[FTP] Cannot open directory: %s\n", path);
+        return NULL;
+    }
+    ftp_listing_t *listing = calloc(1, sizeof(ftp_listing_t));
+    if (!listing) {
+        closedir(dir);
+        return NULL;
+    }
+    listing->refs = 1;
+
+    struct dirent *entry;
+    char line[FTP_MAX_PATH_LENGTH + 128];
+    char full_path[FTP_MAX_PATH_LENGTH];
+    struct stat st;
+    while ((entry = readdir(dir)) != NULL) {
+        // 跳过 . 和 ..
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+            continue;
+        }
+        snprintf(full_path, sizeof(full_path), "%s/%s", path, entry->d_name);
+        if (stat(full_path, &st) != 0) {
+            continue;
+        }
+
+        ftp_stat_t attr = {st.st_size, st.st_mtime, st.st_mode, 0};
+        int len = ftp_list_format_entry(line, sizeof(line), entry->d_name, &attr, mlsd);
+        if (len >= (int)sizeof(line)) {
+            continue;  // 名称过长，跳过
+        }
+        if (listing->len + len > listing->cap) {
+            size_t cap = listing->cap ? listing->cap * 2 : 4096;
+            char *data = realloc(listing->data, cap);
+            if (!data) {
+                closedir(dir);
+                ftp_listing_release(listing);
+                return NULL;
+            }
+            listing->data = data;
+            listing->cap = cap;
+        }
+        memcpy(listing->data + listing->len, line, len);
+        listing->len += len;
+    }
+    closedir(dir);
+    return listing;
+}
+
+/**
+ * @brief 构造目录列表缓存的键，去掉末尾的 '/' 使同一目录只对应一个键
+ */
+static void ftp_list_make_key(ftp_list_key_t *key, const char *dir, size_t dir_len, int mlsd) {
+    while (dir_len > 1 && dir[dir_len - 1] == '/') {
+        dir_len--;
+    }
+    if (dir_len > sizeof(key->path) - 1) {
+        dir_len = sizeof(key->path) - 1;
+    }
+    memset(key, 0, sizeof(*key));
+    memcpy(key->path, dir, dir_len);
+    key->mlsd = mlsd;
+}
+
+static _Thread_local time_t list_evict_time;
+static _Thread_local ftp_list_key_t *list_evict_key;
+static void ftp_list_oldest_fn(void *key, void *value, time_t *timestamp) {
+    if (!list_evict_key || *timestamp < list_evict_time) {
+        list_evict_time = *timestamp;
+        list_evict_key = key;
+    }
+}
+
+/**
+ * @brief 获取目录列表：目录的修改时间未变时直接使用缓存，否则重新渲染
+ *
+ * @param path 目录的文件系统路径
+ * @param mlsd 是否为 MLSD 格式
+ * @return ftp_listing_t* 调用者持有一个引用，用完后须 ftp_listing_release；失败为 NULL
+ */
+static ftp_listing_t *ftp_list_get(const char *path, int mlsd) {
+    struct stat st;
+    if (stat(path, &st) != 0 || !S_ISDIR(st.st_mode)) {
+        return NULL;
+    }
+
+    ftp_list_key_t key;
+    ftp_list_make_key(&key, path, strlen(path), mlsd);
+
+    ftp_list_entry_t *cached = map_get(&ftp_list_cache, &key);
+    if (cached && cached->mtime.tv_sec == st.st_mtim.tv_sec && cached->mtime.tv_nsec == st.st_mtim.tv_nsec) {
+        cached->listing->refs++;
+        return cached->listing;
+    }
+    if (cached) {
+        ftp_listing_release(cached->listing);
+        map_delete(&ftp_list_cache, &key);
+    }
+
+    ftp_list_entry_t entry = {ftp_list_render(path, mlsd), st.st_mtim};
+    if (!entry.listing) {
+        return NULL;
+    }
+    if (map_size(&ftp_list_cache) == FTP_LIST_CACHE_SIZE) {
+        // 缓存已满：淘汰最早渲染的列表
+        list_evict_key = NULL;
+        map_foreach(&ftp_list_cache, ftp_list_oldest_fn);
+        ftp_listing_release(((ftp_list_entry_t *)map_get(&ftp_list_cache, list_evict_key))->listing);
+        map_delete(&ftp_list_cache, list_evict_key);
+    }
+    if (map_set(&ftp_list_cache, &key, &entry) == 0) {
+        entry.listing->refs++;
+    }
+    return entry.listing;
+}
+
+/**
+ * @brief 文件被写入后使其所在目录的缓存列表失效
+ *
+ * 覆盖已有文件不会改变目录的修改时间，因此须显式失效。
+ */
+static void ftp_list_invalidate(const char *file_path) {
+    const char *slash = strrchr(file_path, '/');
+    if (!slash) {
+        return;
+    }
+    ftp_list_key_t key;
+    ftp_list_make_key(&key, file_path, slash - file_path, 0);
+
+    for (key.mlsd = 0; key.mlsd <= 1; key.mlsd++) {
+        ftp_list_entry_t *cached = map_get(&ftp_list_cache, &key);
+        if (cached) {
+            ftp_listing_release(cached->listing);
+            map_delete(&ftp_list_cache, &key);
+        }
+    }
+}
+
 /**
  * @brief 检查目录是否存在
  */
@@ -352,19 +825,40 @@ static void ftp_cmd_type(ftp_session_t *session, tcp_conn_t *conn, const char *a
 static void ftp_data_handler(tcp_conn_t *tcp_conn, uint8_t *data, size_t len,
                               uint8_t *src_ip, uint16_t src_port);
 
+/**
+ * @brief 数据连接事件处理函数
+ */
+static void ftp_data_event_handler(tcp_conn_t *tcp_conn, tcp_event_t event,
+                                    uint8_t *src_ip, uint16_t src_port);
+
+static void ftp_data_start(ftp_session_t *session);
+
 /**
  * @brief 处理 PASV 命令
  */
 static void ftp_cmd_pasv(ftp_session_t *session, tcp_conn_t *conn,
                           uint16_t port, uint8_t *dst_ip, uint16_t dst_port) {
-    // 分配数据端口
-    session->data_port = next_data_port++;
-    if (next_data_port > FTP_DATA_PORT_BASE + 1000) {
-        next_data_port = FTP_DATA_PORT_BASE;
+    // 放弃之前未使用或未完成的数据连接
+    if (session->data_port > 0) {
+        ftp_data_finish(session, NULL, NULL);
     }
 
-    // 打开数据端口监听
-    tcp_open(session->data_port, ftp_data_handler);
+    // 分配数据端口并打开监听
+    uint16_t data_port = ftp_port_alloc();
+    if (data_port == 0) {
+        ftp_send_response(conn, port, dst_ip, dst_port, FTP_RESP_CANT_OPEN_DATA,
+                          "No data port available.");
+        return;
+    }
+    if (tcp_open(data_port, ftp_data_handler) != 0 ||
+        tcp_set_event_handler(data_port, ftp_data_event_handler) != 0) {
+        tcp_close(data_port);
+        ftp_port_release(data_port);
+        ftp_send_response(conn, port, dst_ip, dst_port, FTP_RESP_CANT_OPEN_DATA,
+                          "Cannot open data port.");
+        return;
+    }
+    ftp_set_data_port(session, data_port);
     session->state = FTP_STATE_PASV_WAIT;
 
     // 格式化 PASV 响应
@@ -381,9 +875,9 @@ static void ftp_cmd_pasv(ftp_session_t *session, tcp_conn_t *conn,
 }
 
 /**
- * @brief 处理 LIST 命令
+ * @brief 处理 LIST 命令，mlsd 为1时处理 MLSD 命令
  */
-static void ftp_cmd_list(ftp_session_t *session, tcp_conn_t *conn, const char *arg,
+static void ftp_cmd_list(ftp_session_t *session, tcp_conn_t *conn, const char *arg, int mlsd,
                           uint16_t port, uint8_t *dst_ip, uint16_t dst_port) {
     if (session->state != FTP_STATE_PASV_WAIT && session->state != FTP_STATE_LOGGED_IN) {
         ftp_send_response(conn, port, dst_ip, dst_port, FTP_RESP_CANT_OPEN_DATA,
@@ -398,12 +892,13 @@ static void ftp_cmd_list(ftp_session_t *session, tcp_conn_t *conn, const char *a
         snprintf(real_path, sizeof(real_path), "%s%s", FTP_ROOT_DIR, session->current_dir);
     }
 
-    session->pending_op = FTP_DATA_OP_LIST;
+    session->pending_op = mlsd ? FTP_DATA_OP_MLSD : FTP_DATA_OP_LIST;
     strncpy(session->pending_path, real_path, sizeof(session->pending_path) - 1);
     session->ctrl_conn = conn;
 
     ftp_send_response(conn, port, dst_ip, dst_port, "150",
                       "Here comes the directory listing.");
+    ftp_data_start(session);
 }
 
 /**
@@ -433,18 +928,30 @@ static void ftp_cmd_retr(ftp_session_t *session, tcp_conn_t *conn, const char *a
         return;
     }
 
+    // 检查重新开始位置是否超出文件末尾
+    ftp_stat_t st;
+    if (session->rest_offset > 0 && (ftp_stat_cached(real_path, &st) != 0 || session->rest_offset > st.size)) {
+        session->rest_offset = 0;
+        ftp_send_response(conn, port, dst_ip, dst_port, FTP_RESP_BAD_REST,
+                          "Restart offset beyond end of file.");
+        return;
+    }
+
     session->pending_op = FTP_DATA_OP_RETR;
+    session->transfer_offset = session->rest_offset;
+    session->rest_offset = 0;
     strncpy(session->pending_path, real_path, sizeof(session->pending_path) - 1);
     session->ctrl_conn = conn;
 
     ftp_send_response(conn, port, dst_ip, dst_port, "150",
                       "Opening data connection for file transfer.");
+    ftp_data_start(session);
 }
 
 /**
- * @brief 处理 STOR 命令（上传文件）
+ * @brief 处理 STOR 命令（上传文件），append 为1时处理 APPE 命令（追加到文件末尾）
  */
-static void ftp_cmd_stor(ftp_session_t *session, tcp_conn_t *conn, const char *arg,
+static void ftp_cmd_stor(ftp_session_t *session, tcp_conn_t *conn, const char *arg, int append,
                           uint16_t port, uint8_t *dst_ip, uint16_t dst_port) {
     if (session->state != FTP_STATE_PASV_WAIT && session->state != FTP_STATE_LOGGED_IN) {
         ftp_send_response(conn, port, dst_ip, dst_port, FTP_RESP_CANT_OPEN_DATA,
@@ -475,12 +982,108 @@ static void ftp_cmd_stor(ftp_session_t *session, tcp_conn_t *conn, const char *a
         return;
     }
 
+    // 写入位置：APPE 为文件末尾，REST 之后为指定位置，否则覆盖整个文件
+    ftp_stat_t st;
+    session->transfer_offset = session->rest_offset;
+    if (append) {
+        ftp_stat_invalidate(real_path);
+        session->transfer_offset = ftp_stat_cached(real_path, &st) == 0 ? st.size : 0;
+    }
+    session->rest_offset = 0;
+
     session->pending_op = FTP_DATA_OP_STOR;
     strncpy(session->pending_path, real_path, sizeof(session->pending_path) - 1);
     session->ctrl_conn = conn;
 
     ftp_send_response(conn, port, dst_ip, dst_port, "150",
                       "OK to send data.");
+    ftp_data_start(session);
+}
+
+/**
+ * @brief 处理 REST 命令，设置下一次 RETR/STOR 的起始位置
+ */
+static void ftp_cmd_rest(ftp_session_t *session, tcp_conn_t *conn, const char *arg,
+                          uint16_t port, uint8_t *dst_ip, uint16_t dst_port) {
+    char *end;
+    errno = 0;
+    long long offset = strtoll(arg, &end, 10);
+    if (arg[0] < '0' || arg[0] > '9' || *end != '\0' || errno == ERANGE) {
+        ftp_send_response(conn, port, dst_ip, dst_port, FTP_RESP_PARAM_ERROR,
+                          "Invalid restart offset.");
+        return;
+    }
+
+    session->rest_offset = offset;
+    char response[FTP_MAX_RESPONSE_LENGTH];
+    snprintf(response, sizeof(response), "Restarting at %lld. Send STORE or RETRIEVE to initiate transfer.", offset);
+    ftp_send_response(conn, port, dst_ip, dst_port, FTP_RESP_FILE_PENDING, response);
+}
+
+/**
+ * @brief 处理 SIZE 命令，返回文件大小
+ */
+static void ftp_cmd_size(ftp_session_t *session, tcp_conn_t *conn, const char *arg,
+                          uint16_t port, uint8_t *dst_ip, uint16_t dst_port) {
+    char real_path[FTP_MAX_PATH_LENGTH];
+    ftp_get_real_path(session, arg, real_path, sizeof(real_path));
+
+    ftp_stat_t st;
+    if (arg[0] == '\0' || ftp_stat_cached(real_path, &st) != 0 || !S_ISREG(st.mode)) {
+        ftp_send_response(conn, port, dst_ip, dst_port, FTP_RESP_FILE_NOT_FOUND,
+                          "Could not get file size.");
+        return;
+    }
+
+    char response[32];
+    snprintf(response, sizeof(response), "%lld", (long long)st.size);
+    ftp_send_response(conn, port, dst_ip, dst_port, FTP_RESP_FILE_STATUS, response);
+}
+
+/**
+ * @brief 处理 MDTM 命令，返回文件修改时间（UTC，YYYYMMDDHHMMSS）
+ */
+static void ftp_cmd_mdtm(ftp_session_t *session, tcp_conn_t *conn, const char *arg,
+                          uint16_t port, uint8_t *dst_ip, uint16_t dst_port) {
+    char real_path[FTP_MAX_PATH_LENGTH];
+    ftp_get_real_path(session, arg, real_path, sizeof(real_path));
+
+    ftp_stat_t st;
+    if (arg[0] == '\0' || ftp_stat_cached(real_path, &st) != 0 || !S_ISREG(st.mode)) {
+        ftp_send_response(conn, port, dst_ip, dst_port, FTP_RESP_FILE_NOT_FOUND,
+                          "Could not get file modification time.");
+        return;
+    }
+
+    struct tm tm;
+    char response[32];
+    gmtime_r(&st.mtime, &tm);
+    strftime(response, sizeof(response), "%Y%m%d%H%M%S", &tm);
+    ftp_send_response(conn, port, dst_ip, dst_port, FTP_RESP_FILE_STATUS, response);
+}
+
+/**
+ * @brief 处理 MLST 命令，在控制连接上返回单个文件或目录的事实
+ */
+static void ftp_cmd_mlst(ftp_session_t *session, tcp_conn_t *conn, const char *arg,
+                          uint16_t port, uint8_t *dst_ip, uint16_t dst_port) {
+    char real_path[FTP_MAX_PATH_LENGTH];
+    const char *name = arg[0] ? arg : session->current_dir;
+    ftp_get_real_path(session, name, real_path, sizeof(real_path));
+
+    ftp_stat_t st;
+    if (ftp_stat_cached(real_path, &st) != 0) {
+        ftp_send_response(conn, port, dst_ip, dst_port, FTP_RESP_FILE_NOT_FOUND,
+                          "No such file or directory.");
+        return;
+    }
+
+    // 多行响应：250-Listing <路径>、以空格开头的事实行、250 End
+    char facts[FTP_MAX_PATH_LENGTH + 128];
+    char response[FTP_MAX_RESPONSE_LENGTH + FTP_MAX_PATH_LENGTH];
+    ftp_list_format_entry(facts, sizeof(facts), name, &st, 1);
+    snprintf(response, sizeof(response), "%s\r\n %s250 End", name, facts);
+    ftp_send_response(conn, port, dst_ip, dst_port, "250-Listing", response);
 }
 
 /**
@@ -489,6 +1092,7 @@ static void ftp_cmd_stor(ftp_session_t *session, tcp_conn_t *conn, const char *a
 static void ftp_cmd_quit(ftp_session_t *session, tcp_conn_t *conn,
                           uint16_t port, uint8_t *dst_ip, uint16_t dst_port) {
     ftp_send_response(conn, port, dst_ip, dst_port, FTP_RESP_GOODBYE, "Goodbye.");
+    tcp_send(conn, NULL, 0, port, dst_ip, dst_port);  // 由服务端关闭控制连接
     ftp_close_session(session);
 }
 
@@ -504,90 +1108,245 @@ static void ftp_cmd_noop(ftp_session_t *session, tcp_conn_t *conn,
 /* ========================= 数据传输实现 ========================= */
 
 /**
- * @brief 执行目录列表
+ * @brief 从正在发送的文件或目录列表中读取至多 len 字节
  */
-static void ftp_do_list(ftp_session_t *session, tcp_conn_t *data_conn,
-                         uint16_t data_port, uint8_t *dst_ip, uint16_t dst_port) {
-    DIR *dir = opendir(session->pending_path);
-    if (!dir) {
-        printf("[FTP] Cannot open directory: %s\n", session->pending_path);
-        return;
+static size_t ftp_data_read(ftp_session_t *session, uint8_t *buffer, size_t len) {
+    if (session->listing) {
+        size_t left = session->listing->len - session->listing_offset;
+        if (len > left) {
+            len = left;
+        }
+        memcpy(buffer, session->listing->data + session->listing_offset, len);
+        session->listing_offset += len;
+        return len;
     }
+    return session->retr_file ? fread(buffer, 1, len, session->retr_file) : 0;
+}
 
-    struct dirent *entry;
-    char line[512];
-    struct stat st;
-    char full_path[FTP_MAX_PATH_LENGTH];
+/**
+ * @brief 关闭正在发送的文件或释放目录列表
+ */
+static void ftp_data_source_close(ftp_session_t *session) {
+    if (session->retr_file) {
+        fclose(session->retr_file);
+        session->retr_file = NULL;
+    }
+    ftp_listing_release(session->listing);
+    session->listing = NULL;
+}
 
-    while ((entry = readdir(dir)) != NULL) {
-        // 跳过 . 和 ..
-        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
-            continue;
+/**
+ * @brief 执行文件下载或目录列表：在数据连接的接收窗口内发送下一部分
+ *
+ * 每轮主循环至多发送 FTP_SCHED_QUANTUM 字节，且不超过对端窗口中尚未被占用的部分，
+ * 大文件因此不会阻塞其他会话。数据读完后置 data_done，等待对端确认。
+ */
+static void ftp_do_send(ftp_session_t *session, tcp_conn_t *data_conn,
+                         uint16_t data_port, uint8_t *dst_ip, uint16_t dst_port) {
+    uint32_t in_flight = data_conn->seq - data_conn->snd_una;
+    size_t budget = data_conn->snd_wnd > in_flight ? data_conn->snd_wnd - in_flight : 0;
+    if (budget > FTP_SCHED_QUANTUM) {
+        budget = FTP_SCHED_QUANTUM;
+    }
+
+    uint8_t buffer[FTP_DATA_MSS];
+    while (!session->data_done && budget > 0) {
+        size_t len = budget < sizeof(buffer) ? budget : sizeof(buffer);
+        size_t bytes_read = ftp_data_read(session, buffer, len);
+        if (bytes_read > 0) {
+            tcp_send(data_conn, buffer, bytes_read, data_port, dst_ip, dst_port);
+            budget -= bytes_read;
         }
+        if (bytes_read < len) {
+            ftp_data_source_close(session);
+            session->data_done = 1;
+            printf("[FTP] Sent: %s\n", session->pending_path);
+        }
+    }
+}
 
-        snprintf(full_path, sizeof(full_path), "%s/%s", session->pending_path, entry->d_name);
+/**
+ * @brief 将 STOR 写缓冲区中的数据写入文件
+ *
+ * @return int 成功为0，失败为-1（errno 指示原因）
+ */
+static int ftp_stor_flush(ftp_session_t *session) {
+    size_t written = 0;
+    while (written < session->stor_len) {
+        ssize_t n = pwrite(session->stor_fd, session->stor_buf + written,
+                           session->stor_len - written, session->stor_offset + written);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        written += n;
+    }
+    session->stor_offset += written;
+    session->stor_len = 0;
+    return 0;
+}
 
-        if (stat(full_path, &st) == 0) {
-            char perms[11] = "----------";
-            perms[0] = S_ISDIR(st.st_mode) ? 'd' : '-';
-            perms[1] = (st.st_mode & S_IRUSR) ? 'r' : '-';
-            perms[2] = (st.st_mode & S_IWUSR) ? 'w' : '-';
-            perms[3] = (st.st_mode & S_IXUSR) ? 'x' : '-';
-            perms[4] = (st.st_mode & S_IRGRP) ? 'r' : '-';
-            perms[5] = (st.st_mode & S_IWGRP) ? 'w' : '-';
-            perms[6] = (st.st_mode & S_IXGRP) ? 'x' : '-';
-            perms[7] = (st.st_mode & S_IROTH) ? 'r' : '-';
-            perms[8] = (st.st_mode & S_IWOTH) ? 'w' : '-';
-            perms[9] = (st.st_mode & S_IXOTH) ? 'x' : '-';
+/**
+ * @brief 打开 STOR 的目标文件（覆盖原有内容）并分配写缓冲区
+ *
+ * @return int 成功为0，失败为-1
+ */
+static int ftp_stor_open(ftp_session_t *session) {
+    session->stor_buf = malloc(FTP_STOR_BUFFER_SIZE);
+    if (!session->stor_buf) {
+        return -1;
+    }
+    int flags = O_WRONLY | O_CREAT | (session->transfer_offset > 0 ? 0 : O_TRUNC);
+    session->stor_fd = open(session->pending_path, flags, 0644);
+    if (session->stor_fd < 0) {
+        free(session->stor_buf);
+        session->stor_buf = NULL;
+        return -1;
+    }
+    session->stor_len = 0;
+    session->stor_offset = session->transfer_offset;
+    return 0;
+}
 
-            struct tm *tm = localtime(&st.st_mtime);
-            char time_str[32];
-            strftime(time_str, sizeof(time_str), "%b %d %H:%M", tm);
+/**
+ * @brief 写出缓冲区中剩余的数据并关闭 STOR 文件
+ *
+ * @param session FTP 会话
+ * @param sync    是否在关闭前 fsync，传输正常结束时为1
+ * @return int    成功为0，失败为-1
+ */
+static int ftp_stor_close(ftp_session_t *session, int sync) {
+    if (session->stor_fd < 0) {
+        return 0;
+    }
+    ftp_stat_invalidate(session->pending_path);
+    ftp_list_invalidate(session->pending_path);
+    int ret = ftp_stor_flush(session);
+    if (ret == 0 && sync && fsync(session->stor_fd) != 0) {
+        ret = -1;
+    }
+    if (close(session->stor_fd) != 0) {
+        ret = -1;
+    }
+    free(session->stor_buf);
+    session->stor_buf = NULL;
+    session->stor_fd = -1;
+    return ret;
+}
 
-            int len = snprintf(line, sizeof(line), "%s 1 ftp ftp %8ld %s %s\r\n",
-                               perms, (long)st.st_size, time_str, entry->d_name);
-            tcp_send(data_conn, (uint8_t *)line, len, data_port, dst_ip, dst_port);
+/**
+ * @brief 执行文件上传（接收数据），数据先进入写缓冲区，攒满后一次写入文件
+ *
+ * @return int 成功为0，写入失败为-1
+ */
+static int ftp_do_stor_receive(ftp_session_t *session, uint8_t *data, size_t len) {
+    while (len > 0) {
+        size_t n = FTP_STOR_BUFFER_SIZE - session->stor_len;
+        if (n > len) {
+            n = len;
+        }
+        memcpy(session->stor_buf + session->stor_len, data, n);
+        session->stor_len += n;
+        data += n;
+        len -= n;
+        if (session->stor_len == FTP_STOR_BUFFER_SIZE && ftp_stor_flush(session) != 0) {
+            return -1;
         }
     }
+    return 0;
+}
 
-    closedir(dir);
+/**
+ * @brief 上传文件写入失败时的响应码
+ */
+static const char *ftp_stor_error_code() {
+    return errno == ENOSPC || errno == EDQUOT ? FTP_RESP_INSUFFICIENT : FTP_RESP_LOCAL_ERROR;
 }
 
 /**
- * @brief 执行文件下载
+ * @brief 数据连接已建立且有待处理的命令时开始传输
+ *
+ * 命令先于数据连接到达时只记录时刻，客户端在 FTP_DATA_TIMEOUT 内未连接则以 425 结束。
  */
-static void ftp_do_retr(ftp_session_t *session, tcp_conn_t *data_conn,
-                         uint16_t data_port, uint8_t *dst_ip, uint16_t dst_port) {
-    FILE *file = fopen(session->pending_path, "rb");
-    if (!file) {
-        printf("[FTP] Cannot open file: %s\n", session->pending_path);
+static void ftp_data_start(ftp_session_t *session) {
+    session->data_last_active = net_time();
+    if (!session->data_conn || session->pending_op == FTP_DATA_OP_NONE) {
         return;
     }
+    session->data_acked = session->data_conn->snd_una;
 
-    char buffer[FTP_BUFFER_SIZE];
-    size_t bytes_read;
+    switch (session->pending_op) {
+        case FTP_DATA_OP_LIST:
+        case FTP_DATA_OP_MLSD:
+            // 列表由 ftp_schedule 按窗口分批发送
+            session->listing = ftp_list_get(session->pending_path, session->pending_op == FTP_DATA_OP_MLSD);
+            session->listing_offset = 0;
+            if (!session->listing) {
+                ftp_data_finish(session, FTP_RESP_FILE_NOT_FOUND, "Cannot open directory.");
+            }
+            break;
 
-    while ((bytes_read = fread(buffer, 1, sizeof(buffer), file)) > 0) {
-        tcp_send(data_conn, (uint8_t *)buffer, bytes_read, data_port, dst_ip, dst_port);
-    }
+        case FTP_DATA_OP_RETR:
+            // 文件由 ftp_schedule 按窗口分批发送
+            session->retr_file = fopen(session->pending_path, "rb");
+            if (session->retr_file && fseeko(session->retr_file, session->transfer_offset, SEEK_SET) != 0) {
+                fclose(session->retr_file);
+                session->retr_file = NULL;
+            }
+            if (!session->retr_file) {
+                printf("[FTP] Cannot open file: %s\n", session->pending_path);
+                ftp_data_finish(session, FTP_RESP_LOCAL_ERROR, "Cannot open file.");
+            }
+            break;
+
+        case FTP_DATA_OP_STOR:
+            // 等待对端发送数据并关闭数据连接
+            if (ftp_stor_open(session) != 0) {
+                printf("[FTP] Cannot open file for writing: %s\n", session->pending_path);
+                ftp_data_finish(session, FTP_RESP_LOCAL_ERROR, "Cannot create file.");
+            }
+            break;
 
-    fclose(file);
-    printf("[FTP] File sent: %s\n", session->pending_path);
+        default:
+            break;
+    }
 }
 
 /**
- * @brief 执行文件上传（接收数据）
+ * @brief 结束数据传输：关闭数据连接与数据端口，并在控制连接上回复结果
+ *
+ * @param session FTP 会话
+ * @param code    回复的响应码，为 NULL 时不回复
+ * @param message 回复的消息
  */
-static void ftp_do_stor_receive(ftp_session_t *session, uint8_t *data, size_t len) {
-    FILE *file = fopen(session->pending_path, "ab");
-    if (!file) {
-        printf("[FTP] Cannot open file for writing: %s\n", session->pending_path);
-        return;
+static void ftp_data_finish(ftp_session_t *session, const char *code, const char *message) {
+    uint16_t data_port = session->data_port;
+    tcp_conn_t *data_conn = session->data_conn;
+
+    ftp_data_source_close(session);
+    ftp_stor_close(session, 0);
+    if (data_conn && (data_conn->state == TCP_STATE_ESTABLISHED || data_conn->state == TCP_STATE_CLOSE_WAIT)) {
+        tcp_send(data_conn, NULL, 0, data_port, session->data_ip, session->data_remote_port);
+    }
+
+    // 先从会话中移除数据端口，关闭端口时的 CLOSED 事件便不会再找到本会话
+    ftp_set_data_port(session, 0);
+    session->data_conn = NULL;
+    session->data_done = 0;
+    session->pending_op = FTP_DATA_OP_NONE;
+    session->state = FTP_STATE_LOGGED_IN;
+    session->last_active = net_time();
+    if (data_port > 0) {
+        tcp_close(data_port);
+        ftp_port_release(data_port);
     }
 
-    fwrite(data, 1, len, file);
-    fclose(file);
-    printf("[FTP] Received %zu bytes for: %s\n", len, session->pending_path);
+    if (code && session->ctrl_conn) {
+        ftp_send_response(session->ctrl_conn, FTP_CTRL_PORT,
+                          session->client_ip, session->client_port, code, message);
+    }
 }
 
 /**
@@ -595,57 +1354,140 @@ static void ftp_do_stor_receive(ftp_session_t *session, uint8_t *data, size_t le
  */
 static void ftp_data_handler(tcp_conn_t *tcp_conn, uint8_t *data, size_t len,
                               uint8_t *src_ip, uint16_t src_port) {
-    // 找到对应的会话
-    // 注意：需要根据数据端口查找会话
-    ftp_session_t *session = NULL;
-    for (int i = 0; i < FTP_MAX_SESSIONS; i++) {
-        if (ftp_sessions[i].active && ftp_sessions[i].data_port > 0) {
-            session = &ftp_sessions[i];
-            break;
+    (void)src_ip;
+    (void)src_port;
+    ftp_session_t *session = ftp_get_session_by_data_port(tcp_conn->port);
+    if (!session || session->data_conn != tcp_conn) {
+        printf("[FTP] No session found for data connection\n");
+        return;
+    }
+
+    if (session->pending_op == FTP_DATA_OP_STOR && len > 0) {
+        if (ftp_do_stor_receive(session, data, len) != 0) {
+            printf("[FTP] Write failed: %s: %s\n", session->pending_path, strerror(errno));
+            ftp_data_finish(session, ftp_stor_error_code(), "Failed to write file.");
+            return;
         }
+        session->data_last_active = net_time();
     }
+}
 
+/**
+ * @brief 数据连接事件处理函数
+ *
+ * 连接建立后开始已请求的传输；STOR 以对端关闭数据连接为结束，
+ * 其他情况下数据连接被关闭或重置视为传输中止。
+ */
+static void ftp_data_event_handler(tcp_conn_t *tcp_conn, tcp_event_t event,
+                                    uint8_t *src_ip, uint16_t src_port) {
+    ftp_session_t *session = ftp_get_session_by_data_port(tcp_conn->port);
     if (!session) {
-        printf("[FTP] No session found for data connection\n");
         return;
     }
 
-    switch (session->pending_op) {
-        case FTP_DATA_OP_LIST:
-            ftp_do_list(session, tcp_conn, session->data_port, src_ip, src_port);
-            // 发送完成响应到控制连接
-            if (session->ctrl_conn) {
-                ftp_send_response(session->ctrl_conn, FTP_CTRL_PORT,
-                                  session->client_ip, session->client_port,
-                                  FTP_RESP_TRANSFER_OK, "Directory send OK.");
+    switch (event) {
+        case TCP_EVENT_ESTABLISHED:
+            if (session->data_conn) {
+                return;  // 每次 PASV 只接受一个数据连接
             }
+            session->data_conn = tcp_conn;
+            memcpy(session->data_ip, src_ip, NET_IP_LEN);
+            session->data_remote_port = src_port;
+            ftp_data_start(session);
             break;
 
-        case FTP_DATA_OP_RETR:
-            ftp_do_retr(session, tcp_conn, session->data_port, src_ip, src_port);
-            if (session->ctrl_conn) {
-                ftp_send_response(session->ctrl_conn, FTP_CTRL_PORT,
-                                  session->client_ip, session->client_port,
-                                  FTP_RESP_TRANSFER_OK, "Transfer complete.");
+        case TCP_EVENT_FIN:
+            if (session->data_conn != tcp_conn) {
+                return;
+            }
+            if (session->pending_op == FTP_DATA_OP_STOR) {
+                off_t size = session->stor_offset + session->stor_len;
+                if (ftp_stor_close(session, 1) != 0) {
+                    printf("[FTP] Write failed: %s: %s\n", session->pending_path, strerror(errno));
+                    ftp_data_finish(session, ftp_stor_error_code(), "Failed to write file.");
+                    return;
+                }
+                printf("[FTP] File received: %s (%lld bytes)\n", session->pending_path, (long long)size);
+                ftp_data_finish(session, FTP_RESP_TRANSFER_OK, "Transfer complete.");
+            } else if (session->pending_op == FTP_DATA_OP_NONE) {
+                ftp_data_finish(session, NULL, NULL);
+            } else {
+                ftp_data_finish(session, FTP_RESP_CONN_CLOSED, "Connection closed; transfer aborted.");
             }
             break;
 
-        case FTP_DATA_OP_STOR:
-            if (len > 0) {
-                ftp_do_stor_receive(session, data, len);
+        case TCP_EVENT_CLOSED:
+            if (session->data_conn != tcp_conn) {
+                return;
             }
-            // 注意：实际上 STOR 完成判断需要更复杂的逻辑
+            session->data_conn = NULL;
+            ftp_data_finish(session, session->pending_op == FTP_DATA_OP_NONE ? NULL : FTP_RESP_CONN_CLOSED,
+                            "Connection closed; transfer aborted.");
             break;
+    }
+}
 
-        default:
-            break;
+/**
+ * @brief 推进一个会话的数据传输，或关闭空闲超时的会话
+ *
+ * 按窗口继续发送 RETR，数据全部被确认后关闭数据连接并回复 226，
+ * 长时间无进展的传输以 426 中止，客户端迟迟不连接数据端口时以 425 结束。
+ */
+static void ftp_schedule_session(ftp_session_t *session, time_t now) {
+    tcp_conn_t *data_conn = session->data_conn;
+
+    if (session->pending_op == FTP_DATA_OP_NONE) {
+        if (now - session->last_active > FTP_SESSION_IDLE_TIMEOUT) {
+            printf("[FTP] Session idle timeout\n");
+            if (session->ctrl_conn) {
+                ftp_send_response(session->ctrl_conn, FTP_CTRL_PORT, session->client_ip, session->client_port,
+                                  FTP_RESP_SERVICE_NA, "Idle timeout, closing control connection.");
+                tcp_send(session->ctrl_conn, NULL, 0, FTP_CTRL_PORT, session->client_ip, session->client_port);
+            }
+            ftp_close_session(session);
+        }
+        return;
+    }
+    if (!data_conn) {
+        // 客户端未连接数据端口：超时后释放端口，不再等待
+        if (now - session->data_last_active > FTP_DATA_TIMEOUT) {
+            printf("[FTP] Data connection not opened: %s\n", session->pending_path);
+            ftp_data_finish(session, FTP_RESP_CANT_OPEN_DATA, "Can't open data connection.");
+        }
+        return;
     }
 
-    // 关闭数据端口
-    tcp_close(session->data_port);
-    session->data_port = 0;
-    session->pending_op = FTP_DATA_OP_NONE;
-    session->state = FTP_STATE_LOGGED_IN;
+    if (session->pending_op != FTP_DATA_OP_STOR) {
+        ftp_do_send(session, data_conn, session->data_port, session->data_ip, session->data_remote_port);
+    }
+
+    if (session->data_done && data_conn->snd_una == data_conn->seq) {
+        ftp_data_finish(session, FTP_RESP_TRANSFER_OK,
+                        session->pending_op == FTP_DATA_OP_STOR || session->pending_op == FTP_DATA_OP_RETR ?
+                        "Transfer complete." : "Directory send OK.");
+    } else if (data_conn->snd_una != session->data_acked) {
+        session->data_acked = data_conn->snd_una;
+        session->data_last_active = now;
+    } else if (now - session->data_last_active > FTP_DATA_TIMEOUT) {
+        printf("[FTP] Data transfer timed out: %s\n", session->pending_path);
+        ftp_data_finish(session, FTP_RESP_CONN_CLOSED, "Transfer timed out; aborted.");
+    }
+}
+
+/**
+ * @brief 推进所有会话，在主循环中每次 net_poll 之后调用
+ */
+static void ftp_schedule() {
+    time_t now = net_time();
+
+    for (size_t i = 0; i < ftp_bucket_count; i++) {
+        ftp_session_t *session = ftp_ctrl_buckets[i];
+        while (session) {
+            ftp_session_t *next = session->ctrl_next;  // 会话可能在本轮被关闭
+            ftp_schedule_session(session, now);
+            session = next;
+        }
+    }
 }
 
 /* ========================= 控制连接处理 ========================= */
@@ -691,6 +1533,7 @@ void ftp_ctrl_handler(tcp_conn_t *tcp_conn, uint8_t *data, size_t len, uint8_t *
     }
 
     session->ctrl_conn = tcp_conn;
+    session->last_active = net_time();
 
     // 处理命令
     if (strcmp(cmd, "USER") == 0) {
@@ -722,12 +1565,12 @@ void ftp_ctrl_handler(tcp_conn_t *tcp_conn, uint8_t *data, size_t len, uint8_t *
         } else {
             ftp_cmd_pasv(session, tcp_conn, FTP_CTRL_PORT, src_ip, src_port);
         }
-    } else if (strcmp(cmd, "LIST") == 0) {
+    } else if (strcmp(cmd, "LIST") == 0 || strcmp(cmd, "MLSD") == 0) {
         if (session->state != FTP_STATE_LOGGED_IN && session->state != FTP_STATE_PASV_WAIT) {
             ftp_send_response(tcp_conn, FTP_CTRL_PORT, src_ip, src_port,
                               FTP_RESP_NOT_LOGGED_IN, "Please login first.");
         } else {
-            ftp_cmd_list(session, tcp_conn, arg, FTP_CTRL_PORT, src_ip, src_port);
+            ftp_cmd_list(session, tcp_conn, arg, strcmp(cmd, "MLSD") == 0, FTP_CTRL_PORT, src_ip, src_port);
         }
     } else if (strcmp(cmd, "RETR") == 0) {
         if (session->state != FTP_STATE_LOGGED_IN && session->state != FTP_STATE_PASV_WAIT) {
@@ -736,12 +1579,40 @@ void ftp_ctrl_handler(tcp_conn_t *tcp_conn, uint8_t *data, size_t len, uint8_t *
         } else {
             ftp_cmd_retr(session, tcp_conn, arg, FTP_CTRL_PORT, src_ip, src_port);
         }
-    } else if (strcmp(cmd, "STOR") == 0) {
+    } else if (strcmp(cmd, "STOR") == 0 || strcmp(cmd, "APPE") == 0) {
+        if (session->state != FTP_STATE_LOGGED_IN && session->state != FTP_STATE_PASV_WAIT) {
+            ftp_send_response(tcp_conn, FTP_CTRL_PORT, src_ip, src_port,
+                              FTP_RESP_NOT_LOGGED_IN, "Please login first.");
+        } else {
+            ftp_cmd_stor(session, tcp_conn, arg, strcmp(cmd, "APPE") == 0, FTP_CTRL_PORT, src_ip, src_port);
+        }
+    } else if (strcmp(cmd, "REST") == 0) {
+        if (session->state != FTP_STATE_LOGGED_IN && session->state != FTP_STATE_PASV_WAIT) {
+            ftp_send_response(tcp_conn, FTP_CTRL_PORT, src_ip, src_port,
+                              FTP_RESP_NOT_LOGGED_IN, "Please login first.");
+        } else {
+            ftp_cmd_rest(session, tcp_conn, arg, FTP_CTRL_PORT, src_ip, src_port);
+        }
+    } else if (strcmp(cmd, "SIZE") == 0) {
         if (session->state != FTP_STATE_LOGGED_IN && session->state != FTP_STATE_PASV_WAIT) {
             ftp_send_response(tcp_conn, FTP_CTRL_PORT, src_ip, src_port,
                               FTP_RESP_NOT_LOGGED_IN, "Please login first.");
         } else {
-            ftp_cmd_stor(session, tcp_conn, arg, FTP_CTRL_PORT, src_ip, src_port);
+            ftp_cmd_size(session, tcp_conn, arg, FTP_CTRL_PORT, src_ip, src_port);
+        }
+    } else if (strcmp(cmd, "MDTM") == 0) {
+        if (session->state != FTP_STATE_LOGGED_IN && session->state != FTP_STATE_PASV_WAIT) {
+            ftp_send_response(tcp_conn, FTP_CTRL_PORT, src_ip, src_port,
+                              FTP_RESP_NOT_LOGGED_IN, "Please login first.");
+        } else {
+            ftp_cmd_mdtm(session, tcp_conn, arg, FTP_CTRL_PORT, src_ip, src_port);
+        }
+    } else if (strcmp(cmd, "MLST") == 0) {
+        if (session->state != FTP_STATE_LOGGED_IN && session->state != FTP_STATE_PASV_WAIT) {
+            ftp_send_response(tcp_conn, FTP_CTRL_PORT, src_ip, src_port,
+                              FTP_RESP_NOT_LOGGED_IN, "Please login first.");
+        } else {
+            ftp_cmd_mlst(session, tcp_conn, arg, FTP_CTRL_PORT, src_ip, src_port);
         }
     } else if (strcmp(cmd, "QUIT") == 0) {
         ftp_cmd_quit(session, tcp_conn, FTP_CTRL_PORT, src_ip, src_port);
@@ -750,7 +1621,7 @@ void ftp_ctrl_handler(tcp_conn_t *tcp_conn, uint8_t *data, size_t len, uint8_t *
     } else if (strcmp(cmd, "FEAT") == 0) {
         // 特性列表
         ftp_send_response(tcp_conn, FTP_CTRL_PORT, src_ip, src_port,
-                          "211", "Features:\r\n PASV\r\n UTF8\r\n211 End");
+                          "211", "Features:\r\n PASV\r\n UTF8\r\n SIZE\r\n MDTM\r\n REST STREAM\r\n MLST type*;size*;modify*;UNIX.mode*;\r\n211 End");
     } else if (strcmp(cmd, "OPTS") == 0) {
         // 选项命令
         ftp_send_response(tcp_conn, FTP_CTRL_PORT, src_ip, src_port,
@@ -769,6 +1640,41 @@ void ftp_send_welcome(tcp_conn_t *tcp_conn, uint8_t *dst_ip, uint16_t dst_port)
                       FTP_RESP_READY, "Welcome to Simple FTP Server.");
 }
 
+/**
+ * @brief 控制连接事件处理函数
+ *
+ * 连接建立时创建会话并发送欢迎消息，对端关闭或连接被移除时释放会话。
+ */
+static void ftp_ctrl_event_handler(tcp_conn_t *tcp_conn, tcp_event_t event, uint8_t *src_ip, uint16_t src_port) {
+    ftp_session_t *session = ftp_get_session(src_ip, src_port, event == TCP_EVENT_ESTABLISHED);
+
+    switch (event) {
+        case TCP_EVENT_ESTABLISHED:
+            if (!session) {
+                ftp_send_response(tcp_conn, FTP_CTRL_PORT, src_ip, src_port,
+                                  FTP_RESP_SERVICE_NA, "Too many connections.");
+                tcp_send(tcp_conn, NULL, 0, FTP_CTRL_PORT, src_ip, src_port);
+                return;
+            }
+            session->ctrl_conn = tcp_conn;
+            ftp_send_welcome(tcp_conn, src_ip, src_port);
+            break;
+
+        case TCP_EVENT_FIN:
+            if (session) {
+                ftp_close_session(session);
+            }
+            tcp_send(tcp_conn, NULL, 0, FTP_CTRL_PORT, src_ip, src_port);
+            break;
+
+        case TCP_EVENT_CLOSED:
+            if (session) {
+                ftp_close_session(session);
+            }
+            break;
+    }
+}
+
 /* ========================= 主函数 ========================= */
 
 int main(int argc, char const *argv[]) {
@@ -786,16 +1692,24 @@ int main(int argc, char const *argv[]) {
     }
 
     // 初始化会话表
-    memset(ftp_sessions, 0, sizeof(ftp_sessions));
+    if (ftp_session_table_init() != 0) {
+        printf("[FTP] Session table initialization failed.\n");
+        return -1;
+    }
+    map_init(&ftp_stat_cache, FTP_MAX_PATH_LENGTH, sizeof(ftp_stat_t), FTP_STAT_CACHE_SIZE, 0,
+             (map_compare_t)strncmp, NULL);
+    map_init(&ftp_list_cache, sizeof(ftp_list_key_t), sizeof(ftp_list_entry_t), FTP_LIST_CACHE_SIZE, 0, NULL, NULL);
 
     // 注册 FTP 控制端口监听
     tcp_open(FTP_CTRL_PORT, ftp_ctrl_handler);
+    tcp_set_event_handler(FTP_CTRL_PORT, ftp_ctrl_event_handler);
 
     printf("[FTP] Server started, listening on port %d...\n", FTP_CTRL_PORT);
 
     // 主循环
     while (1) {
         net_poll();
+        ftp_schedule();
     }
 
     return 0;
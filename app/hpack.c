@@ -0,0 +1,544 @@
+/**
+ * @file hpack.c
+ * @brief HTTP/2 头部压缩（RFC 7541）
+ *
+ * 解码端支持索引表示、三种字面量表示、动态表大小更新与 Huffman 解码；
+ * 编码端输出索引表示或原始字面量（不做 Huffman 编码），重复出现的头部
+ * 通过动态表压缩为单字节索引。
+ */
+
+#include "hpack.h"
+
+#include <string.h>
+
+/**
+ * @brief 静态表（RFC 7541 附录 A），下标 0 对应索引 1
+ *
+ */
+static const struct {
+    const char *name;
+    const char *value;
+} hpack_static_table[HPACK_STATIC_TABLE_LEN] = {
+    {":authority", ""},
+    {":method", "GET"},
+    {":method", "POST"},
+    {":path", "/"},
+    {":path", "/index.html"},
+    {":scheme", "http"},
+    {":scheme", "https"},
+    {":status", "200"},
+    {":status", "204"},
+    {":status", "206"},
+    {":status", "304"},
+    {":status", "400"},
+    {":status", "404"},
+    {":status", "500"},
+    {"accept-charset", ""},
+    {"accept-encoding", "gzip, deflate"},
+    {"accept-language", ""},
+    {"accept-ranges", ""},
+    {"accept", ""},
+    {"access-control-allow-origin", ""},
+    {"age", ""},
+    {"allow", ""},
+    {"authorization", ""},
+    {"cache-control", ""},
+    {"content-disposition", ""},
+    {"content-encoding", ""},
+    {"content-language", ""},
+    {"content-length", ""},
+    {"content-location", ""},
+    {"content-range", ""},
+    {"content-type", ""},
+    {"cookie", ""},
+    {"date", ""},
+    {"etag", ""},
+    {"expect", ""},
+    {"expires", ""},
+    {"from", ""},
+    {"host", ""},
+    {"if-match", ""},
+    {"if-modified-since", ""},
+    {"if-none-match", ""},
+    {"if-range", ""},
+    {"if-unmodified-since", ""},
+    {"last-modified", ""},
+    {"link", ""},
+    {"location", ""},
+    {"max-forwards", ""},
+    {"proxy-authenticate", ""},
+    {"proxy-authorization", ""},
+    {"range", ""},
+    {"referer", ""},
+    {"refresh", ""},
+    {"retry-after", ""},
+    {"server", ""},
+    {"set-cookie", ""},
+    {"strict-transport-security", ""},
+    {"transfer-encoding", ""},
+    {"user-agent", ""},
+    {"vary", ""},
+    {"via", ""},
+    {"www-authenticate", ""},
+};
+
+/**
+ * @brief Huffman 编码表（RFC 7541 附录 B），下标为符号，256 为 EOS
+ *
+ */
+static const struct {
+    uint32_t code;
+    uint8_t bits;
+} hpack_huffman_table[257] = {
+    {0x1ff8, 13}, {0x7fffd8, 23}, {0xfffffe2, 28}, {0xfffffe3, 28},
+    {0xfffffe4, 28}, {0xfffffe5, 28}, {0xfffffe6, 28}, {0xfffffe7, 28},
+    {0xfffffe8, 28}, {0xffffea, 24}, {0x3ffffffc, 30}, {0xfffffe9, 28},
+    {0xfffffea, 28}, {0x3ffffffd, 30}, {0xfffffeb, 28}, {0xfffffec, 28},
+    {0xfffffed, 28}, {0xfffffee, 28}, {0xfffffef, 28}, {0xffffff0, 28},
+    {0xffffff1, 28}, {0xffffff2, 28}, {0x3ffffffe, 30}, {0xffffff3, 28},
+    {0xffffff4, 28}, {0xffffff5, 28}, {0xffffff6, 28}, {0xffffff7, 28},
+    {0xffffff8, 28}, {0xffffff9, 28}, {0xffffffa, 28}, {0xffffffb, 28},
+    {0x14, 6}, {0x3f8, 10}, {0x3f9, 10}, {0xffa, 12},
+    {0x1ff9, 13}, {0x15, 6}, {0xf8, 8}, {0x7fa, 11},
+    {0x3fa, 10}, {0x3fb, 10}, {0xf9, 8}, {0x7fb, 11},
+    {0xfa, 8}, {0x16, 6}, {0x17, 6}, {0x18, 6},
+    {0x0, 5}, {0x1, 5}, {0x2, 5}, {0x19, 6},
+    {0x1a, 6}, {0x1b, 6}, {0x1c, 6}, {0x1d, 6},
+    {0x1e, 6}, {0x1f, 6}, {0x5c, 7}, {0xfb, 8},
+    {0x7ffc, 15}, {0x20, 6}, {0xffb, 12}, {0x3fc, 10},
+    {0x1ffa, 13}, {0x21, 6}, {0x5d, 7}, {0x5e, 7},
+    {0x5f, 7}, {0x60, 7}, {0x61, 7}, {0x62, 7},
+    {0x63, 7}, {0x64, 7}, {0x65, 7}, {0x66, 7},
+    {0x67, 7}, {0x68, 7}, {0x69, 7}, {0x6a, 7},
+    {0x6b, 7}, {0x6c, 7}, {0x6d, 7}, {0x6e, 7},
+    {0x6f, 7}, {0x70, 7}, {0x71, 7}, {0x72, 7},
+    {0xfc, 8}, {0x73, 7}, {0xfd, 8}, {0x1ffb, 13},
+    {0x7fff0, 19}, {0x1ffc, 13}, {0x3ffc, 14}, {0x22, 6},
+    {0x7ffd, 15}, {0x3, 5}, {0x23, 6}, {0x4, 5},
+    {0x24, 6}, {0x5, 5}, {0x25, 6}, {0x26, 6},
+    {0x27, 6}, {0x6, 5}, {0x74, 7}, {0x75, 7},
+    {0x28, 6}, {0x29, 6}, {0x2a, 6}, {0x7, 5},
+    {0x2b, 6}, {0x76, 7}, {0x2c, 6}, {0x8, 5},
+    {0x9, 5}, {0x2d, 6}, {0x77, 7}, {0x78, 7},
+    {0x79, 7}, {0x7a, 7}, {0x7b, 7}, {0x7ffe, 15},
+    {0x7fc, 11}, {0x3ffd, 14}, {0x1ffd, 13}, {0xffffffc, 28},
+    {0xfffe6, 20}, {0x3fffd2, 22}, {0xfffe7, 20}, {0xfffe8, 20},
+    {0x3fffd3, 22}, {0x3fffd4, 22}, {0x3fffd5, 22}, {0x7fffd9, 23},
+    {0x3fffd6, 22}, {0x7fffda, 23}, {0x7fffdb, 23}, {0x7fffdc, 23},
+    {0x7fffdd, 23}, {0x7fffde, 23}, {0xffffeb, 24}, {0x7fffdf, 23},
+    {0xffffec, 24}, {0xffffed, 24}, {0x3fffd7, 22}, {0x7fffe0, 23},
+    {0xffffee, 24}, {0x7fffe1, 23}, {0x7fffe2, 23}, {0x7fffe3, 23},
+    {0x7fffe4, 23}, {0x1fffdc, 21}, {0x3fffd8, 22}, {0x7fffe5, 23},
+    {0x3fffd9, 22}, {0x7fffe6, 23}, {0x7fffe7, 23}, {0xffffef, 24},
+    {0x3fffda, 22}, {0x1fffdd, 21}, {0xfffe9, 20}, {0x3fffdb, 22},
+    {0x3fffdc, 22}, {0x7fffe8, 23}, {0x7fffe9, 23}, {0x1fffde, 21},
+    {0x7fffea, 23}, {0x3fffdd, 22}, {0x3fffde, 22}, {0xfffff0, 24},
+    {0x1fffdf, 21}, {0x3fffdf, 22}, {0x7fffeb, 23}, {0x7fffec, 23},
+    {0x1fffe0, 21}, {0x1fffe1, 21}, {0x3fffe0, 22}, {0x1fffe2, 21},
+    {0x7fffed, 23}, {0x3fffe1, 22}, {0x7fffee, 23}, {0x7fffef, 23},
+    {0xfffea, 20}, {0x3fffe2, 22}, {0x3fffe3, 22}, {0x3fffe4, 22},
+    {0x7ffff0, 23}, {0x3fffe5, 22}, {0x3fffe6, 22}, {0x7ffff1, 23},
+    {0x3ffffe0, 26}, {0x3ffffe1, 26}, {0xfffeb, 20}, {0x7fff1, 19},
+    {0x3fffe7, 22}, {0x7ffff2, 23}, {0x3fffe8, 22}, {0x1ffffec, 25},
+    {0x3ffffe2, 26}, {0x3ffffe3, 26}, {0x3ffffe4, 26}, {0x7ffffde, 27},
+    {0x7ffffdf, 27}, {0x3ffffe5, 26}, {0xfffff1, 24}, {0x1ffffed, 25},
+    {0x7fff2, 19}, {0x1fffe3, 21}, {0x3ffffe6, 26}, {0x7ffffe0, 27},
+    {0x7ffffe1, 27}, {0x3ffffe7, 26}, {0x7ffffe2, 27}, {0xfffff2, 24},
+    {0x1fffe4, 21}, {0x1fffe5, 21}, {0x3ffffe8, 26}, {0x3ffffe9, 26},
+    {0xffffffd, 28}, {0x7ffffe3, 27}, {0x7ffffe4, 27}, {0x7ffffe5, 27},
+    {0xfffec, 20}, {0xfffff3, 24}, {0xfffed, 20}, {0x1fffe6, 21},
+    {0x3fffe9, 22}, {0x1fffe7, 21}, {0x1fffe8, 21}, {0x7ffff3, 23},
+    {0x3fffea, 22}, {0x3fffeb, 22}, {0x1ffffee, 25}, {0x1ffffef, 25},
+    {0xfffff4, 24}, {0xfffff5, 24}, {0x3ffffea, 26}, {0x7ffff4, 23},
+    {0x3ffffeb, 26}, {0x7ffffe6, 27}, {0x3ffffec, 26}, {0x3ffffed, 26},
+    {0x7ffffe7, 27}, {0x7ffffe8, 27}, {0x7ffffe9, 27}, {0x7ffffea, 27},
+    {0x7ffffeb, 27}, {0xffffffe, 28}, {0x7ffffec, 27}, {0x7ffffed, 27},
+    {0x7ffffee, 27}, {0x7ffffef, 27}, {0x7fffff0, 27}, {0x3ffffee, 26},
+    {0x3fffffff, 30},
+};
+
+#define HPACK_HUFFMAN_MAX_BITS 30
+
+/**
+ * @brief 规范 Huffman 解码表，由编码表在首次使用时生成
+ *
+ */
+static struct {
+    int ready;
+    uint32_t first_code[HPACK_HUFFMAN_MAX_BITS + 1];  // 每个码长的第一个码字
+    uint16_t count[HPACK_HUFFMAN_MAX_BITS + 1];       // 每个码长的码字数
+    uint16_t offset[HPACK_HUFFMAN_MAX_BITS + 1];      // 每个码长在 symbols 中的起始下标
+    uint16_t symbols[257];                            // 按（码长，码字）排序的符号
+} hpack_huffman_decoder;
+
+/**
+ * @brief 生成规范 Huffman 解码表
+ *
+ */
+static void hpack_huffman_init() {
+    if (hpack_huffman_decoder.ready)
+        return;
+    uint16_t n = 0;
+    for (int bits = 1; bits <= HPACK_HUFFMAN_MAX_BITS; bits++) {
+        hpack_huffman_decoder.offset[bits] = n;
+        for (int sym = 0; sym < 257; sym++) {
+            if (hpack_huffman_table[sym].bits != bits)
+                continue;
+            if (hpack_huffman_decoder.count[bits]++ == 0)
+                hpack_huffman_decoder.first_code[bits] = hpack_huffman_table[sym].code;
+            hpack_huffman_decoder.symbols[n++] = sym;
+        }
+    }
+    hpack_huffman_decoder.ready = 1;
+}
+
+/**
+ * @brief Huffman 解码
+ *
+ * @param in      编码数据
+ * @param len     编码数据长度
+ * @param out     出口参数，解码结果
+ * @param out_cap out 缓冲区大小
+ * @param out_len 出口参数，解码结果长度
+ * @return int    成功为0，失败为-1
+ */
+static int hpack_huffman_decode(const uint8_t *in, size_t len, char *out, size_t out_cap, size_t *out_len) {
+    hpack_huffman_init();
+    uint32_t code = 0;
+    int bits = 0;
+    size_t n = 0;
+    for (size_t i = 0; i < len; i++) {
+        for (int b = 7; b >= 0; b--) {
+            code = (code << 1) | ((in[i] >> b) & 1);
+            bits++;
+            if (bits > HPACK_HUFFMAN_MAX_BITS)
+                return -1;
+            uint32_t index = code - hpack_huffman_decoder.first_code[bits];
+            if (hpack_huffman_decoder.count[bits] && code >= hpack_huffman_decoder.first_code[bits] &&
+                index < hpack_huffman_decoder.count[bits]) {
+                uint16_t sym = hpack_huffman_decoder.symbols[hpack_huffman_decoder.offset[bits] + index];
+                if (sym == 256 || n == out_cap)  // 串中出现 EOS 视为错误
+                    return -1;
+                out[n++] = (char)sym;
+                code = 0;
+                bits = 0;
+            }
+        }
+    }
+    // 末尾填充必须是不超过 7 位的 EOS 前缀（全 1）
+    if (bits > 7 || code != (1u << bits) - 1)
+        return -1;
+    *out_len = n;
+    return 0;
+}
+
+/**
+ * @brief 解码带 N 位前缀的整数（RFC 7541 5.1）
+ *
+ * @param p      读取位置，解码后前移
+ * @param end    数据结尾
+ * @param prefix 前缀位数
+ * @param out    出口参数，解码结果
+ * @return int   成功为0，失败为-1
+ */
+static int hpack_decode_int(const uint8_t **p, const uint8_t *end, int prefix, uint32_t *out) {
+    if (*p >= end)
+        return -1;
+    uint32_t max_prefix = (1u << prefix) - 1;
+    uint32_t value = *(*p)++ & max_prefix;
+    if (value < max_prefix) {
+        *out = value;
+        return 0;
+    }
+    for (int shift = 0; *p < end; shift += 7) {
+        uint8_t byte = *(*p)++;
+        if (shift > 21)  // 超过 28 位的整数对本实现没有意义
+            return -1;
+        value += (uint32_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            *out = value;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief 解码字符串字面量（RFC 7541 5.2）
+ *
+ * @return int 成功为0，失败为-1
+ */
+static int hpack_decode_string(const uint8_t **p, const uint8_t *end, char *out, size_t out_cap, size_t *out_len) {
+    if (*p >= end)
+        return -1;
+    int huffman = **p & 0x80;
+    uint32_t len;
+    if (hpack_decode_int(p, end, 7, &len) != 0 || len > (size_t)(end - *p))
+        return -1;
+    if (huffman) {
+        if (hpack_huffman_decode(*p, len, out, out_cap, out_len) != 0)
+            return -1;
+    } else {
+        if (len > out_cap)
+            return -1;
+        memcpy(out, *p, len);
+        *out_len = len;
+    }
+    *p += len;
+    return 0;
+}
+
+/**
+ * @brief 编码带 N 位前缀的整数
+ *
+ * @return int 写入的字节数，空间不足为-1
+ */
+static int hpack_encode_int(uint8_t *out, size_t out_len, int prefix, uint8_t flags, uint32_t value) {
+    uint32_t max_prefix = (1u << prefix) - 1;
+    size_t n = 0;
+    if (out_len == 0)
+        return -1;
+    if (value < max_prefix) {
+        out[n++] = flags | value;
+        return n;
+    }
+    out[n++] = flags | max_prefix;
+    value -= max_prefix;
+    while (value >= 0x80) {
+        if (n == out_len)
+            return -1;
+        out[n++] = (value & 0x7f) | 0x80;
+        value >>= 7;
+    }
+    if (n == out_len)
+        return -1;
+    out[n++] = value;
+    return n;
+}
+
+/**
+ * @brief 编码原始字符串字面量（不使用 Huffman）
+ *
+ * @return int 写入的字节数，空间不足为-1
+ */
+static int hpack_encode_string(uint8_t *out, size_t out_len, const char *str) {
+    size_t len = strlen(str);
+    int n = hpack_encode_int(out, out_len, 7, 0, len);
+    if (n < 0 || n + len > out_len)
+        return -1;
+    memcpy(out + n, str, len);
+    return n + len;
+}
+
+/**
+ * @brief 初始化动态表
+ *
+ * @param table    动态表
+ * @param max_size 最大大小，不超过 HPACK_DEFAULT_TABLE_SIZE
+ */
+void hpack_table_init(hpack_table_t *table, size_t max_size) {
+    memset(table, 0, sizeof(hpack_table_t));
+    table->max_size = max_size > HPACK_DEFAULT_TABLE_SIZE ? HPACK_DEFAULT_TABLE_SIZE : max_size;
+    table->pending_size_update = SIZE_MAX;
+}
+
+/**
+ * @brief 淘汰表项直到当前大小不超过 limit
+ *
+ */
+static void hpack_table_evict(hpack_table_t *table, size_t limit) {
+    while (table->count > 0 && table->size > limit) {
+        hpack_entry_t *oldest = &table->entries[--table->count];
+        table->size -= oldest->name_len + oldest->value_len + HPACK_ENTRY_OVERHEAD;
+    }
+}
+
+/**
+ * @brief 修改动态表最大大小
+ *
+ * 编码端调用时会在下一个头部块开头通告新的大小。
+ *
+ * @param table    动态表
+ * @param max_size 新的最大大小
+ */
+void hpack_table_set_max_size(hpack_table_t *table, size_t max_size) {
+    if (max_size > HPACK_DEFAULT_TABLE_SIZE)
+        max_size = HPACK_DEFAULT_TABLE_SIZE;
+    table->max_size = max_size;
+    table->pending_size_update = max_size;
+    hpack_table_evict(table, max_size);
+}
+
+/**
+ * @brief 向动态表插入一个表项
+ *
+ */
+static void hpack_table_add(hpack_table_t *table, const char *name, size_t name_len, const char *value, size_t value_len) {
+    size_t entry_size = name_len + value_len + HPACK_ENTRY_OVERHEAD;
+    if (entry_size > table->max_size) {  // 大于整表的表项会清空动态表（RFC 7541 4.4）
+        hpack_table_evict(table, 0);
+        return;
+    }
+    hpack_table_evict(table, table->max_size - entry_size);
+
+    // 表项数据紧密排列，最新表项位于开头
+    size_t used = table->size - table->count * HPACK_ENTRY_OVERHEAD;
+    memmove(table->data + name_len + value_len, table->data, used);
+    memcpy(table->data, name, name_len);
+    memcpy(table->data + name_len, value, value_len);
+    memmove(&table->entries[1], &table->entries[0], table->count * sizeof(hpack_entry_t));
+    for (int i = 1; i <= table->count; i++)
+        table->entries[i].offset += name_len + value_len;
+    table->entries[0].offset = 0;
+    table->entries[0].name_len = name_len;
+    table->entries[0].value_len = value_len;
+    table->count++;
+    table->size += entry_size;
+}
+
+/**
+ * @brief 按索引（静态表与动态表统一编址，从1开始）查找表项
+ *
+ * @return int 成功为0，索引无效为-1
+ */
+static int hpack_table_get(hpack_table_t *table, uint32_t index, const char **name, size_t *name_len, const char **value, size_t *value_len) {
+    if (index == 0)
+        return -1;
+    if (index <= HPACK_STATIC_TABLE_LEN) {
+        *name = hpack_static_table[index - 1].name;
+        *name_len = strlen(*name);
+        *value = hpack_static_table[index - 1].value;
+        *value_len = strlen(*value);
+        return 0;
+    }
+    index -= HPACK_STATIC_TABLE_LEN + 1;
+    if (index >= (uint32_t)table->count)
+        return -1;
+    hpack_entry_t *entry = &table->entries[index];
+    *name = (const char *)table->data + entry->offset;
+    *name_len = entry->name_len;
+    *value = *name + entry->name_len;
+    *value_len = entry->value_len;
+    return 0;
+}
+
+/**
+ * @brief 解码一个完整的头部块
+ *
+ * @param table   解码端动态表
+ * @param block   头部块
+ * @param len     头部块长度
+ * @param handler 每解出一个头部调用一次，返回非0则中止解码
+ * @param ctx     传给 handler 的上下文
+ * @return int    成功为0，压缩错误为-1，handler 中止时返回其返回值
+ */
+int hpack_decode(hpack_table_t *table, const uint8_t *block, size_t len, hpack_header_handler_t handler, void *ctx) {
+    const uint8_t *p = block;
+    const uint8_t *end = block + len;
+    char name_buf[HPACK_MAX_STRING_LENGTH];
+    char value_buf[HPACK_MAX_STRING_LENGTH];
+    int header_seen = 0;
+
+    while (p < end) {
+        uint8_t first = *p;
+        uint32_t index;
+        const char *name, *value;
+        size_t name_len, value_len;
+        int ret;
+
+        if (first & 0x80) {  // 索引表示
+            if (hpack_decode_int(&p, end, 7, &index) != 0 ||
+                hpack_table_get(table, index, &name, &name_len, &value, &value_len) != 0)
+                return -1;
+            header_seen = 1;
+            if ((ret = handler(ctx, name, name_len, value, value_len)) != 0)
+                return ret;
+            continue;
+        }
+
+        if ((first & 0xe0) == 0x20) {  // 动态表大小更新，只能出现在头部块开头
+            if (header_seen || hpack_decode_int(&p, end, 5, &index) != 0 || index > HPACK_DEFAULT_TABLE_SIZE)
+                return -1;
+            table->max_size = index;
+            hpack_table_evict(table, index);
+            continue;
+        }
+
+        // 字面量表示：01 带增量索引，0000 不索引，0001 永不索引
+        int indexing = (first & 0xc0) == 0x40;
+        if (hpack_decode_int(&p, end, indexing ? 6 : 4, &index) != 0)
+            return -1;
+        if (index) {
+            // 名称可能引用即将被淘汰的动态表项，先拷贝出来
+            if (hpack_table_get(table, index, &name, &name_len, &value, &value_len) != 0)
+                return -1;
+            memcpy(name_buf, name, name_len);
+        } else if (hpack_decode_string(&p, end, name_buf, sizeof(name_buf), &name_len) != 0) {
+            return -1;
+        }
+        if (hpack_decode_string(&p, end, value_buf, sizeof(value_buf), &value_len) != 0)
+            return -1;
+        if (indexing)
+            hpack_table_add(table, name_buf, name_len, value_buf, value_len);
+        header_seen = 1;
+        if ((ret = handler(ctx, name_buf, name_len, value_buf, value_len)) != 0)
+            return ret;
+    }
+    return 0;
+}
+
+/**
+ * @brief 编码一个头部
+ *
+ * 优先使用完全匹配的静态表或动态表索引，否则输出引用名称索引的字面量。
+ *
+ * @param table    编码端动态表
+ * @param out      输出缓冲区
+ * @param out_len  输出缓冲区大小
+ * @param name     头部名称（小写）
+ * @param value    头部值
+ * @param indexing 为1则以带增量索引的字面量输出并加入动态表，适用于会在后续响应中重复出现的头部
+ * @return int     写入的字节数，空间不足为-1
+ */
+int hpack_encode(hpack_table_t *table, uint8_t *out, size_t out_len, const char *name, const char *value, int indexing) {
+    int n = 0, ret;
+    if (table->pending_size_update != SIZE_MAX) {
+        if ((ret = hpack_encode_int(out, out_len, 5, 0x20, table->pending_size_update)) < 0)
+            return -1;
+        n += ret;
+        table->pending_size_update = SIZE_MAX;
+    }
+
+    size_t name_len = strlen(name);
+    size_t value_len = strlen(value);
+    uint32_t name_index = 0;
+    for (uint32_t i = 1; i <= HPACK_STATIC_TABLE_LEN + (uint32_t)table->count; i++) {
+        const char *entry_name, *entry_value;
+        size_t entry_name_len, entry_value_len;
+        hpack_table_get(table, i, &entry_name, &entry_name_len, &entry_value, &entry_value_len);
+        if (entry_name_len != name_len || memcmp(entry_name, name, name_len) != 0)
+            continue;
+        if (entry_value_len == value_len && memcmp(entry_value, value, value_len) == 0) {
+            if ((ret = hpack_encode_int(out + n, out_len - n, 7, 0x80, i)) < 0)
+                return -1;
+            return n + ret;
+        }
+        if (!name_index)
+            name_index = i;
+    }
+
+    if ((ret = hpack_encode_int(out + n, out_len - n, indexing ? 6 : 4, indexing ? 0x40 : 0x00, name_index)) < 0)
+        return -1;
+    n += ret;
+    if (!name_index) {
+        if ((ret = hpack_encode_string(out + n, out_len - n, name)) < 0)
+            return -1;
+        n += ret;
+    }
+    if ((ret = hpack_encode_string(out + n, out_len - n, value)) < 0)
+        return -1;
+    n += ret;
+    if (indexing)
+        hpack_table_add(table, name, name_len, value, value_len);
+    return n;
+}
@@ -0,0 +1,35 @@
+#ifndef HPACK_H
+#define HPACK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define HPACK_DEFAULT_TABLE_SIZE 4096                  // 动态表默认大小（SETTINGS_HEADER_TABLE_SIZE 初值）
+#define HPACK_ENTRY_OVERHEAD 32                        // 每个表项的额外开销（RFC 7541 4.1）
+#define HPACK_MAX_ENTRIES (HPACK_DEFAULT_TABLE_SIZE / HPACK_ENTRY_OVERHEAD)
+#define HPACK_STATIC_TABLE_LEN 61                      // 静态表项数
+#define HPACK_MAX_STRING_LENGTH 4096                   // 解码后单个名称或值的最大长度
+
+typedef struct hpack_entry {
+    uint16_t offset;     // 在 data 中的偏移
+    uint16_t name_len;   // 名称长度
+    uint16_t value_len;  // 值长度
+} hpack_entry_t;
+
+typedef struct hpack_table  // HPACK 动态表，编码端与解码端各维护一份
+{
+    size_t size;                                 // 当前大小（名称+值+32 之和）
+    size_t max_size;                             // 当前允许的最大大小
+    size_t pending_size_update;                  // 编码端：待通告的新大小，为 SIZE_MAX 表示无
+    int count;                                   // 表项数，entries[0] 为最新表项
+    hpack_entry_t entries[HPACK_MAX_ENTRIES];    // 表项
+    uint8_t data[HPACK_DEFAULT_TABLE_SIZE];      // 名称与值的存储区
+} hpack_table_t;
+
+typedef int (*hpack_header_handler_t)(void *ctx, const char *name, size_t name_len, const char *value, size_t value_len);
+
+void hpack_table_init(hpack_table_t *table, size_t max_size);
+void hpack_table_set_max_size(hpack_table_t *table, size_t max_size);
+int hpack_decode(hpack_table_t *table, const uint8_t *block, size_t len, hpack_header_handler_t handler, void *ctx);
+int hpack_encode(hpack_table_t *table, uint8_t *out, size_t out_len, const char *name, const char *value, int indexing);
+#endif
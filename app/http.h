@@ -0,0 +1,68 @@
+#ifndef HTTP_H
+#define HTTP_H
+
+#include "net.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define HTTP_MAX_PATH_LENGTH 1024
+#define HTTP_MAX_HEADER_VALUE_LENGTH 256
+#define HTTP_MAX_RANGES 8  // 单个请求最多接受的区间数，超出则忽略 Range 头
+
+/**
+ * @brief 解析后的 HTTP 请求，HTTP/1.1 与 HTTP/2 共用
+ *
+ */
+typedef struct http_request {
+    char method[8];                                      // 请求方法
+    char url_path[HTTP_MAX_PATH_LENGTH];                 // 请求 URL
+    char range[HTTP_MAX_HEADER_VALUE_LENGTH];            // Range 请求头，空串表示不存在
+    char if_range[HTTP_MAX_HEADER_VALUE_LENGTH];         // If-Range 请求头，空串表示不存在
+    char connection[HTTP_MAX_HEADER_VALUE_LENGTH];       // Connection 请求头（仅 HTTP/1.1）
+    char upgrade[HTTP_MAX_HEADER_VALUE_LENGTH];          // Upgrade 请求头（仅 HTTP/1.1）
+    char http2_settings[HTTP_MAX_HEADER_VALUE_LENGTH];   // HTTP2-Settings 请求头（仅 HTTP/1.1）
+    int version;                                         // 协议版本，1 或 2
+    uint8_t remote_ip[NET_IP_LEN];                       // 客户端 IP
+    uint64_t start_us;                                   // 收到请求的时刻（net_now_us）
+} http_request_t;
+
+/**
+ * @brief 字节区间 [start, end]，两端均包含
+ *
+ */
+typedef struct http_range {
+    size_t start;
+    size_t end;
+} http_range_t;
+
+/**
+ * @brief 与传输无关的响应描述，消息体可按偏移分段读取，以便在多次发送中续传
+ *
+ */
+typedef struct http_response {
+    int status;                              // 状态码
+    const char *reason;                      // 状态描述
+    const char *content_type;                // Content-Type，NULL 表示不发送
+    const char *part_type;                   // 资源本身的 MIME 类型（多区间时每段使用）
+    int accept_ranges;                       // 是否发送 Accept-Ranges: bytes
+    char etag[64];                           // ETag，空串表示不发送
+    char last_modified[64];                  // Last-Modified，空串表示不发送
+    char content_range[96];                  // Content-Range，空串表示不发送
+    size_t content_length;                   // 消息体长度
+    const char *body;                        // 内存中的消息体，为 NULL 时从文件读取
+    char *owned_body;                        // 动态生成的消息体，由 http_response_release 释放
+    FILE *file;                              // 资源文件
+    size_t file_size;                        // 文件大小
+    http_range_t ranges[HTTP_MAX_RANGES];    // 返回的区间
+    int range_count;                         // 区间数，0 表示完整文件，大于1为 multipart/byteranges
+    uint64_t first_byte_us;                  // 响应头发出的时刻（net_now_us），0 表示尚未发出
+} http_response_t;
+
+void http_prepare_response(http_request_t *request, http_response_t *response);
+size_t http_body_read(http_response_t *response, size_t offset, uint8_t *buf, size_t len);
+void http_response_release(http_response_t *response);
+int http_server_init();
+void http_schedule();
+#endif
@@ -0,0 +1,790 @@
+/**
+ * @file http2.c
+ * @brief 明文 HTTP/2（h2c，RFC 9113）
+ *
+ * 支持 prior knowledge 与 HTTP/1.1 Upgrade 两种建立方式。一个 TCP 连接上的
+ * 多个流各自持有一个 http_response_t。收到的帧在 http2_input 中处理，响应由
+ * 应用调用 http2_flush 按流量控制窗口与字节预算轮转发送，窗口耗尽时等待
+ * WINDOW_UPDATE 后继续。
+ */
+
+#include "http2.h"
+
+#include "http_log.h"
+#include "map.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @brief HTTP/2 连接表
+ *
+ */
+static map_t http2_conn_table;  // tcp_conn -> http2_conn
+
+/**
+ * @brief 判断数据是否以 HTTP/2 连接前言开头（允许前言被拆分到多个报文）
+ *
+ * @param data 数据
+ * @param len  数据长度
+ * @return int 是为1，否则为0
+ */
+int http2_is_preface(const uint8_t *data, size_t len) {
+    if (len > HTTP2_PREFACE_LEN)
+        len = HTTP2_PREFACE_LEN;
+    return len >= 4 && memcmp(data, HTTP2_PREFACE, len) == 0;
+}
+
+/**
+ * @brief 发送一个帧
+ *
+ * @param conn      连接
+ * @param type      帧类型
+ * @param flags     标志
+ * @param stream_id 流标识符
+ * @param payload   负载
+ * @param len       负载长度，不超过 HTTP2_MAX_SEND_FRAME
+ */
+static void http2_send_frame(http2_conn_t *conn, uint8_t type, uint8_t flags, uint32_t stream_id, const uint8_t *payload, size_t len) {
+    uint8_t frame[HTTP2_FRAME_HEADER_LEN + HTTP2_MAX_SEND_FRAME];
+    frame[0] = len >> 16;
+    frame[1] = len >> 8;
+    frame[2] = len;
+    frame[3] = type;
+    frame[4] = flags;
+    frame[5] = (stream_id >> 24) & 0x7f;
+    frame[6] = stream_id >> 16;
+    frame[7] = stream_id >> 8;
+    frame[8] = stream_id;
+    if (len)
+        memcpy(frame + HTTP2_FRAME_HEADER_LEN, payload, len);
+    tcp_send(conn->tcp_conn, frame, HTTP2_FRAME_HEADER_LEN + len, conn->port, conn->remote_ip, conn->remote_port);
+}
+
+static inline uint32_t http2_read_u32(const uint8_t *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static inline void http2_write_u32(uint8_t *p, uint32_t value) {
+    p[0] = value >> 24;
+    p[1] = value >> 16;
+    p[2] = value >> 8;
+    p[3] = value;
+}
+
+/**
+ * @brief 连接错误：发送 GOAWAY 并关闭 TCP 连接
+ *
+ * @param conn  连接
+ * @param error 错误码
+ */
+static void http2_conn_error(http2_conn_t *conn, http2_error_t error) {
+    uint8_t payload[8];
+    http2_write_u32(payload, conn->last_stream_id);
+    http2_write_u32(payload + 4, error);
+    http2_send_frame(conn, HTTP2_FRAME_GOAWAY, 0, 0, payload, sizeof(payload));
+    tcp_send(conn->tcp_conn, NULL, 0, conn->port, conn->remote_ip, conn->remote_port);
+    conn->closing = 1;
+}
+
+/**
+ * @brief 发送服务端连接前言（SETTINGS 帧），仅发送一次
+ *
+ * @param conn 连接
+ */
+static void http2_send_settings(http2_conn_t *conn) {
+    if (conn->settings_sent)
+        return;
+    uint8_t settings[6];
+    settings[0] = 0;
+    settings[1] = HTTP2_SETTINGS_MAX_CONCURRENT_STREAMS;
+    http2_write_u32(settings + 2, HTTP2_MAX_STREAMS);
+    http2_send_frame(conn, HTTP2_FRAME_SETTINGS, 0, 0, settings, sizeof(settings));
+    conn->settings_sent = 1;
+}
+
+/**
+ * @brief 查找流
+ *
+ * @param conn      连接
+ * @param stream_id 流标识符
+ * @return http2_stream_t* 未找到为NULL
+ */
+static http2_stream_t *http2_stream_get(http2_conn_t *conn, uint32_t stream_id) {
+    for (int i = 0; i < HTTP2_MAX_STREAMS; i++)
+        if (conn->streams[i].state != HTTP2_STREAM_IDLE && conn->streams[i].id == stream_id)
+            return &conn->streams[i];
+    return NULL;
+}
+
+/**
+ * @brief 分配一个空闲流
+ *
+ * @param conn      连接
+ * @param stream_id 流标识符
+ * @return http2_stream_t* 已达并发上限为NULL
+ */
+static http2_stream_t *http2_stream_new(http2_conn_t *conn, uint32_t stream_id) {
+    for (int i = 0; i < HTTP2_MAX_STREAMS; i++) {
+        http2_stream_t *stream = &conn->streams[i];
+        if (stream->state == HTTP2_STREAM_IDLE) {
+            memset(stream, 0, sizeof(http2_stream_t));
+            stream->id = stream_id;
+            stream->state = HTTP2_STREAM_OPEN;
+            stream->send_window = conn->peer_initial_window;
+            return stream;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief 释放流
+ *
+ * @param stream 流
+ */
+static void http2_stream_free(http2_stream_t *stream) {
+    if (stream->state == HTTP2_STREAM_RESPONDING) {
+        http_log_request(&stream->request, &stream->response, stream->body_offset);
+        http_response_release(&stream->response);
+    }
+    stream->state = HTTP2_STREAM_IDLE;
+}
+
+/**
+ * @brief 流错误：发送 RST_STREAM
+ *
+ * @param conn      连接
+ * @param stream_id 流标识符
+ * @param error     错误码
+ */
+static void http2_stream_reset(http2_conn_t *conn, uint32_t stream_id, http2_error_t error) {
+    uint8_t payload[4];
+    http2_write_u32(payload, error);
+    http2_send_frame(conn, HTTP2_FRAME_RST_STREAM, 0, stream_id, payload, sizeof(payload));
+    http2_stream_t *stream = http2_stream_get(conn, stream_id);
+    if (stream)
+        http2_stream_free(stream);
+}
+
+/**
+ * @brief 发送响应头
+ *
+ * @param conn   连接
+ * @param stream 流
+ * @return int   头部块长度，超出单帧为-1
+ */
+static int http2_send_headers(http2_conn_t *conn, http2_stream_t *stream) {
+    http_response_t *response = &stream->response;
+    uint8_t block[HTTP2_MAX_SEND_FRAME];
+    char value[32];
+    int len = 0, ret;
+
+#define HTTP2_ENCODE(name, value, indexing)                                                 \
+    do {                                                                                     \
+        if ((ret = hpack_encode(&conn->encoder, block + len, sizeof(block) - len, name, value, indexing)) < 0) \
+            return -1;                                                                       \
+        len += ret;                                                                          \
+    } while (0)
+
+    snprintf(value, sizeof(value), "%d", response->status);
+    HTTP2_ENCODE(":status", value, 1);
+    if (response->accept_ranges)
+        HTTP2_ENCODE("accept-ranges", "bytes", 1);
+    if (response->etag[0])
+        HTTP2_ENCODE("etag", response->etag, 0);
+    if (response->last_modified[0])
+        HTTP2_ENCODE("last-modified", response->last_modified, 0);
+    if (response->content_type)
+        HTTP2_ENCODE("content-type", response->content_type, 1);
+    if (response->content_range[0])
+        HTTP2_ENCODE("content-range", response->content_range, 0);
+    snprintf(value, sizeof(value), "%zu", response->content_length);
+    HTTP2_ENCODE("content-length", value, 0);
+#undef HTTP2_ENCODE
+
+    uint8_t flags = HTTP2_FLAG_END_HEADERS;
+    if (response->content_length == 0)
+        flags |= HTTP2_FLAG_END_STREAM;
+    http2_send_frame(conn, HTTP2_FRAME_HEADERS, flags, stream->id, block, len);
+    return len;
+}
+
+/**
+ * @brief 在窗口与预算允许的范围内轮转发送各流的响应，每轮每个流至多一帧
+ *
+ * @param conn    连接
+ * @param budget  本次最多发送的字节数（帧负载），响应头不受此限制
+ * @return size_t 实际发送的字节数，为0表示当前无数据可发
+ */
+size_t http2_flush(http2_conn_t *conn, size_t budget) {
+    uint8_t data[HTTP2_MAX_SEND_FRAME];
+    size_t sent = 0;
+    int progress = 1;
+    while (progress && sent < budget && !conn->closing) {
+        progress = 0;
+        for (int i = 0; i < HTTP2_MAX_STREAMS; i++) {
+            http2_stream_t *stream = &conn->streams[(conn->next_stream + i) % HTTP2_MAX_STREAMS];
+            if (stream->state != HTTP2_STREAM_RESPONDING)
+                continue;
+            http_response_t *response = &stream->response;
+
+            if (!stream->headers_sent) {
+                int header_len = http2_send_headers(conn, stream);
+                if (header_len < 0) {
+                    // 编码表状态已被部分修改，无法再与对端保持一致
+                    http2_conn_error(conn, HTTP2_INTERNAL_ERROR);
+                    return sent;
+                }
+                stream->headers_sent = 1;
+                response->first_byte_us = net_now_us();
+                sent += header_len;
+                progress = 1;
+                if (response->content_length == 0) {
+                    http2_stream_free(stream);
+                    continue;
+                }
+            }
+
+            int64_t window = conn->send_window < stream->send_window ? conn->send_window : stream->send_window;
+            size_t len = response->content_length - stream->body_offset;
+            if (window <= 0 || sent >= budget)
+                continue;
+            if (len > (uint64_t)window)
+                len = window;
+            if (len > sizeof(data))
+                len = sizeof(data);
+            if (len > budget - sent)
+                len = budget - sent;
+
+            len = http_body_read(response, stream->body_offset, data, len);
+            if (len == 0) {  // 文件在发送过程中被截断
+                http2_stream_reset(conn, stream->id, HTTP2_INTERNAL_ERROR);
+                continue;
+            }
+            stream->body_offset += len;
+            sent += len;
+            conn->send_window -= len;
+            stream->send_window -= len;
+            int end = stream->body_offset == response->content_length;
+            http2_send_frame(conn, HTTP2_FRAME_DATA, end ? HTTP2_FLAG_END_STREAM : 0, stream->id, data, len);
+            progress = 1;
+            if (end)
+                http2_stream_free(stream);
+        }
+        conn->next_stream = (conn->next_stream + 1) % HTTP2_MAX_STREAMS;
+    }
+    return sent;
+}
+
+/**
+ * @brief 请求已完整接收，生成响应并开始发送
+ *
+ * @param conn   连接
+ * @param stream 流
+ */
+static void http2_stream_respond(http2_conn_t *conn, http2_stream_t *stream) {
+    if (!stream->request.method[0] || !stream->request.url_path[0]) {
+        http2_stream_reset(conn, stream->id, HTTP2_PROTOCOL_ERROR);
+        return;
+    }
+    http_prepare_response(&stream->request, &stream->response);
+    stream->state = HTTP2_STREAM_RESPONDING;
+}
+
+/**
+ * @brief 复制长度受限的头部值并以 '\0' 结尾，超长时截断
+ *
+ */
+static void http2_copy_value(char *dst, size_t dst_len, const char *value, size_t value_len) {
+    if (value_len >= dst_len)
+        value_len = dst_len - 1;
+    memcpy(dst, value, value_len);
+    dst[value_len] = '\0';
+}
+
+/**
+ * @brief HPACK 解码回调，填充请求中关心的字段
+ *
+ */
+static int http2_header_handler(void *ctx, const char *name, size_t name_len, const char *value, size_t value_len) {
+    http_request_t *request = ctx;
+    if (name_len == 7 && memcmp(name, ":method", 7) == 0)
+        http2_copy_value(request->method, sizeof(request->method), value, value_len);
+    else if (name_len == 5 && memcmp(name, ":path", 5) == 0)
+        http2_copy_value(request->url_path, sizeof(request->url_path), value, value_len);
+    else if (name_len == 5 && memcmp(name, "range", 5) == 0)
+        http2_copy_value(request->range, sizeof(request->range), value, value_len);
+    else if (name_len == 8 && memcmp(name, "if-range", 8) == 0)
+        http2_copy_value(request->if_range, sizeof(request->if_range), value, value_len);
+    return 0;
+}
+
+/**
+ * @brief 解码一个完整的头部块
+ *
+ * 即使流被拒绝也必须解码，以保持动态表与对端同步。
+ *
+ * @param conn 连接
+ */
+static void http2_headers_complete(http2_conn_t *conn) {
+    uint32_t stream_id = conn->header_stream;
+    conn->header_stream = 0;
+
+    http_request_t discard;
+    http2_stream_t *stream = http2_stream_get(conn, stream_id);
+    int trailers = stream != NULL;
+    if (!stream && stream_id <= conn->last_stream_id) {  // 已关闭的流
+        http2_conn_error(conn, HTTP2_STREAM_CLOSED);
+        return;
+    }
+    if (!stream) {
+        conn->last_stream_id = stream_id;
+        stream = http2_stream_new(conn, stream_id);
+        if (stream) {
+            stream->request.version = 2;
+            stream->request.start_us = net_now_us();
+            memcpy(stream->request.remote_ip, conn->remote_ip, NET_IP_LEN);
+        }
+    }
+
+    memset(&discard, 0, sizeof(discard));
+    http_request_t *request = stream && !trailers ? &stream->request : &discard;
+    if (hpack_decode(&conn->decoder, conn->header_block, conn->header_block_len, http2_header_handler, request) != 0) {
+        http2_conn_error(conn, HTTP2_COMPRESSION_ERROR);
+        return;
+    }
+
+    if (!stream) {
+        http2_stream_reset(conn, stream_id, HTTP2_REFUSED_STREAM);
+        return;
+    }
+    if (trailers && stream->state != HTTP2_STREAM_OPEN) {
+        http2_stream_reset(conn, stream_id, HTTP2_STREAM_CLOSED);
+        return;
+    }
+    if (trailers && !conn->header_end_stream) {  // 尾部头部块必须结束流
+        http2_stream_reset(conn, stream_id, HTTP2_PROTOCOL_ERROR);
+        return;
+    }
+    if (conn->header_end_stream)
+        http2_stream_respond(conn, stream);
+}
+
+/**
+ * @brief 应用对端的 SETTINGS 参数
+ *
+ * @param conn    连接
+ * @param payload SETTINGS 负载
+ * @param len     负载长度，为6的整数倍
+ * @return int    成功为0，否则为连接错误码
+ */
+static int http2_apply_settings(http2_conn_t *conn, const uint8_t *payload, size_t len) {
+    for (size_t i = 0; i + 6 <= len; i += 6) {
+        uint16_t id = (payload[i] << 8) | payload[i + 1];
+        uint32_t value = http2_read_u32(payload + i + 2);
+        switch (id) {
+            case HTTP2_SETTINGS_HEADER_TABLE_SIZE:
+                hpack_table_set_max_size(&conn->encoder, value);
+                break;
+            case HTTP2_SETTINGS_ENABLE_PUSH:
+                if (value > 1)
+                    return HTTP2_PROTOCOL_ERROR;
+                break;
+            case HTTP2_SETTINGS_INITIAL_WINDOW_SIZE:
+                if (value > HTTP2_MAX_WINDOW_SIZE)
+                    return HTTP2_FLOW_CONTROL_ERROR;
+                // 调整所有流的发送窗口（RFC 9113 6.9.2）
+                for (int j = 0; j < HTTP2_MAX_STREAMS; j++)
+                    conn->streams[j].send_window += (int64_t)value - conn->peer_initial_window;
+                conn->peer_initial_window = value;
+                break;
+            case HTTP2_SETTINGS_MAX_FRAME_SIZE:
+                // 发送端单帧不超过 HTTP2_MAX_SEND_FRAME，只需校验取值
+                if (value < HTTP2_MAX_FRAME_SIZE || value > 0xffffff)
+                    return HTTP2_PROTOCOL_ERROR;
+                break;
+            default:  // 忽略未知参数
+                break;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief 处理一个完整的帧
+ *
+ * @param conn      连接
+ * @param type      帧类型
+ * @param flags     标志
+ * @param stream_id 流标识符
+ * @param payload   负载
+ * @param len       负载长度
+ */
+static void http2_process_frame(http2_conn_t *conn, uint8_t type, uint8_t flags, uint32_t stream_id, const uint8_t *payload, size_t len) {
+    // 头部块必须连续，中间只能出现同一流的 CONTINUATION
+    if (conn->header_stream && (type != HTTP2_FRAME_CONTINUATION || stream_id != conn->header_stream)) {
+        http2_conn_error(conn, HTTP2_PROTOCOL_ERROR);
+        return;
+    }
+    // 连接前言之后的第一帧必须为 SETTINGS
+    if (!conn->settings_received && type != HTTP2_FRAME_SETTINGS) {
+        http2_conn_error(conn, HTTP2_PROTOCOL_ERROR);
+        return;
+    }
+
+    switch (type) {
+        case HTTP2_FRAME_DATA: {
+            if (stream_id == 0) {
+                http2_conn_error(conn, HTTP2_PROTOCOL_ERROR);
+                return;
+            }
+            // 请求体直接丢弃，填充只需校验长度
+            if ((flags & HTTP2_FLAG_PADDED) && (len < 1 || payload[0] >= len)) {
+                http2_conn_error(conn, HTTP2_PROTOCOL_ERROR);
+                return;
+            }
+
+            // 请求体不做缓存，收到即归还接收窗口（整帧长度都计入流量控制）
+            uint8_t increment[4];
+            http2_write_u32(increment, len);
+            http2_stream_t *stream = http2_stream_get(conn, stream_id);
+            if (len) {
+                http2_send_frame(conn, HTTP2_FRAME_WINDOW_UPDATE, 0, 0, increment, sizeof(increment));
+                if (stream && stream->state == HTTP2_STREAM_OPEN && !(flags & HTTP2_FLAG_END_STREAM))
+                    http2_send_frame(conn, HTTP2_FRAME_WINDOW_UPDATE, 0, stream_id, increment, sizeof(increment));
+            }
+            if (!stream && stream_id > conn->last_stream_id) {
+                http2_conn_error(conn, HTTP2_PROTOCOL_ERROR);
+                return;
+            }
+            if (!stream || stream->state != HTTP2_STREAM_OPEN) {
+                http2_stream_reset(conn, stream_id, HTTP2_STREAM_CLOSED);
+                return;
+            }
+            if (flags & HTTP2_FLAG_END_STREAM)
+                http2_stream_respond(conn, stream);
+            break;
+        }
+        case HTTP2_FRAME_HEADERS: {
+            if (stream_id == 0 || (stream_id % 2 == 0)) {
+                http2_conn_error(conn, HTTP2_PROTOCOL_ERROR);
+                return;
+            }
+            size_t pad = 0, skip = 0;
+            if (flags & HTTP2_FLAG_PADDED) {
+                if (len < 1) {
+                    http2_conn_error(conn, HTTP2_PROTOCOL_ERROR);
+                    return;
+                }
+                pad = payload[0];
+                skip = 1;
+            }
+            if (flags & HTTP2_FLAG_PRIORITY)
+                skip += 5;
+            if (skip + pad > len) {
+                http2_conn_error(conn, HTTP2_PROTOCOL_ERROR);
+                return;
+            }
+            size_t fragment_len = len - skip - pad;
+            if (fragment_len > sizeof(conn->header_block)) {
+                http2_conn_error(conn, HTTP2_ENHANCE_YOUR_CALM);
+                return;
+            }
+            memcpy(conn->header_block, payload + skip, fragment_len);
+            conn->header_block_len = fragment_len;
+            conn->header_stream = stream_id;
+            conn->header_end_stream = flags & HTTP2_FLAG_END_STREAM;
+            if (flags & HTTP2_FLAG_END_HEADERS)
+                http2_headers_complete(conn);
+            break;
+        }
+        case HTTP2_FRAME_CONTINUATION:
+            if (!conn->header_stream) {
+                http2_conn_error(conn, HTTP2_PROTOCOL_ERROR);
+                return;
+            }
+            if (conn->header_block_len + len > sizeof(conn->header_block)) {
+                http2_conn_error(conn, HTTP2_ENHANCE_YOUR_CALM);
+                return;
+            }
+            memcpy(conn->header_block + conn->header_block_len, payload, len);
+            conn->header_block_len += len;
+            if (flags & HTTP2_FLAG_END_HEADERS)
+                http2_headers_complete(conn);
+            break;
+        case HTTP2_FRAME_PRIORITY:  // 不做优先级调度
+            if (stream_id == 0) {
+                http2_conn_error(conn, HTTP2_PROTOCOL_ERROR);
+                return;
+            }
+            if (len != 5)
+                http2_stream_reset(conn, stream_id, HTTP2_FRAME_SIZE_ERROR);
+            break;
+        case HTTP2_FRAME_RST_STREAM: {
+            if (stream_id == 0 || stream_id > conn->last_stream_id) {
+                http2_conn_error(conn, HTTP2_PROTOCOL_ERROR);
+                return;
+            }
+            if (len != 4) {
+                http2_conn_error(conn, HTTP2_FRAME_SIZE_ERROR);
+                return;
+            }
+            http2_stream_t *stream = http2_stream_get(conn, stream_id);
+            if (stream)
+                http2_stream_free(stream);
+            break;
+        }
+        case HTTP2_FRAME_SETTINGS: {
+            if (stream_id != 0) {
+                http2_conn_error(conn, HTTP2_PROTOCOL_ERROR);
+                return;
+            }
+            if (len % 6 != 0 || ((flags & HTTP2_FLAG_ACK) && len != 0)) {
+                http2_conn_error(conn, HTTP2_FRAME_SIZE_ERROR);
+                return;
+            }
+            if (flags & HTTP2_FLAG_ACK)
+                break;
+            int error = http2_apply_settings(conn, payload, len);
+            if (error) {
+                http2_conn_error(conn, error);
+                return;
+            }
+            conn->settings_received = 1;
+            http2_send_frame(conn, HTTP2_FRAME_SETTINGS, HTTP2_FLAG_ACK, 0, NULL, 0);
+            break;
+        }
+        case HTTP2_FRAME_PING:
+            if (stream_id != 0) {
+                http2_conn_error(conn, HTTP2_PROTOCOL_ERROR);
+                return;
+            }
+            if (len != 8) {
+                http2_conn_error(conn, HTTP2_FRAME_SIZE_ERROR);
+                return;
+            }
+            if (!(flags & HTTP2_FLAG_ACK))
+                http2_send_frame(conn, HTTP2_FRAME_PING, HTTP2_FLAG_ACK, 0, payload, len);
+            break;
+        case HTTP2_FRAME_GOAWAY:  // 对端不再发起新流，已有的流照常完成，由对端关闭连接
+            if (stream_id != 0) {
+                http2_conn_error(conn, HTTP2_PROTOCOL_ERROR);
+                return;
+            }
+            break;
+        case HTTP2_FRAME_WINDOW_UPDATE: {
+            if (len != 4) {
+                http2_conn_error(conn, HTTP2_FRAME_SIZE_ERROR);
+                return;
+            }
+            uint32_t increment = http2_read_u32(payload) & HTTP2_MAX_WINDOW_SIZE;
+            if (stream_id == 0) {
+                if (increment == 0) {
+                    http2_conn_error(conn, HTTP2_PROTOCOL_ERROR);
+                    return;
+                }
+                conn->send_window += increment;
+                if (conn->send_window > HTTP2_MAX_WINDOW_SIZE) {
+                    http2_conn_error(conn, HTTP2_FLOW_CONTROL_ERROR);
+                    return;
+                }
+                break;
+            }
+            http2_stream_t *stream = http2_stream_get(conn, stream_id);
+            if (!stream)  // 已关闭的流上仍可能收到 WINDOW_UPDATE
+                break;
+            if (increment == 0) {
+                http2_stream_reset(conn, stream_id, HTTP2_PROTOCOL_ERROR);
+                break;
+            }
+            stream->send_window += increment;
+            if (stream->send_window > HTTP2_MAX_WINDOW_SIZE)
+                http2_stream_reset(conn, stream_id, HTTP2_FLOW_CONTROL_ERROR);
+            break;
+        }
+        case HTTP2_FRAME_PUSH_PROMISE:  // 客户端不得发送
+            http2_conn_error(conn, HTTP2_PROTOCOL_ERROR);
+            return;
+        default:  // 忽略未知类型的帧
+            break;
+    }
+}
+
+/**
+ * @brief 处理 TCP 连接上收到的数据：连接前言与若干帧
+ *
+ * @param conn 连接
+ * @param data 数据
+ * @param len  数据长度
+ */
+void http2_input(http2_conn_t *conn, const uint8_t *data, size_t len) {
+    // 校验连接前言
+    while (len && conn->preface_len < HTTP2_PREFACE_LEN && !conn->closing) {
+        if (*data != (uint8_t)HTTP2_PREFACE[conn->preface_len]) {
+            http2_conn_error(conn, HTTP2_PROTOCOL_ERROR);
+            return;
+        }
+        conn->preface_len++;
+        data++;
+        len--;
+        if (conn->preface_len == HTTP2_PREFACE_LEN)
+            http2_send_settings(conn);
+    }
+
+    while (len && !conn->closing) {
+        size_t n = sizeof(conn->rx_buf) - conn->rx_len;
+        if (n > len)
+            n = len;
+        memcpy(conn->rx_buf + conn->rx_len, data, n);
+        conn->rx_len += n;
+        data += n;
+        len -= n;
+
+        // 逐个处理完整的帧
+        size_t pos = 0;
+        while (!conn->closing && conn->rx_len - pos >= HTTP2_FRAME_HEADER_LEN) {
+            uint8_t *frame = conn->rx_buf + pos;
+            size_t frame_len = ((size_t)frame[0] << 16) | (frame[1] << 8) | frame[2];
+            if (frame_len > HTTP2_MAX_FRAME_SIZE) {
+                http2_conn_error(conn, HTTP2_FRAME_SIZE_ERROR);
+                break;
+            }
+            if (conn->rx_len - pos < HTTP2_FRAME_HEADER_LEN + frame_len)
+                break;
+            http2_process_frame(conn, frame[3], frame[4], http2_read_u32(frame + 5) & 0x7fffffff, frame + HTTP2_FRAME_HEADER_LEN, frame_len);
+            pos += HTTP2_FRAME_HEADER_LEN + frame_len;
+        }
+        memmove(conn->rx_buf, conn->rx_buf + pos, conn->rx_len - pos);
+        conn->rx_len -= pos;
+    }
+}
+
+/**
+ * @brief 解码 base64url（无填充）
+ *
+ * @param in      输入
+ * @param out     出口参数
+ * @param out_len 输出缓冲区长度
+ * @return int    解码后长度，格式错误为-1
+ */
+static int http2_base64url_decode(const char *in, uint8_t *out, size_t out_len) {
+    uint32_t bits = 0;
+    int nbits = 0;
+    size_t n = 0;
+    for (; *in && *in != '='; in++) {
+        int v;
+        if (*in >= 'A' && *in <= 'Z')
+            v = *in - 'A';
+        else if (*in >= 'a' && *in <= 'z')
+            v = *in - 'a' + 26;
+        else if (*in >= '0' && *in <= '9')
+            v = *in - '0' + 52;
+        else if (*in == '-' || *in == '+')
+            v = 62;
+        else if (*in == '_' || *in == '/')
+            v = 63;
+        else
+            return -1;
+        bits = (bits << 6) | v;
+        nbits += 6;
+        if (nbits >= 8) {
+            nbits -= 8;
+            if (n == out_len)
+                return -1;
+            out[n++] = bits >> nbits;
+        }
+    }
+    return n;
+}
+
+/**
+ * @brief 完成 HTTP/1.1 Upgrade：应用 HTTP2-Settings，并在流 1 上响应原请求
+ *
+ * 调用前应已发送 101 Switching Protocols。
+ *
+ * @param conn    连接
+ * @param request 触发升级的 HTTP/1.1 请求
+ */
+void http2_upgrade(http2_conn_t *conn, http_request_t *request) {
+    http2_send_settings(conn);
+    uint8_t settings[HTTP_MAX_HEADER_VALUE_LENGTH];
+    int len = http2_base64url_decode(request->http2_settings, settings, sizeof(settings));
+    int error = len < 0 || len % 6 != 0 ? HTTP2_PROTOCOL_ERROR : http2_apply_settings(conn, settings, len);
+    if (error) {
+        http2_conn_error(conn, error);
+        return;
+    }
+
+    // 升级请求隐式占用流 1，状态为 half-closed (remote)
+    conn->last_stream_id = 1;
+    http2_stream_t *stream = http2_stream_new(conn, 1);
+    stream->request = *request;
+    stream->request.version = 2;
+    http2_stream_respond(conn, stream);
+}
+
+/**
+ * @brief 查找 TCP 连接对应的 HTTP/2 连接
+ *
+ * @param tcp_conn TCP 连接
+ * @return http2_conn_t* 不存在为NULL
+ */
+http2_conn_t *http2_conn_get(tcp_conn_t *tcp_conn) {
+    http2_conn_t **conn = map_get(&http2_conn_table, &tcp_conn);
+    return conn ? *conn : NULL;
+}
+
+/**
+ * @brief 在 TCP 连接上建立 HTTP/2 连接
+ *
+ * 服务端连接前言在收到客户端连接前言或完成 Upgrade 时发送。
+ *
+ * @param tcp_conn    TCP 连接
+ * @param port        本地端口
+ * @param remote_ip   对端 IP
+ * @param remote_port 对端端口
+ * @return http2_conn_t* 内存或连接表不足时为NULL
+ */
+http2_conn_t *http2_conn_open(tcp_conn_t *tcp_conn, uint16_t port, uint8_t *remote_ip, uint16_t remote_port) {
+    http2_conn_t *conn = calloc(1, sizeof(http2_conn_t));
+    if (!conn)
+        return NULL;
+    if (map_set(&http2_conn_table, &tcp_conn, &conn) != 0) {
+        free(conn);
+        return NULL;
+    }
+    conn->tcp_conn = tcp_conn;
+    conn->port = port;
+    memcpy(conn->remote_ip, remote_ip, NET_IP_LEN);
+    conn->remote_port = remote_port;
+    conn->peer_initial_window = HTTP2_DEFAULT_WINDOW_SIZE;
+    conn->send_window = HTTP2_DEFAULT_WINDOW_SIZE;
+    hpack_table_init(&conn->decoder, HPACK_DEFAULT_TABLE_SIZE);
+    hpack_table_init(&conn->encoder, HPACK_DEFAULT_TABLE_SIZE);
+    return conn;
+}
+
+/**
+ * @brief 释放 TCP 连接对应的 HTTP/2 连接（若存在）
+ *
+ * @param tcp_conn TCP 连接
+ */
+void http2_conn_close(tcp_conn_t *tcp_conn) {
+    http2_conn_t *conn = http2_conn_get(tcp_conn);
+    if (!conn)
+        return;
+    for (int i = 0; i < HTTP2_MAX_STREAMS; i++)
+        if (conn->streams[i].state != HTTP2_STREAM_IDLE)
+            http2_stream_free(&conn->streams[i]);
+    map_delete(&http2_conn_table, &tcp_conn);
+    free(conn);
+}
+
+/**
+ * @brief 初始化 HTTP/2
+ *
+ */
+void http2_init() {
+    map_init(&http2_conn_table, sizeof(tcp_conn_t *), sizeof(http2_conn_t *), 0, 0, NULL, NULL);
+}
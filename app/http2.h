@@ -0,0 +1,108 @@
+#ifndef HTTP2_H
+#define HTTP2_H
+
+#include "hpack.h"
+#include "http.h"
+#include "net.h"
+#include "tcp.h"
+
+#define HTTP2_PREFACE "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n"  // 客户端连接前言
+#define HTTP2_PREFACE_LEN 24
+#define HTTP2_FRAME_HEADER_LEN 9
+#define HTTP2_MAX_FRAME_SIZE 16384      // 接收端允许的最大帧负载（SETTINGS_MAX_FRAME_SIZE 初值）
+#define HTTP2_MAX_SEND_FRAME 1024       // 发送端单帧负载上限，与 HTTP/1.1 分块大小一致
+#define HTTP2_MAX_HEADER_BLOCK 8192     // HEADERS + CONTINUATION 拼接后的最大长度
+#define HTTP2_MAX_STREAMS 8             // 每个连接同时打开的最大流数（SETTINGS_MAX_CONCURRENT_STREAMS）
+#define HTTP2_DEFAULT_WINDOW_SIZE 65535 // 流量控制窗口初值
+#define HTTP2_MAX_WINDOW_SIZE 0x7fffffff
+
+typedef enum http2_frame_type {
+    HTTP2_FRAME_DATA = 0x0,
+    HTTP2_FRAME_HEADERS = 0x1,
+    HTTP2_FRAME_PRIORITY = 0x2,
+    HTTP2_FRAME_RST_STREAM = 0x3,
+    HTTP2_FRAME_SETTINGS = 0x4,
+    HTTP2_FRAME_PUSH_PROMISE = 0x5,
+    HTTP2_FRAME_PING = 0x6,
+    HTTP2_FRAME_GOAWAY = 0x7,
+    HTTP2_FRAME_WINDOW_UPDATE = 0x8,
+    HTTP2_FRAME_CONTINUATION = 0x9,
+} http2_frame_type_t;
+
+#define HTTP2_FLAG_END_STREAM 0x1
+#define HTTP2_FLAG_ACK 0x1
+#define HTTP2_FLAG_END_HEADERS 0x4
+#define HTTP2_FLAG_PADDED 0x8
+#define HTTP2_FLAG_PRIORITY 0x20
+
+typedef enum http2_settings_id {
+    HTTP2_SETTINGS_HEADER_TABLE_SIZE = 0x1,
+    HTTP2_SETTINGS_ENABLE_PUSH = 0x2,
+    HTTP2_SETTINGS_MAX_CONCURRENT_STREAMS = 0x3,
+    HTTP2_SETTINGS_INITIAL_WINDOW_SIZE = 0x4,
+    HTTP2_SETTINGS_MAX_FRAME_SIZE = 0x5,
+    HTTP2_SETTINGS_MAX_HEADER_LIST_SIZE = 0x6,
+} http2_settings_id_t;
+
+typedef enum http2_error {
+    HTTP2_NO_ERROR = 0x0,
+    HTTP2_PROTOCOL_ERROR = 0x1,
+    HTTP2_INTERNAL_ERROR = 0x2,
+    HTTP2_FLOW_CONTROL_ERROR = 0x3,
+    HTTP2_STREAM_CLOSED = 0x5,
+    HTTP2_FRAME_SIZE_ERROR = 0x6,
+    HTTP2_REFUSED_STREAM = 0x7,
+    HTTP2_COMPRESSION_ERROR = 0x9,
+    HTTP2_ENHANCE_YOUR_CALM = 0xb,
+} http2_error_t;
+
+typedef enum http2_stream_state {
+    HTTP2_STREAM_IDLE,        // 空闲槽位
+    HTTP2_STREAM_OPEN,        // 已收到请求头，等待 END_STREAM
+    HTTP2_STREAM_RESPONDING,  // 请求已完整（half-closed remote），正在发送响应
+} http2_stream_state_t;
+
+typedef struct http2_stream {
+    uint32_t id;                  // 流标识符
+    http2_stream_state_t state;   // 流状态
+    int64_t send_window;          // 发送窗口，对端调小 INITIAL_WINDOW_SIZE 后可能为负
+    int headers_sent;             // 响应头是否已发送
+    size_t body_offset;           // 已发送的消息体长度
+    http_request_t request;       // 请求
+    http_response_t response;     // 响应
+} http2_stream_t;
+
+typedef struct http2_conn  // 一个 HTTP/2 连接，与 TCP 连接一一对应
+{
+    tcp_conn_t *tcp_conn;                                        // 所属 TCP 连接
+    uint16_t port;                                               // 本地端口
+    uint8_t remote_ip[NET_IP_LEN];                               // 对端 IP
+    uint16_t remote_port;                                        // 对端端口
+    int closing;                                                 // 已发送 GOAWAY 并关闭，忽略后续输入
+    int settings_sent;                                           // 是否已发送服务端连接前言
+    size_t preface_len;                                          // 已收到的连接前言长度
+    int settings_received;                                       // 是否已收到对端的首个 SETTINGS
+    uint8_t rx_buf[HTTP2_FRAME_HEADER_LEN + HTTP2_MAX_FRAME_SIZE];  // 尚未凑成完整帧的输入
+    size_t rx_len;                                               // rx_buf 中的数据长度
+    uint8_t header_block[HTTP2_MAX_HEADER_BLOCK];                // 待解码的头部块
+    size_t header_block_len;                                     // 头部块长度
+    uint32_t header_stream;                                      // 等待 CONTINUATION 的流，0 表示无
+    int header_end_stream;                                       // 该头部块所在 HEADERS 帧是否带 END_STREAM
+    hpack_table_t decoder;                                       // 请求头解码表
+    hpack_table_t encoder;                                       // 响应头编码表
+    uint32_t peer_initial_window;                                // 对端 SETTINGS_INITIAL_WINDOW_SIZE
+    int64_t send_window;                                         // 连接级发送窗口
+    uint32_t last_stream_id;                                     // 已处理的最大客户端流标识符
+    int next_stream;                                             // 轮转发送的起始槽位
+    http2_stream_t streams[HTTP2_MAX_STREAMS];                   // 流
+} http2_conn_t;
+
+void http2_init();
+int http2_is_preface(const uint8_t *data, size_t len);
+http2_conn_t *http2_conn_get(tcp_conn_t *tcp_conn);
+http2_conn_t *http2_conn_open(tcp_conn_t *tcp_conn, uint16_t port, uint8_t *remote_ip, uint16_t remote_port);
+void http2_conn_close(tcp_conn_t *tcp_conn);
+void http2_input(http2_conn_t *conn, const uint8_t *data, size_t len);
+void http2_upgrade(http2_conn_t *conn, http_request_t *request);
+size_t http2_flush(http2_conn_t *conn, size_t budget);
+#endif
@@ -0,0 +1,287 @@
+/**
+ * @file http_log.c
+ * @brief web_server 访问日志与请求统计
+ *
+ * 请求完成时由协议栈线程写入单生产者单消费者的无锁环形队列，后台线程
+ * 取出后以 JSON Lines 格式写入访问日志，队列满时丢弃并计数，不阻塞协议栈。
+ * 按路径统计请求数、字节数、状态码与首字节/总时延直方图，由 /__stats 从内存返回。
+ */
+
+#include "http_log.h"
+
+#include "map.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/**
+ * @brief 一条访问日志
+ *
+ */
+typedef struct http_log_entry {
+    time_t timestamp;                    // 完成时刻
+    uint8_t remote_ip[NET_IP_LEN];       // 客户端 IP
+    int version;                         // 协议版本
+    char method[8];                      // 请求方法
+    char path[HTTP_LOG_PATH_LENGTH];     // 请求路径
+    int status;                          // 状态码
+    size_t bytes;                        // 已发送的消息体字节数
+    uint64_t first_byte_us;              // 首字节时延
+    uint64_t total_us;                   // 总时延
+} http_log_entry_t;
+
+/**
+ * @brief 单个路径（或总计）的统计
+ *
+ */
+typedef struct http_stats {
+    uint64_t requests;                           // 请求数
+    uint64_t bytes;                              // 消息体字节数
+    uint64_t status[5];                          // 1xx ~ 5xx 的请求数
+    uint64_t first_byte[HTTP_STATS_BUCKETS];     // 首字节时延直方图
+    uint64_t total[HTTP_STATS_BUCKETS];          // 总时延直方图
+} http_stats_t;
+
+static http_log_entry_t log_ring[HTTP_LOG_RING_SIZE];
+static atomic_size_t log_head;     // 生产者（协议栈线程）写入位置
+static atomic_size_t log_tail;     // 消费者（日志线程）读取位置
+static atomic_size_t log_dropped;  // 队列满而丢弃的日志数
+static FILE *log_file;
+
+static map_t http_stats_table;     // path -> http_stats
+static http_stats_t http_stats_total;
+static uint64_t http_stats_start_us;
+
+/**
+ * @brief 以 JSON 字符串格式写出，转义引号、反斜杠与控制字符
+ *
+ * @param out     输出缓冲区
+ * @param out_len 缓冲区长度
+ * @param str     字符串
+ * @return int    写入的长度（不含结尾'\0'），空间不足时截断
+ */
+static int http_json_string(char *out, size_t out_len, const char *str) {
+    size_t n = 0;
+    if (out_len < 3)
+        return 0;
+    out[n++] = '"';
+    for (; *str && n + 8 < out_len; str++) {
+        unsigned char c = *str;
+        if (c == '"' || c == '\\') {
+            out[n++] = '\\';
+            out[n++] = c;
+        } else if (c < 0x20 || c == 0x7f) {
+            n += snprintf(out + n, out_len - n, "\\u%04x", c);
+        } else {
+            out[n++] = c;
+        }
+    }
+    out[n++] = '"';
+    out[n] = '\0';
+    return n;
+}
+
+/**
+ * @brief 日志线程：取出队列中的日志写入文件，队列为空时刷新文件并休眠
+ *
+ */
+static void *http_log_thread(void *arg) {
+    struct timespec idle = {0, HTTP_LOG_IDLE_SLEEP_MS * 1000000L};
+    char path[2 * HTTP_LOG_PATH_LENGTH + 8];
+    char date[32];
+    struct tm tm;
+    (void)arg;
+
+    while (1) {
+        size_t tail = atomic_load_explicit(&log_tail, memory_order_relaxed);
+        if (tail == atomic_load_explicit(&log_head, memory_order_acquire)) {
+            fflush(log_file);
+            nanosleep(&idle, NULL);
+            continue;
+        }
+        http_log_entry_t *entry = &log_ring[tail & (HTTP_LOG_RING_SIZE - 1)];
+        gmtime_r(&entry->timestamp, &tm);
+        strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", &tm);
+        http_json_string(path, sizeof(path), entry->path);
+        fprintf(log_file,
+                "{\"time\":\"%s\",\"client\":\"%u.%u.%u.%u\",\"proto\":\"HTTP/%s\",\"method\":\"%s\",\"path\":%s,"
+                "\"status\":%d,\"bytes\":%zu,\"first_byte_us\":%llu,\"total_us\":%llu}\n",
+                date, entry->remote_ip[0], entry->remote_ip[1], entry->remote_ip[2], entry->remote_ip[3],
+                entry->version == 2 ? "2" : "1.1", entry->method, path, entry->status, entry->bytes,
+                (unsigned long long)entry->first_byte_us, (unsigned long long)entry->total_us);
+        atomic_store_explicit(&log_tail, tail + 1, memory_order_release);
+    }
+    return NULL;
+}
+
+/**
+ * @brief 时延所在的直方图桶
+ *
+ */
+static inline int http_stats_bucket(uint64_t us) {
+    int i = 0;
+    while (us > 1 && i < HTTP_STATS_BUCKETS - 1) {
+        us >>= 1;
+        i++;
+    }
+    return i;
+}
+
+static void http_stats_add(http_stats_t *stats, int status, size_t bytes, uint64_t first_byte_us, uint64_t total_us) {
+    stats->requests++;
+    stats->bytes += bytes;
+    if (status >= 100 && status < 600)
+        stats->status[status / 100 - 1]++;
+    stats->first_byte[http_stats_bucket(first_byte_us)]++;
+    stats->total[http_stats_bucket(total_us)]++;
+}
+
+/**
+ * @brief 记录一个已完成（或中途终止）的请求
+ *
+ * 由协议栈线程调用，只做内存操作，文件写入由日志线程完成。
+ *
+ * @param request    请求
+ * @param response   响应
+ * @param body_bytes 已发送的消息体字节数
+ */
+void http_log_request(http_request_t *request, http_response_t *response, size_t body_bytes) {
+    uint64_t now = net_now_us();
+    uint64_t total_us = now - request->start_us;
+    uint64_t first_byte_us = response->first_byte_us ? response->first_byte_us - request->start_us : total_us;
+
+    // 按路径统计，忽略查询字符串
+    char path[HTTP_LOG_PATH_LENGTH];
+    size_t path_len = strcspn(request->url_path, "?");
+    if (path_len > sizeof(path) - 1)
+        path_len = sizeof(path) - 1;
+    memset(path, 0, sizeof(path));
+    memcpy(path, request->url_path, path_len);
+
+    http_stats_add(&http_stats_total, response->status, body_bytes, first_byte_us, total_us);
+    http_stats_t *stats = map_get(&http_stats_table, path);
+    if (!stats) {
+        http_stats_t new_stats;
+        memset(&new_stats, 0, sizeof(new_stats));
+        if (map_set(&http_stats_table, path, &new_stats) == 0)
+            stats = map_get(&http_stats_table, path);
+    }
+    if (stats)
+        http_stats_add(stats, response->status, body_bytes, first_byte_us, total_us);
+
+    // 写入日志队列
+    size_t head = atomic_load_explicit(&log_head, memory_order_relaxed);
+    if (!log_file || head - atomic_load_explicit(&log_tail, memory_order_acquire) == HTTP_LOG_RING_SIZE) {
+        atomic_fetch_add_explicit(&log_dropped, 1, memory_order_relaxed);
+        return;
+    }
+    http_log_entry_t *entry = &log_ring[head & (HTTP_LOG_RING_SIZE - 1)];
+    entry->timestamp = time(NULL);
+    memcpy(entry->remote_ip, request->remote_ip, NET_IP_LEN);
+    entry->version = request->version;
+    memcpy(entry->method, request->method, sizeof(entry->method));
+    memcpy(entry->path, path, sizeof(entry->path));
+    entry->status = response->status;
+    entry->bytes = body_bytes;
+    entry->first_byte_us = first_byte_us;
+    entry->total_us = total_us;
+    atomic_store_explicit(&log_head, head + 1, memory_order_release);
+}
+
+/**
+ * @brief 由直方图估计分位数，返回所在桶的上界（微秒）
+ *
+ */
+static uint64_t http_stats_percentile(const uint64_t *histogram, uint64_t count, int percent) {
+    uint64_t target = (count * percent + 99) / 100, seen = 0;
+    for (int i = 0; i < HTTP_STATS_BUCKETS; i++) {
+        seen += histogram[i];
+        if (seen >= target && seen)
+            return (uint64_t)2 << i;
+    }
+    return 0;
+}
+
+static int http_stats_format(char *out, size_t out_len, const http_stats_t *stats) {
+    return snprintf(out, out_len,
+                    "{\"requests\":%llu,\"bytes\":%llu,"
+                    "\"status\":{\"1xx\":%llu,\"2xx\":%llu,\"3xx\":%llu,\"4xx\":%llu,\"5xx\":%llu},"
+                    "\"first_byte_us\":{\"p50\":%llu,\"p90\":%llu,\"p99\":%llu},"
+                    "\"total_us\":{\"p50\":%llu,\"p90\":%llu,\"p99\":%llu}}",
+                    (unsigned long long)stats->requests, (unsigned long long)stats->bytes,
+                    (unsigned long long)stats->status[0], (unsigned long long)stats->status[1], (unsigned long long)stats->status[2],
+                    (unsigned long long)stats->status[3], (unsigned long long)stats->status[4],
+                    (unsigned long long)http_stats_percentile(stats->first_byte, stats->requests, 50),
+                    (unsigned long long)http_stats_percentile(stats->first_byte, stats->requests, 90),
+                    (unsigned long long)http_stats_percentile(stats->first_byte, stats->requests, 99),
+                    (unsigned long long)http_stats_percentile(stats->total, stats->requests, 50),
+                    (unsigned long long)http_stats_percentile(stats->total, stats->requests, 90),
+                    (unsigned long long)http_stats_percentile(stats->total, stats->requests, 99));
+}
+
+static _Thread_local char *render_buf;
+static _Thread_local size_t render_len, render_cap;
+static void http_stats_render_fn(void *key, void *value, time_t *timestamp) {
+    char line[1024];
+    int n = http_json_string(line, HTTP_LOG_PATH_LENGTH * 2, key);
+    n += snprintf(line + n, sizeof(line) - n, "%s", ":");
+    n += http_stats_format(line + n, sizeof(line) - n, value);
+    if (render_len + n + 2 < render_cap) {
+        if (render_buf[render_len - 1] != '{')
+            render_buf[render_len++] = ',';
+        memcpy(render_buf + render_len, line, n);
+        render_len += n;
+    }
+}
+
+/**
+ * @brief 生成统计页面（JSON）
+ *
+ * @param len     出口参数，页面长度
+ * @return char*  malloc 分配的页面，内存不足为NULL
+ */
+char *http_stats_render(size_t *len) {
+    render_cap = 512 + (size_t)HTTP_STATS_MAX_PATHS * 1024;
+    render_buf = malloc(render_cap);
+    if (!render_buf)
+        return NULL;
+
+    uint64_t uptime_us = net_now_us() - http_stats_start_us;
+    render_len = snprintf(render_buf, render_cap, "{\"uptime_s\":%.3f,\"requests_per_s\":%.2f,\"log_dropped\":%zu,\"total\":",
+                          uptime_us / 1e6, uptime_us ? http_stats_total.requests * 1e6 / uptime_us : 0.0,
+                          atomic_load_explicit(&log_dropped, memory_order_relaxed));
+    render_len += http_stats_format(render_buf + render_len, render_cap - render_len, &http_stats_total);
+    render_len += snprintf(render_buf + render_len, render_cap - render_len, ",\"paths\":{");
+    map_foreach(&http_stats_table, http_stats_render_fn);
+    render_len += snprintf(render_buf + render_len, render_cap - render_len, "}}\n");
+    *len = render_len;
+    return render_buf;
+}
+
+/**
+ * @brief 初始化访问日志与统计，首次调用时启动日志线程
+ *
+ * @return int 成功为0，失败为-1（统计仍可用，日志被丢弃）
+ */
+int http_log_init() {
+    map_init(&http_stats_table, HTTP_LOG_PATH_LENGTH, sizeof(http_stats_t), HTTP_STATS_MAX_PATHS, 0, NULL, NULL);
+    http_stats_start_us = net_now_us();
+
+    if (log_file)  // 重新初始化协议栈时沿用已启动的写日志线程
+        return 0;
+    FILE *file = fopen(HTTP_ACCESS_LOG, "a");
+    if (!file)
+        return -1;
+    pthread_t thread;
+    log_file = file;
+    if (pthread_create(&thread, NULL, http_log_thread, NULL) != 0) {
+        log_file = NULL;
+        fclose(file);
+        return -1;
+    }
+    pthread_detach(thread);
+    return 0;
+}
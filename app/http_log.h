@@ -0,0 +1,19 @@
+#ifndef HTTP_LOG_H
+#define HTTP_LOG_H
+
+#include "http.h"
+
+#ifndef HTTP_ACCESS_LOG
+#define HTTP_ACCESS_LOG "access.log"  // 访问日志文件
+#endif
+#define HTTP_LOG_RING_SIZE 1024       // 日志环形队列长度，须为2的幂
+#define HTTP_LOG_PATH_LENGTH 128      // 日志与统计中保留的路径长度
+#define HTTP_LOG_IDLE_SLEEP_MS 10     // 日志线程队列为空时的休眠时间
+#define HTTP_STATS_MAX_PATHS 128      // 单独统计的最大路径数，超出的只计入总计
+#define HTTP_STATS_BUCKETS 32         // 时延直方图桶数，第 i 个桶为 [2^i, 2^(i+1)) 微秒
+#define HTTP_STATS_PATH "/__stats"    // 统计页面路径
+
+int http_log_init();
+void http_log_request(http_request_t *request, http_response_t *response, size_t body_bytes);
+char *http_stats_render(size_t *len);
+#endif
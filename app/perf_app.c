@@ -0,0 +1,629 @@
+/**
+ * @file perf_app.c
+ * @brief iperf 式吞吐量测试程序
+ *
+ * 服务端 perf_app -s，客户端 perf_app -c <ip>，均可与内核协议栈上的对端互测（veth/TAP）。
+ * 模式：discard（客户端发送、服务端丢弃）、chargen（服务端发送、客户端接收）、bidir（双向）。
+ * 服务端按自身的 -m 决定是否发送，总会统计收到的数据。
+ *
+ * TCP 直接收发字节流，可与 nc 等对接；UDP 报文以 perf_udp_hdr_t 开头，
+ * 接收方据此按流统计丢包（序号间隔）与抖动（RFC 3550 到达间隔抖动），短于报头的报文只计入流量。
+ * UDP chargen 客户端每秒向服务端发送一个只有报头的探测报文，服务端向最近 PERF_UDP_PEER_TIMEOUT 秒内
+ * 收到过报文的对端发送。每秒输出一次收发吞吐量、包速率、丢包与抖动。
+ * 以 IMPAIR 编译，可通过 NET_IMPAIR_TX / NET_IMPAIR_RX 在受损链路上测量（见 impair.c）。
+ * 以 QOS 编译，可通过 NET_QOS 设置出口调度（见 qos.c），如以 weight=本端端口:权重 区分各流的份额。
+ * -B 以忙轮询代替 net_poll（见 busy_poll.c），并每秒输出忙碌、自旋、睡眠与阻塞的时间占比。
+ */
+
+#include "busy_poll.h"
+#include "driver.h"
+#include "net.h"
+#include "utils.h"
+
+#ifdef TCP
+#include "tcp.h"
+#endif
+#ifdef UDP
+#include "udp.h"
+#endif
+#ifdef IMPAIR
+#include "impair.h"
+#endif
+#ifdef QOS
+#include "qos.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define PERF_DEFAULT_PORT 5001           // 默认服务端端口
+#define PERF_LOCAL_PORT_BASE 40000       // 客户端第 i 条流使用的本端端口为 PERF_LOCAL_PORT_BASE + i
+#define PERF_MAX_STREAMS 64              // 最大并行流数
+#define PERF_MAX_MSG_LEN 8192            // 最大消息长度
+#define PERF_TCP_MSS 1460                // TCP 默认消息长度
+#define PERF_UDP_MSG_LEN 1470            // UDP 默认消息长度
+#define PERF_UDP_DEFAULT_RATE 10000000   // UDP 默认发送速率（bit/s）
+#define PERF_UDP_PEER_TIMEOUT 3          // UDP 对端超时（秒）
+#define PERF_MAX_PEERS 256               // 记录的最大对端数（UDP 流统计与 TCP 连接）
+#define PERF_SYN_RETRY_US 1000000        // 重传 SYN 的间隔
+#define PERF_CLOSE_WAIT_US 2000000       // 结束时等待连接关闭的最长时间
+
+typedef enum perf_mode {
+    PERF_MODE_DISCARD,  // 客户端发送
+    PERF_MODE_CHARGEN,  // 服务端发送
+    PERF_MODE_BIDIR,    // 双向
+} perf_mode_t;
+
+#pragma pack(1)
+typedef struct perf_udp_hdr {
+    uint32_t stream32;   // 流编号
+    uint32_t seq32;      // 序号，探测报文为 UINT32_MAX
+    uint32_t sec32;      // 发送时刻（秒）
+    uint32_t usec32;     // 发送时刻（微秒）
+} perf_udp_hdr_t;
+#pragma pack()
+
+#define PERF_UDP_PROBE_SEQ UINT32_MAX
+
+/**
+ * @brief 流量计数
+ *
+ */
+typedef struct perf_counter {
+    uint64_t bytes;     // 字节数
+    uint64_t packets;   // 报文（消息）数
+    uint64_t lost;      // 丢失的 UDP 报文数
+    uint64_t expected;  // 应收到的 UDP 报文数
+} perf_counter_t;
+
+/**
+ * @brief 对端标识：远端 IP 与端口
+ *
+ */
+typedef struct perf_peer_key {
+    uint8_t ip[NET_IP_LEN];
+    uint16_t port;
+} perf_peer_key_t;
+
+/**
+ * @brief 一条 UDP 接收流的丢包与抖动状态
+ *
+ */
+typedef struct perf_udp_stream {
+    uint32_t next_seq;    // 期望的下一个序号
+    int64_t transit_us;   // 上一个报文的传输时间（接收时刻 - 发送时刻）
+    double jitter_us;     // 平滑后的到达间隔抖动
+    uint8_t started;      // 是否已收到第一个报文
+} perf_udp_stream_t;
+
+static int server;
+static int use_udp;
+static perf_mode_t mode = PERF_MODE_DISCARD;
+static uint8_t peer_ip[NET_IP_LEN];
+static uint16_t port = PERF_DEFAULT_PORT;
+static size_t msg_len;
+static int num_streams = 1;
+static int duration_s = 10;
+static uint64_t udp_rate = PERF_UDP_DEFAULT_RATE;
+static const char *busy_spec;  // 忙轮询参数，NULL 时使用 net_poll
+
+static uint8_t message[PERF_MAX_MSG_LEN];
+static perf_counter_t rx_interval, rx_total, tx_interval, tx_total;
+static uint64_t start_us, interval_start_us;
+static busy_poll_stats_t busy_interval_start;  // 本次报告区间开始时的忙轮询统计
+
+static map_t perf_peers;  // 服务端：对端 -> UDP 流状态或 TCP 连接
+
+/**
+ * @brief 本端是否发送数据
+ *
+ */
+static inline int perf_sending() {
+    if (server)
+        return mode != PERF_MODE_DISCARD;
+    return mode != PERF_MODE_CHARGEN;
+}
+
+static void perf_count(perf_counter_t *counter, size_t bytes) {
+    counter->bytes += bytes;
+    counter->packets++;
+}
+
+/* ========================= UDP ========================= */
+
+#ifdef UDP
+static uint32_t udp_next_seq[PERF_MAX_STREAMS];  // 客户端各流的下一个序号
+static uint64_t udp_tokens_bits;                 // 令牌桶中可发送的比特数
+static uint64_t udp_last_refill_us, udp_last_probe_us;
+
+static _Thread_local double jitter_sum;
+static _Thread_local size_t jitter_streams;
+static void perf_jitter_fn(void *key, void *value, time_t *timestamp) {
+    perf_udp_stream_t *stream = value;
+    if (stream->started) {
+        jitter_sum += stream->jitter_us;
+        jitter_streams++;
+    }
+}
+
+/**
+ * @brief 各 UDP 接收流抖动的平均值（毫秒）
+ *
+ */
+static double perf_udp_jitter_ms() {
+    jitter_sum = 0;
+    jitter_streams = 0;
+    map_foreach(&perf_peers, perf_jitter_fn);
+    return jitter_streams ? jitter_sum / jitter_streams / 1000 : 0;
+}
+
+/**
+ * @brief 按报头更新一条流的丢包与抖动统计
+ */
+static void perf_udp_track(perf_udp_stream_t *stream, perf_udp_hdr_t *hdr, uint64_t now) {
+    uint32_t seq = swap32(hdr->seq32);
+    int64_t transit = (int64_t)now - ((int64_t)swap32(hdr->sec32) * 1000000 + swap32(hdr->usec32));
+    if (!stream->started) {
+        stream->started = 1;
+        stream->next_seq = seq + 1;
+        stream->transit_us = transit;
+        rx_interval.expected++;
+        return;
+    }
+
+    int32_t gap = (int32_t)(seq - stream->next_seq);
+    if (gap >= 0) {
+        rx_interval.expected += gap + 1;
+        rx_interval.lost += gap;
+        stream->next_seq = seq + 1;
+    } else if (rx_interval.lost > 0) {
+        rx_interval.lost--;  // 乱序到达的报文此前被计为丢失
+    }
+
+    // RFC 3550 6.4.1：J += (|D| - J) / 16
+    int64_t d = transit - stream->transit_us;
+    stream->transit_us = transit;
+    stream->jitter_us += ((d < 0 ? -d : d) - stream->jitter_us) / 16;
+}
+
+static void perf_udp_handler(uint8_t *data, size_t len, uint8_t *src_ip, uint16_t src_port) {
+    uint64_t now = net_now_us();
+    perf_peer_key_t key;
+    memcpy(key.ip, src_ip, NET_IP_LEN);
+    key.port = src_port;
+    perf_udp_stream_t *stream = map_get(&perf_peers, &key);
+    if (!stream) {
+        perf_udp_stream_t new_stream;
+        memset(&new_stream, 0, sizeof(new_stream));
+        map_set(&perf_peers, &key, &new_stream);  // 同时刷新对端的超时时间
+        stream = map_get(&perf_peers, &key);
+    } else {
+        perf_udp_stream_t copy = *stream;
+        map_set(&perf_peers, &key, &copy);
+    }
+
+    if (len >= sizeof(perf_udp_hdr_t)) {
+        perf_udp_hdr_t *hdr = (perf_udp_hdr_t *)data;
+        if (swap32(hdr->seq32) == PERF_UDP_PROBE_SEQ)
+            return;
+        if (stream)
+            perf_udp_track(stream, hdr, now);
+    }
+    perf_count(&rx_interval, len);
+}
+
+/**
+ * @brief 以报头填充并发送一个 UDP 报文
+ */
+static void perf_udp_send_one(uint32_t stream, uint32_t seq, size_t len, uint16_t src_port, uint8_t *dst_ip, uint16_t dst_port) {
+    uint64_t now = net_now_us();
+    perf_udp_hdr_t *hdr = (perf_udp_hdr_t *)message;
+    hdr->stream32 = swap32(stream);
+    hdr->seq32 = swap32(seq);
+    hdr->sec32 = swap32(now / 1000000);
+    hdr->usec32 = swap32(now % 1000000);
+    udp_send(message, len, src_port, dst_ip, dst_port);
+}
+
+static _Thread_local uint32_t udp_send_round;
+static void perf_udp_peer_send_fn(void *key, void *value, time_t *timestamp) {
+    perf_peer_key_t *peer = key;
+    perf_udp_send_one(0, udp_send_round, msg_len, port, peer->ip, peer->port);
+    perf_count(&tx_interval, msg_len);
+}
+
+/**
+ * @brief 按令牌桶限速发送 UDP 报文；chargen 客户端只发送探测报文
+ */
+static void perf_udp_poll(uint64_t now) {
+    if (!server && !perf_sending()) {
+        if (now - udp_last_probe_us >= 1000000) {
+            udp_last_probe_us = now;
+            for (int i = 0; i < num_streams; i++)
+                perf_udp_send_one(i, PERF_UDP_PROBE_SEQ, sizeof(perf_udp_hdr_t), PERF_LOCAL_PORT_BASE + i, peer_ip, port);
+        }
+        return;
+    }
+    if (!perf_sending())
+        return;
+
+    // 服务端按对端轮流发送，客户端每轮每条流各发送一个报文，速率均为每条流 udp_rate
+    uint64_t round_bits = msg_len * 8 * (server ? 1 : num_streams);
+    uint64_t rate = server ? udp_rate : udp_rate * num_streams;
+    udp_tokens_bits += (now - udp_last_refill_us) * rate / 1000000;
+    udp_last_refill_us = now;
+    if (udp_tokens_bits > rate / 10 && udp_tokens_bits > round_bits)
+        udp_tokens_bits = rate / 10 > round_bits ? rate / 10 : round_bits;  // 最多积累 100ms 的突发
+
+    if (server) {
+        while (map_size(&perf_peers) && udp_tokens_bits >= round_bits) {
+            udp_tokens_bits -= round_bits;
+            map_foreach(&perf_peers, perf_udp_peer_send_fn);
+            udp_send_round++;
+        }
+        return;
+    }
+    while (udp_tokens_bits >= round_bits) {
+        udp_tokens_bits -= round_bits;
+        for (int i = 0; i < num_streams; i++) {
+            perf_udp_send_one(i, udp_next_seq[i]++, msg_len, PERF_LOCAL_PORT_BASE + i, peer_ip, port);
+            perf_count(&tx_interval, msg_len);
+        }
+    }
+}
+#endif
+
+/* ========================= TCP ========================= */
+
+#ifdef TCP
+static tcp_conn_t *tcp_streams[PERF_MAX_STREAMS];  // 客户端各流的连接，未建立时为NULL
+static uint8_t tcp_stream_done[PERF_MAX_STREAMS];   // 客户端各流是否已关闭
+static uint64_t tcp_last_syn_us;
+
+static void perf_tcp_handler(tcp_conn_t *tcp_conn, uint8_t *data, size_t len, uint8_t *src_ip, uint16_t src_port) {
+    perf_count(&rx_interval, len);
+}
+
+static void perf_tcp_event_handler(tcp_conn_t *tcp_conn, tcp_event_t event, uint8_t *src_ip, uint16_t src_port) {
+    perf_peer_key_t key;
+    memcpy(key.ip, src_ip, NET_IP_LEN);
+    key.port = src_port;
+    if (event == TCP_EVENT_ESTABLISHED) {
+        if (server) {
+            map_set(&perf_peers, &key, &tcp_conn);
+            printf("[perf] connected from %s:%u\n", iptos(src_ip), src_port);
+        }
+    } else if (event == TCP_EVENT_FIN) {
+        tcp_send(tcp_conn, NULL, 0, tcp_conn->port, src_ip, src_port);  // 对端结束发送，本端随之关闭
+    } else if (event == TCP_EVENT_CLOSED) {
+        if (server) {
+            map_delete(&perf_peers, &key);
+        } else if (tcp_conn->port >= PERF_LOCAL_PORT_BASE && tcp_conn->port < PERF_LOCAL_PORT_BASE + num_streams) {
+            tcp_stream_done[tcp_conn->port - PERF_LOCAL_PORT_BASE] = 1;
+        }
+    }
+}
+
+/**
+ * @brief 在对端窗口内尽量填满一个连接
+ */
+static void perf_tcp_fill(tcp_conn_t *tcp_conn, uint8_t *dst_ip, uint16_t dst_port) {
+    if (tcp_conn->state != TCP_STATE_ESTABLISHED && tcp_conn->state != TCP_STATE_CLOSE_WAIT)
+        return;
+    uint32_t in_flight = tcp_conn->seq - tcp_conn->snd_una;
+    while (tcp_conn->snd_wnd > in_flight && tcp_conn->snd_wnd - in_flight >= msg_len) {
+        tcp_send(tcp_conn, message, msg_len, tcp_conn->port, dst_ip, dst_port);
+        tcp_conn->not_send_empty_ack = 0;  // 主动发送的数据不代替对后续报文的确认
+        perf_count(&tx_interval, msg_len);
+        in_flight += msg_len;
+    }
+}
+
+static void perf_tcp_peer_fill_fn(void *key, void *value, time_t *timestamp) {
+    perf_peer_key_t *peer = key;
+    perf_tcp_fill(*(tcp_conn_t **)value, peer->ip, peer->port);
+}
+
+static void perf_tcp_poll(uint64_t now) {
+    if (server) {
+        if (perf_sending())
+            map_foreach(&perf_peers, perf_tcp_peer_fill_fn);
+        return;
+    }
+
+    // 协议栈不重传 SYN，未建立的流按间隔重新发起
+    int retry = now - tcp_last_syn_us >= PERF_SYN_RETRY_US;
+    for (int i = 0; i < num_streams; i++) {
+        tcp_conn_t *tcp_conn = tcp_streams[i];
+        if (tcp_stream_done[i])
+            continue;
+        if (!tcp_conn || tcp_conn->state == TCP_STATE_SYN_SENT) {
+            if (retry)
+                tcp_streams[i] = tcp_connect(PERF_LOCAL_PORT_BASE + i, peer_ip, port);
+            continue;
+        }
+        if (perf_sending())
+            perf_tcp_fill(tcp_conn, peer_ip, port);
+    }
+    if (retry)
+        tcp_last_syn_us = now;
+}
+#endif
+
+/* ========================= 报告 ========================= */
+
+static void perf_report_line(const char *label, perf_counter_t *rx, perf_counter_t *tx, double seconds) {
+    printf("[perf] %-11s  rx %9.2f Mbit/s %8.0f pkt/s", label, rx->bytes * 8 / seconds / 1e6, rx->packets / seconds);
+    if (use_udp) {
+        printf("  loss %llu/%llu (%.2f%%)", (unsigned long long)rx->lost, (unsigned long long)rx->expected,
+               rx->expected ? 100.0 * rx->lost / rx->expected : 0.0);
+#ifdef UDP
+        printf("  jitter %.3f ms", perf_udp_jitter_ms());
+#endif
+    }
+    printf("  |  tx %9.2f Mbit/s %8.0f pkt/s\n", tx->bytes * 8 / seconds / 1e6, tx->packets / seconds);
+    fflush(stdout);
+}
+
+static void perf_report(uint64_t now) {
+    char label[32];
+    snprintf(label, sizeof(label), "%6.1f-%4.1fs", (interval_start_us - start_us) / 1e6, (now - start_us) / 1e6);
+    perf_report_line(label, &rx_interval, &tx_interval, (now - interval_start_us) / 1e6);
+    if (busy_spec) {
+        const busy_poll_stats_t *stats = busy_poll_get_stats();
+        busy_poll_stats_t *last = &busy_interval_start;
+        double busy = stats->busy_ns - last->busy_ns, spin = stats->spin_ns - last->spin_ns;
+        double sleep = stats->sleep_ns - last->sleep_ns, block = stats->block_ns - last->block_ns;
+        double total = busy + spin + sleep + block;
+        if (total > 0)
+            printf("[perf] %-11s  poll busy %5.1f%%  spin %5.1f%%  sleep %5.1f%%  block %5.1f%%  %.2f pkt/poll\n", "",
+                   100 * busy / total, 100 * spin / total, 100 * sleep / total, 100 * block / total,
+                   stats->polls > last->polls ? (double)(stats->packets - last->packets) / (stats->polls - last->polls) : 0.0);
+        *last = *stats;
+    }
+
+    rx_total.bytes += rx_interval.bytes;
+    rx_total.packets += rx_interval.packets;
+    rx_total.lost += rx_interval.lost;
+    rx_total.expected += rx_interval.expected;
+    tx_total.bytes += tx_interval.bytes;
+    tx_total.packets += tx_interval.packets;
+    memset(&rx_interval, 0, sizeof(rx_interval));
+    memset(&tx_interval, 0, sizeof(tx_interval));
+    interval_start_us = now;
+}
+
+/* ========================= 主程序 ========================= */
+
+static void perf_usage(const char *name) {
+    printf("Usage: %s -s [options]            run as server\n", name);
+    printf("       %s -c <server_ip> [options] run as client\n", name);
+    printf("  -u           use UDP instead of TCP\n");
+    printf("  -m <mode>    discard | chargen | bidir (default discard)\n");
+    printf("  -p <port>    server port (default %d)\n", PERF_DEFAULT_PORT);
+    printf("  -l <bytes>   message size (default %d TCP, %d UDP)\n", PERF_TCP_MSS, PERF_UDP_MSG_LEN);
+    printf("  -P <n>       parallel client streams (default 1, max %d)\n", PERF_MAX_STREAMS);
+    printf("  -t <sec>     client test duration, 0 runs forever (default 10)\n");
+    printf("  -b <bits/s>  UDP send rate per stream, K/M/G suffixes allowed (default 10M)\n");
+    printf("  -B <spec>    busy-poll, e.g. cpu=2,budget=64,spin=100us,sleep=10ms,nap=50us,block=10ms\n");
+}
+
+static uint64_t perf_parse_rate(const char *str) {
+    char *end;
+    double value = strtod(str, &end);
+    if (*end == 'K' || *end == 'k')
+        value *= 1e3;
+    else if (*end == 'M' || *end == 'm')
+        value *= 1e6;
+    else if (*end == 'G' || *end == 'g')
+        value *= 1e9;
+    return value;
+}
+
+int main(int argc, char *argv[]) {
+    int opt, client = 0;
+    while ((opt = getopt(argc, argv, "sc:um:p:l:P:t:b:B:")) != -1) {
+        switch (opt) {
+            case 's':
+                server = 1;
+                break;
+            case 'c': {
+                int a, b, c, d;
+                if (sscanf(optarg, "%d.%d.%d.%d", &a, &b, &c, &d) != 4 || (a | b | c | d) & ~0xff) {
+                    printf("Invalid IP address format: %s\n", optarg);
+                    return -1;
+                }
+                peer_ip[0] = a;
+                peer_ip[1] = b;
+                peer_ip[2] = c;
+                peer_ip[3] = d;
+                client = 1;
+                break;
+            }
+            case 'u':
+                use_udp = 1;
+                break;
+            case 'm':
+                if (strcmp(optarg, "discard") == 0)
+                    mode = PERF_MODE_DISCARD;
+                else if (strcmp(optarg, "chargen") == 0)
+                    mode = PERF_MODE_CHARGEN;
+                else if (strcmp(optarg, "bidir") == 0)
+                    mode = PERF_MODE_BIDIR;
+                else {
+                    perf_usage(argv[0]);
+                    return -1;
+                }
+                break;
+            case 'p':
+                port = atoi(optarg);
+                break;
+            case 'l':
+                msg_len = atoi(optarg);
+                break;
+            case 'P':
+                num_streams = atoi(optarg);
+                break;
+            case 't':
+                duration_s = atoi(optarg);
+                break;
+            case 'b':
+                udp_rate = perf_parse_rate(optarg);
+                break;
+            case 'B':
+                busy_spec = optarg;
+                break;
+            default:
+                perf_usage(argv[0]);
+                return -1;
+        }
+    }
+    if (server == client || num_streams < 1 || num_streams > PERF_MAX_STREAMS || msg_len > PERF_MAX_MSG_LEN ||
+        (use_udp && msg_len && msg_len < sizeof(perf_udp_hdr_t)) || udp_rate == 0 || duration_s < 0) {
+        perf_usage(argv[0]);
+        return -1;
+    }
+#ifndef UDP
+    if (use_udp) {
+        printf("perf_app was built without UDP.\n");
+        return -1;
+    }
+#endif
+#ifndef TCP
+    if (!use_udp) {
+        printf("perf_app was built without TCP.\n");
+        return -1;
+    }
+#endif
+    if (!msg_len)
+        msg_len = use_udp ? PERF_UDP_MSG_LEN : PERF_TCP_MSS;
+    for (size_t i = 0; i < sizeof(message); i++)
+        message[i] = ' ' + i % 95;  // chargen 字符序列
+
+    if (net_init() == -1) {  // 初始化协议栈
+        printf("net init failed.\n");
+        return -1;
+    }
+    if (busy_spec) {
+        busy_poll_config_t config;
+        if (busy_poll_parse(busy_spec, &config) < 0 || busy_poll_configure(&config) < 0) {
+            printf("Invalid busy-poll parameters: %s\n", busy_spec);
+            return -1;
+        }
+    }
+
+    if (use_udp) {
+#ifdef UDP
+        map_init(&perf_peers, sizeof(perf_peer_key_t), sizeof(perf_udp_stream_t), PERF_MAX_PEERS, PERF_UDP_PEER_TIMEOUT, NULL, NULL);
+        if (server) {
+            udp_open(port, perf_udp_handler);
+        } else {
+            for (int i = 0; i < num_streams; i++)
+                udp_open(PERF_LOCAL_PORT_BASE + i, perf_udp_handler);
+        }
+#endif
+    } else {
+#ifdef TCP
+        map_init(&perf_peers, sizeof(perf_peer_key_t), sizeof(tcp_conn_t *), PERF_MAX_PEERS, 0, NULL, NULL);
+        if (server) {
+            tcp_open(port, perf_tcp_handler);
+            tcp_set_event_handler(port, perf_tcp_event_handler);
+        } else {
+            for (int i = 0; i < num_streams; i++) {
+                tcp_open(PERF_LOCAL_PORT_BASE + i, perf_tcp_handler);
+                tcp_set_event_handler(PERF_LOCAL_PORT_BASE + i, perf_tcp_event_handler);
+            }
+        }
+#endif
+    }
+
+    const char *mode_names[] = {"discard", "chargen", "bidir"};
+    if (server)
+        printf("[perf] %s server listening on %s:%u, mode %s, %zu-byte messages\n", use_udp ? "UDP" : "TCP",
+               iptos(net_if_ip), port, mode_names[mode], msg_len);
+    else
+        printf("[perf] %s client to %s:%u, mode %s, %d stream(s), %zu-byte messages, %d s\n", use_udp ? "UDP" : "TCP",
+               iptos(peer_ip), port, mode_names[mode], num_streams, msg_len, duration_s);
+
+    start_us = interval_start_us = net_now_us();
+#ifdef UDP
+    udp_last_refill_us = start_us;
+#endif
+    uint64_t stop_us = 0;
+    while (1) {
+        if (busy_spec)
+            busy_poll();
+        else
+            net_poll();
+        uint64_t now = net_now_us();
+
+        if (stop_us == 0) {
+            if (use_udp) {
+#ifdef UDP
+                perf_udp_poll(now);
+#endif
+            } else {
+#ifdef TCP
+                perf_tcp_poll(now);
+#endif
+            }
+        }
+
+        if (now - interval_start_us >= 1000000)
+            perf_report(now);
+
+        if (server)
+            continue;
+        if (stop_us == 0 && duration_s && now - start_us >= (uint64_t)duration_s * 1000000) {
+            stop_us = now;
+#ifdef TCP
+            // 结束：关闭已建立的流，等待对端完成挥手
+            for (int i = 0; i < num_streams && !use_udp; i++) {
+                tcp_conn_t *tcp_conn = tcp_streams[i];
+                if (tcp_conn && !tcp_stream_done[i] && tcp_conn->state == TCP_STATE_ESTABLISHED)
+                    tcp_send(tcp_conn, NULL, 0, tcp_conn->port, peer_ip, port);
+                else
+                    tcp_stream_done[i] = 1;
+            }
+#endif
+        }
+        if (stop_us) {
+            int done = 1;
+#ifdef TCP
+            for (int i = 0; i < num_streams && !use_udp; i++)
+                done &= tcp_stream_done[i];
+#endif
+            if (done || now - stop_us >= PERF_CLOSE_WAIT_US)
+                break;
+        }
+    }
+
+    uint64_t end_us = net_now_us();
+    perf_report(end_us);
+    perf_report_line("total", &rx_total, &tx_total, (end_us - start_us) / 1e6);
+#ifdef IMPAIR
+    // 以 NET_IMPAIR_TX / NET_IMPAIR_RX 施加损伤时，输出损伤层的统计
+    for (int dir = IMPAIR_TX; dir <= IMPAIR_RX; dir++) {
+        const impair_stats_t *stats = impair_get_stats(dir);
+        if (stats->frames != stats->delivered)
+            printf("[perf] impair %s: %llu frames, %llu lost, %llu overflow, %llu duplicated, %llu corrupted, %llu reordered\n",
+                   dir == IMPAIR_TX ? "tx" : "rx", (unsigned long long)stats->frames, (unsigned long long)stats->lost,
+                   (unsigned long long)stats->overflow, (unsigned long long)stats->duplicated,
+                   (unsigned long long)stats->corrupted, (unsigned long long)stats->reordered);
+    }
+#endif
+#ifdef QOS
+    // 输出出口调度各类别的统计
+    static const char *qos_names[QOS_CLASS_NUM] = {"net", "control", "data"};
+    for (int cls = QOS_CLASS_NET; cls < QOS_CLASS_NUM; cls++) {
+        const qos_stats_t *stats = qos_get_stats(cls);
+        if (stats->queued || stats->dropped)
+            printf("[perf] qos %s: %llu frames, %llu bytes, %llu queued, %llu dropped, avg delay %.1f us\n",
+                   qos_names[cls], (unsigned long long)stats->frames, (unsigned long long)stats->bytes,
+                   (unsigned long long)stats->queued, (unsigned long long)stats->dropped,
+                   stats->queued ? (double)stats->delay_us / stats->queued : 0.0);
+    }
+#endif
+    return 0;
+}
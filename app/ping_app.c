@@ -53,11 +53,11 @@ int main(int argc, char const *argv[]) {
         return -1;
     }
 
-    last_ping_time = time(NULL);
+    last_ping_time = net_time();
 
     while (1) {
         // Check if it's time to send another ping
-        time_t current_time = time(NULL);
+        time_t current_time = net_time();
         if (ping_sent_count < PING_COUNT &&
             current_time - last_ping_time >= PING_INTERVAL) {
 
@@ -1,10 +1,47 @@
 #include "driver.h"
+#include "http.h"
+#include "http2.h"
+#include "http_log.h"
+#include "map.h"
 #include "net.h"
 #include "tcp.h"
 
-#define HTTP_MAX_PATH_LENGTH 1024
+#include <strings.h>
+#include <sys/stat.h>
+#include <time.h>
+
 #define HTTP_MAX_RESPONSE_LENGTH 1024
+#define HTTP_MAX_REQUEST_LENGTH 4096
 #define HTTP_LISTEN_PORT 80
+#define HTTP_MULTIPART_BOUNDARY "NET_LAB_BYTERANGES"
+#define HTTP_SCHED_QUANTUM 4096  // 调度器每轮为每个连接发送的最大字节数
+#define HTTP_PIPELINE_DEPTH 4    // HTTP/1.1 每个连接可排队的流水线请求数
+
+/**
+ * @brief 一个连接上正在进行的发送任务
+ *
+ * HTTP/1.1 连接按顺序发送响应体，HTTP/2 连接由 http2_flush 在各流之间轮转。
+ */
+typedef struct http_job {
+    http2_conn_t *h2_conn;           // HTTP/2 连接，HTTP/1.1 为NULL
+    uint8_t remote_ip[NET_IP_LEN];   // 对端 IP
+    uint16_t remote_port;            // 对端端口
+    int busy;                        // HTTP/1.1：是否有响应正在发送
+    int fin_pending;                 // HTTP/1.1：对端已半关闭，发完响应后关闭本端
+    http_request_t request;          // HTTP/1.1：当前请求
+    http_response_t response;        // HTTP/1.1：当前响应
+    size_t body_offset;              // HTTP/1.1：已发送的消息体长度
+    http_request_t pending[HTTP_PIPELINE_DEPTH];  // HTTP/1.1：排队的请求（环形队列）
+    size_t pending_head;             // HTTP/1.1：队首下标
+    size_t pending_count;            // HTTP/1.1：排队的请求数
+    int overflow;                    // HTTP/1.1：队列满时又收到请求，排队的响应发完后回复 503 并关闭
+} http_job_t;
+
+/**
+ * @brief 发送任务表
+ *
+ */
+static map_t http_job_table;  // tcp_conn -> http_job
 
 /**
  * @brief 根据文件路径返回对应的 MIME 类型
@@ -28,142 +65,670 @@ static inline const char *http_get_mime_type(const char *file_path) {
 }
 
 /**
- * @brief 响应函数
+ * @brief 在请求头中查找指定字段（字段名不区分大小写）
  *
- * @param tcp_conn  指向当前 TCP 连接的指针
- * @param url_path  资源文件路径
- * @param port      本连接端口
- * @param dst_ip    目标 IP 地址
- * @param dst_port  目标端口
+ * @param request   以 '\0' 结尾的请求报文
+ * @param name      字段名，如 "Range"
+ * @param value     出口参数，字段值（去掉首尾空白）
+ * @param value_len value 缓冲区大小
+ * @return int      找到为1，否则为0
+ */
+static int http_get_header(const char *request, const char *name, char *value, size_t value_len) {
+    size_t name_len = strlen(name);
+    const char *line = strstr(request, "\r\n");  // 跳过请求行
+    while (line && line[2] != '\0' && !(line[2] == '\r' && line[3] == '\n')) {
+        line += 2;
+        const char *line_end = strstr(line, "\r\n");
+        if (!line_end)
+            line_end = line + strlen(line);
+        if (strncasecmp(line, name, name_len) == 0 && line[name_len] == ':') {
+            const char *p = line + name_len + 1;
+            while (p < line_end && (*p == ' ' || *p == '\t'))
+                p++;
+            size_t n = line_end - p;
+            while (n > 0 && (p[n - 1] == ' ' || p[n - 1] == '\t'))
+                n--;
+            if (n >= value_len)
+                n = value_len - 1;
+            memcpy(value, p, n);
+            value[n] = '\0';
+            return 1;
+        }
+        line = *line_end ? line_end : NULL;
+    }
+    return 0;
+}
+
+/**
+ * @brief 解析 Range 请求头（仅支持 bytes 单位）
+ *
+ * @param spec       Range 请求头的值，如 "bytes=0-99,200-"
+ * @param file_size  文件大小
+ * @param ranges     出口参数，可满足的区间
+ * @param max_ranges ranges 的容量
+ * @return int       可满足的区间数；0 表示全部不可满足（应回复 416）；-1 表示语法无效或区间过多（应忽略 Range）
+ */
+static int http_parse_range(const char *spec, size_t file_size, http_range_t *ranges, int max_ranges) {
+    if (strncasecmp(spec, "bytes=", 6) != 0)
+        return -1;
+
+    int count = 0;
+    const char *p = spec + 6;
+    while (*p) {
+        while (*p == ' ' || *p == ',')
+            p++;
+        if (!*p)
+            break;
+
+        char *endp;
+        int has_first = (*p >= '0' && *p <= '9');
+        unsigned long long first = has_first ? strtoull(p, &endp, 10) : 0;
+        if (has_first)
+            p = endp;
+        if (*p++ != '-')
+            return -1;
+        int has_last = (*p >= '0' && *p <= '9');
+        unsigned long long last = has_last ? strtoull(p, &endp, 10) : 0;
+        if (has_last)
+            p = endp;
+        while (*p == ' ')
+            p++;
+        if (*p && *p != ',')
+            return -1;
+
+        http_range_t range;
+        if (has_first) {
+            if (has_last && last < first)
+                return -1;
+            if (first >= file_size)
+                continue;  // 不可满足的区间，跳过
+            range.start = first;
+            range.end = (has_last && last < file_size) ? last : file_size - 1;
+        } else {
+            if (!has_last)
+                return -1;
+            if (last == 0 || file_size == 0)
+                continue;  // 后缀长度为0，不可满足
+            range.start = last >= file_size ? 0 : file_size - last;
+            range.end = file_size - 1;
+        }
+
+        if (count == max_ranges)
+            return -1;
+        ranges[count++] = range;
+    }
+    return count;
+}
+
+/**
+ * @brief 将时间戳格式化为 HTTP 日期（RFC 7231 IMF-fixdate）
+ *
+ * @param timestamp 时间戳
+ * @param out       出口参数
+ * @param out_len   out 缓冲区大小
+ */
+static void http_format_date(time_t timestamp, char *out, size_t out_len) {
+    struct tm *utc_time = gmtime(&timestamp);
+    strftime(out, out_len, "%a, %d %b %Y %H:%M:%S GMT", utc_time);
+}
+
+/**
+ * @brief 判断 If-Range 条件是否成立
+ *
+ * @param if_range      If-Range 请求头的值
+ * @param etag          当前文件的强 ETag
+ * @param last_modified 当前文件的 Last-Modified
+ * @return int          成立为1（可以返回部分内容），否则为0（应返回完整内容）
+ */
+static int http_if_range_match(const char *if_range, const char *etag, const char *last_modified) {
+    if (if_range[0] == '"')  // 实体标签，必须强比较
+        return strcmp(if_range, etag) == 0;
+    if (strncmp(if_range, "W/", 2) == 0)  // 弱标签永远不匹配
+        return 0;
+    return strcmp(if_range, last_modified) == 0;
+}
+
+/**
+ * @brief 生成 multipart/byteranges 中一个分段的头部
+ *
+ * @return int 头部长度
+ */
+static int http_format_part_header(char *out, size_t out_len, const char *content_type, http_range_t *range, size_t file_size) {
+    return snprintf(out, out_len,
+                    "\r\n--" HTTP_MULTIPART_BOUNDARY "\r\n"
+                    "Content-Type: %s\r\n"
+                    "Content-Range: bytes %zu-%zu/%zu\r\n"
+                    "\r\n",
+                    content_type, range->start, range->end, file_size);
+}
+
+/**
+ * @brief 读取消息体中 [offset, offset + len) 的内容，不读取文件中被跳过的部分
+ *
+ * @param response 响应
+ * @param offset   消息体内的偏移
+ * @param buf      出口参数
+ * @param len      最多读取的长度
+ * @return size_t  实际读取的长度
+ */
+size_t http_body_read(http_response_t *response, size_t offset, uint8_t *buf, size_t len) {
+    if (offset >= response->content_length)
+        return 0;
+    if (len > response->content_length - offset)
+        len = response->content_length - offset;
+
+    if (response->body) {
+        memcpy(buf, response->body + offset, len);
+        return len;
+    }
+
+    if (response->range_count <= 1) {
+        size_t start = response->range_count == 1 ? response->ranges[0].start : 0;
+        fseek(response->file, start + offset, SEEK_SET);
+        return fread(buf, 1, len, response->file);
+    }
+
+    // multipart/byteranges：依次由分段头部、文件区间和结束分隔符拼接而成
+    char part_header[HTTP_MAX_RESPONSE_LENGTH];
+    size_t pos = 0, done = 0;
+    for (int i = 0; i <= response->range_count && done < len; i++) {
+        int header_len;
+        if (i < response->range_count)
+            header_len = http_format_part_header(part_header, sizeof(part_header), response->part_type, &response->ranges[i], response->file_size);
+        else
+            header_len = snprintf(part_header, sizeof(part_header), "\r\n--" HTTP_MULTIPART_BOUNDARY "--\r\n");
+        if (offset + done < pos + header_len) {
+            size_t n = pos + header_len - (offset + done);
+            if (n > len - done)
+                n = len - done;
+            memcpy(buf + done, part_header + (offset + done - pos), n);
+            done += n;
+        }
+        pos += header_len;
+        if (i == response->range_count || done == len)
+            continue;
+
+        size_t part_len = response->ranges[i].end - response->ranges[i].start + 1;
+        if (offset + done < pos + part_len) {
+            size_t n = pos + part_len - (offset + done);
+            if (n > len - done)
+                n = len - done;
+            fseek(response->file, response->ranges[i].start + (offset + done - pos), SEEK_SET);
+            size_t bytes_read = fread(buf + done, 1, n, response->file);
+            done += bytes_read;
+            if (bytes_read < n)
+                break;
+        }
+        pos += part_len;
+    }
+    return done;
+}
+
+/**
+ * @brief 释放响应占用的资源
+ *
+ * @param response 响应
+ */
+void http_response_release(http_response_t *response) {
+    if (response->file)
+        fclose(response->file);
+    response->file = NULL;
+    free(response->owned_body);
+    response->owned_body = NULL;
+}
+
+/**
+ * @brief 根据请求生成响应描述：定位资源文件，处理 Range 与 If-Range
+ *
+ * @param request  解析后的请求
+ * @param response 出口参数，生成的响应
  */
-void http_respond(tcp_conn_t *tcp_conn, char *url_path, uint16_t port, uint8_t *dst_ip, uint16_t dst_port) {
+void http_prepare_response(http_request_t *request, http_response_t *response) {
     FILE *file;
     char file_path[HTTP_MAX_PATH_LENGTH];
+    memset(response, 0, sizeof(http_response_t));
     memcpy(file_path, HTTP_RESOURCE_DIR, sizeof(HTTP_RESOURCE_DIR));
 
+    // 仅支持 GET 请求
+    if (strcmp(request->method, "GET") != 0) {
+        response->status = 405;
+        response->reason = "Method Not Allowed";
+        response->body = "";
+        return;
+    }
+
+    // 统计页面由内存生成
+    if (strcmp(request->url_path, HTTP_STATS_PATH) == 0) {
+        response->owned_body = http_stats_render(&response->content_length);
+        if (!response->owned_body) {
+            response->status = 500;
+            response->reason = "Internal Server Error";
+            response->body = "";
+            return;
+        }
+        response->status = 200;
+        response->reason = "OK";
+        response->content_type = "application/json";
+        response->body = response->owned_body;
+        return;
+    }
+
     // 获取文件路径，打开文件
-    if (strcmp(url_path, "/") == 0) {  // 如果路径为 "/", 则默认打开 index.html
+    if (strcmp(request->url_path, "/") == 0) {  // 如果路径为 "/", 则默认打开 index.html
         strcat(file_path, "/index.html");
     } else {
-        strcat(file_path, url_path);  // 否则，文件路径为 "${HTTP_RESOURCE_DIR}${url_path}"
+        strncat(file_path, request->url_path, sizeof(file_path) - sizeof(HTTP_RESOURCE_DIR));  // 否则，文件路径为 "${HTTP_RESOURCE_DIR}${url_path}"
     }
     // 打开文件
     file = fopen(file_path, "rb");
 
-    char resp_buffer[HTTP_MAX_RESPONSE_LENGTH] = {0};
-
-    // 文件不存在时发送 404 响应
-    if (!file) {
+    // 文件不存在时返回 404 响应
+    struct stat st;
+    if (!file || fstat(fileno(file), &st) != 0 || !S_ISREG(st.st_mode)) {
+        if (file)
+            fclose(file);
         // HTTP 404 响应请求体
-        char *not_found_body = "<HTML><TITLE>Not Found</TITLE>\r\n"
-                               "The resource specified\r\n"
-                               "is unavailable or nonexistent.\r\n"
-                               "</BODY></HTML>\r\n";
-        /* Step1 ：发送 HTTP 404 请求头 */
-        // TODO: 发送 HTTP 状态行
-        sprintf(resp_buffer, "HTTP/1.1 404 Not Found\r\n");
-        tcp_send(tcp_conn, (uint8_t *)resp_buffer, strlen(resp_buffer), port, dst_ip, dst_port);
-
-
-        // 发送 HTTP 连接信息
-        sprintf(resp_buffer, "Connection: Keep-Alive\r\n");
-        tcp_send(tcp_conn, (uint8_t *)resp_buffer, strlen(resp_buffer), port, dst_ip, dst_port);
+        response->status = 404;
+        response->reason = "Not Found";
+        response->content_type = "text/html";
+        response->body = "<HTML><TITLE>Not Found</TITLE>\r\n"
+                         "The resource specified\r\n"
+                         "is unavailable or nonexistent.\r\n"
+                         "</BODY></HTML>\r\n";
+        response->content_length = strlen(response->body);
+        return;
+    }
 
-        // TODO: 发送 HTTP 内容类型
-        sprintf(resp_buffer, "Content-Type: text/html\r\n");
-        tcp_send(tcp_conn, (uint8_t *)resp_buffer, strlen(resp_buffer), port, dst_ip, dst_port);
+    response->file = file;
+    response->file_size = st.st_size;
+    response->part_type = http_get_mime_type(file_path);
+    response->accept_ranges = 1;
 
+    // 生成校验器：强 ETag 由文件大小与修改时间组成
+    snprintf(response->etag, sizeof(response->etag), "\"%zx-%lx\"", response->file_size, (unsigned long)st.st_mtime);
+    http_format_date(st.st_mtime, response->last_modified, sizeof(response->last_modified));
 
-        // TODO: 发送 HTTP 内容长度
-        sprintf(resp_buffer, "Content-Length: %zu\r\n", strlen(not_found_body));
-        tcp_send(tcp_conn, (uint8_t *)resp_buffer, strlen(resp_buffer), port, dst_ip, dst_port);
+    // 解析 Range：If-Range 不成立时按完整内容响应
+    int range_count = -1;
+    if (request->range[0] &&
+        (!request->if_range[0] || http_if_range_match(request->if_range, response->etag, response->last_modified))) {
+        range_count = http_parse_range(request->range, response->file_size, response->ranges, HTTP_MAX_RANGES);
+    }
 
+    if (range_count == 0) {
+        // 所有区间都不可满足：416
+        http_response_release(response);
+        response->status = 416;
+        response->reason = "Range Not Satisfiable";
+        response->etag[0] = response->last_modified[0] = '\0';
+        snprintf(response->content_range, sizeof(response->content_range), "bytes */%zu", response->file_size);
+        response->body = "";
+    } else if (range_count == 1) {
+        // 单区间：206，Content-Range 描述返回的区间
+        response->status = 206;
+        response->reason = "Partial Content";
+        response->content_type = response->part_type;
+        response->range_count = 1;
+        snprintf(response->content_range, sizeof(response->content_range), "bytes %zu-%zu/%zu",
+                 response->ranges[0].start, response->ranges[0].end, response->file_size);
+        response->content_length = response->ranges[0].end - response->ranges[0].start + 1;
+    } else if (range_count > 1) {
+        // 多区间：206，multipart/byteranges，先计算整个消息体的长度
+        char part_header[HTTP_MAX_RESPONSE_LENGTH];
+        response->status = 206;
+        response->reason = "Partial Content";
+        response->content_type = "multipart/byteranges; boundary=" HTTP_MULTIPART_BOUNDARY;
+        response->range_count = range_count;
+        response->content_length = strlen("\r\n--" HTTP_MULTIPART_BOUNDARY "--\r\n");
+        for (int i = 0; i < range_count; i++) {
+            response->content_length += http_format_part_header(part_header, sizeof(part_header), response->part_type, &response->ranges[i], response->file_size);
+            response->content_length += response->ranges[i].end - response->ranges[i].start + 1;
+        }
+    } else {
+        // 无 Range 或 Range 被忽略：200，返回完整内容
+        response->status = 200;
+        response->reason = "OK";
+        response->content_type = response->part_type;
+        response->content_length = response->file_size;
+    }
+}
 
-        // TODO: 发送 HTTP 响应头与响应体的分隔符
-        sprintf(resp_buffer, "\r\n");
-        tcp_send(tcp_conn, (uint8_t *)resp_buffer, strlen(resp_buffer), port, dst_ip, dst_port);
+/**
+ * @brief 以 HTTP/1.1 格式发送响应头
+ *
+ * @param tcp_conn  指向当前 TCP 连接的指针
+ * @param response  响应
+ * @param port      本连接端口
+ * @param dst_ip    目标 IP 地址
+ * @param dst_port  目标端口
+ */
+static void http1_send_headers(tcp_conn_t *tcp_conn, http_response_t *response, uint16_t port, uint8_t *dst_ip, uint16_t dst_port) {
+    char resp_buffer[HTTP_MAX_RESPONSE_LENGTH];
+    int resp_len;
+
+    // 发送 HTTP 响应头：状态行、连接信息、校验器、内容类型、内容长度及分隔符
+    resp_len = snprintf(resp_buffer, sizeof(resp_buffer), "HTTP/1.1 %d %s\r\nConnection: Keep-Alive\r\n", response->status, response->reason);
+    if (response->accept_ranges)
+        resp_len += snprintf(resp_buffer + resp_len, sizeof(resp_buffer) - resp_len, "Accept-Ranges: bytes\r\n");
+    if (response->etag[0])
+        resp_len += snprintf(resp_buffer + resp_len, sizeof(resp_buffer) - resp_len, "ETag: %s\r\n", response->etag);
+    if (response->last_modified[0])
+        resp_len += snprintf(resp_buffer + resp_len, sizeof(resp_buffer) - resp_len, "Last-Modified: %s\r\n", response->last_modified);
+    if (response->content_type)
+        resp_len += snprintf(resp_buffer + resp_len, sizeof(resp_buffer) - resp_len, "Content-Type: %s\r\n", response->content_type);
+    if (response->content_range[0])
+        resp_len += snprintf(resp_buffer + resp_len, sizeof(resp_buffer) - resp_len, "Content-Range: %s\r\n", response->content_range);
+    resp_len += snprintf(resp_buffer + resp_len, sizeof(resp_buffer) - resp_len, "Content-Length: %zu\r\n\r\n", response->content_length);
+    tcp_send(tcp_conn, (uint8_t *)resp_buffer, resp_len, port, dst_ip, dst_port);
+}
 
+/**
+ * @brief 开始一个 HTTP/1.1 响应：生成响应并立即发送响应头，消息体交由调度器分批发送
+ *
+ * @param tcp_conn  指向当前 TCP 连接的指针
+ * @param job       连接的发送任务
+ * @param request   解析后的请求
+ */
+static void http1_start_response(tcp_conn_t *tcp_conn, http_job_t *job, http_request_t *request) {
+    job->request = *request;
+    http_prepare_response(&job->request, &job->response);
+    http1_send_headers(tcp_conn, &job->response, HTTP_LISTEN_PORT, job->remote_ip, job->remote_port);
+    job->response.first_byte_us = net_now_us();
+    job->body_offset = 0;
+    job->busy = 1;
+}
 
-        // TODO: 发送 HTTP 响应体
-        tcp_send(tcp_conn, (uint8_t *)not_found_body, strlen(not_found_body), port, dst_ip, dst_port);
+/**
+ * @brief 回复 503 并关闭本端，用于流水线队列溢出的连接
+ *
+ * 其后的请求不再处理，客户端按 HTTP/1.1 的约定在新连接上重试连接关闭时未获响应的请求。
+ *
+ * @param tcp_conn  指向当前 TCP 连接的指针
+ * @param job       连接的发送任务
+ */
+static void http1_send_overflow(tcp_conn_t *tcp_conn, http_job_t *job) {
+    const char *unavailable = "HTTP/1.1 503 Service Unavailable\r\n"
+                              "Connection: close\r\n"
+                              "Content-Length: 0\r\n"
+                              "\r\n";
+    tcp_send(tcp_conn, (uint8_t *)unavailable, strlen(unavailable), HTTP_LISTEN_PORT, job->remote_ip, job->remote_port);
+    tcp_send(tcp_conn, NULL, 0, HTTP_LISTEN_PORT, job->remote_ip, job->remote_port);
+    job->overflow = 0;
+    job->fin_pending = 0;
+}
 
+/**
+ * @brief 发送 HTTP/1.1 响应体，至多 budget 字节；响应完成后开始排队中的下一个请求
+ *
+ * @param tcp_conn  指向当前 TCP 连接的指针
+ * @param job       连接的发送任务
+ * @param budget    本轮可发送的字节数
+ * @return size_t   实际发送的字节数
+ */
+static size_t http1_send_body(tcp_conn_t *tcp_conn, http_job_t *job, size_t budget) {
+    uint8_t resp_buffer[HTTP_MAX_RESPONSE_LENGTH];
+    size_t sent = 0;
+    while (job->busy && sent < budget) {
+        size_t len = budget - sent < sizeof(resp_buffer) ? budget - sent : sizeof(resp_buffer);
+        size_t bytes_read = http_body_read(&job->response, job->body_offset, resp_buffer, len);
+        if (bytes_read > 0) {
+            tcp_send(tcp_conn, resp_buffer, bytes_read, HTTP_LISTEN_PORT, job->remote_ip, job->remote_port);
+            job->body_offset += bytes_read;
+            sent += bytes_read;
+        }
+        // 发送完毕（或文件被截断）：记录日志，关闭文件，继续处理流水线中的请求
+        if (bytes_read < len || job->body_offset == job->response.content_length) {
+            http_log_request(&job->request, &job->response, job->body_offset);
+            http_response_release(&job->response);
+            job->busy = 0;
+            if (job->pending_count) {
+                http_request_t *next = &job->pending[job->pending_head];
+                job->pending_head = (job->pending_head + 1) % HTTP_PIPELINE_DEPTH;
+                job->pending_count--;
+                http1_start_response(tcp_conn, job, next);
+            } else if (job->overflow) {
+                http1_send_overflow(tcp_conn, job);
+            }
+        }
+    }
+    return sent;
+}
 
+/**
+ * @brief 释放发送任务
+ *
+ * @param tcp_conn  指向当前 TCP 连接的指针
+ */
+static void http_job_delete(tcp_conn_t *tcp_conn) {
+    http_job_t *job = map_get(&http_job_table, &tcp_conn);
+    if (!job)
         return;
+    if (job->busy) {  // 连接在响应发完之前被关闭
+        http_log_request(&job->request, &job->response, job->body_offset);
+        http_response_release(&job->response);
     }
+    map_delete(&http_job_table, &tcp_conn);
+}
 
-    /* Step2 ：发送 HTTP 请求头 */
-    // TODO: 发送 HTTP 状态行
-    sprintf(resp_buffer, "HTTP/1.1 200 OK\r\n");
-    tcp_send(tcp_conn, (uint8_t *)resp_buffer, strlen(resp_buffer), port, dst_ip, dst_port);
-
-    // 发送 HTTP 连接信息
-    sprintf(resp_buffer, "Connection: Keep-Alive\r\n");
-    tcp_send(tcp_conn, (uint8_t *)resp_buffer, strlen(resp_buffer), port, dst_ip, dst_port);
-
-    const char *content_type = http_get_mime_type(file_path);
-    // TODO: 发送 HTTP 内容类型，根据文件类型设置 MIME 类型
-    sprintf(resp_buffer, "Content-Type: %s\r\n", content_type);
-    tcp_send(tcp_conn, (uint8_t *)resp_buffer, strlen(resp_buffer), port, dst_ip, dst_port);
+/**
+ * @brief 获取连接的发送任务，不存在则新建
+ *
+ * @param tcp_conn  指向当前 TCP 连接的指针
+ * @param h2_conn   HTTP/2 连接，HTTP/1.1 为NULL
+ * @param src_ip    对端 IP 地址
+ * @param src_port  对端端口
+ * @return http_job_t* 任务表已满为NULL
+ */
+static http_job_t *http_job_get(tcp_conn_t *tcp_conn, http2_conn_t *h2_conn, uint8_t *src_ip, uint16_t src_port) {
+    http_job_t *job = map_get(&http_job_table, &tcp_conn);
+    if (job)
+        return job;
+    http_job_t new_job;
+    memset(&new_job, 0, sizeof(http_job_t));
+    new_job.h2_conn = h2_conn;
+    memcpy(new_job.remote_ip, src_ip, NET_IP_LEN);
+    new_job.remote_port = src_port;
+    if (map_set(&http_job_table, &tcp_conn, &new_job) != 0)
+        return NULL;
+    return map_get(&http_job_table, &tcp_conn);
+}
 
+/**
+ * @brief 为一个连接执行一轮发送，本轮无数据可发的任务被移出调度
+ *
+ */
+static void http_schedule_fn(void *key, void *value, time_t *timestamp) {
+    tcp_conn_t *tcp_conn = *(tcp_conn_t **)key;
+    http_job_t *job = value;
+    size_t sent;
+    if (job->h2_conn)
+        sent = http2_flush(job->h2_conn, HTTP_SCHED_QUANTUM);
+    else
+        sent = http1_send_body(tcp_conn, job, HTTP_SCHED_QUANTUM);
+
+    if (sent == 0 && !job->busy) {
+        // 对端已半关闭，响应发送完毕后关闭本端
+        if (job->fin_pending)
+            tcp_send(tcp_conn, NULL, 0, HTTP_LISTEN_PORT, job->remote_ip, job->remote_port);
+        map_delete(&http_job_table, key);
+    }
+}
 
-    fseek(file, 0, SEEK_END);
-    size_t content_length = ftell(file);
-    fseek(file, 0, SEEK_SET);
-    // TODO: 发送 HTTP 内容长度
-    sprintf(resp_buffer, "Content-Length: %zu\r\n", content_length);
-    tcp_send(tcp_conn, (uint8_t *)resp_buffer, strlen(resp_buffer), port, dst_ip, dst_port);
+/**
+ * @brief 轮转调度各连接的响应发送，每次调用为每个有数据待发的连接发送至多 HTTP_SCHED_QUANTUM 字节
+ *
+ * 大文件下载因此不会阻塞其他连接上的小请求。
+ */
+void http_schedule() {
+    if (map_size(&http_job_table) == 0)  // 空闲时不扫描任务表
+        return;
+    map_foreach(&http_job_table, http_schedule_fn);
+}
 
+/**
+ * @brief 解析 HTTP/1.x 请求
+ *
+ * @param data    请求报文
+ * @param len     报文长度
+ * @param request 出口参数，解析结果
+ * @return int    成功为0，失败为-1
+ */
+static int http_parse_request(uint8_t *data, size_t len, http_request_t *request) {
+    char text[HTTP_MAX_REQUEST_LENGTH];
+    if (len >= sizeof(text))
+        len = sizeof(text) - 1;
+    memcpy(text, data, len);
+    text[len] = '\0';
+
+    memset(request, 0, sizeof(http_request_t));
+    request->version = 1;
+    request->start_us = net_now_us();
+    if (sscanf(text, "%7s", request->method) != 1)
+        return -1;
 
-    // TODO: 发送 HTTP 响应头与响应体的分隔符
-    sprintf(resp_buffer, "\r\n");
-    tcp_send(tcp_conn, (uint8_t *)resp_buffer, strlen(resp_buffer), port, dst_ip, dst_port);
+    // 获取请求 URL
+    char *p = strchr(text, ' ');
+    if (!p)
+        return -1;
+    ++p;
+    size_t j = 0;
+    while (*p && *p != ' ' && *p != '\r' && j < sizeof(request->url_path) - 1) {
+        request->url_path[j++] = *p++;
+    }
+    request->url_path[j] = '\0';
 
+    http_get_header(text, "Range", request->range, sizeof(request->range));
+    http_get_header(text, "If-Range", request->if_range, sizeof(request->if_range));
+    http_get_header(text, "Connection", request->connection, sizeof(request->connection));
+    http_get_header(text, "Upgrade", request->upgrade, sizeof(request->upgrade));
+    http_get_header(text, "HTTP2-Settings", request->http2_settings, sizeof(request->http2_settings));
+    return 0;
+}
 
-    /* Step3 ：发送 HTTP 响应体 */
-    size_t bytes_read;
-    while ((bytes_read = fread(resp_buffer, 1, sizeof(resp_buffer), file)) > 0) {
-        // TODO: 每次发送读取的文件内容块
-        tcp_send(tcp_conn, (uint8_t *)resp_buffer, bytes_read, port, dst_ip, dst_port);
+/**
+ * @brief 判断以逗号分隔的请求头值中是否包含指定记号（不区分大小写）
+ *
+ * @param value 请求头的值
+ * @param token 记号
+ * @return int  包含为1，否则为0
+ */
+static int http_header_has_token(const char *value, const char *token) {
+    size_t token_len = strlen(token);
+    const char *p = value;
+    while (*p) {
+        while (*p == ' ' || *p == ',')
+            p++;
+        const char *end = p;
+        while (*end && *end != ',' && *end != ' ')
+            end++;
+        if ((size_t)(end - p) == token_len && strncasecmp(p, token, token_len) == 0)
+            return 1;
+        p = end;
     }
-
-    // 后处理: 关闭文件
-    fclose(file);
+    return 0;
 }
 
 void http_request_handler(tcp_conn_t *tcp_conn, uint8_t *data, size_t len, uint8_t *src_ip, uint16_t src_port) {
-    char method[4];
-    char url_path[HTTP_MAX_PATH_LENGTH];
+    http_request_t request;
+
+    // 已升级为 HTTP/2 的连接，或以连接前言开头的 HTTP/2（prior knowledge）连接
+    http2_conn_t *h2_conn = http2_conn_get(tcp_conn);
+    if (!h2_conn && http2_is_preface(data, len))
+        h2_conn = http2_conn_open(tcp_conn, HTTP_LISTEN_PORT, src_ip, src_port);
+    if (h2_conn) {
+        http2_input(h2_conn, data, len);
+        http_job_get(tcp_conn, h2_conn, src_ip, src_port);
+        return;
+    }
 
     // 提取 HTTP 方法。目前仅支持 "GET" 请求
-    if (sscanf((char *)data, "%3s", method) != 1 || strcmp(method, "GET") != 0)
+    if (http_parse_request(data, len, &request) != 0 || strcmp(request.method, "GET") != 0)
         return;
+    memcpy(request.remote_ip, src_ip, NET_IP_LEN);
+
+    // 请求升级到 h2c：回复 101 后在流 1 上以 HTTP/2 响应原请求
+    if (http_header_has_token(request.upgrade, "h2c") && request.http2_settings[0] &&
+        http_header_has_token(request.connection, "Upgrade") && http_header_has_token(request.connection, "HTTP2-Settings")) {
+        h2_conn = http2_conn_open(tcp_conn, HTTP_LISTEN_PORT, src_ip, src_port);
+        if (h2_conn) {
+            const char *switching = "HTTP/1.1 101 Switching Protocols\r\n"
+                                    "Connection: Upgrade\r\n"
+                                    "Upgrade: h2c\r\n"
+                                    "\r\n";
+            tcp_send(tcp_conn, (uint8_t *)switching, strlen(switching), HTTP_LISTEN_PORT, src_ip, src_port);
+            http2_upgrade(h2_conn, &request);
+            http_job_get(tcp_conn, h2_conn, src_ip, src_port);
+            return;
+        }
+    }
 
-    // 获取请求 URL
-    int idx = 0;
-    int j = 0;
-    while (data[idx] != ' ')
-        ++idx;
-    ++idx;
-    while (data[idx] != ' ') {
-        url_path[j++] = data[idx++];
+    // 发送响应头，消息体由 http_schedule 分批发送；前一个响应未完成时排队（流水线）
+    http_job_t *job = http_job_get(tcp_conn, NULL, src_ip, src_port);
+    if (!job)
+        return;
+    if (job->overflow)
+        return;  // 已决定回复 503 并关闭，其后的请求由客户端重试
+    if (!job->busy) {
+        http1_start_response(tcp_conn, job, &request);
+    } else if (job->pending_count < HTTP_PIPELINE_DEPTH) {
+        job->pending[(job->pending_head + job->pending_count++) % HTTP_PIPELINE_DEPTH] = request;
+    } else {
+        job->overflow = 1;
     }
-    url_path[j] = '\0';
+}
 
-    // 发送响应
-    http_respond(tcp_conn, url_path, HTTP_LISTEN_PORT, src_ip, src_port);
+/**
+ * @brief TCP 连接事件处理函数
+ *
+ * 对端关闭时同样关闭本端（HTTP/1.1 响应尚未发完时推迟到发完之后），
+ * 连接移除时释放发送任务与 HTTP/2 连接状态。
+ */
+void http_event_handler(tcp_conn_t *tcp_conn, tcp_event_t event, uint8_t *src_ip, uint16_t src_port) {
+    if (event == TCP_EVENT_ESTABLISHED)  // 服务端等待请求到达，无需处理
+        return;
+    http_job_t *job = map_get(&http_job_table, &tcp_conn);
+    if (event == TCP_EVENT_FIN && job && job->busy) {
+        job->fin_pending = 1;
+        return;
+    }
+    http_job_delete(tcp_conn);
+    http2_conn_close(tcp_conn);
+    if (event == TCP_EVENT_FIN)
+        tcp_send(tcp_conn, NULL, 0, HTTP_LISTEN_PORT, src_ip, src_port);
 }
 
+/**
+ * @brief 初始化 web 服务器并开始监听，须在 net_init 之后调用
+ *
+ * @return int 成功为0，失败为-1
+ */
+int http_server_init() {
+    if (http_log_init() == -1)
+        printf("access log disabled: cannot open %s.\n", HTTP_ACCESS_LOG);
+    http2_init();
+    map_init(&http_job_table, sizeof(tcp_conn_t *), sizeof(http_job_t), 0, 0, NULL, NULL);
+    if (tcp_open(HTTP_LISTEN_PORT, http_request_handler) != 0)  // 注册端口的tcp监听回调
+        return -1;
+    return tcp_set_event_handler(HTTP_LISTEN_PORT, http_event_handler);
+}
+
+#ifndef HTTP_NO_MAIN  // 基准测试等程序复用本文件时自行提供 main
 int main(int argc, char const *argv[]) {
     if (net_init() == -1) {  // 初始化协议栈
         printf("net init failed.");
         return -1;
     }
 
-    tcp_open(HTTP_LISTEN_PORT, http_request_handler);  // 注册端口的tcp监听回调
+    if (http_server_init() == -1) {
+        printf("http server init failed.");
+        return -1;
+    }
 
     while (1) {
-        net_poll();  // 一次主循环
+        net_poll();       // 一次主循环
+        http_schedule();  // 轮转发送各连接的响应
     }
 
     return 0;
 }
+#endif
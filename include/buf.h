@@ -10,10 +10,13 @@ typedef struct buf  // 协议栈的通用数据包buffer, 可以在头部装卸
 {
     size_t len;                    // 包中有效数据大小
     uint8_t *data;                 // 包的数据起始地址
+    uint8_t *head;                 // 可用空间的起始地址，头部最多扩展到这里
+    uint8_t *end;                  // 可用空间的结束地址，尾部最多扩展到这里
     uint8_t payload[BUF_MAX_LEN];  // 最大负载数据量
 } buf_t;
 
 int buf_init(buf_t *buf, size_t len);
+void buf_attach(buf_t *buf, uint8_t *head, size_t size, uint8_t *data, size_t len);
 int buf_add_header(buf_t *buf, size_t len);
 int buf_remove_header(buf_t *buf, size_t len);
 int buf_add_padding(buf_t *buf, size_t len);
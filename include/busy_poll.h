@@ -0,0 +1,40 @@
+#ifndef BUSY_POLL_H
+#define BUSY_POLL_H
+
+#include "net.h"
+
+#define BUSY_POLL_PAUSES 64  // 自旋阶段每次空闲轮询后执行的 pause 指令数
+
+/**
+ * @brief 忙轮询参数
+ *
+ * 空闲时间从最近一次收发数据包起算：短于 spin_us 时以 pause 自旋，短于 sleep_us 时每次睡眠 nap_us，
+ * 此后在驱动的文件描述符上阻塞等待，最长 block_us，以免错过协议栈的定时任务。
+ */
+typedef struct busy_poll_config {
+    int cpu;            // 绑定的CPU，-1 不绑定
+    uint32_t budget;    // 有流量时一次 busy_poll 最多调用 net_poll 的次数
+    uint64_t spin_us;   // 空闲多久后从自旋转为短睡眠
+    uint64_t sleep_us;  // 空闲多久后从短睡眠转为阻塞
+    uint64_t nap_us;    // 短睡眠的时长
+    uint64_t block_us;  // 阻塞等待的最长时间
+} busy_poll_config_t;
+
+/**
+ * @brief 忙轮询统计，时间均为纳秒
+ *
+ */
+typedef struct busy_poll_stats {
+    uint64_t polls;     // net_poll 调用次数
+    uint64_t packets;   // 处理的数据包数
+    uint64_t busy_ns;   // 有收发时的轮询时间
+    uint64_t spin_ns;   // 空闲自旋的时间
+    uint64_t sleep_ns;  // 短睡眠的时间
+    uint64_t block_ns;  // 阻塞等待的时间
+} busy_poll_stats_t;
+
+int busy_poll_parse(const char *spec, busy_poll_config_t *config);
+int busy_poll_configure(const busy_poll_config_t *config);
+int busy_poll();
+const busy_poll_stats_t *busy_poll_get_stats();
+#endif
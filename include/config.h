@@ -29,6 +29,11 @@
 
 #define ETHERNET_MAX_TRANSPORT_UNIT 1500  // 以太网最大传输单元
 
+#ifndef TEST
+#define NET_LOCAL_DELIVERY      // 发往本机地址（含 127.0.0.0/8 与 ::1）的数据包不经过驱动，在下一次轮询时直接交给 ip_in / ipv6_in
+#endif
+#define NET_LOCAL_QUEUE_LEN 64  // 本机投递队列的长度（数据包）
+
 #define ARP_TIMEOUT_SEC (60 * 5)  // arp表过期时间
 #define ARP_MIN_INTERVAL 1        // 向相同地址发送arp请求的最小间隔
 
@@ -6,8 +6,50 @@
 #ifndef PCAP_BUF_SIZE
 #define PCAP_BUF_SIZE 1024
 #endif
+#define DRIVER_MAX_BACKENDS 16  // 可注册的驱动数上限
+#define DRIVER_NAMES_LEN 128    // driver_select 名称列表的最大长度
+
+/**
+ * @brief 驱动能力标志
+ *
+ */
+typedef enum driver_cap {
+    DRIVER_CAP_SELECT_FD = 1 << 0,  // 提供可 select / poll 的文件描述符，driver_fd 只对声明此能力的驱动返回
+} driver_cap_t;
+
+/**
+ * @brief 一个驱动的操作表
+ *
+ * 各驱动以 DRIVER_REGISTER 在程序启动时注册，链接进程序的驱动都可在运行时按名称选用。
+ */
+typedef struct driver_ops {
+    const char *name;             // 驱动名称，用于 driver_select 与 NET_DRIVER
+    uint32_t caps;                // 能力标志，driver_cap_t 的组合
+    int rank;                     // 未指定名称时按此从高到低依次尝试，0 表示只按名称选用
+    int (*open)();                // 成功为0，失败为-1
+    int (*recv)(buf_t *buf);      // 收到的数据包长度，未收到为0，错误为-1
+    int (*send)(buf_t *buf);      // 成功为0，失败为-1
+    void (*close)();
+    int (*fd)();                  // 可 select / poll 的文件描述符，未声明 DRIVER_CAP_SELECT_FD 时可为NULL
+} driver_ops_t;
+
+/**
+ * @brief 在程序启动时注册驱动
+ *
+ */
+#define DRIVER_REGISTER(ops)                                          \
+    __attribute__((constructor)) static void driver_register_##ops() { \
+        driver_register(&ops);                                        \
+    }
+
+void driver_register(const driver_ops_t *ops);
+int driver_select(const char *names);
+const driver_ops_t *driver_current();
+int driver_fd();
+uint64_t driver_sent();
+
 int driver_open();
 int driver_recv(buf_t *buf);
 int driver_send(buf_t *buf);
 void driver_close();
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,58 @@
+#ifndef IMPAIR_H
+#define IMPAIR_H
+
+#include "net.h"
+
+#ifndef IMPAIR_QUEUE_LEN
+#define IMPAIR_QUEUE_LEN 1024  // 每个方向最多暂存的帧数
+#endif
+#define IMPAIR_FRAME_MAX (ETHERNET_MAX_TRANSPORT_UNIT + 14)  // 暂存帧的最大长度（含以太网头部）
+
+typedef enum impair_dir {
+    IMPAIR_TX,  // driver_send 方向
+    IMPAIR_RX,  // driver_recv 方向
+} impair_dir_t;
+
+/**
+ * @brief 一个方向的损伤参数，全部为0时直通
+ *
+ */
+typedef struct impair_config {
+    uint64_t seed;          // 随机数种子，相同的种子与输入得到相同的决策序列
+    double loss;            // Bernoulli 丢包率
+    double ge_p;            // Gilbert-Elliott：好状态转入坏状态的概率，非0时取代 loss
+    double ge_r;            // Gilbert-Elliott：坏状态转回好状态的概率
+    double ge_loss_good;    // Gilbert-Elliott：好状态下的丢包率
+    double ge_loss_bad;     // Gilbert-Elliott：坏状态下的丢包率
+    uint64_t delay_us;      // 固定时延
+    uint64_t jitter_us;     // 时延在 [-jitter, +jitter] 内均匀抖动
+    double reorder;         // 额外推迟 reorder_us 的帧比例，使后续帧越过它
+    uint64_t reorder_us;    // 乱序帧的额外时延
+    double duplicate;       // 重复发送的帧比例
+    double corrupt;         // 翻转以太网头部之后一个随机比特的帧比例
+    uint64_t rate_bps;      // 链路速率，0 为不限速
+    uint32_t limit;         // 暂存队列长度上限（帧），超出时尾部丢弃，0 为 IMPAIR_QUEUE_LEN
+} impair_config_t;
+
+/**
+ * @brief 一个方向的统计
+ *
+ */
+typedef struct impair_stats {
+    uint64_t frames;      // 进入损伤层的帧数
+    uint64_t delivered;   // 交出的帧数（含重复）
+    uint64_t lost;        // 按丢包模型丢弃的帧数
+    uint64_t overflow;    // 队列满而丢弃的帧数
+    uint64_t duplicated;  // 重复的帧数
+    uint64_t corrupted;   // 损坏的帧数
+    uint64_t reordered;   // 被推迟乱序的帧数
+} impair_stats_t;
+
+void impair_init();
+int impair_configure(impair_dir_t dir, const impair_config_t *config);
+int impair_parse(const char *spec, impair_config_t *config);
+const impair_stats_t *impair_get_stats(impair_dir_t dir);
+int impair_send(buf_t *buf);
+int impair_recv(buf_t *buf);
+void impair_poll();
+#endif
@@ -68,7 +68,7 @@ typedef enum ipv6_addr_type {
 } ipv6_addr_type_t;
 
 // 全局变量声明
-extern uint8_t net_if_ipv6[NET_IPV6_LEN];   // 本机IPv6地址
+extern _Thread_local uint8_t net_if_ipv6[NET_IPV6_LEN];   // 本机IPv6地址
 extern uint8_t ipv6_unspecified[NET_IPV6_LEN]; // 未指定地址 ::
 extern uint8_t ipv6_loopback[NET_IPV6_LEN];    // 回环地址 ::1
 extern uint8_t ipv6_all_nodes_multicast[NET_IPV6_LEN]; // 所有节点组播地址
@@ -0,0 +1,62 @@
+#ifndef LOOP_H
+#define LOOP_H
+
+#include "net.h"
+#ifdef IMPAIR
+#include "impair.h"
+#endif
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+#ifndef LOOP_RING_LEN
+#define LOOP_RING_LEN 1024  // 每个方向环形队列的槽数，须为2的幂
+#endif
+#define LOOP_FRAME_MAX (ETHERNET_MAX_TRANSPORT_UNIT + 14)  // 一个槽的最大帧长（含以太网头部）
+#define LOOP_THREAD_STACK (64 << 20)                       // 实例线程的栈大小，需容纳线程局部的协议栈状态
+
+/**
+ * @brief 单生产者单消费者的无锁环形队列，承载一个方向的以太网帧
+ *
+ */
+typedef struct loop_ring {
+    _Alignas(64) atomic_size_t head;  // 生产者下一个写入的位置
+    _Alignas(64) atomic_size_t tail;  // 消费者下一个读取的位置
+    _Alignas(64) uint64_t dropped;    // 队列满而丢弃的帧数，只由生产者修改
+    struct {
+        size_t len;
+        uint8_t data[LOOP_FRAME_MAX];
+    } slots[LOOP_RING_LEN];
+} loop_ring_t;
+
+typedef struct net_stack net_stack_t;
+typedef void (*net_stack_handler_t)(net_stack_t *stack);
+
+/**
+ * @brief 一个协议栈实例
+ *
+ * 协议栈的状态为线程局部变量，每个实例在自己的线程中初始化并轮询，经 loop_link 建立的
+ * 内存链路与对端实例交换以太网帧。回调均在实例线程中执行，可直接调用协议栈的接口。
+ */
+struct net_stack {
+    uint8_t mac[NET_MAC_LEN];     // 本实例的MAC地址
+    uint8_t ip[NET_IP_LEN];       // 本实例的IP地址
+    net_stack_handler_t setup;    // net_init 之后调用一次，用于打开端口等
+    net_stack_handler_t poll;     // 每次 net_poll 之后调用
+    void *arg;                    // 供回调使用的参数
+#ifdef IMPAIR
+    const char *impair_tx;        // 发送方向的损伤参数（见 impair_parse），NULL 时沿用环境变量
+    const char *impair_rx;        // 接收方向的损伤参数
+#endif
+    loop_ring_t *rx, *tx;         // 链路两个方向的队列，由 loop_link 设置
+    pthread_t thread;
+    atomic_int running;
+    int ret;                      // 实例线程的结果，初始化失败为-1
+};
+
+int loop_link(net_stack_t *a, net_stack_t *b);
+void loop_unlink(net_stack_t *a, net_stack_t *b);
+int loop_start(net_stack_t *stack);
+void loop_stop(net_stack_t *stack);
+net_stack_t *loop_self();
+#endif
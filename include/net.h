@@ -7,6 +7,7 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
 typedef enum net_protocol {
     NET_PROTOCOL_ARP = 0x0806,
     NET_PROTOCOL_IP = 0x0800,
@@ -34,16 +35,27 @@ typedef enum net_protocol {
 } net_protocol_t;
 
 typedef void (*net_handler_t)(buf_t *buf, uint8_t *src);
+typedef uint64_t (*net_clock_t)();
+typedef void (*net_port_hook_t)();
 
 #define NET_MAC_LEN 6  // mac地址长度
 #define NET_IP_LEN 4   // ip地址长度
 
-extern uint8_t net_if_mac[NET_MAC_LEN];
-extern uint8_t net_if_ip[NET_IP_LEN];
-extern buf_t rxbuf, txbuf;  // 一个buf足够单线程使用
+// 协议栈状态均为线程局部变量，每个线程可运行一个独立的协议栈实例
+extern _Thread_local uint8_t net_if_mac[NET_MAC_LEN];
+extern _Thread_local uint8_t net_if_ip[NET_IP_LEN];
+extern _Thread_local buf_t rxbuf, txbuf;  // 一个buf足够单线程使用
 
 int net_init();
-void net_poll();
+int net_poll();
+uint64_t net_now_us();
+time_t net_time();
+void net_set_clock(net_clock_t clock);
 int net_in(buf_t *buf, uint16_t protocol, uint8_t *src);
+#ifdef NET_LOCAL_DELIVERY
+int net_local_out(buf_t *buf, uint16_t protocol);
+#endif
 void net_add_protocol(uint16_t protocol, net_handler_t handler);
+void net_set_port_hook(net_port_hook_t hook);
+void net_ports_changed();
 #endif
\ No newline at end of file
@@ -0,0 +1,69 @@
+#ifndef QOS_H
+#define QOS_H
+
+#include "net.h"
+
+#ifndef QOS_QUEUE_LEN
+#define QOS_QUEUE_LEN 1024  // 所有类别共用的暂存帧数
+#endif
+#define QOS_FRAME_MAX (ETHERNET_MAX_TRANSPORT_UNIT + 14)  // 暂存帧的最大长度（含以太网头部）
+#define QOS_FLOWS 64                                      // 数据类别的流队列数，流按哈希分配
+#define QOS_QUANTUM QOS_FRAME_MAX                         // 权重为1的流每轮可发送的字节数
+#define QOS_MAX_WEIGHTS 16                                // 可单独设置权重的本端端口数
+#define QOS_BURST_US 2000                                 // 默认令牌桶深度为按速率发送这么长时间的字节数
+
+/**
+ * @brief 流量类别，按严格优先级从高到低
+ *
+ */
+typedef enum qos_class {
+    QOS_CLASS_NET,      // ARP 与 ICMPv6 邻居发现
+    QOS_CLASS_CONTROL,  // ICMP 与不带数据的 TCP 段（SYN、ACK、FIN、RST）
+    QOS_CLASS_DATA,     // 其他数据包，各流之间加权公平排队
+    QOS_CLASS_NUM,
+} qos_class_t;
+
+/**
+ * @brief 一个本端端口的权重
+ *
+ */
+typedef struct qos_weight {
+    uint16_t port;
+    uint16_t weight;
+} qos_weight_t;
+
+/**
+ * @brief 出口调度参数
+ *
+ * 链路速率为0时只在驱动拒绝发送（如发送队列满）时排队；设为略低于实际链路的速率，
+ * 队列就留在协议栈中，由调度决定发送顺序。
+ */
+typedef struct qos_config {
+    uint64_t rate_bps;                       // 出口链路速率，0 为不限速
+    uint32_t burst;                          // 链路令牌桶深度（字节），0 为默认值（见 QOS_BURST_US）
+    uint64_t class_rate_bps[QOS_CLASS_NUM];  // 各类别的限速，0 为不限速
+    uint32_t class_burst[QOS_CLASS_NUM];     // 各类别令牌桶深度（字节），0 为默认值
+    uint32_t limit;                          // 暂存帧数上限，超出时尾部丢弃，0 为 QOS_QUEUE_LEN
+    qos_weight_t weights[QOS_MAX_WEIGHTS];   // 按本端端口设置的流权重，其余流权重为1
+    size_t num_weights;
+} qos_config_t;
+
+/**
+ * @brief 一个类别的统计
+ *
+ */
+typedef struct qos_stats {
+    uint64_t frames;    // 发出的帧数
+    uint64_t bytes;     // 发出的字节数
+    uint64_t dropped;   // 队列满而丢弃的帧数
+    uint64_t queued;    // 经过排队（未直接发出）的帧数
+    uint64_t delay_us;  // 排队帧的累计排队时间
+} qos_stats_t;
+
+void qos_init();
+int qos_configure(const qos_config_t *config);
+int qos_parse(const char *spec, qos_config_t *config);
+const qos_stats_t *qos_get_stats(qos_class_t cls);
+int qos_send(buf_t *buf);
+void qos_poll();
+#endif
@@ -44,8 +44,11 @@ typedef struct tcp_connection {
 
     /* TCP communication states */
     int port;
-    uint32_t seq;  // 要发送的序列号
-    uint32_t ack;  // 要发送的 ACK
+    uint32_t seq;      // 要发送的序列号
+    uint32_t ack;      // 要发送的 ACK
+    uint32_t snd_una;  // 对端已确认的序列号，seq - snd_una 为已发送未确认的字节数
+    uint16_t snd_wnd;  // 对端通告的接收窗口
+    time_t fin_time;   // 本端发送 FIN 的时刻，FIN_WAIT 超过 TCP_FIN_WAIT_TIMEOUT 后回收连接
 } tcp_conn_t;
 
 #define TCP_FLG_URG (1 << 5)
@@ -59,16 +62,26 @@ typedef struct tcp_connection {
 
 #define TCP_HEADER_LEN 20
 #define TCP_RETRANSMISSON_TIMEOUT 3
+#define TCP_FIN_WAIT_TIMEOUT 60  // 主动关闭后等待对端 FIN 的最长时间（秒）
 #define TCP_MAX_WINDOW_SIZE UINT16_MAX
 #define TCP_MAX_CONN_NUM (MAP_MAX_LEN / (sizeof(tcp_key_t) + sizeof(tcp_conn_t) + sizeof(time_t)))
 
+typedef enum tcp_event {
+    TCP_EVENT_ESTABLISHED,  // 三次握手完成，应用可开始主动发送数据
+    TCP_EVENT_FIN,          // 对端已发送 FIN，不会再有数据到达，应用可调用 tcp_send(len=0) 关闭本端
+    TCP_EVENT_CLOSED,       // 连接已从连接表中移除（收到 RST、完成挥手或端口被关闭），此后 tcp_conn 失效
+} tcp_event_t;
+
 typedef void (*tcp_handler_t)(tcp_conn_t *tcp_conn, uint8_t *data, size_t len, uint8_t *src_ip, uint16_t src_port);
+typedef void (*tcp_event_handler_t)(tcp_conn_t *tcp_conn, tcp_event_t event, uint8_t *src_ip, uint16_t src_port);
 
 void tcp_init();
 int tcp_open(uint16_t port, tcp_handler_t handler);
+int tcp_set_event_handler(uint16_t port, tcp_event_handler_t handler);
 void tcp_close(uint16_t port);
 
 void tcp_in(buf_t *buf, uint8_t *src_ip);
 void tcp_out(tcp_conn_t *tcp_conn, buf_t *buf, uint16_t src_port, uint8_t *dst_ip, uint16_t dst_port, uint8_t flags);
 void tcp_send(tcp_conn_t *tcp_conn, uint8_t *data, uint16_t len, uint16_t src_port, uint8_t *dst_ip, uint16_t dst_port);
+tcp_conn_t *tcp_connect(uint16_t host_port, uint8_t *dst_ip, uint16_t dst_port);
 #endif
\ No newline at end of file
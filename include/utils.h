@@ -16,4 +16,6 @@ char *iptos(uint8_t *ip);
 char *mactos(uint8_t *mac);
 char *timetos(time_t timestamp);
 uint8_t ip_prefix_match(uint8_t *ipa, uint8_t *ipb);
+int parse_time_us(const char *value, uint64_t *us);
+int parse_rate_bps(const char *value, uint64_t *rate_bps);
 #endif
\ No newline at end of file
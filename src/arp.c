@@ -22,13 +22,13 @@ static const arp_pkt_t arp_init_pkt = {
  * @brief arp地址转换表，<ip,mac>的容器
  *
  */
-map_t arp_table;
+_Thread_local map_t arp_table;
 
 /**
  * @brief arp buffer，<ip,buf_t>的容器
  *
  */
-map_t arp_buf;
+_Thread_local map_t arp_buf;
 
 /**
  * @brief 打印一条arp表项
@@ -62,6 +62,8 @@ void arp_req(uint8_t *target_ip) {
     buf_add_header(&txbuf, sizeof(arp_pkt_t));
     arp_pkt_t *arp_hdr = (arp_pkt_t *)txbuf.data;
     memcpy(arp_hdr, &arp_init_pkt, sizeof(arp_pkt_t));
+    memcpy(arp_hdr->sender_ip, net_if_ip, NET_IP_LEN);  // 以实例的地址为准，而非编译期配置
+    memcpy(arp_hdr->sender_mac, net_if_mac, NET_MAC_LEN);
     arp_hdr->opcode16 = swap16(ARP_REQUEST);
     memcpy(arp_hdr->target_ip, target_ip, NET_IP_LEN);
     // ethernet
@@ -81,6 +83,8 @@ void arp_resp(uint8_t *target_ip, uint8_t *target_mac) {
     buf_add_header(&txbuf, sizeof(arp_pkt_t));
     arp_pkt_t *arp_hdr = (arp_pkt_t *)txbuf.data;
     memcpy(arp_hdr, &arp_init_pkt, sizeof(arp_pkt_t));
+    memcpy(arp_hdr->sender_ip, net_if_ip, NET_IP_LEN);  // 以实例的地址为准，而非编译期配置
+    memcpy(arp_hdr->sender_mac, net_if_mac, NET_MAC_LEN);
     // 设置ARP响应的字段
     arp_hdr->opcode16 = swap16(ARP_REPLY);
     memcpy(arp_hdr->target_ip, target_ip, NET_IP_LEN);
@@ -17,9 +17,30 @@ int buf_init(buf_t *buf, size_t len) {
 
     buf->len = len;
     buf->data = buf->payload + BUF_MAX_LEN / 2 - len;
+    buf->head = buf->payload;
+    buf->end = buf->payload + BUF_MAX_LEN;
     return 0;
 }
 
+/**
+ * @brief 让buffer直接使用外部内存中的数据包，不拷贝
+ *
+ * 用于驱动把收到的帧所在的内存（如 AF_XDP 的 UMEM 帧）借给协议栈，
+ * 头部与尾部的增减限制在该段内存之内，内存须在buffer使用期间保持有效。
+ *
+ * @param buf 要设置的buffer
+ * @param head 外部内存的起始地址
+ * @param size 外部内存的长度
+ * @param data 数据包在外部内存中的起始地址
+ * @param len 数据包长度
+ */
+void buf_attach(buf_t *buf, uint8_t *head, size_t size, uint8_t *data, size_t len) {
+    buf->head = head;
+    buf->end = head + size;
+    buf->data = data;
+    buf->len = len;
+}
+
 /**
  * @brief 为buffer在头部增加一段长度，用于添加协议头
  *
@@ -28,7 +49,7 @@ int buf_init(buf_t *buf, size_t len) {
  * @return int 成功为0，失败为-1
  */
 int buf_add_header(buf_t *buf, size_t len) {
-    if (buf->data - len < buf->payload) {
+    if (buf->data - buf->head < len) {
         fprintf(stderr, "Error in buf_add_header:%zu+%zu\n", buf->len, len);
         return -1;
     }
@@ -62,7 +83,7 @@ int buf_remove_header(buf_t *buf, size_t len) {
  * @return int 成功为0，失败为-1
  */
 int buf_add_padding(buf_t *buf, size_t len) {
-    if (buf->data + buf->len + len >= buf->payload + BUF_MAX_LEN) {
+    if (buf->data + buf->len + len >= buf->end) {
         fprintf(stderr, "Error in buf_add_padding:%zu+%zu\n", buf->len, len);
         return -1;
     }
@@ -98,5 +119,5 @@ void buf_copy(void *pdst, const void *psrc, size_t len) {
     buf_t *dst = pdst;
     const buf_t *src = psrc;
     buf_init(dst, src->len);
-    memcpy(dst->payload, src->payload, BUF_MAX_LEN);
+    memcpy(dst->data, src->data, src->len);
 }
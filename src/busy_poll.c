@@ -0,0 +1,226 @@
+/**
+ * @file busy_poll.c
+ * @brief 忙轮询：有流量时不经系统调用连续轮询驱动，空闲时逐级退避
+ *
+ * 应用在主循环中以 busy_poll 代替 net_poll。有数据包收发时在 budget 次以内连续调用 net_poll；
+ * 空闲时按空闲时长逐级退避：先以 pause 指令自旋，再短暂睡眠，最后在驱动的文件描述符上阻塞
+ * （驱动不提供时睡眠同样时长）。退避的各级时长可配置，以在 CPU 占用与尾延迟之间取舍；
+ * 各阶段所用时间计入统计，供按部署调整参数。状态为线程局部变量，与协议栈一致。
+ *
+ * 参数格式为逗号分隔的 key=value（见 busy_poll_parse），也可由环境变量 NET_BUSY_POLL 给出，例如
+ *   cpu=2,budget=64,spin=200us,sleep=5ms,nap=50us,block=10ms
+ */
+
+#ifdef __linux__
+#define _GNU_SOURCE
+#include <sched.h>
+#endif
+#include "busy_poll.h"
+
+#include "driver.h"
+
+#include <stdlib.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <poll.h>
+#endif
+
+#define BUSY_POLL_DEFAULT_BUDGET 64
+
+static _Thread_local busy_poll_config_t busy_config;
+static _Thread_local int busy_configured;
+static _Thread_local busy_poll_stats_t busy_stats;
+static _Thread_local uint64_t busy_last_active_ns;  // 最近一次收发数据包的时刻
+static _Thread_local uint64_t busy_last_sent;       // 上次检查时驱动已发送的帧数
+
+static uint64_t busy_clock_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static inline void busy_pause() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ volatile("yield");
+#endif
+}
+
+static void busy_sleep_us(uint64_t us) {
+#ifdef _WIN32
+    Sleep(us / 1000);
+#else
+    struct timespec ts = {.tv_sec = us / 1000000, .tv_nsec = us % 1000000 * 1000};
+    nanosleep(&ts, NULL);
+#endif
+}
+
+/**
+ * @brief 在驱动的文件描述符上等待，最长 us 微秒；驱动未声明 DRIVER_CAP_SELECT_FD 时睡眠同样时长
+ *
+ */
+static void busy_block_us(uint64_t us) {
+#ifndef _WIN32
+    int fd = driver_fd();
+    if (fd >= 0) {
+        struct pollfd pfd = {.fd = fd, .events = POLLIN};
+        poll(&pfd, 1, (us + 999) / 1000);
+        return;
+    }
+#endif
+    busy_sleep_us(us);
+}
+
+/**
+ * @brief 解析忙轮询参数
+ *
+ * 可用的键：cpu（CPU编号）、budget（次数）、spin、sleep、nap、block（时间，可带 us/ms/s 后缀，默认微秒），
+ * 未给出的键取默认值。
+ *
+ * @param spec 参数字符串
+ * @param config 出口参数，解析结果
+ * @return int 成功为0，格式错误为-1
+ */
+int busy_poll_parse(const char *spec, busy_poll_config_t *config) {
+    config->cpu = -1;
+    config->budget = BUSY_POLL_DEFAULT_BUDGET;
+    config->spin_us = 100;
+    config->sleep_us = 10000;
+    config->nap_us = 50;
+    config->block_us = 10000;
+
+    char copy[256];
+    if (strlen(spec) >= sizeof(copy))
+        return -1;
+    strcpy(copy, spec);
+    for (char *save, *item = strtok_r(copy, ",", &save); item; item = strtok_r(NULL, ",", &save)) {
+        char *value = strchr(item, '=');
+        if (!value)
+            return -1;
+        *value++ = '\0';
+        int ret = 0;
+        char *end;
+        if (strcmp(item, "cpu") == 0) {
+            config->cpu = strtol(value, &end, 10);
+            ret = *end ? -1 : 0;
+        } else if (strcmp(item, "budget") == 0) {
+            config->budget = strtoul(value, &end, 10);
+            ret = *end || !config->budget ? -1 : 0;
+        } else if (strcmp(item, "spin") == 0)
+            ret = parse_time_us(value, &config->spin_us);
+        else if (strcmp(item, "sleep") == 0)
+            ret = parse_time_us(value, &config->sleep_us);
+        else if (strcmp(item, "nap") == 0)
+            ret = parse_time_us(value, &config->nap_us);
+        else if (strcmp(item, "block") == 0)
+            ret = parse_time_us(value, &config->block_us);
+        else
+            ret = -1;
+        if (ret != 0)
+            return -1;
+    }
+    return config->sleep_us < config->spin_us ? -1 : 0;
+}
+
+/**
+ * @brief 设置当前线程的忙轮询参数，并按参数绑定CPU
+ *
+ * @param config 参数，NULL 时取环境变量 NET_BUSY_POLL，未设置时取默认值
+ * @return int 成功为0，参数无效或绑定CPU失败为-1
+ */
+int busy_poll_configure(const busy_poll_config_t *config) {
+    busy_poll_config_t parsed;
+    if (!config) {
+        const char *spec = getenv("NET_BUSY_POLL");
+        if (busy_poll_parse(spec ? spec : "", &parsed) < 0) {
+            fprintf(stderr, "invalid NET_BUSY_POLL: %s\n", spec);
+            return -1;
+        }
+        config = &parsed;
+    }
+    if (!config->budget)
+        return -1;
+    if (config->cpu >= 0) {
+#if defined(__linux__)
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(config->cpu, &set);
+        if (sched_setaffinity(0, sizeof(set), &set) < 0) {
+            fprintf(stderr, "Error in busy_poll_configure: cannot pin to cpu %d.\n", config->cpu);
+            return -1;
+        }
+#elif defined(_WIN32)
+        if (!SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << config->cpu)) {
+            fprintf(stderr, "Error in busy_poll_configure: cannot pin to cpu %d.\n", config->cpu);
+            return -1;
+        }
+#else
+        fprintf(stderr, "Error in busy_poll_configure: cpu pinning not supported.\n");
+        return -1;
+#endif
+    }
+    busy_config = *config;
+    busy_configured = 1;
+    memset(&busy_stats, 0, sizeof(busy_stats));
+    busy_last_active_ns = busy_clock_ns();
+    busy_last_sent = driver_sent();
+    return 0;
+}
+
+/**
+ * @brief 一次忙轮询，代替主循环中的 net_poll
+ *
+ * @return int 本次处理的数据包数
+ */
+int busy_poll() {
+    if (!busy_configured && busy_poll_configure(NULL) < 0) {
+        busy_poll_config_t config;  // 环境变量无效时使用默认参数
+        busy_poll_parse("", &config);
+        busy_poll_configure(&config);
+    }
+    uint64_t start = busy_clock_ns();
+    int packets = 0;
+    for (uint32_t i = 0; i < busy_config.budget; i++) {
+        int n = net_poll();
+        busy_stats.polls++;
+        if (!n)
+            break;
+        packets += n;
+    }
+    uint64_t now = busy_clock_ns();
+    // 应用在两次轮询之间发送的数据包同样视为有流量
+    uint64_t sent = driver_sent();
+    if (packets || sent != busy_last_sent) {
+        busy_last_sent = sent;
+        busy_last_active_ns = now;
+        busy_stats.packets += packets;
+        busy_stats.busy_ns += now - start;
+        return packets;
+    }
+
+    uint64_t idle_us = (now - busy_last_active_ns) / 1000;
+    uint64_t *phase;
+    if (idle_us < busy_config.spin_us) {
+        for (int i = 0; i < BUSY_POLL_PAUSES; i++)
+            busy_pause();
+        phase = &busy_stats.spin_ns;
+    } else if (idle_us < busy_config.sleep_us) {
+        busy_sleep_us(busy_config.nap_us);
+        phase = &busy_stats.sleep_ns;
+    } else {
+        busy_block_us(busy_config.block_us);
+        phase = &busy_stats.block_ns;
+    }
+    *phase += busy_clock_ns() - start;
+    return 0;
+}
+
+/**
+ * @brief 当前线程的忙轮询统计
+ *
+ */
+const busy_poll_stats_t *busy_poll_get_stats() {
+    return &busy_stats;
+}
@@ -1,87 +1,117 @@
+/**
+ * @file driver.c
+ * @brief 驱动注册与选择
+ *
+ * 链接进程序的驱动（pcap、pcap-file、xdp 等）在启动时注册到驱动表，协议栈经 driver_open /
+ * driver_recv / driver_send / driver_close 调用当前选用的驱动。driver_open 按以下顺序确定候选：
+ *   - driver_select 设置的名称列表；
+ *   - 环境变量 NET_DRIVER；
+ *   - 以上均未设置时，rank 大于0的驱动按 rank 从高到低。
+ * 名称列表以逗号分隔，如 "xdp,pcap"，依次尝试直到有一个打开成功，可在不重新编译的情况下
+ * 优先使用本机可用的最快驱动。选用的驱动为线程局部状态，与协议栈状态一致。
+ */
+
 #include "driver.h"
 
-#include <pcap.h>
+#include <stdlib.h>
+
+static const driver_ops_t *driver_table[DRIVER_MAX_BACKENDS];  // 已注册的驱动，按 rank 从高到低
+static size_t driver_count;
+static _Thread_local const driver_ops_t *driver_ops;   // 当前选用的驱动
+static _Thread_local char driver_names[DRIVER_NAMES_LEN];  // driver_select 设置的名称列表
+static _Thread_local uint64_t driver_tx;                   // 已成功发送的帧数
 
-#ifdef _WIN32
-#include <tchar.h>
 /**
- * @brief npcp官方提供的加载npcap的dll库函数
+ * @brief 注册一个驱动，由 DRIVER_REGISTER 在启动时调用
  *
- * @return BOOL 是否成功
+ * @param ops 驱动的操作表
  */
-BOOL LoadNpcapDlls() {
-    _TCHAR npcap_dir[512];
-    UINT len;
-    len = GetSystemDirectory(npcap_dir, 480);
-    if (!len) {
-        fprintf(stderr, "Error in GetSystemDirectory: %lx", GetLastError());
-        return FALSE;
-    }
-    _tcscat_s(npcap_dir, 512, _T("\\Npcap"));
-    if (SetDllDirectory(npcap_dir) == 0) {
-        fprintf(stderr, "Error in SetDllDirectory: %lx", GetLastError());
-        return FALSE;
+void driver_register(const driver_ops_t *ops) {
+    if (driver_count == DRIVER_MAX_BACKENDS) {
+        fprintf(stderr, "Error in driver_register: too many drivers, %s ignored.\n", ops->name);
+        return;
     }
-    return TRUE;
+    size_t i = driver_count++;
+    for (; i > 0 && driver_table[i - 1]->rank < ops->rank; i--)
+        driver_table[i] = driver_table[i - 1];
+    driver_table[i] = ops;
 }
-#endif
-
-pcap_t *pcap;
-char pcap_errbuf[PCAP_ERRBUF_SIZE];
 
 /**
- * @brief 根据ip进行前缀匹配，选取最长前缀匹配的网卡
+ * @brief 按名称查找驱动
  *
- * @param ip ip地址
- * @param if_name 出口参数，选取的网卡名
- * @param mask 出口参数，该网卡的掩码
- * @return int 成功为0，失败为-1
+ * @param name 驱动名称
+ * @param len 名称长度
+ * @return const driver_ops_t* 未找到为NULL
  */
-int driver_find(uint8_t *ip, char *if_name, uint8_t *mask) {
-    pcap_if_t *alldevs;
-    pcap_if_t *d;
-    pcap_addr_t *a;
-    size_t i;
-    uint8_t match[PCAP_BUF_SIZE] = {0};
-    size_t if_num = 0;
-    uint32_t mask_all = PCAP_NETMASK_UNKNOWN;
-    if (pcap_findalldevs(&alldevs, pcap_errbuf) == -1) {
-        fprintf(stderr, "Error in pcap_findalldevs: %s\n", pcap_errbuf);
-        return -1;
-    }
+static const driver_ops_t *driver_lookup(const char *name, size_t len) {
+    for (size_t i = 0; i < driver_count; i++)
+        if (strlen(driver_table[i]->name) == len && !strncmp(driver_table[i]->name, name, len))
+            return driver_table[i];
+    return NULL;
+}
 
-    for (d = alldevs; d; d = d->next, if_num++)
-        for (a = d->addresses; a; a = a->next)
-            if (a->addr && a->addr->sa_family == AF_INET) {
-                match[if_num] = ip_prefix_match(ip, (uint8_t *)&((struct sockaddr_in *)a->addr)->sin_addr.s_addr);
-                if (match[if_num] < ip_prefix_match((uint8_t *)&mask_all, (uint8_t *)&((struct sockaddr_in *)(a->netmask))->sin_addr.s_addr))
-                    match[if_num] = 0;
-            }
-    if (if_num == 0) {
-        fprintf(stderr, "Error, no interface found.\n");
-        return -1;
+/**
+ * @brief 设置 driver_open 依次尝试的驱动，须在 net_init 之前调用
+ *
+ * @param names 逗号分隔的驱动名称列表，NULL 恢复默认
+ * @return int 成功为0，列表过长或含未注册的名称为-1
+ */
+int driver_select(const char *names) {
+    if (!names) {
+        driver_names[0] = '\0';
+        return 0;
     }
-    uint8_t max_match = 0;
-    size_t max_if = 0;
-    for (i = 0; i < if_num; i++)
-        if (match[i] > max_match)
-            max_if = i, max_match = match[i];
-    if (max_match == 0) {
-        fprintf(stderr, "Error, no interface found.\n");
+    if (strlen(names) >= DRIVER_NAMES_LEN)
         return -1;
+    for (const char *p = names; *p;) {
+        size_t len = strcspn(p, ",");
+        if (!driver_lookup(p, len)) {
+            fprintf(stderr, "Error in driver_select: unknown driver %.*s.\n", (int)len, p);
+            return -1;
+        }
+        p += len + (p[len] == ',');
     }
+    strcpy(driver_names, names);
+    return 0;
+}
+
+/**
+ * @brief 当前选用的驱动
+ *
+ * @return const driver_ops_t* 未打开时为NULL
+ */
+const driver_ops_t *driver_current() {
+    return driver_ops;
+}
 
-    for (d = alldevs, i = 0; i < max_if; d = d->next, i++)
-        ;
-    if (max_match == 32) {
-        fprintf(stderr, "Error, interface %s have the same ip %s with me.\n", d->name, iptos(net_if_ip));
+/**
+ * @brief 当前驱动可 select / poll 的文件描述符
+ *
+ * @return int 文件描述符，驱动未声明 DRIVER_CAP_SELECT_FD 时为-1
+ */
+int driver_fd() {
+    if (!driver_ops || !(driver_ops->caps & DRIVER_CAP_SELECT_FD) || !driver_ops->fd)
         return -1;
-    }
-    for (a = d->addresses; a; a = a->next)
-        if (a->addr && a->addr->sa_family == AF_INET)
-            *(uint32_t *)mask = ((struct sockaddr_in *)(a->netmask))->sin_addr.s_addr;
+    return driver_ops->fd();
+}
+
+/**
+ * @brief 当前线程经驱动成功发送的帧数，用于判断协议栈是否空闲
+ *
+ */
+uint64_t driver_sent() {
+    return driver_tx;
+}
 
-    strcpy(if_name, d->name);
+/**
+ * @brief 尝试打开一个驱动
+ *
+ */
+static int driver_try(const driver_ops_t *ops) {
+    if (ops->open() < 0)
+        return -1;
+    driver_ops = ops;
     return 0;
 }
 
@@ -91,59 +121,26 @@ int driver_find(uint8_t *ip, char *if_name, uint8_t *mask) {
  * @return int 成功为0，失败为-1
  */
 int driver_open() {
-#ifdef _WIN32
-    /* Load Npcap and its functions. */
-    if (!LoadNpcapDlls()) {
-        fprintf(stderr, "Couldn't load Npcap\n");
-        return -1;
-    }
-#endif
-
-    char if_name[PCAP_BUF_SIZE];
-    uint32_t mask;
-    if (driver_find(net_if_ip, if_name, (uint8_t *)&mask) < 0) {
-        fprintf(stderr, "Error in driver find.\n");
-        return -1;
-    }
-    printf("Using interface %s, my ip is %s.\n", if_name, iptos(net_if_ip));
-
-    if ((pcap = pcap_open_live(if_name, 65536, 1, 10, pcap_errbuf)) == NULL)  // 混杂模式打开网卡
-    {
-        fprintf(stderr, "Error in pcap_open_live.\n%s.\n", pcap_errbuf);
-        return -1;
-    }
-    if (pcap_setnonblock(pcap, 1, pcap_errbuf) < 0)  // 设置非阻塞模式
-    {
-        fprintf(stderr, "Error in pcap_setnonblock. %s.\n", pcap_errbuf);
-        return -1;
-    }
-    char filter_exp[PCAP_BUF_SIZE];
-    struct bpf_program fp;
-    uint8_t mac_addr[6] = NET_IF_MAC;
-    sprintf(filter_exp,  // 过滤数据包
-            "(ether dst %02x:%02x:%02x:%02x:%02x:%02x or ether broadcast) and (not ether src %02x:%02x:%02x:%02x:%02x:%02x)",
-            mac_addr[0],
-            mac_addr[1],
-            mac_addr[2],
-            mac_addr[3],
-            mac_addr[4],
-            mac_addr[5],
-            mac_addr[0],
-            mac_addr[1],
-            mac_addr[2],
-            mac_addr[3],
-            mac_addr[4],
-            mac_addr[5]);
-    if (pcap_compile(pcap, &fp, filter_exp, 0, mask) < 0) {
-        fprintf(stderr, "Error in pcap_compile.\n%s.\n", pcap_geterr(pcap));
-        return -1;
-    }
-    if (pcap_setfilter(pcap, &fp) < 0) {
-        fprintf(stderr, "Error in pcap_setfilter.\n%s.\n", pcap_geterr(pcap));
-        return -1;
+    const char *names = driver_names[0] ? driver_names : getenv("NET_DRIVER");
+    if (names && *names) {
+        for (const char *p = names; *p;) {
+            size_t len = strcspn(p, ",");
+            const driver_ops_t *ops = driver_lookup(p, len);
+            if (!ops)
+                fprintf(stderr, "Error in driver_open: unknown driver %.*s.\n", (int)len, p);
+            else if (driver_try(ops) == 0)
+                return 0;
+            p += len + (p[len] == ',');
+        }
+    } else {
+        for (size_t i = 0; i < driver_count && driver_table[i]->rank > 0; i++)
+            if (driver_try(driver_table[i]) == 0)
+                return 0;
     }
-    return 0;
+    fprintf(stderr, "Error in driver_open: no driver available.\n");
+    return -1;
 }
+
 /**
  * @brief 试图从网卡接收数据包
  *
@@ -151,19 +148,9 @@ int driver_open() {
  * @return int 数据包的长度，未收到为0，错误为-1
  */
 int driver_recv(buf_t *buf) {
-    struct pcap_pkthdr *pkt_hdr;
-    const uint8_t *pkt_data;
-    int ret = pcap_next_ex(pcap, &pkt_hdr, &pkt_data);
-    if (ret == 0)
-        return 0;
-    else if (ret == 1) {
-        memcpy(buf->data, pkt_data, pkt_hdr->len);
-        buf->len = pkt_hdr->len;
-        return pkt_hdr->len;
-    }
-    fprintf(stderr, "Error in driver_recv.\n%s.\n", pcap_geterr(pcap));
-    return -1;
+    return driver_ops ? driver_ops->recv(buf) : -1;
 }
+
 /**
  * @brief 使用网卡发送一个数据包
  *
@@ -171,17 +158,18 @@ int driver_recv(buf_t *buf) {
  * @return int 成功为0，失败为-1
  */
 int driver_send(buf_t *buf) {
-    if (pcap_sendpacket(pcap, buf->data, buf->len) == -1) {
-        fprintf(stderr, "Error in driver_send.\n%s.\n", pcap_geterr(pcap));
+    if (!driver_ops || driver_ops->send(buf) < 0)
         return -1;
-    }
-
+    driver_tx++;
     return 0;
 }
+
 /**
  * @brief 关闭网卡
  *
  */
 void driver_close() {
-    pcap_close(pcap);
+    if (driver_ops)
+        driver_ops->close();
+    driver_ops = NULL;
 }
@@ -0,0 +1,123 @@
+/**
+ * @file driver_file.c
+ * @brief pcap-file 驱动，从 pcap 文件读入数据包，发送的数据包写入另一个 pcap 文件
+ *
+ * 输入文件由环境变量 NET_PCAP_IN 指定，读完后不再收到数据包；输出文件由 NET_PCAP_OUT 指定，
+ * 未设置时丢弃发送的数据包。不需要网卡与管理员权限，可离线复现抓到的流量。
+ */
+
+#include "driver.h"
+
+#include <pcap.h>
+#include <stdlib.h>
+
+#ifdef _WIN32
+BOOL LoadNpcapDlls();
+#endif
+
+static pcap_t *file_in;
+static pcap_t *file_dead;  // 输出文件没有对应的输入时用于创建 dumper
+static pcap_dumper_t *file_out;
+static char file_errbuf[PCAP_ERRBUF_SIZE];
+
+static void file_driver_close();
+
+/**
+ * @brief 打开输入与输出文件
+ *
+ * @return int 成功为0，失败为-1
+ */
+static int file_driver_open() {
+    const char *in = getenv("NET_PCAP_IN");
+    const char *out = getenv("NET_PCAP_OUT");
+    if (!in) {
+        fprintf(stderr, "Error in pcap-file driver: NET_PCAP_IN not set.\n");
+        return -1;
+    }
+#ifdef _WIN32
+    if (!LoadNpcapDlls()) {
+        fprintf(stderr, "Couldn't load Npcap\n");
+        return -1;
+    }
+#endif
+    if ((file_in = pcap_open_offline(in, file_errbuf)) == NULL) {
+        fprintf(stderr, "Error in pcap_open_offline.\n%s.\n", file_errbuf);
+        return -1;
+    }
+    if (out) {
+        file_dead = pcap_open_dead(DLT_EN10MB, 65536);
+        if (file_dead == NULL || (file_out = pcap_dump_open(file_dead, out)) == NULL) {
+            fprintf(stderr, "Error in pcap_dump_open: %s.\n", out);
+            file_driver_close();
+            return -1;
+        }
+    }
+    printf("Reading %s, writing %s, my ip is %s.\n", in, out ? out : "nothing", iptos(net_if_ip));
+    return 0;
+}
+
+/**
+ * @brief 读入下一个数据包
+ *
+ * @param buf 读入的数据包
+ * @return int 数据包的长度，文件已读完为0，错误为-1
+ */
+static int file_driver_recv(buf_t *buf) {
+    struct pcap_pkthdr *pkt_hdr;
+    const uint8_t *pkt_data;
+    int ret = pcap_next_ex(file_in, &pkt_hdr, &pkt_data);
+    if (ret == PCAP_ERROR_BREAK)
+        return 0;
+    if (ret != 1) {
+        fprintf(stderr, "Error in driver_recv: %s\n", pcap_geterr(file_in));
+        return -1;
+    }
+    if (buf_init(buf, pkt_hdr->caplen) < 0)
+        return 0;  // 超出buffer容量的数据包丢弃
+    memcpy(buf->data, pkt_data, pkt_hdr->caplen);
+    return pkt_hdr->caplen;
+}
+
+/**
+ * @brief 把发送的数据包写入输出文件，时间戳为当前时间
+ *
+ * @param buf 要发送的数据包
+ * @return int 成功为0
+ */
+static int file_driver_send(buf_t *buf) {
+    if (!file_out)
+        return 0;
+    uint64_t now = net_now_us();
+    struct pcap_pkthdr header;
+    header.ts.tv_sec = now / 1000000;
+    header.ts.tv_usec = now % 1000000;
+    header.caplen = buf->len;
+    header.len = buf->len;
+    pcap_dump((u_char *)file_out, &header, buf->data);
+    return 0;
+}
+
+/**
+ * @brief 关闭输入与输出文件
+ *
+ */
+static void file_driver_close() {
+    if (file_out)
+        pcap_dump_close(file_out);
+    if (file_dead)
+        pcap_close(file_dead);
+    if (file_in)
+        pcap_close(file_in);
+    file_out = NULL;
+    file_dead = NULL;
+    file_in = NULL;
+}
+
+static const driver_ops_t file_driver = {
+    .name = "pcap-file",
+    .open = file_driver_open,
+    .recv = file_driver_recv,
+    .send = file_driver_send,
+    .close = file_driver_close,
+};
+DRIVER_REGISTER(file_driver)
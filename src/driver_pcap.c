@@ -0,0 +1,344 @@
+/**
+ * @file driver_pcap.c
+ * @brief pcap 驱动，经 libpcap 在网卡上收发
+ *
+ * 以混杂模式打开与本机ip最长前缀匹配的网卡，并按协议栈状态生成内核过滤规则。
+ */
+
+#include "driver.h"
+
+#include "ipv6.h"
+
+#include <pcap.h>
+#include <stdarg.h>
+
+#ifdef _WIN32
+#include <tchar.h>
+/**
+ * @brief npcp官方提供的加载npcap的dll库函数
+ *
+ * @return BOOL 是否成功
+ */
+BOOL LoadNpcapDlls() {
+    _TCHAR npcap_dir[512];
+    UINT len;
+    len = GetSystemDirectory(npcap_dir, 480);
+    if (!len) {
+        fprintf(stderr, "Error in GetSystemDirectory: %lx", GetLastError());
+        return FALSE;
+    }
+    _tcscat_s(npcap_dir, 512, _T("\\Npcap"));
+    if (SetDllDirectory(npcap_dir) == 0) {
+        fprintf(stderr, "Error in SetDllDirectory: %lx", GetLastError());
+        return FALSE;
+    }
+    return TRUE;
+}
+#endif
+
+static pcap_t *pcap;
+static char pcap_errbuf[PCAP_ERRBUF_SIZE];
+static uint32_t driver_mask;  // 网卡掩码，编译过滤规则时使用
+
+#define DRIVER_FILTER_LEN 8192       // 过滤规则表达式的最大长度
+#define DRIVER_FILTER_MAX_PORTS 128  // 逐个列出的端口数上限，超出时放行整个协议
+
+static char *filter_pos, *filter_end;  // 表达式的写入位置与末尾
+static char filter_installed[DRIVER_FILTER_LEN];  // 已安装的表达式，相同时不重新编译
+static int filter_dirty;                          // 端口集合已变化，尚未重新生成过滤规则
+
+/**
+ * @brief 向过滤规则表达式追加内容，超出长度时截断，由 driver_set_filter 检查
+ *
+ */
+static void filter_append(const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(filter_pos, filter_end - filter_pos, fmt, args);
+    va_end(args);
+    filter_pos = n < filter_end - filter_pos ? filter_pos + n : filter_end;
+}
+
+#if defined(UDP) || defined(TCP)
+extern _Thread_local map_t udp_table;
+extern _Thread_local map_t tcp_handler_table;
+
+static size_t filter_ports;       // 当前协议已列出的端口数
+static const char *filter_proto;  // 当前列出端口的协议
+
+static void filter_port_fn(void *key, void *value, time_t *timestamp) {
+    if (filter_ports++ < DRIVER_FILTER_MAX_PORTS)
+        filter_append(" or %s dst port %u", filter_proto, *(uint16_t *)key);
+}
+
+/**
+ * @brief 追加一个传输层协议已打开端口的条件
+ *
+ * @param proto 协议名，udp 或 tcp
+ * @param table 端口号为键的处理程序表
+ */
+static void filter_append_ports(const char *proto, map_t *table) {
+    filter_proto = proto;
+    filter_ports = 0;
+    char *start = filter_pos;
+    map_foreach(table, filter_port_fn);
+    if (filter_ports > DRIVER_FILTER_MAX_PORTS) {
+        filter_pos = start;
+        *filter_pos = '\0';
+        filter_append(" or %s", proto);  // 端口太多，规则过长，放行整个协议由协议栈过滤
+    }
+}
+#endif
+
+/**
+ * @brief 根据协议栈状态生成并安装内核过滤规则
+ *
+ * 只放行发给本机的帧：目标为本机ip的arp，目标为本机ip、且为ICMP、非首个分片或发往已打开的
+ * UDP/TCP端口的IPv4数据包，以及发往本机IPv6地址、所有节点组播与被请求节点组播地址的IPv6数据包。
+ * 其他主机的arp、广播与发往未打开端口的数据包不会被复制到用户态，也不会触发端口不可达。
+ * 表达式与已安装的相同时不重新编译与安装。
+ *
+ * @return int 成功为0，失败为-1
+ */
+static int driver_set_filter() {
+    static char filter_exp[DRIVER_FILTER_LEN];
+    filter_pos = filter_exp;
+    filter_end = filter_exp + DRIVER_FILTER_LEN;
+    const uint8_t *mac = net_if_mac;
+    const uint8_t *ip = net_if_ip;
+    filter_append("(ether dst %02x:%02x:%02x:%02x:%02x:%02x or ether broadcast",
+                  mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+#ifdef IPV6
+    filter_append(" or ether multicast");
+#endif
+    filter_append(") and not ether src %02x:%02x:%02x:%02x:%02x:%02x and (",
+                  mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+    filter_append("(arp and arp dst host %u.%u.%u.%u)", ip[0], ip[1], ip[2], ip[3]);
+    filter_append(" or (ip dst host %u.%u.%u.%u and (ip[6:2] & 0x1fff != 0", ip[0], ip[1], ip[2], ip[3]);
+#ifdef ICMP
+    filter_append(" or icmp");
+#endif
+#ifdef UDP
+    filter_append_ports("udp", &udp_table);
+#endif
+#ifdef TCP
+    filter_append_ports("tcp", &tcp_handler_table);
+#endif
+    filter_append("))");
+#ifdef IPV6
+    const uint8_t *ip6 = net_if_ipv6;
+    filter_append(" or (ip6 and (ip6 dst host %s or ip6 dst host ff02::1", ipv6_to_str(ip6));
+    filter_append(" or ip6 dst host ff02::1:ff%02x:%02x%02x))", ip6[13], ip6[14], ip6[15]);
+#endif
+    filter_append(")");
+    if (filter_pos == filter_end) {
+        fprintf(stderr, "Error in driver_set_filter: filter too long.\n");
+        return -1;
+    }
+    if (strcmp(filter_exp, filter_installed) == 0)
+        return 0;
+
+    struct bpf_program fp;
+    if (pcap_compile(pcap, &fp, filter_exp, 1, driver_mask) < 0) {
+        fprintf(stderr, "Error in pcap_compile.\n%s.\n", pcap_geterr(pcap));
+        return -1;
+    }
+    int ret = pcap_setfilter(pcap, &fp);
+    pcap_freecode(&fp);
+    if (ret < 0) {
+        fprintf(stderr, "Error in pcap_setfilter.\n%s.\n", pcap_geterr(pcap));
+        return -1;
+    }
+    strcpy(filter_installed, filter_exp);
+    return 0;
+}
+
+/**
+ * @brief 端口集合变化时标记过滤规则待更新
+ *
+ * 一次处理中可能连续打开或关闭多个端口（如 FTP 被动模式），规则在下一次收发时才重新生成，
+ * 编译与安装因此每次收发至多一次。发送前更新保证对端得知新端口（如 PASV 的回复）时规则已生效。
+ */
+static void driver_refresh_filter() {
+    filter_dirty = 1;
+}
+
+/**
+ * @brief 安装待更新的过滤规则
+ *
+ */
+static inline void driver_apply_filter() {
+    if (filter_dirty) {
+        filter_dirty = 0;
+        driver_set_filter();
+    }
+}
+
+/**
+ * @brief 根据ip进行前缀匹配，选取最长前缀匹配的网卡
+ *
+ * @param ip ip地址
+ * @param if_name 出口参数，选取的网卡名
+ * @param mask 出口参数，该网卡的掩码
+ * @return int 成功为0，失败为-1
+ */
+static int driver_find(uint8_t *ip, char *if_name, uint8_t *mask) {
+    pcap_if_t *alldevs;
+    pcap_if_t *d;
+    pcap_addr_t *a;
+    size_t i;
+    uint8_t match[PCAP_BUF_SIZE] = {0};
+    size_t if_num = 0;
+    uint32_t mask_all = PCAP_NETMASK_UNKNOWN;
+    if (pcap_findalldevs(&alldevs, pcap_errbuf) == -1) {
+        fprintf(stderr, "Error in pcap_findalldevs: %s\n", pcap_errbuf);
+        return -1;
+    }
+
+    for (d = alldevs; d; d = d->next, if_num++)
+        for (a = d->addresses; a; a = a->next)
+            if (a->addr && a->addr->sa_family == AF_INET) {
+                match[if_num] = ip_prefix_match(ip, (uint8_t *)&((struct sockaddr_in *)a->addr)->sin_addr.s_addr);
+                if (match[if_num] < ip_prefix_match((uint8_t *)&mask_all, (uint8_t *)&((struct sockaddr_in *)(a->netmask))->sin_addr.s_addr))
+                    match[if_num] = 0;
+            }
+    if (if_num == 0) {
+        fprintf(stderr, "Error, no interface found.\n");
+        return -1;
+    }
+    uint8_t max_match = 0;
+    size_t max_if = 0;
+    for (i = 0; i < if_num; i++)
+        if (match[i] > max_match)
+            max_if = i, max_match = match[i];
+    if (max_match == 0) {
+        fprintf(stderr, "Error, no interface found.\n");
+        return -1;
+    }
+
+    for (d = alldevs, i = 0; i < max_if; d = d->next, i++)
+        ;
+    if (max_match == 32) {
+        fprintf(stderr, "Error, interface %s have the same ip %s with me.\n", d->name, iptos(net_if_ip));
+        return -1;
+    }
+    for (a = d->addresses; a; a = a->next)
+        if (a->addr && a->addr->sa_family == AF_INET)
+            *(uint32_t *)mask = ((struct sockaddr_in *)(a->netmask))->sin_addr.s_addr;
+
+    strcpy(if_name, d->name);
+    return 0;
+}
+
+/**
+ * @brief 打开网卡
+ *
+ * @return int 成功为0，失败为-1
+ */
+static int pcap_driver_open() {
+#ifdef _WIN32
+    /* Load Npcap and its functions. */
+    if (!LoadNpcapDlls()) {
+        fprintf(stderr, "Couldn't load Npcap\n");
+        return -1;
+    }
+#endif
+
+    char if_name[PCAP_BUF_SIZE];
+    uint32_t mask;
+    if (driver_find(net_if_ip, if_name, (uint8_t *)&mask) < 0) {
+        fprintf(stderr, "Error in driver find.\n");
+        return -1;
+    }
+    printf("Using interface %s, my ip is %s.\n", if_name, iptos(net_if_ip));
+
+    if ((pcap = pcap_open_live(if_name, 65536, 1, 10, pcap_errbuf)) == NULL)  // 混杂模式打开网卡
+    {
+        fprintf(stderr, "Error in pcap_open_live.\n%s.\n", pcap_errbuf);
+        return -1;
+    }
+    if (pcap_setnonblock(pcap, 1, pcap_errbuf) < 0)  // 设置非阻塞模式
+    {
+        fprintf(stderr, "Error in pcap_setnonblock. %s.\n", pcap_errbuf);
+        return -1;
+    }
+    driver_mask = mask;
+    filter_installed[0] = '\0';  // 新打开的网卡尚未安装规则
+    filter_dirty = 0;
+    if (driver_set_filter() < 0)
+        return -1;
+    net_set_port_hook(driver_refresh_filter);
+    return 0;
+}
+/**
+ * @brief 试图从网卡接收数据包
+ *
+ * @param buf 收到的数据包
+ * @return int 数据包的长度，未收到为0，错误为-1
+ */
+static int pcap_driver_recv(buf_t *buf) {
+    struct pcap_pkthdr *pkt_hdr;
+    const uint8_t *pkt_data;
+    driver_apply_filter();
+    int ret = pcap_next_ex(pcap, &pkt_hdr, &pkt_data);
+    if (ret == 0)
+        return 0;
+    else if (ret == 1) {
+        memcpy(buf->data, pkt_data, pkt_hdr->len);
+        buf->len = pkt_hdr->len;
+        return pkt_hdr->len;
+    }
+    fprintf(stderr, "Error in driver_recv.\n%s.\n", pcap_geterr(pcap));
+    return -1;
+}
+/**
+ * @brief 使用网卡发送一个数据包
+ *
+ * @param buf 要发送的数据包
+ * @return int 成功为0，失败为-1
+ */
+static int pcap_driver_send(buf_t *buf) {
+    driver_apply_filter();
+    if (pcap_sendpacket(pcap, buf->data, buf->len) == -1) {
+        fprintf(stderr, "Error in driver_send.\n%s.\n", pcap_geterr(pcap));
+        return -1;
+    }
+
+    return 0;
+}
+/**
+ * @brief 关闭网卡
+ *
+ */
+static void pcap_driver_close() {
+    net_set_port_hook(NULL);
+    pcap_close(pcap);
+    pcap = NULL;
+}
+
+/**
+ * @brief 可用于 select / poll 的文件描述符
+ *
+ * @return int 文件描述符，不支持时为-1
+ */
+static int pcap_driver_fd() {
+#ifdef _WIN32
+    return -1;
+#else
+    return pcap ? pcap_get_selectable_fd(pcap) : -1;
+#endif
+}
+
+static const driver_ops_t pcap_driver = {
+    .name = "pcap",
+#ifndef _WIN32
+    .caps = DRIVER_CAP_SELECT_FD,
+#endif
+    .rank = 10,
+    .open = pcap_driver_open,
+    .recv = pcap_driver_recv,
+    .send = pcap_driver_send,
+    .close = pcap_driver_close,
+    .fd = pcap_driver_fd,
+};
+DRIVER_REGISTER(pcap_driver)
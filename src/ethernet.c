@@ -4,6 +4,12 @@
 #include "driver.h"
 #include "ip.h"
 #include "utils.h"
+#ifdef IMPAIR
+#include "impair.h"
+#endif
+#ifdef QOS
+#include "qos.h"
+#endif
 /**
  * @brief 处理一个收到的数据包
  *
@@ -48,7 +54,13 @@ void ethernet_out(buf_t *buf, const uint8_t *mac, net_protocol_t protocol) {
     memcpy(hdr->dst, mac, NET_MAC_LEN);
     memcpy(hdr->src, net_if_mac, NET_MAC_LEN);
     hdr->protocol16 = swap16((uint16_t)protocol);
+#if defined(QOS)
+    qos_send(buf);
+#elif defined(IMPAIR)
+    impair_send(buf);
+#else
     driver_send(buf);
+#endif
 }
 /**
  * @brief 初始化以太网协议
@@ -61,8 +73,19 @@ void ethernet_init() {
 /**
  * @brief 一次以太网轮询
  *
+ * @return int 收到并处理了一帧为1，否则为0
  */
-void ethernet_poll() {
-    if (driver_recv(&rxbuf) > 0)
-        ethernet_in(&rxbuf);
+int ethernet_poll() {
+#ifdef QOS
+    qos_poll();
+#endif
+#ifdef IMPAIR
+    impair_poll();
+    if (impair_recv(&rxbuf) <= 0)
+#else
+    if (driver_recv(&rxbuf) <= 0)
+#endif
+        return 0;
+    ethernet_in(&rxbuf);
+    return 1;
 }
@@ -6,9 +6,9 @@
 #include <time.h>
 
 // Global variables for ping functionality
-static map_t icmp_ping_requests;     // Map to store pending ping requests
-static icmp_ping_stats_t icmp_stats; // Statistics for ping requests
-static uint16_t icmp_ping_id = 0;    // ID for ping requests
+static _Thread_local map_t icmp_ping_requests;     // Map to store pending ping requests
+static _Thread_local icmp_ping_stats_t icmp_stats; // Statistics for ping requests
+static _Thread_local uint16_t icmp_ping_id = 0;    // ID for ping requests
 
 /**
  * @brief 发送icmp响应
@@ -89,7 +89,7 @@ void icmp_in(buf_t *buf, uint8_t *src_ip) {
         icmp_ping_request_t *request = map_get(&icmp_ping_requests, &seq);
         if (request != NULL) {
             // Calculate response time
-            time_t now = time(NULL);
+            time_t now = net_time();
             long response_time = (now - request->timestamp) * 1000; // Convert to milliseconds
 
             // Print reply information in ping format
@@ -255,7 +255,7 @@ void icmp_ping_request(uint8_t *dest_ip) {
     icmp_ping_request_t request;
     request.id = icmp_ping_id;
     request.seq = icmp_stats.sent;
-    request.timestamp = time(NULL);
+    request.timestamp = net_time();
     memcpy(request.dest_ip, dest_ip, NET_IP_LEN);
 
     // Store in map using sequence number as key
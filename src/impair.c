@@ -0,0 +1,392 @@
+/**
+ * @file impair.c
+ * @brief 网络损伤层
+ *
+ * 以 IMPAIR 编译时，以太网层经由本层调用 driver_send / driver_recv，可对任意驱动的收发两个方向
+ * 分别施加丢包（Bernoulli 或 Gilbert-Elliott）、固定与抖动时延、乱序、重复、限速与比特损坏。
+ * 所有随机决策来自按方向播种的伪随机数，相同的种子与输入帧序列得到相同的决策。
+ *
+ * 被推迟的帧复制到固定大小的队列中，按到期时间与进入顺序出队：发送方向在 ethernet_poll 与每次发送时
+ * 把到期的帧交给 driver_send，接收方向先把驱动中已到达的帧全部取入队列，再交出一个到期的帧。
+ *
+ * 参数来自环境变量 NET_IMPAIR_TX / NET_IMPAIR_RX（见 impair_parse），也可由 impair_configure 设置。
+ */
+
+#ifdef IMPAIR
+#include "impair.h"
+
+#include "driver.h"
+
+#include <stdlib.h>
+
+#define IMPAIR_RECV_BURST 64  // 每次 impair_recv 最多从驱动取出的帧数
+
+/**
+ * @brief 队列中的一帧
+ *
+ */
+typedef struct impair_frame {
+    uint64_t due_us;  // 到期时间
+    uint64_t order;   // 进入顺序，到期时间相同时先进先出
+    size_t len;
+    uint8_t data[IMPAIR_FRAME_MAX];
+} impair_frame_t;
+
+/**
+ * @brief 一个方向的损伤状态
+ *
+ */
+typedef struct impair_link {
+    impair_config_t config;
+    int enabled;
+    uint64_t rng;                                // 伪随机数状态
+    int ge_bad;                                  // Gilbert-Elliott 当前是否处于坏状态
+    uint64_t link_free_us;                       // 限速时链路空闲的时刻
+    uint64_t order;
+    impair_frame_t frames[IMPAIR_QUEUE_LEN];
+    uint16_t heap[IMPAIR_QUEUE_LEN];             // 按 (due_us, order) 排列的最小堆，元素为 frames 下标
+    uint16_t free_list[IMPAIR_QUEUE_LEN];
+    size_t count;                                // 队列中的帧数
+    size_t free_count;
+    impair_stats_t stats;
+} impair_link_t;
+
+static _Thread_local impair_link_t impair_links[2];
+static _Thread_local buf_t impair_rxbuf;  // 从驱动接收的临时缓冲区
+
+/* =============================== TOOLS =============================== */
+
+static uint64_t impair_rand(impair_link_t *link) {
+    link->rng ^= link->rng >> 12;
+    link->rng ^= link->rng << 25;
+    link->rng ^= link->rng >> 27;
+    return link->rng * 0x2545F4914F6CDD1DULL;
+}
+
+/**
+ * @brief 以概率 p 返回1
+ */
+static int impair_chance(impair_link_t *link, double p) {
+    if (p <= 0)
+        return 0;
+    return (impair_rand(link) >> 11) * (1.0 / 9007199254740992.0) < p;
+}
+
+static inline int impair_before(impair_link_t *link, uint16_t a, uint16_t b) {
+    impair_frame_t *x = &link->frames[a], *y = &link->frames[b];
+    return x->due_us < y->due_us || (x->due_us == y->due_us && x->order < y->order);
+}
+
+static void impair_heap_push(impair_link_t *link, uint16_t index) {
+    size_t i = link->count++;
+    link->heap[i] = index;
+    while (i > 0 && impair_before(link, link->heap[i], link->heap[(i - 1) / 2])) {
+        uint16_t tmp = link->heap[i];
+        link->heap[i] = link->heap[(i - 1) / 2];
+        link->heap[(i - 1) / 2] = tmp;
+        i = (i - 1) / 2;
+    }
+}
+
+static uint16_t impair_heap_pop(impair_link_t *link) {
+    uint16_t top = link->heap[0];
+    link->heap[0] = link->heap[--link->count];
+    for (size_t i = 0;;) {
+        size_t min = i, l = 2 * i + 1, r = l + 1;
+        if (l < link->count && impair_before(link, link->heap[l], link->heap[min]))
+            min = l;
+        if (r < link->count && impair_before(link, link->heap[r], link->heap[min]))
+            min = r;
+        if (min == i)
+            break;
+        uint16_t tmp = link->heap[i];
+        link->heap[i] = link->heap[min];
+        link->heap[min] = tmp;
+        i = min;
+    }
+    return top;
+}
+
+/**
+ * @brief 按丢包模型判断本帧是否丢失
+ */
+static int impair_lost(impair_link_t *link) {
+    impair_config_t *config = &link->config;
+    if (config->ge_p <= 0)
+        return impair_chance(link, config->loss);
+    // 先按当前状态决定丢包，再转移状态
+    int lost = impair_chance(link, link->ge_bad ? config->ge_loss_bad : config->ge_loss_good);
+    if (link->ge_bad ? impair_chance(link, config->ge_r) : impair_chance(link, config->ge_p))
+        link->ge_bad = !link->ge_bad;
+    return lost;
+}
+
+/**
+ * @brief 把一帧（的一个副本）放入队列
+ */
+static void impair_enqueue(impair_link_t *link, const uint8_t *data, size_t len, uint64_t due_us, int corrupt) {
+    size_t limit = link->config.limit ? link->config.limit : IMPAIR_QUEUE_LEN;
+    if (link->count >= limit || link->free_count == 0) {
+        link->stats.overflow++;
+        return;
+    }
+    uint16_t index = link->free_list[--link->free_count];
+    impair_frame_t *frame = &link->frames[index];
+    frame->due_us = due_us;
+    frame->order = link->order++;
+    frame->len = len;
+    memcpy(frame->data, data, len);
+    if (corrupt && len > 14) {
+        size_t byte = 14 + impair_rand(link) % (len - 14);  // 保留以太网头部，使损坏的帧到达上层校验
+        frame->data[byte] ^= 1 << (impair_rand(link) % 8);
+        link->stats.corrupted++;
+    }
+    impair_heap_push(link, index);
+}
+
+/**
+ * @brief 对一帧施加损伤：决定丢弃、重复、损坏与到期时间
+ */
+static void impair_admit(impair_link_t *link, const uint8_t *data, size_t len, uint64_t now) {
+    impair_config_t *config = &link->config;
+    link->stats.frames++;
+    if (impair_lost(link)) {
+        link->stats.lost++;
+        return;
+    }
+
+    // 限速：帧在链路空闲后开始发送，占用 len * 8 / rate 的时间
+    uint64_t sent_us = now;
+    if (config->rate_bps) {
+        uint64_t start = link->link_free_us > now ? link->link_free_us : now;
+        sent_us = start + len * 8 * 1000000 / config->rate_bps;
+        link->link_free_us = sent_us;
+    }
+
+    int copies = impair_chance(link, config->duplicate) ? 2 : 1;
+    link->stats.duplicated += copies - 1;
+    for (int i = 0; i < copies; i++) {
+        int64_t delay = config->delay_us;
+        if (config->jitter_us)
+            delay += (int64_t)(impair_rand(link) % (2 * config->jitter_us + 1)) - (int64_t)config->jitter_us;
+        if (impair_chance(link, config->reorder)) {
+            delay += config->reorder_us;
+            link->stats.reordered++;
+        }
+        if (delay < 0)
+            delay = 0;
+        impair_enqueue(link, data, len, sent_us + delay, impair_chance(link, config->corrupt));
+    }
+}
+
+/**
+ * @brief 取出一个到期的帧，没有时返回NULL；返回的帧在下一次入队前有效
+ */
+static impair_frame_t *impair_dequeue(impair_link_t *link, uint64_t now) {
+    if (link->count == 0 || link->frames[link->heap[0]].due_us > now)
+        return NULL;
+    uint16_t index = impair_heap_pop(link);
+    link->free_list[link->free_count++] = index;
+    link->stats.delivered++;
+    return &link->frames[index];
+}
+
+static void impair_reset(impair_link_t *link) {
+    link->rng = link->config.seed ? link->config.seed : 0x9E3779B97F4A7C15ULL;
+    link->ge_bad = 0;
+    link->link_free_us = 0;
+    link->order = 0;
+    link->count = 0;
+    link->free_count = IMPAIR_QUEUE_LEN;
+    for (size_t i = 0; i < IMPAIR_QUEUE_LEN; i++)
+        link->free_list[i] = IMPAIR_QUEUE_LEN - 1 - i;
+    memset(&link->stats, 0, sizeof(link->stats));
+}
+
+/**
+ * @brief 解析比例，可带 % 后缀
+ */
+static int impair_parse_ratio(const char *value, double *ratio) {
+    char *end;
+    double number = strtod(value, &end);
+    if (strcmp(end, "%") == 0)
+        number /= 100;
+    else if (*end)
+        return -1;
+    if (number < 0 || number > 1)
+        return -1;
+    *ratio = number;
+    return 0;
+}
+
+/* =============================== API =============================== */
+
+/**
+ * @brief 解析损伤参数
+ *
+ * 形如 "loss=1%,delay=20ms,jitter=5ms,rate=10M"，可用的键：
+ * loss、ge_p、ge_r、ge_good、ge_bad、reorder、dup、corrupt（比例，可带 %），
+ * delay、jitter、reorder_delay（时间，可带 us/ms/s），rate（bit/s，可带 K/M/G），limit、seed。
+ *
+ * @param spec      参数字符串
+ * @param config    出口参数，解析得到的参数（未出现的键为0）
+ * @return int      成功为0，失败为-1
+ */
+int impair_parse(const char *spec, impair_config_t *config) {
+    memset(config, 0, sizeof(impair_config_t));
+    config->reorder_us = 1000;
+    config->ge_loss_bad = 1;
+
+    char copy[512];
+    if (strlen(spec) >= sizeof(copy))
+        return -1;
+    strcpy(copy, spec);
+    for (char *save, *item = strtok_r(copy, ",", &save); item; item = strtok_r(NULL, ",", &save)) {
+        char *value = strchr(item, '=');
+        if (!value)
+            return -1;
+        *value++ = '\0';
+        int ret = 0;
+        if (strcmp(item, "loss") == 0)
+            ret = impair_parse_ratio(value, &config->loss);
+        else if (strcmp(item, "ge_p") == 0)
+            ret = impair_parse_ratio(value, &config->ge_p);
+        else if (strcmp(item, "ge_r") == 0)
+            ret = impair_parse_ratio(value, &config->ge_r);
+        else if (strcmp(item, "ge_good") == 0)
+            ret = impair_parse_ratio(value, &config->ge_loss_good);
+        else if (strcmp(item, "ge_bad") == 0)
+            ret = impair_parse_ratio(value, &config->ge_loss_bad);
+        else if (strcmp(item, "reorder") == 0)
+            ret = impair_parse_ratio(value, &config->reorder);
+        else if (strcmp(item, "dup") == 0)
+            ret = impair_parse_ratio(value, &config->duplicate);
+        else if (strcmp(item, "corrupt") == 0)
+            ret = impair_parse_ratio(value, &config->corrupt);
+        else if (strcmp(item, "delay") == 0)
+            ret = parse_time_us(value, &config->delay_us);
+        else if (strcmp(item, "jitter") == 0)
+            ret = parse_time_us(value, &config->jitter_us);
+        else if (strcmp(item, "reorder_delay") == 0)
+            ret = parse_time_us(value, &config->reorder_us);
+        else if (strcmp(item, "rate") == 0)
+            ret = parse_rate_bps(value, &config->rate_bps);
+        else if (strcmp(item, "limit") == 0)
+            config->limit = strtoul(value, NULL, 10);
+        else if (strcmp(item, "seed") == 0)
+            config->seed = strtoull(value, NULL, 0);
+        else
+            ret = -1;
+        if (ret != 0)
+            return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief 设置一个方向的损伤参数并清空该方向的队列与统计
+ *
+ * @param dir       方向
+ * @param config    参数，NULL 为直通
+ * @return int      成功为0，参数非法为-1
+ */
+int impair_configure(impair_dir_t dir, const impair_config_t *config) {
+    impair_link_t *link = &impair_links[dir];
+    if (config && (config->limit > IMPAIR_QUEUE_LEN || (config->ge_p > 0 && config->ge_r <= 0)))
+        return -1;
+    if (config)
+        link->config = *config;
+    else
+        memset(&link->config, 0, sizeof(link->config));
+    impair_config_t *c = &link->config;
+    link->enabled = c->loss > 0 || c->ge_p > 0 || c->delay_us || c->jitter_us || c->reorder > 0 ||
+                    c->duplicate > 0 || c->corrupt > 0 || c->rate_bps;
+    impair_reset(link);
+    return 0;
+}
+
+/**
+ * @brief 获取一个方向的统计
+ */
+const impair_stats_t *impair_get_stats(impair_dir_t dir) {
+    return &impair_links[dir].stats;
+}
+
+/**
+ * @brief 发送一帧，经损伤后由 driver_send 发出
+ *
+ * @param buf   要发送的帧
+ * @return int  直通时为 driver_send 的返回值，否则为0
+ */
+int impair_send(buf_t *buf) {
+    impair_link_t *link = &impair_links[IMPAIR_TX];
+    if (!link->enabled || buf->len > IMPAIR_FRAME_MAX)
+        return driver_send(buf);
+    impair_admit(link, buf->data, buf->len, net_now_us());
+    impair_poll();
+    return 0;
+}
+
+/**
+ * @brief 接收一帧：先把驱动中已到达的帧取入损伤队列，再交出一个到期的帧
+ *
+ * @param buf   出口参数，收到的帧
+ * @return int  帧长度，没有到期的帧为0
+ */
+int impair_recv(buf_t *buf) {
+    impair_link_t *link = &impair_links[IMPAIR_RX];
+    if (!link->enabled)
+        return driver_recv(buf);
+
+    uint64_t now = net_now_us();
+    for (int i = 0; i < IMPAIR_RECV_BURST; i++) {
+        int len = driver_recv(&impair_rxbuf);
+        if (len <= 0)
+            break;
+        if (impair_rxbuf.len > IMPAIR_FRAME_MAX)
+            continue;
+        impair_admit(link, impair_rxbuf.data, impair_rxbuf.len, now);
+    }
+
+    impair_frame_t *frame = impair_dequeue(link, now);
+    if (!frame)
+        return 0;
+    buf_init(buf, frame->len);
+    memcpy(buf->data, frame->data, frame->len);
+    return frame->len;
+}
+
+/**
+ * @brief 把发送方向到期的帧交给驱动，在每次轮询时调用
+ */
+void impair_poll() {
+    impair_link_t *link = &impair_links[IMPAIR_TX];
+    impair_frame_t *frame;
+    static _Thread_local buf_t tx_buf;
+    uint64_t now = net_now_us();
+    while ((frame = impair_dequeue(link, now)) != NULL) {
+        buf_init(&tx_buf, frame->len);
+        memcpy(tx_buf.data, frame->data, frame->len);
+        driver_send(&tx_buf);
+    }
+}
+
+/**
+ * @brief 初始化损伤层，从环境变量 NET_IMPAIR_TX / NET_IMPAIR_RX 读取参数
+ */
+void impair_init() {
+    const char *names[] = {"NET_IMPAIR_TX", "NET_IMPAIR_RX"};
+    for (int dir = IMPAIR_TX; dir <= IMPAIR_RX; dir++) {
+        impair_config_t config;
+        const char *spec = getenv(names[dir]);
+        if (spec && (impair_parse(spec, &config) != 0 || impair_configure(dir, &config) != 0)) {
+            fprintf(stderr, "invalid %s: %s, impairment disabled\n", names[dir], spec);
+            spec = NULL;
+        }
+        if (!spec)
+            impair_configure(dir, NULL);
+        else if (impair_links[dir].enabled)
+            printf("impair %s: %s\n", dir == IMPAIR_TX ? "tx" : "rx", spec);
+    }
+}
+#endif
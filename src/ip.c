@@ -50,7 +50,12 @@ void ip_in(buf_t *buf, uint8_t *src_mac) {
     hdr->hdr_checksum16 = old_checksum;  // 恢复原始校验和值
 
     // 对比目的IP地址
-    if (memcmp(hdr->dst_ip, net_if_ip, NET_IP_LEN) != 0) {
+#ifdef NET_LOCAL_DELIVERY
+    int loopback = src_mac == net_if_mac && hdr->dst_ip[0] == 127;  // 仅接受本机投递的回环地址
+#else
+    int loopback = 0;
+#endif
+    if (memcmp(hdr->dst_ip, net_if_ip, NET_IP_LEN) != 0 && !loopback) {
         return;  // 目的IP不是本机IP，丢弃
     }
 
@@ -98,6 +103,11 @@ void ip_fragment_out(buf_t *buf, uint8_t *ip, net_protocol_t protocol, int id, u
     hdr->ttl = 64;                      // TTL值设为64
     hdr->protocol = protocol;           // 上层协议
     memcpy(hdr->src_ip, net_if_ip, NET_IP_LEN);  // 源IP地址
+#ifdef NET_LOCAL_DELIVERY
+    // 发往回环地址时以目的地址为源地址：伪首部只对源与目的地址求和，传输层已算好的校验和不变
+    if (ip[0] == 127)
+        memcpy(hdr->src_ip, ip, NET_IP_LEN);
+#endif
     memcpy(hdr->dst_ip, ip, NET_IP_LEN);         // 目标IP地址
     
     // 设置分片相关字段
@@ -112,6 +122,12 @@ void ip_fragment_out(buf_t *buf, uint8_t *ip, net_protocol_t protocol, int id, u
     hdr->hdr_checksum16 = 0;  // 先将校验和字段填为0
     hdr->hdr_checksum16 = checksum16((uint16_t *)hdr, sizeof(ip_hdr_t) / 2);  // 计算校验和并填入字段
     
+#ifdef NET_LOCAL_DELIVERY
+    if (ip[0] == 127 || !memcmp(ip, net_if_ip, NET_IP_LEN)) {
+        net_local_out(buf, NET_PROTOCOL_IP);  // 发往本机，不经过arp与驱动
+        return;
+    }
+#endif
     arp_out(buf, ip);  
 }
 
@@ -131,7 +147,7 @@ void ip_out(buf_t *buf, uint8_t *ip, net_protocol_t protocol) {
     if (buf->len > max_payload) {
         // 分片处理
         // 静态ID计数器，用于标识同一数据报的不同分片
-        static int id = 0;
+        static _Thread_local int id = 0;
         int current_id = id; // 使用当前ID发送所有分片
         
         int offset = 0; // 当前偏移量（以字节为单位）
@@ -164,7 +180,7 @@ void ip_out(buf_t *buf, uint8_t *ip, net_protocol_t protocol) {
         id++;
     } else {
         // 直接发送
-        static int id = 0;
+        static _Thread_local int id = 0;
         // 直接调用ip_fragment_out发送，偏移量为0，MF标志为0（单个分片）
         ip_fragment_out(buf, ip, protocol, id++, 0, 0);
     }
@@ -7,7 +7,7 @@
 #include <string.h>
 
 // 本机IPv6地址（链路本地地址，基于MAC地址生成）
-uint8_t net_if_ipv6[NET_IPV6_LEN] = NET_IF_IPV6;
+_Thread_local uint8_t net_if_ipv6[NET_IPV6_LEN] = NET_IF_IPV6;
 
 // 特殊地址定义
 uint8_t ipv6_unspecified[NET_IPV6_LEN] = {0};  // ::
@@ -141,7 +141,7 @@ void ipv6_make_ipv4_mapped(const uint8_t *ipv4, uint8_t *ipv6) {
  * @brief 将IPv6地址转换为字符串表示
  */
 char *ipv6_to_str(const uint8_t *ip) {
-    static char str[40];  // xxxx:xxxx:xxxx:xxxx:xxxx:xxxx:xxxx:xxxx + \0
+    static _Thread_local char str[40];  // xxxx:xxxx:xxxx:xxxx:xxxx:xxxx:xxxx:xxxx + \0
     
     // 检查是否为IPv4映射地址
     if (ipv6_is_ipv4_mapped(ip)) {
@@ -187,6 +187,11 @@ void ipv6_in(buf_t *buf, uint8_t *src_mac) {
     // Step4: 检查目的地址
     // 检查是否发往本机的单播地址
     int is_for_us = ipv6_addr_equal(hdr->dst_ip, net_if_ipv6);
+#ifdef NET_LOCAL_DELIVERY
+    // 仅接受本机投递的回环地址
+    if (src_mac == net_if_mac && ipv6_addr_equal(hdr->dst_ip, ipv6_loopback))
+        is_for_us = 1;
+#endif
     
     // 检查是否是组播地址（本机需要处理的组播）
     if (!is_for_us && hdr->dst_ip[0] == 0xff) {
@@ -290,6 +295,15 @@ void ipv6_out(buf_t *buf, uint8_t *ip, ipv6_next_header_t next_header) {
     // 目标地址
     memcpy(hdr->dst_ip, ip, NET_IPV6_LEN);
     
+#ifdef NET_LOCAL_DELIVERY
+    // 发往本机，不经过邻居发现与驱动；发往 ::1 时以 ::1 为源地址，伪首部校验和不变
+    if (ipv6_addr_equal(ip, ipv6_loopback) || ipv6_addr_equal(ip, net_if_ipv6)) {
+        memcpy(hdr->src_ip, ip, NET_IPV6_LEN);
+        net_local_out(buf, NET_PROTOCOL_IPV6);
+        return;
+    }
+#endif
+    
     // Step3: 确定目标MAC地址并发送
     // IPv6使用邻居发现协议(NDP)而不是ARP
     // 对于链路本地地址，可以直接从IPv6地址推导MAC地址
@@ -0,0 +1,193 @@
+/**
+ * @file loop.c
+ * @brief 进程内回环链路
+ *
+ * 以 LOOPBACK 编译时注册名为 loop 的驱动，实例线程在初始化协议栈前选用它：
+ * 两个协议栈实例各运行在自己的线程中，发送的帧写入对端接收方向的单生产者单消费者无锁环形队列，
+ * 不经过网卡、pcap 文件或内核，收发两端只在队列头尾的原子变量上同步。
+ * 同时以 IMPAIR 编译时，每个实例的损伤层位于协议栈与本驱动之间，可单独配置。
+ *
+ * 队列满时发送的帧被丢弃并计数，与真实网卡一致。
+ */
+
+#ifdef LOOPBACK
+#include "loop.h"
+
+#include "driver.h"
+
+#include <sched.h>
+#include <stdlib.h>
+
+static _Thread_local net_stack_t *loop_stack;  // 当前线程运行的实例
+static _Thread_local int loop_idle;            // 本轮轮询是否没有收发任何帧
+
+/**
+ * @brief 创建一条链路，连接两个实例
+ *
+ * @param a 一端的实例
+ * @param b 另一端的实例
+ * @return int 成功为0，失败为-1
+ */
+int loop_link(net_stack_t *a, net_stack_t *b) {
+    loop_ring_t *ab = aligned_alloc(64, sizeof(loop_ring_t));
+    loop_ring_t *ba = aligned_alloc(64, sizeof(loop_ring_t));
+    if (!ab || !ba) {
+        free(ab);
+        free(ba);
+        return -1;
+    }
+    atomic_init(&ab->head, 0);
+    atomic_init(&ab->tail, 0);
+    ab->dropped = 0;
+    atomic_init(&ba->head, 0);
+    atomic_init(&ba->tail, 0);
+    ba->dropped = 0;
+    a->tx = b->rx = ab;
+    b->tx = a->rx = ba;
+    return 0;
+}
+
+/**
+ * @brief 释放链路，两端的实例须已停止
+ *
+ */
+void loop_unlink(net_stack_t *a, net_stack_t *b) {
+    free(a->tx);
+    free(b->tx);
+    a->tx = a->rx = b->tx = b->rx = NULL;
+}
+
+/**
+ * @brief 当前线程运行的实例，可在回调之外获取
+ *
+ */
+net_stack_t *loop_self() {
+    return loop_stack;
+}
+
+/**
+ * @brief 实例线程：初始化协议栈后持续轮询，直到 loop_stop
+ *
+ */
+static void *loop_main(void *arg) {
+    net_stack_t *stack = arg;
+    loop_stack = stack;
+    memcpy(net_if_mac, stack->mac, NET_MAC_LEN);
+    memcpy(net_if_ip, stack->ip, NET_IP_LEN);
+    if (driver_select("loop") < 0 || net_init() == -1) {
+        stack->ret = -1;
+        return NULL;
+    }
+#ifdef IMPAIR
+    const char *specs[] = {stack->impair_tx, stack->impair_rx};
+    for (int dir = IMPAIR_TX; dir <= IMPAIR_RX; dir++) {
+        impair_config_t config;
+        if (specs[dir] && (impair_parse(specs[dir], &config) < 0 || impair_configure(dir, &config) < 0)) {
+            fprintf(stderr, "loop: bad impairment \"%s\"\n", specs[dir]);
+            stack->ret = -1;
+            driver_close();
+            return NULL;
+        }
+    }
+#endif
+    if (stack->setup)
+        stack->setup(stack);
+    while (atomic_load_explicit(&stack->running, memory_order_relaxed)) {
+        loop_idle = 1;
+        net_poll();
+        if (stack->poll)
+            stack->poll(stack);
+        if (loop_idle)
+            sched_yield();  // 链路空闲时让出处理器，避免在核数少的机器上饿死对端
+    }
+    driver_close();
+    return NULL;
+}
+
+/**
+ * @brief 在新线程中启动实例
+ *
+ * @param stack 已由 loop_link 连接的实例
+ * @return int 成功为0，失败为-1
+ */
+int loop_start(net_stack_t *stack) {
+    if (!stack->rx || !stack->tx)
+        return -1;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, LOOP_THREAD_STACK);
+    stack->ret = 0;
+    atomic_store(&stack->running, 1);
+    int ret = pthread_create(&stack->thread, &attr, loop_main, stack);
+    pthread_attr_destroy(&attr);
+    if (ret) {
+        atomic_store(&stack->running, 0);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief 停止实例并等待其线程退出
+ *
+ */
+void loop_stop(net_stack_t *stack) {
+    atomic_store(&stack->running, 0);
+    pthread_join(stack->thread, NULL);
+}
+
+static int loop_driver_open() {
+    return loop_stack && loop_stack->rx && loop_stack->tx ? 0 : -1;
+}
+
+/**
+ * @brief 从本实例的接收队列取出一帧
+ *
+ * @param buf 收到的数据包
+ * @return int 数据包的长度，未收到为0
+ */
+static int loop_driver_recv(buf_t *buf) {
+    loop_ring_t *ring = loop_stack->rx;
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    if (tail == atomic_load_explicit(&ring->head, memory_order_acquire))
+        return 0;
+    size_t len = ring->slots[tail % LOOP_RING_LEN].len;
+    buf_init(buf, len);
+    memcpy(buf->data, ring->slots[tail % LOOP_RING_LEN].data, len);
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+    loop_idle = 0;
+    return len;
+}
+
+/**
+ * @brief 把一帧写入对端的接收队列
+ *
+ * @param buf 要发送的数据包
+ * @return int 成功为0，队列满或帧过长为-1
+ */
+static int loop_driver_send(buf_t *buf) {
+    loop_ring_t *ring = loop_stack->tx;
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    loop_idle = 0;
+    if (buf->len > LOOP_FRAME_MAX || head - atomic_load_explicit(&ring->tail, memory_order_acquire) == LOOP_RING_LEN) {
+        ring->dropped++;
+        return -1;
+    }
+    ring->slots[head % LOOP_RING_LEN].len = buf->len;
+    memcpy(ring->slots[head % LOOP_RING_LEN].data, buf->data, buf->len);
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+    return 0;
+}
+
+static void loop_driver_close() {
+}
+
+static const driver_ops_t loop_driver = {
+    .name = "loop",
+    .open = loop_driver_open,
+    .recv = loop_driver_recv,
+    .send = loop_driver_send,
+    .close = loop_driver_close,
+};
+DRIVER_REGISTER(loop_driver)
+#endif
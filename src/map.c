@@ -1,4 +1,5 @@
 #include "map.h"
+#include "net.h"
 
 #include <string.h>
 
@@ -61,7 +62,7 @@ void *map_entry_get(map_t *map, size_t pos) {
  */
 int map_entry_valid(map_t *map, const void *entry) {
     time_t entry_time = *(time_t *)((uint8_t *)entry + map->key_len + map->value_len);
-    return entry_time && (!map->timeout || entry_time + map->timeout >= time(NULL));
+    return entry_time && (!map->timeout || entry_time + map->timeout >= net_time());
 }
 
 /**
@@ -94,7 +95,7 @@ int map_set(map_t *map, const void *key, const void *value) {
     uint8_t *old_value = map_get(map, key);
     if (old_value) {
         map->value_constuctor(old_value, value, map->value_len);
-        *(time_t *)(old_value + map->value_len) = time(NULL);
+        *(time_t *)(old_value + map->value_len) = net_time();
         return 0;
     }
     if (map->size == map->max_size)
@@ -104,7 +105,7 @@ int map_set(map_t *map, const void *key, const void *value) {
         if (!map_entry_valid(map, entry)) {
             memcpy(entry, key, map->key_len);
             map->value_constuctor(entry + map->key_len, value, map->value_len);
-            *(time_t *)(entry + map->key_len + map->value_len) = time(NULL);
+            *(time_t *)(entry + map->key_len + map->value_len) = net_time();
             map->size++;
             return 0;
         }
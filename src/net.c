@@ -11,30 +11,36 @@
 #ifdef ICMPV6
 #include "icmpv6.h"
 #endif
+#ifdef IMPAIR
+#include "impair.h"
+#endif
+#ifdef QOS
+#include "qos.h"
+#endif
 
 /**
  * @brief 协议表 <协议号,处理程序>的容器
  *
  */
-map_t net_table;
+_Thread_local map_t net_table;
 
 /**
  * @brief 网卡MAC地址
  *
  */
-uint8_t net_if_mac[NET_MAC_LEN] = NET_IF_MAC;
+_Thread_local uint8_t net_if_mac[NET_MAC_LEN] = NET_IF_MAC;
 
 /**
  * @brief 网卡IP地址
  *
  */
-uint8_t net_if_ip[NET_IP_LEN] = NET_IF_IP;
+_Thread_local uint8_t net_if_ip[NET_IP_LEN] = NET_IF_IP;
 
 /**
  * @brief 网卡接收和发送缓冲区
  *
  */
-buf_t rxbuf, txbuf;  // 一个buf足够单线程使用
+_Thread_local buf_t rxbuf, txbuf;  // 一个buf足够单线程使用
 
 /**
  * @brief 初始化协议栈
@@ -44,6 +50,12 @@ int net_init() {
     map_init(&net_table, sizeof(uint16_t), sizeof(net_handler_t), 0, 0, NULL, NULL);
     if (driver_open() == -1)
         return -1;
+#ifdef IMPAIR
+    impair_init();
+#endif
+#ifdef QOS
+    qos_init();
+#endif
     ethernet_init();
     arp_init();
     ip_init();
@@ -75,6 +87,30 @@ void net_add_protocol(uint16_t protocol, net_handler_t handler) {
     map_set(&net_table, &protocol, &handler);
 }
 
+/**
+ * @brief 端口集合变化时的回调，驱动据此更新过滤规则
+ *
+ */
+static _Thread_local net_port_hook_t net_port_hook;
+
+/**
+ * @brief 注册端口集合变化时的回调，NULL 取消
+ *
+ * @param hook 回调
+ */
+void net_set_port_hook(net_port_hook_t hook) {
+    net_port_hook = hook;
+}
+
+/**
+ * @brief 通知已打开的 UDP/TCP 端口发生了变化
+ *
+ */
+void net_ports_changed() {
+    if (net_port_hook)
+        net_port_hook();
+}
+
 /**
  * @brief 向协议栈的上层协议传递数据包
  *
@@ -92,10 +128,113 @@ int net_in(buf_t *buf, uint16_t protocol, uint8_t *src) {
     return -1;
 }
 
+#ifdef NET_LOCAL_DELIVERY
+/**
+ * @brief 本机投递队列中的一个数据包
+ *
+ */
+typedef struct net_local_packet {
+    uint16_t protocol;  // 以太网类型，NET_PROTOCOL_IP 或 NET_PROTOCOL_IPV6
+    uint16_t len;
+    uint8_t data[ETHERNET_MAX_TRANSPORT_UNIT];
+} net_local_packet_t;
+
+static _Thread_local net_local_packet_t net_local_queue[NET_LOCAL_QUEUE_LEN];
+static _Thread_local size_t net_local_head, net_local_count;
+
+/**
+ * @brief 把发往本机的网络层数据包放入本机投递队列
+ *
+ * 数据包在下一次 net_poll 时交给网络层，不经过 arp、以太网与驱动；
+ * 在处理程序内发送的回复同样排队，避免递归。
+ *
+ * @param buf 含网络层头部的数据包
+ * @param protocol 以太网类型
+ * @return int 成功为0，队列满或数据包过长为-1
+ */
+int net_local_out(buf_t *buf, uint16_t protocol) {
+    if (net_local_count == NET_LOCAL_QUEUE_LEN || buf->len > ETHERNET_MAX_TRANSPORT_UNIT)
+        return -1;
+    net_local_packet_t *packet = &net_local_queue[(net_local_head + net_local_count++) % NET_LOCAL_QUEUE_LEN];
+    packet->protocol = protocol;
+    packet->len = buf->len;
+    memcpy(packet->data, buf->data, buf->len);
+    return 0;
+}
+
+/**
+ * @brief 投递本次轮询之前排队的本机数据包
+ *
+ * 以 net_if_mac 作为源mac地址，网络层据此接受发往回环地址的数据包。
+ *
+ * @return int 投递的数据包数
+ */
+static int net_local_poll() {
+    int delivered = net_local_count;
+    for (size_t n = net_local_count; n > 0; n--) {
+        net_local_packet_t *packet = &net_local_queue[net_local_head];
+        net_local_head = (net_local_head + 1) % NET_LOCAL_QUEUE_LEN;
+        net_local_count--;
+        buf_init(&rxbuf, packet->len);
+        memcpy(rxbuf.data, packet->data, packet->len);
+        net_in(&rxbuf, packet->protocol, net_if_mac);
+    }
+    return delivered;
+}
+#endif
+
 /**
  * @brief 一次协议栈轮询
  *
+ * @return int 本次处理的数据包数，为0时本次轮询空闲
+ */
+int net_poll() {
+    int handled = 0;
+#ifdef NET_LOCAL_DELIVERY
+    handled += net_local_poll();
+#endif
+    handled += ethernet_poll();
+    return handled;
+}
+
+/**
+ * @brief 注入的时钟，NULL 时使用系统时钟
+ *
+ */
+static _Thread_local net_clock_t net_clock;
+
+/**
+ * @brief 替换协议栈时钟
+ *
+ * 测试中可注入由输入报文时间戳推进的虚拟时钟，使超时等行为可复现且不必等待真实时间。
+ * 与其他协议栈状态一样只作用于调用线程中的实例。
+ *
+ * @param clock 返回当前微秒数的函数，NULL 恢复系统时钟
+ */
+void net_set_clock(net_clock_t clock) {
+    net_clock = clock;
+}
+
+/**
+ * @brief 协议栈时钟
+ *
+ * @return uint64_t 单调递增的微秒数，用于测量时延
+ */
+uint64_t net_now_us() {
+    if (net_clock)
+        return net_clock();
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/**
+ * @brief 协议栈的秒级时间，用于表项超时等定时行为
+ *
+ * @return time_t 系统时钟下为 time(NULL)，注入时钟下为其秒数
  */
-void net_poll() {
-    ethernet_poll();
+time_t net_time() {
+    if (net_clock)
+        return net_clock() / 1000000;
+    return time(NULL);
 }
\ No newline at end of file
@@ -0,0 +1,482 @@
+/**
+ * @file qos.c
+ * @brief 出口调度
+ *
+ * 以 QOS 编译时，ethernet_out 经由本层发送。帧按内容分为三个类别，类别之间为严格优先级：
+ *   - NET：ARP 与 ICMPv6 邻居发现，地址解析不被其他流量阻塞；
+ *   - CONTROL：ICMP 与不带数据的 TCP 段，握手、确认与挥手不排在大块数据之后；
+ *   - DATA：其他数据包，按（协议、目标地址、端口）哈希到 QOS_FLOWS 个流队列，
+ *     以差额轮询（DRR）近似加权公平排队，流的权重按本端端口设置。
+ * 链路与每个类别都可以设置令牌桶限速。链路不限速时，只有驱动拒绝发送（如发送队列满）后
+ * 帧才进入队列；否则队列留在协议栈中，由调度决定顺序，大块传输不会拖慢交互流量。
+ *
+ * 排队的帧复制到固定大小的帧池中，在 ethernet_poll 与每次发送时按调度顺序交给下一层
+ * （以 IMPAIR 编译时为损伤层，否则为驱动）。
+ *
+ * 参数来自环境变量 NET_QOS（见 qos_parse），也可由 qos_configure 设置。
+ */
+
+#ifdef QOS
+#include "qos.h"
+
+#include "driver.h"
+#include "ethernet.h"
+#include "ip.h"
+#include "ipv6.h"
+#include "tcp.h"
+#ifdef IMPAIR
+#include "impair.h"
+#endif
+
+#include <stdlib.h>
+
+#define QOS_NONE UINT16_MAX  // 空链表
+
+/**
+ * @brief 帧池中的一帧
+ *
+ */
+typedef struct qos_frame {
+    uint16_t next;        // 同一队列中的下一帧
+    uint16_t len;
+    uint64_t enqueue_us;  // 入队时间，用于统计排队时间
+    uint8_t data[QOS_FRAME_MAX];
+} qos_frame_t;
+
+/**
+ * @brief 先进先出队列，元素为帧池下标
+ *
+ */
+typedef struct qos_fifo {
+    uint16_t head, tail;
+} qos_fifo_t;
+
+/**
+ * @brief 令牌桶，令牌以字节计，允许透支一帧，使深度小于帧长时仍能发送
+ *
+ */
+typedef struct qos_bucket {
+    uint64_t rate_bps;  // 0 为不限速
+    double burst;
+    double tokens;
+    uint64_t last_us;
+} qos_bucket_t;
+
+/**
+ * @brief 数据类别的一个流队列
+ *
+ */
+typedef struct qos_flow {
+    qos_fifo_t fifo;
+    int64_t deficit;  // DRR 差额（字节）
+    uint32_t weight;
+    int active;       // 是否在轮询环中
+} qos_flow_t;
+
+static _Thread_local qos_config_t qos_config;
+static _Thread_local int qos_enabled;
+static _Thread_local qos_frame_t qos_frames[QOS_QUEUE_LEN];
+static _Thread_local uint16_t qos_free_list[QOS_QUEUE_LEN];
+static _Thread_local size_t qos_free_count;
+static _Thread_local size_t qos_count;                    // 队列中的帧数
+static _Thread_local qos_fifo_t qos_fifos[QOS_CLASS_DATA];  // NET 与 CONTROL 类别的队列
+static _Thread_local qos_flow_t qos_flows[QOS_FLOWS];
+static _Thread_local uint16_t qos_ring[QOS_FLOWS];         // 有帧的流，按轮询顺序
+static _Thread_local size_t qos_ring_head, qos_ring_count;
+static _Thread_local qos_bucket_t qos_link;
+static _Thread_local qos_bucket_t qos_buckets[QOS_CLASS_NUM];
+static _Thread_local qos_stats_t qos_stats[QOS_CLASS_NUM];
+static _Thread_local buf_t qos_txbuf;
+
+/* =============================== TOOLS =============================== */
+
+static void qos_fifo_push(qos_fifo_t *fifo, uint16_t index) {
+    qos_frames[index].next = QOS_NONE;
+    if (fifo->head == QOS_NONE)
+        fifo->head = index;
+    else
+        qos_frames[fifo->tail].next = index;
+    fifo->tail = index;
+}
+
+static uint16_t qos_fifo_pop(qos_fifo_t *fifo) {
+    uint16_t index = fifo->head;
+    fifo->head = qos_frames[index].next;
+    return index;
+}
+
+static void qos_bucket_init(qos_bucket_t *bucket, uint64_t rate_bps, uint32_t burst) {
+    bucket->rate_bps = rate_bps;
+    // 默认深度覆盖两次轮询之间的间隔，否则间隔中积累的令牌被截断，实际速率低于设定
+    bucket->burst = burst ? burst : rate_bps * QOS_BURST_US / 8e6;
+    if (bucket->burst < QOS_FRAME_MAX)
+        bucket->burst = QOS_FRAME_MAX;
+    bucket->tokens = bucket->burst;
+    bucket->last_us = net_now_us();
+}
+
+/**
+ * @brief 补充令牌并判断是否可以发送
+ */
+static int qos_bucket_ready(qos_bucket_t *bucket, uint64_t now) {
+    if (!bucket->rate_bps)
+        return 1;
+    if (now > bucket->last_us) {
+        bucket->tokens += (now - bucket->last_us) * bucket->rate_bps / 8e6;
+        if (bucket->tokens > bucket->burst)
+            bucket->tokens = bucket->burst;
+        bucket->last_us = now;
+    }
+    return bucket->tokens > 0;
+}
+
+static void qos_bucket_take(qos_bucket_t *bucket, size_t len) {
+    if (bucket->rate_bps)
+        bucket->tokens -= len;
+}
+
+/**
+ * @brief 按帧内容分类，数据类别同时给出流队列与本端端口
+ *
+ * @param data 以太网帧
+ * @param len 帧长度
+ * @param flow 出口参数，数据类别的流队列下标
+ * @param port 出口参数，数据类别的本端端口，没有时为0
+ * @return qos_class_t 类别
+ */
+static qos_class_t qos_classify(const uint8_t *data, size_t len, size_t *flow, uint16_t *port) {
+    const ether_hdr_t *eth = (const ether_hdr_t *)data;
+    const uint8_t *l3 = data + sizeof(ether_hdr_t);
+    size_t l3_len = len - sizeof(ether_hdr_t);
+    uint16_t protocol = swap16(eth->protocol16);
+    const uint8_t *l4 = NULL, *dst = NULL;
+    size_t l4_len = 0, dst_len = 0;
+    uint8_t proto = 0;
+    *port = 0;
+
+    if (protocol == NET_PROTOCOL_ARP)
+        return QOS_CLASS_NET;
+    if (protocol == NET_PROTOCOL_IP && l3_len >= sizeof(ip_hdr_t)) {
+        const ip_hdr_t *ip = (const ip_hdr_t *)l3;
+        size_t hdr_len = ip->hdr_len * IP_HDR_LEN_PER_BYTE;
+        size_t total = swap16(ip->total_len16);
+        proto = ip->protocol;
+        dst = ip->dst_ip;
+        dst_len = NET_IP_LEN;
+        if (proto == NET_PROTOCOL_ICMP)
+            return QOS_CLASS_CONTROL;
+        // 非首个分片没有传输层头部，只按地址归流
+        if (!(swap16(ip->flags_fragment16) & 0x1fff) && hdr_len <= total && total <= l3_len) {
+            l4 = l3 + hdr_len;
+            l4_len = total - hdr_len;
+        }
+    } else if (protocol == NET_PROTOCOL_IPV6 && l3_len >= sizeof(ipv6_hdr_t)) {
+        const ipv6_hdr_t *ip6 = (const ipv6_hdr_t *)l3;
+        size_t payload = swap16(ip6->payload_len16);
+        proto = ip6->next_header;
+        dst = ip6->dst_ip;
+        dst_len = NET_IPV6_LEN;
+        if (proto == NET_PROTOCOL_ICMPV6) {
+            uint8_t type = l3_len > sizeof(ipv6_hdr_t) ? l3[sizeof(ipv6_hdr_t)] : 0;
+            return type >= 133 && type <= 137 ? QOS_CLASS_NET : QOS_CLASS_CONTROL;  // 133~137 为邻居发现
+        }
+        if (sizeof(ipv6_hdr_t) + payload <= l3_len) {
+            l4 = l3 + sizeof(ipv6_hdr_t);
+            l4_len = payload;
+        }
+    }
+
+    uint16_t src_port = 0, dst_port = 0;
+    if (l4 && (proto == NET_PROTOCOL_TCP || proto == NET_PROTOCOL_UDP) && l4_len >= 4) {
+        src_port = swap16(((const uint16_t *)l4)[0]);
+        dst_port = swap16(((const uint16_t *)l4)[1]);
+        if (proto == NET_PROTOCOL_TCP && l4_len >= sizeof(tcp_hdr_t) &&
+            l4_len <= (size_t)(((const tcp_hdr_t *)l4)->doff >> 4) * 4)
+            return QOS_CLASS_CONTROL;  // 不带数据的 TCP 段
+    }
+
+    // FNV-1a：协议、目标地址与两端端口
+    uint32_t hash = 2166136261u;
+    uint8_t key[4] = {proto, (uint8_t)(src_port >> 8) ^ (uint8_t)dst_port, (uint8_t)src_port, (uint8_t)(dst_port >> 8)};
+    for (size_t i = 0; i < sizeof(key); i++)
+        hash = (hash ^ key[i]) * 16777619u;
+    for (size_t i = 0; i < dst_len; i++)
+        hash = (hash ^ dst[i]) * 16777619u;
+    *flow = hash % QOS_FLOWS;
+    *port = src_port;
+    return QOS_CLASS_DATA;
+}
+
+static uint32_t qos_port_weight(uint16_t port) {
+    for (size_t i = 0; i < qos_config.num_weights; i++)
+        if (qos_config.weights[i].port == port)
+            return qos_config.weights[i].weight;
+    return 1;
+}
+
+/**
+ * @brief 把帧交给下一层
+ *
+ * @return int 成功为0，下一层拒绝为-1
+ */
+static int qos_output(buf_t *buf) {
+#ifdef IMPAIR
+    return impair_send(buf);
+#else
+    return driver_send(buf);
+#endif
+}
+
+/**
+ * @brief 下一个可发送的类别与帧，没有时返回 QOS_CLASS_NUM
+ *
+ * 严格优先级依次检查 NET 与 CONTROL，再按 DRR 选出 DATA 中下一个流；类别的令牌不足时跳过该类别。
+ */
+static qos_class_t qos_pick(uint64_t now, uint16_t *index, qos_flow_t **flow) {
+    *flow = NULL;
+    for (int cls = QOS_CLASS_NET; cls < QOS_CLASS_DATA; cls++) {
+        if (qos_fifos[cls].head != QOS_NONE && qos_bucket_ready(&qos_buckets[cls], now)) {
+            *index = qos_fifos[cls].head;
+            return cls;
+        }
+    }
+    if (!qos_ring_count || !qos_bucket_ready(&qos_buckets[QOS_CLASS_DATA], now))
+        return QOS_CLASS_NUM;
+    for (;;) {
+        qos_flow_t *f = &qos_flows[qos_ring[qos_ring_head]];
+        uint16_t head = f->fifo.head;
+        if (f->deficit >= qos_frames[head].len) {
+            *index = head;
+            *flow = f;
+            return QOS_CLASS_DATA;
+        }
+        // 差额不足以发送队首帧，本轮结束，补充差额后轮到下一个流
+        f->deficit += (int64_t)QOS_QUANTUM * f->weight;
+        qos_ring_head = (qos_ring_head + 1) % QOS_FLOWS;
+        qos_ring[(qos_ring_head + qos_ring_count - 1) % QOS_FLOWS] = f - qos_flows;
+    }
+}
+
+/**
+ * @brief 把帧放入所属类别或流的队列
+ *
+ * @return int 成功为0，队列满为-1
+ */
+static int qos_enqueue(buf_t *buf, qos_class_t cls, size_t flow_index, uint16_t port, uint64_t now) {
+    size_t limit = qos_config.limit ? qos_config.limit : QOS_QUEUE_LEN;
+    if (qos_count >= limit || qos_free_count == 0) {
+        qos_stats[cls].dropped++;
+        return -1;
+    }
+    uint16_t index = qos_free_list[--qos_free_count];
+    qos_frame_t *frame = &qos_frames[index];
+    frame->len = buf->len;
+    frame->enqueue_us = now;
+    memcpy(frame->data, buf->data, buf->len);
+    qos_count++;
+    qos_stats[cls].queued++;
+    if (cls != QOS_CLASS_DATA) {
+        qos_fifo_push(&qos_fifos[cls], index);
+        return 0;
+    }
+    qos_flow_t *flow = &qos_flows[flow_index];
+    qos_fifo_push(&flow->fifo, index);
+    if (!flow->active) {
+        flow->active = 1;
+        flow->deficit = 0;
+        flow->weight = qos_port_weight(port);
+        qos_ring[(qos_ring_head + qos_ring_count++) % QOS_FLOWS] = flow_index;
+    }
+    return 0;
+}
+
+static void qos_account(qos_class_t cls, size_t len) {
+    qos_bucket_take(&qos_link, len);
+    qos_bucket_take(&qos_buckets[cls], len);
+    qos_stats[cls].frames++;
+    qos_stats[cls].bytes += len;
+}
+
+static void qos_reset() {
+    qos_count = 0;
+    qos_free_count = QOS_QUEUE_LEN;
+    for (size_t i = 0; i < QOS_QUEUE_LEN; i++)
+        qos_free_list[i] = QOS_QUEUE_LEN - 1 - i;
+    for (int cls = QOS_CLASS_NET; cls < QOS_CLASS_DATA; cls++)
+        qos_fifos[cls].head = qos_fifos[cls].tail = QOS_NONE;
+    for (size_t i = 0; i < QOS_FLOWS; i++) {
+        qos_flows[i].fifo.head = qos_flows[i].fifo.tail = QOS_NONE;
+        qos_flows[i].active = 0;
+    }
+    qos_ring_head = qos_ring_count = 0;
+    qos_bucket_init(&qos_link, qos_config.rate_bps, qos_config.burst);
+    for (int cls = QOS_CLASS_NET; cls < QOS_CLASS_NUM; cls++)
+        qos_bucket_init(&qos_buckets[cls], qos_config.class_rate_bps[cls], qos_config.class_burst[cls]);
+    memset(qos_stats, 0, sizeof(qos_stats));
+}
+
+/* =============================== API =============================== */
+
+/**
+ * @brief 解析出口调度参数
+ *
+ * 形如 "rate=90M,data_rate=50M,weight=21:4"，可用的键：
+ * rate、net_rate、control_rate、data_rate（bit/s，可带 K/M/G），
+ * burst、net_burst、control_burst、data_burst（字节），limit（帧），
+ * weight=端口:权重（可出现多次）。
+ *
+ * @param spec      参数字符串
+ * @param config    出口参数，解析得到的参数（未出现的键为0）
+ * @return int      成功为0，失败为-1
+ */
+int qos_parse(const char *spec, qos_config_t *config) {
+    static const char *class_names[QOS_CLASS_NUM] = {"net", "control", "data"};
+    memset(config, 0, sizeof(qos_config_t));
+
+    char copy[512];
+    if (strlen(spec) >= sizeof(copy))
+        return -1;
+    strcpy(copy, spec);
+    for (char *save, *item = strtok_r(copy, ",", &save); item; item = strtok_r(NULL, ",", &save)) {
+        char *value = strchr(item, '=');
+        if (!value)
+            return -1;
+        *value++ = '\0';
+        int ret = -1;
+        char *end;
+        if (strcmp(item, "rate") == 0)
+            ret = parse_rate_bps(value, &config->rate_bps);
+        else if (strcmp(item, "burst") == 0) {
+            config->burst = strtoul(value, &end, 10);
+            ret = *end ? -1 : 0;
+        } else if (strcmp(item, "limit") == 0) {
+            config->limit = strtoul(value, &end, 10);
+            ret = *end ? -1 : 0;
+        } else if (strcmp(item, "weight") == 0) {
+            unsigned port, weight;
+            if (config->num_weights < QOS_MAX_WEIGHTS && sscanf(value, "%u:%u", &port, &weight) == 2 &&
+                port <= UINT16_MAX && weight >= 1 && weight <= UINT16_MAX) {
+                config->weights[config->num_weights].port = port;
+                config->weights[config->num_weights++].weight = weight;
+                ret = 0;
+            }
+        } else {
+            for (int cls = QOS_CLASS_NET; cls < QOS_CLASS_NUM; cls++) {
+                size_t n = strlen(class_names[cls]);
+                if (strncmp(item, class_names[cls], n) || item[n] != '_')
+                    continue;
+                if (strcmp(item + n + 1, "rate") == 0)
+                    ret = parse_rate_bps(value, &config->class_rate_bps[cls]);
+                else if (strcmp(item + n + 1, "burst") == 0) {
+                    config->class_burst[cls] = strtoul(value, &end, 10);
+                    ret = *end ? -1 : 0;
+                }
+            }
+        }
+        if (ret != 0)
+            return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief 设置出口调度参数，清空队列与统计
+ *
+ * @param config    参数，NULL 为直通
+ * @return int      成功为0，参数非法为-1
+ */
+int qos_configure(const qos_config_t *config) {
+    if (config && (config->limit > QOS_QUEUE_LEN || config->num_weights > QOS_MAX_WEIGHTS))
+        return -1;
+    if (config)
+        qos_config = *config;
+    else
+        memset(&qos_config, 0, sizeof(qos_config));
+    qos_enabled = config != NULL;
+    qos_reset();
+    return 0;
+}
+
+/**
+ * @brief 获取一个类别的统计
+ */
+const qos_stats_t *qos_get_stats(qos_class_t cls) {
+    return &qos_stats[cls];
+}
+
+/**
+ * @brief 发送一帧，按调度顺序交给下一层
+ *
+ * 队列为空且令牌充足时直接发出，不复制；否则排队，由 qos_poll 发出。
+ *
+ * @param buf   要发送的帧
+ * @return int  成功发出或入队为0，队列满为-1
+ */
+int qos_send(buf_t *buf) {
+    if (!qos_enabled || buf->len > QOS_FRAME_MAX)
+        return qos_output(buf);
+    uint64_t now = net_now_us();
+    size_t flow = 0;
+    uint16_t port;
+    qos_class_t cls = qos_classify(buf->data, buf->len, &flow, &port);
+    if (!qos_count && qos_bucket_ready(&qos_link, now) && qos_bucket_ready(&qos_buckets[cls], now) &&
+        qos_output(buf) == 0) {
+        qos_account(cls, buf->len);
+        return 0;
+    }
+    int ret = qos_enqueue(buf, cls, flow, port, now);
+    qos_poll();
+    return ret;
+}
+
+/**
+ * @brief 按调度顺序发出排队的帧，直到队列为空、令牌不足或下一层拒绝，在每次轮询时调用
+ */
+void qos_poll() {
+    uint64_t now = net_now_us();
+    while (qos_count && qos_bucket_ready(&qos_link, now)) {
+        uint16_t index;
+        qos_flow_t *flow;
+        qos_class_t cls = qos_pick(now, &index, &flow);
+        if (cls == QOS_CLASS_NUM)
+            break;
+        qos_frame_t *frame = &qos_frames[index];
+        buf_init(&qos_txbuf, frame->len);
+        memcpy(qos_txbuf.data, frame->data, frame->len);
+        if (qos_output(&qos_txbuf) < 0)
+            break;  // 下一层暂时不能发送，帧留在队首
+        qos_account(cls, frame->len);
+        qos_stats[cls].delay_us += now - frame->enqueue_us;
+        if (flow) {
+            qos_fifo_pop(&flow->fifo);
+            flow->deficit -= frame->len;
+            if (flow->fifo.head == QOS_NONE) {
+                // 流已空，移出轮询环
+                flow->active = 0;
+                qos_ring_head = (qos_ring_head + 1) % QOS_FLOWS;
+                qos_ring_count--;
+            }
+        } else {
+            qos_fifo_pop(&qos_fifos[cls]);
+        }
+        qos_free_list[qos_free_count++] = index;
+        qos_count--;
+    }
+}
+
+/**
+ * @brief 初始化出口调度，从环境变量 NET_QOS 读取参数，未设置时直通
+ */
+void qos_init() {
+    qos_config_t config;
+    const char *spec = getenv("NET_QOS");
+    if (spec && (qos_parse(spec, &config) != 0 || qos_configure(&config) != 0)) {
+        fprintf(stderr, "invalid NET_QOS: %s, scheduling disabled\n", spec);
+        spec = NULL;
+    }
+    if (!spec)
+        qos_configure(NULL);
+    else
+        printf("qos: %s\n", spec);
+}
+#endif
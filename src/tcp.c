@@ -10,12 +10,17 @@
  * @brief TCP 处理程序表
  *
  */
-map_t tcp_handler_table;  // dst-port -> handler
+_Thread_local map_t tcp_handler_table;  // dst-port -> handler
+/**
+ * @brief TCP 连接事件处理程序表
+ *
+ */
+static _Thread_local map_t tcp_event_table;  // dst-port -> event handler
 /**
  * @brief TCP 连接表
  *
  */
-static map_t tcp_conn_table;  // [src_ip, src_port, dst_port] -> tcp_conn
+static _Thread_local map_t tcp_conn_table;  // [src_ip, src_port, dst_port] -> tcp_conn
 
 /* =============================== TOOLS =============================== */
 
@@ -83,12 +88,28 @@ static inline tcp_conn_t *tcp_get_connection(uint8_t remote_ip[NET_IP_LEN], uint
     if (!tcp_conn && create_if_missing) {
         tcp_conn_t new_conn;
         tcp_rst(&new_conn);
+        new_conn.port = host_port;
         map_set(&tcp_conn_table, &key, &new_conn);
         tcp_conn = map_get(&tcp_conn_table, &key);
     }
     return tcp_conn;
 }
 
+/**
+ * @brief 向端口的事件处理程序通知一个连接事件
+ *
+ * @param tcp_conn
+ * @param event
+ * @param remote_ip
+ * @param remote_port
+ * @param host_port
+ */
+static inline void tcp_notify(tcp_conn_t *tcp_conn, tcp_event_t event, uint8_t *remote_ip, uint16_t remote_port, uint16_t host_port) {
+    tcp_event_handler_t *handler = map_get(&tcp_event_table, &host_port);
+    if (handler)
+        (*handler)(tcp_conn, event, remote_ip, remote_port);
+}
+
 /**
  * @brief 关闭一个 TCP 连接
  *
@@ -98,9 +119,36 @@ static inline tcp_conn_t *tcp_get_connection(uint8_t remote_ip[NET_IP_LEN], uint
  */
 static inline void tcp_close_connection(uint8_t remote_ip[NET_IP_LEN], uint16_t remote_port, uint16_t host_port) {
     tcp_key_t key = generate_tcp_key(remote_ip, remote_port, host_port);
+    tcp_conn_t *tcp_conn = map_get(&tcp_conn_table, &key);
+    if (tcp_conn)
+        tcp_notify(tcp_conn, TCP_EVENT_CLOSED, remote_ip, remote_port, host_port);
     map_delete(&tcp_conn_table, &key);
 }
 
+static _Thread_local time_t tcp_reap_now;
+static void tcp_reap_fn(void *key, void *value, time_t *timestamp) {
+    tcp_key_t *tcp_key = key;
+    tcp_conn_t *tcp_conn = value;
+    if ((tcp_conn->state == TCP_STATE_FIN_WAIT1 || tcp_conn->state == TCP_STATE_FIN_WAIT2) &&
+        tcp_reap_now - tcp_conn->fin_time >= TCP_FIN_WAIT_TIMEOUT) {
+        tcp_notify(tcp_conn, TCP_EVENT_CLOSED, tcp_key->remote_ip, tcp_key->remote_port, tcp_key->host_port);
+        map_delete(&tcp_conn_table, key);
+    }
+}
+
+/**
+ * @brief 回收等待对端 FIN 超时的连接，每秒最多扫描一次连接表
+ *
+ * 协议栈不重传 FIN，对端不再响应时连接会停在 FIN_WAIT，超时后移除以免占满连接表。
+ */
+static void tcp_reap_fin_wait() {
+    time_t now = net_time();
+    if (now == tcp_reap_now)
+        return;
+    tcp_reap_now = now;
+    map_foreach(&tcp_conn_table, tcp_reap_fn);
+}
+
 /* =============================== TOOLS =============================== */
 
 /* =============================== COMMON API =============================== */
@@ -157,13 +205,19 @@ void tcp_in(buf_t *buf, uint8_t *src_ip) {
     // 校验checksum
     uint16_t checksum = hdr->checksum16;
     hdr->checksum16 = 0;
-    if (transport_checksum(NET_PROTOCOL_TCP, buf, src_ip, net_if_ip) != checksum)
+    uint16_t calculated_checksum = transport_checksum(NET_PROTOCOL_TCP, buf, src_ip, net_if_ip);
+    hdr->checksum16 = checksum;  // 恢复原始校验和，不改动收到的数据包
+    if (calculated_checksum != checksum)
         return;
 
+    tcp_reap_fin_wait();
+
     uint8_t *remote_ip = src_ip;
     uint16_t remote_port = swap16(hdr->src_port16);
     uint16_t host_port = swap16(hdr->dst_port16);
     tcp_conn_t *tcp_conn = tcp_get_connection(remote_ip, remote_port, host_port, true);
+    if (tcp_conn == NULL)
+        return;  // 连接表已满，丢弃报文段，对端会重传 SYN
 
     uint8_t recv_flags = hdr->flags;
     // 收到RST，关闭 TCP 连接
@@ -179,6 +233,17 @@ void tcp_in(buf_t *buf, uint8_t *src_ip) {
     /* Step1 ：根据接收包数据更新当前TCP连接内部状态，并填写回复报文的标志部分。 */
 
     uint8_t send_flags = 0;  // 回复报文的标志位字段
+    uint8_t peer_fin = 0;    // 本报文是否使连接进入 CLOSE_WAIT
+    uint8_t established = 0; // 本报文是否完成三次握手
+
+    // 记录对端的确认号与接收窗口，供应用按窗口发送并判断数据是否已被确认
+    if (TCP_FLG_ISSET(recv_flags, TCP_FLG_ACK) && tcp_conn->state != TCP_STATE_LISTEN) {
+        uint32_t acked = swap32(hdr->ack) - tcp_conn->snd_una;
+        if (acked <= tcp_conn->seq - tcp_conn->snd_una) {  // 忽略确认了未发送数据的 ACK
+            tcp_conn->snd_una += acked;
+            tcp_conn->snd_wnd = swap16(hdr->win);
+        }
+    }
 
      // 根据当前 TCP 连接的状态进行不同的处理    
     switch (tcp_conn->state) {
@@ -190,6 +255,8 @@ void tcp_in(buf_t *buf, uint8_t *src_ip) {
 
             // 初始化 TCP 连接的seq字段（初始序列号）
             tcp_conn->seq = tcp_generate_initial_seq();
+            tcp_conn->snd_una = tcp_conn->seq;
+            tcp_conn->snd_wnd = swap16(hdr->win);
 
             // 填写TCP连接的ack字段（下一个期望接收的序号）
             tcp_conn->ack = remote_seq + 1;
@@ -202,6 +269,21 @@ void tcp_in(buf_t *buf, uint8_t *src_ip) {
 
             break;
 
+        case TCP_STATE_SYN_SENT:
+            // 主动打开：仅处理确认了本端 SYN 的 SYN+ACK
+            if (!TCP_FLG_ISSET(recv_flags, TCP_FLG_SYN) || !TCP_FLG_ISSET(recv_flags, TCP_FLG_ACK) ||
+                swap32(hdr->ack) != tcp_conn->seq) {
+                return;
+            }
+
+            // 记录对端初始序列号，回复ACK并进入ESTABLISHED
+            tcp_conn->ack = remote_seq + 1;
+            send_flags = TCP_FLG_ACK;
+            tcp_conn->state = TCP_STATE_ESTABLISHED;
+            established = 1;
+
+            break;
+
         case TCP_STATE_SYN_RECEIVED:
             // 仅在收到ACK报文时才处理
             if (!TCP_FLG_ISSET(recv_flags, TCP_FLG_ACK)) {
@@ -210,6 +292,7 @@ void tcp_in(buf_t *buf, uint8_t *src_ip) {
 
             // 进行状态转移：ESTABLISHED
             tcp_conn->state = TCP_STATE_ESTABLISHED;
+            established = 1;
 
             break;
 
@@ -231,6 +314,7 @@ void tcp_in(buf_t *buf, uint8_t *src_ip) {
             if (TCP_FLG_ISSET(recv_flags, TCP_FLG_FIN)) {
                 send_flags |= TCP_FLG_ACK;  // 对FIN进行确认
                 tcp_conn->state = TCP_STATE_CLOSE_WAIT;  // 转移到CLOSE_WAIT状态
+                peer_fin = 1;
                 // 不再直接返回，而是继续处理以便发送ACK确认
             }
             // 如果接收报文携带数据，则发送ACK回复
@@ -247,6 +331,32 @@ void tcp_in(buf_t *buf, uint8_t *src_ip) {
             // 直接返回，不处理任何数据或发送任何回复
             return;
 
+        case TCP_STATE_FIN_WAIT1:
+        case TCP_STATE_FIN_WAIT2:
+            // 主动关闭：本端已发送 FIN，未收到顺序包时发送重复 ACK
+            if (remote_seq != tcp_conn->ack) {
+                buf_init(&txbuf, 0);
+                tcp_out(tcp_conn, &txbuf, host_port, remote_ip, remote_port, TCP_FLG_ACK);
+                return;
+            }
+
+            // 对端确认了本端的 FIN
+            if (tcp_conn->state == TCP_STATE_FIN_WAIT1 && tcp_conn->snd_una == tcp_conn->seq)
+                tcp_conn->state = TCP_STATE_FIN_WAIT2;
+
+            // 本端已不再接收数据，顺序到达的数据仍推进 ACK 并确认后丢弃，对端随后的 FIN 才能按序到达
+            size_t fin_data_len = buf->len - tcp_hdr_sz;
+            tcp_conn->ack = remote_seq + bytes_in_flight(fin_data_len, recv_flags);
+            if (fin_data_len > 0 || TCP_FLG_ISSET(recv_flags, TCP_FLG_FIN)) {
+                buf_init(&txbuf, 0);
+                tcp_out(tcp_conn, &txbuf, host_port, remote_ip, remote_port, TCP_FLG_ACK);
+            }
+
+            // 确认对端的 FIN 后直接关闭连接（不保留 TIME_WAIT）
+            if (TCP_FLG_ISSET(recv_flags, TCP_FLG_FIN))
+                tcp_close_connection(remote_ip, remote_port, host_port);
+            return;
+
         case TCP_STATE_LAST_ACK:
             // 仅在收到ACK报文时才处理
             if (!TCP_FLG_ISSET(recv_flags, TCP_FLG_ACK)) {
@@ -263,6 +373,9 @@ void tcp_in(buf_t *buf, uint8_t *src_ip) {
             break;
     }
 
+    if (established)
+        tcp_notify(tcp_conn, TCP_EVENT_ESTABLISHED, remote_ip, remote_port, host_port);
+
     /* Step2 ：如果接收报文携带数据，则将数据部分交付给上层应用 */
     // 获取数据长度
     size_t data_len = buf->len - tcp_hdr_sz;
@@ -283,6 +396,9 @@ void tcp_in(buf_t *buf, uint8_t *src_ip) {
         (*handler)(tcp_conn, buf->data, buf->len, remote_ip, remote_port);
     }
 
+    // 数据交付后再通知对端关闭，应用可在此时发送 FIN 与 ACK 合并
+    if (peer_fin)
+        tcp_notify(tcp_conn, TCP_EVENT_FIN, remote_ip, remote_port, host_port);
 
     /* Step3 ：调用tcp_out()发送回复报文，更新TCP连接序列号。 */
     // 如果无需回复，则接收逻辑结束
@@ -341,19 +457,54 @@ void tcp_send(tcp_conn_t *tcp_conn, uint8_t *data, uint16_t len, uint16_t src_po
     // 如果发送了FIN包，更新连接状态
     if (len == 0 && tcp_conn->state == TCP_STATE_ESTABLISHED) {
         tcp_conn->state = TCP_STATE_FIN_WAIT1;
+        tcp_conn->fin_time = net_time();
+    } else if (len == 0 && tcp_conn->state == TCP_STATE_CLOSE_WAIT) {
+        tcp_conn->state = TCP_STATE_LAST_ACK;
     }
 }
 
+/**
+ * @brief 主动打开一个 TCP 连接，发送 SYN
+ *
+ * 本端端口需已通过 tcp_open 注册处理程序，握手完成后以 TCP_EVENT_ESTABLISHED 通知。
+ * 协议栈不重传 SYN，连接仍处于 SYN_SENT 时再次调用即以相同的初始序列号重传。
+ *
+ * @param host_port 本端端口号
+ * @param dst_ip    目的ip地址
+ * @param dst_port  目的端口号
+ * @return tcp_conn_t* 连接，连接表已满或该连接已不处于 SYN_SENT 时为NULL
+ */
+tcp_conn_t *tcp_connect(uint16_t host_port, uint8_t *dst_ip, uint16_t dst_port) {
+    tcp_reap_fin_wait();
+    tcp_conn_t *tcp_conn = tcp_get_connection(dst_ip, dst_port, host_port, true);
+    if (tcp_conn == NULL)
+        return NULL;
+    if (tcp_conn->state == TCP_STATE_LISTEN) {
+        tcp_conn->seq = tcp_generate_initial_seq();
+        tcp_conn->snd_una = tcp_conn->seq;
+        tcp_conn->state = TCP_STATE_SYN_SENT;
+    } else if (tcp_conn->state != TCP_STATE_SYN_SENT) {
+        return NULL;
+    }
+
+    tcp_conn->seq = tcp_conn->snd_una;
+    buf_init(&txbuf, 0);
+    tcp_out(tcp_conn, &txbuf, host_port, dst_ip, dst_port, TCP_FLG_SYN);
+    tcp_conn->seq += bytes_in_flight(0, TCP_FLG_SYN);
+    return tcp_conn;
+}
+
 /**
  * @brief 初始化 TCP 协议
  *
  */
 void tcp_init() {
     map_init(&tcp_handler_table, sizeof(uint16_t), sizeof(tcp_handler_t), 0, 0, NULL, NULL);
+    map_init(&tcp_event_table, sizeof(uint16_t), sizeof(tcp_event_handler_t), 0, 0, NULL, NULL);
     map_init(&tcp_conn_table, sizeof(tcp_key_t), sizeof(tcp_conn_t), 0, 0, NULL, NULL);
     net_add_protocol(NET_PROTOCOL_TCP, tcp_in);
     // 初始化随机数种子，为生成 TCP 初始序列号提供支持
-    srand(time(NULL));
+    srand(net_time());
 }
 
 /**
@@ -364,13 +515,27 @@ void tcp_init() {
  * @return int      成功为0，失败为-1
  */
 int tcp_open(uint16_t port, tcp_handler_t handler) {
-    return map_set(&tcp_handler_table, &port, &handler);
+    int ret = map_set(&tcp_handler_table, &port, &handler);
+    net_ports_changed();
+    return ret;
+}
+
+/**
+ * @brief 为 TCP 端口注册连接事件处理程序
+ *
+ * @param port      端口号
+ * @param handler   事件处理程序
+ * @return int      成功为0，失败为-1
+ */
+int tcp_set_event_handler(uint16_t port, tcp_event_handler_t handler) {
+    return map_set(&tcp_event_table, &port, &handler);
 }
 
 static _Thread_local uint16_t close_port;
 static void close_port_fn(void *key, void *value, time_t *timestamp) {
     tcp_key_t *tcp_key = key;
     if (tcp_key->host_port == close_port) {
+        tcp_notify(value, TCP_EVENT_CLOSED, tcp_key->remote_ip, tcp_key->remote_port, tcp_key->host_port);
         map_delete(&tcp_conn_table, key);
     }
 }
@@ -381,6 +546,8 @@ void tcp_close(uint16_t port) {
     close_port = port;
     map_foreach(&tcp_conn_table, close_port_fn);
     map_delete(&tcp_handler_table, &port);
+    map_delete(&tcp_event_table, &port);
+    net_ports_changed();
 }
 
 /* =============================== COMMON API =============================== */
\ No newline at end of file
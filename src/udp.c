@@ -7,7 +7,7 @@
  * @brief udp处理程序表
  *
  */
-map_t udp_table;
+_Thread_local map_t udp_table;
 
 /**
  * @brief 处理一个收到的udp数据包
@@ -36,6 +36,7 @@ void udp_in(buf_t *buf, uint8_t *src_ip) {
     
     // 重新计算校验和
     uint16_t calculated_checksum = transport_checksum(NET_PROTOCOL_UDP, buf, src_ip, net_if_ip);
+    udp_hdr->checksum16 = received_checksum;  // 恢复原始校验和，不改动收到的数据包
     
     // 比较校验和
     if (received_checksum != calculated_checksum) {
@@ -107,7 +108,9 @@ void udp_init() {
  * @return int 成功为0，失败为-1
  */
 int udp_open(uint16_t port, udp_handler_t handler) {
-    return map_set(&udp_table, &port, &handler);
+    int ret = map_set(&udp_table, &port, &handler);
+    net_ports_changed();
+    return ret;
 }
 
 /**
@@ -117,6 +120,7 @@ int udp_open(uint16_t port, udp_handler_t handler) {
  */
 void udp_close(uint16_t port) {
     map_delete(&udp_table, &port);
+    net_ports_changed();
 }
 
 /**
@@ -3,6 +3,7 @@
 #include "net.h"
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 /**
  * @brief ip转字符串
@@ -11,7 +12,7 @@
  * @return char* 生成的字符串
  */
 char *iptos(uint8_t *ip) {
-    static char output[3 * 4 + 3 + 1];
+    static _Thread_local char output[3 * 4 + 3 + 1];
     sprintf(output, "%d.%d.%d.%d", ip[0], ip[1], ip[2], ip[3]);
     return output;
 }
@@ -23,7 +24,7 @@ char *iptos(uint8_t *ip) {
  * @return char* 生成的字符串
  */
 char *mactos(uint8_t *mac) {
-    static char output[2 * 6 + 5 + 1];
+    static _Thread_local char output[2 * 6 + 5 + 1];
     sprintf(output, "%02X-%02X-%02X-%02X-%02X-%02X", mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
     return output;
 }
@@ -35,7 +36,7 @@ char *mactos(uint8_t *mac) {
  * @return char* 生成的字符串
  */
 char *timetos(time_t timestamp) {
-    static char output[20];
+    static _Thread_local char output[20];
     struct tm *utc_time = gmtime(&timestamp);
     sprintf(output, "%04d-%02d-%02d %02d:%02d:%02d", utc_time->tm_year + 1900, utc_time->tm_mon + 1, utc_time->tm_mday, utc_time->tm_hour, utc_time->tm_min, utc_time->tm_sec);
     return output;
@@ -62,6 +63,52 @@ uint8_t ip_prefix_match(uint8_t *ipa, uint8_t *ipb) {
     return count;
 }
 
+/**
+ * @brief 解析带单位的时间，如 "20ms"，可用的单位为 us、ms、s，无单位为微秒
+ *
+ * @param value 要解析的字符串
+ * @param us 出口参数，微秒数
+ * @return int 成功为0，缺少数值、数值为负或单位无效为-1
+ */
+int parse_time_us(const char *value, uint64_t *us) {
+    char *end;
+    double number = strtod(value, &end);
+    if (end == value || number < 0)
+        return -1;
+    if (strcmp(end, "ms") == 0)
+        number *= 1e3;
+    else if (strcmp(end, "s") == 0)
+        number *= 1e6;
+    else if (*end && strcmp(end, "us") != 0)
+        return -1;
+    *us = number;
+    return 0;
+}
+
+/**
+ * @brief 解析速率，如 "10M"，可带 K/M/G 后缀，单位为 bit/s
+ *
+ * @param value 要解析的字符串
+ * @param rate_bps 出口参数，速率
+ * @return int 成功为0，缺少数值、数值为负或后缀无效为-1
+ */
+int parse_rate_bps(const char *value, uint64_t *rate_bps) {
+    char *end;
+    double rate = strtod(value, &end);
+    if (end == value || rate < 0)
+        return -1;
+    if (*end == 'K' || *end == 'k')
+        rate *= 1e3, end++;
+    else if (*end == 'M' || *end == 'm')
+        rate *= 1e6, end++;
+    else if (*end == 'G' || *end == 'g')
+        rate *= 1e9, end++;
+    if (*end)
+        return -1;
+    *rate_bps = rate;
+    return 0;
+}
+
 /**
  * @brief 计算16位校验和
  *
@@ -124,10 +171,14 @@ uint16_t transport_checksum(uint8_t protocol, buf_t *buf, uint8_t *src_ip, uint8
     // Step4: 计算UDP校验和
     uint16_t checksum;
     if (buf->len % 2 == 1) {
-        // 如果长度为奇数，需要特殊处理
-        buf_add_padding(buf, 1);  // 添加一个字节的填充
-        checksum = checksum16((uint16_t *)buf->data, buf->len / 2);
-        buf_remove_padding(buf, 1);  // 去除填充
+        // 如果长度为奇数，最后一个字节补0参与计算；不写入数据末尾之后的内存
+        uint8_t last[2] = {buf->data[buf->len - 1], 0};
+        uint32_t sum = (uint16_t)~checksum16((uint16_t *)buf->data, buf->len / 2);
+        sum += *(uint16_t *)last;
+        while (sum >> 16) {
+            sum = (sum & 0xFFFF) + (sum >> 16);
+        }
+        checksum = ~sum;
     } else {
         checksum = checksum16((uint16_t *)buf->data, buf->len / 2);
     }
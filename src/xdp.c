@@ -0,0 +1,414 @@
+/**
+ * @file xdp.c
+ * @brief AF_XDP 驱动
+ *
+ * 以 XDP 编译时（CMake 在 linux/if_xdp.h 可用时定义）注册名为 xdp 的驱动：
+ * 在网卡的一个队列上绑定 AF_XDP 套接字，并挂载一个最小的 XDP 程序，把该队列收到的所有帧重定向到套接字。
+ * 帧存放在与内核共享的 UMEM 中，经 fill / completion / RX / TX 四个环形队列交换帧地址：
+ *   - 接收：UMEM 帧经 buf_attach 直接借给协议栈的 rxbuf，协议处理完成后（下一次接收时）
+ *     归还到 fill 队列，网卡与协议处理程序之间没有拷贝；
+ *   - 发送：协议栈在 txbuf 中组装的帧拷贝到一个空闲的 UMEM 帧后提交到 TX 队列，
+ *     发送完成后经 completion 队列回收。
+ *
+ * 网卡驱动支持时以零拷贝模式绑定并以驱动模式挂载 XDP 程序，否则退回拷贝模式与通用模式（如 veth）。
+ * 该队列的流量全部交给协议栈，内核不再看到，应使用专用的网卡队列或 veth，因此只按名称选用
+ * （NET_DRIVER=xdp，或 xdp,pcap 在不可用时退回 pcap）。
+ * 使用 veth 时对端须关闭发送校验和卸载（ethtool -K <对端> tx off），否则 TCP/UDP 报文的校验和未填写完整。
+ *
+ * 环境变量：
+ *   NET_XDP_IF     网卡名，默认按本机ip做最长前缀匹配选取
+ *   NET_XDP_QUEUE  队列号，默认0
+ *   NET_XDP_MODE   auto（默认）、zerocopy 或 copy
+ */
+
+#ifdef XDP
+#include "driver.h"
+
+#include <errno.h>
+#include <ifaddrs.h>
+#include <linux/bpf.h>
+#include <linux/if_link.h>
+#include <linux/if_xdp.h>
+#include <net/if.h>
+#include <netinet/in.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#ifndef SOL_XDP
+#define SOL_XDP 283
+#endif
+
+#define XDP_NUM_FRAMES 4096                   // UMEM 帧数
+#define XDP_FRAME_SIZE 2048                   // 每帧大小，对齐模式下须为2的幂
+#define XDP_RING_SIZE 2048                    // 四个队列的长度
+#define XDP_RX_FRAMES (XDP_NUM_FRAMES / 2)    // 用于接收的帧数，其余用于发送
+#define XDP_MAP_ENTRIES 64                    // XSKMAP 的容量（队列数上限）
+
+/**
+ * @brief 用户态映射的一个环形队列
+ *
+ */
+typedef struct xdp_ring {
+    uint32_t *producer;
+    uint32_t *consumer;
+    uint32_t *flags;
+    void *desc;
+    void *map;        // mmap 的起始地址与长度，用于释放
+    size_t map_len;
+} xdp_ring_t;
+
+static int xsk_fd = -1;
+static int xsk_map_fd = -1;
+static int xdp_prog_fd = -1;
+static int xdp_link_fd = -1;
+static uint8_t *umem;
+static xdp_ring_t rx_ring, tx_ring, fill_ring, comp_ring;
+static uint64_t tx_free[XDP_NUM_FRAMES - XDP_RX_FRAMES];  // 空闲的发送帧
+static size_t tx_free_count;
+static uint64_t lent_addr;  // 借给协议栈的接收帧
+static int lent;
+
+static void xdp_driver_close();
+
+static uint32_t xdp_load(uint32_t *p) {
+    return atomic_load_explicit((_Atomic uint32_t *)p, memory_order_acquire);
+}
+
+static void xdp_store(uint32_t *p, uint32_t v) {
+    atomic_store_explicit((_Atomic uint32_t *)p, v, memory_order_release);
+}
+
+static long xdp_bpf(int cmd, union bpf_attr *attr) {
+    return syscall(__NR_bpf, cmd, attr, sizeof(*attr));
+}
+
+/**
+ * @brief 创建 XSKMAP 并加载重定向程序：按接收队列号查 XSKMAP，未命中时交给内核
+ *
+ * @return int 成功为0，失败为-1
+ */
+static int xdp_load_prog() {
+    union bpf_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.map_type = BPF_MAP_TYPE_XSKMAP;
+    attr.key_size = sizeof(uint32_t);
+    attr.value_size = sizeof(uint32_t);
+    attr.max_entries = XDP_MAP_ENTRIES;
+    xsk_map_fd = xdp_bpf(BPF_MAP_CREATE, &attr);
+    if (xsk_map_fd < 0)
+        return -1;
+
+    struct bpf_insn prog[] = {
+        // r2 = ctx->rx_queue_index
+        {.code = BPF_LDX | BPF_W | BPF_MEM, .dst_reg = BPF_REG_2, .src_reg = BPF_REG_1, .off = offsetof(struct xdp_md, rx_queue_index)},
+        // r1 = xsk_map
+        {.code = BPF_LD | BPF_DW | BPF_IMM, .dst_reg = BPF_REG_1, .src_reg = BPF_PSEUDO_MAP_FD, .imm = xsk_map_fd},
+        {0},
+        // r3 = XDP_PASS，作为未命中时的返回值
+        {.code = BPF_ALU64 | BPF_MOV | BPF_K, .dst_reg = BPF_REG_3, .imm = XDP_PASS},
+        // return bpf_redirect_map(r1, r2, r3)
+        {.code = BPF_JMP | BPF_CALL, .imm = BPF_FUNC_redirect_map},
+        {.code = BPF_JMP | BPF_EXIT},
+    };
+    memset(&attr, 0, sizeof(attr));
+    attr.prog_type = BPF_PROG_TYPE_XDP;
+    attr.insns = (uintptr_t)prog;
+    attr.insn_cnt = sizeof(prog) / sizeof(prog[0]);
+    attr.license = (uintptr_t) "GPL";
+    xdp_prog_fd = xdp_bpf(BPF_PROG_LOAD, &attr);
+    return xdp_prog_fd < 0 ? -1 : 0;
+}
+
+/**
+ * @brief 把程序挂载到网卡，关闭返回的链接即卸载
+ *
+ * @param ifindex 网卡序号
+ * @param flags XDP_FLAGS_DRV_MODE 或 XDP_FLAGS_SKB_MODE
+ * @return int 成功为0，失败为-1
+ */
+static int xdp_attach(int ifindex, uint32_t flags) {
+    union bpf_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.link_create.prog_fd = xdp_prog_fd;
+    attr.link_create.target_ifindex = ifindex;
+    attr.link_create.attach_type = BPF_XDP;
+    attr.link_create.flags = flags;
+    xdp_link_fd = xdp_bpf(BPF_LINK_CREATE, &attr);
+    return xdp_link_fd < 0 ? -1 : 0;
+}
+
+/**
+ * @brief 映射一个环形队列
+ *
+ */
+static int xdp_map_ring(xdp_ring_t *ring, const struct xdp_ring_offset *off, size_t desc_size, off_t pgoff) {
+    ring->map_len = off->desc + XDP_RING_SIZE * desc_size;
+    ring->map = mmap(NULL, ring->map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, xsk_fd, pgoff);
+    if (ring->map == MAP_FAILED) {
+        ring->map = NULL;
+        return -1;
+    }
+    ring->producer = (uint32_t *)((uint8_t *)ring->map + off->producer);
+    ring->consumer = (uint32_t *)((uint8_t *)ring->map + off->consumer);
+    ring->flags = (uint32_t *)((uint8_t *)ring->map + off->flags);
+    ring->desc = (uint8_t *)ring->map + off->desc;
+    return 0;
+}
+
+/**
+ * @brief 根据ip进行前缀匹配，选取最长前缀匹配的网卡
+ *
+ * @param ip ip地址
+ * @param if_name 出口参数，选取的网卡名
+ * @return int 成功为0，失败为-1
+ */
+static int xdp_find(uint8_t *ip, char *if_name) {
+    struct ifaddrs *ifaddr;
+    if (getifaddrs(&ifaddr) < 0)
+        return -1;
+    int best = -1;
+    for (struct ifaddrs *a = ifaddr; a; a = a->ifa_next) {
+        if (!a->ifa_addr || a->ifa_addr->sa_family != AF_INET)
+            continue;
+        int match = ip_prefix_match(ip, (uint8_t *)&((struct sockaddr_in *)a->ifa_addr)->sin_addr.s_addr);
+        if (match > best) {
+            best = match;
+            snprintf(if_name, IF_NAMESIZE, "%s", a->ifa_name);
+        }
+    }
+    freeifaddrs(ifaddr);
+    return best < 0 ? -1 : 0;
+}
+
+/**
+ * @brief 把接收帧交给 fill 队列
+ *
+ */
+static void xdp_fill(uint64_t addr) {
+    uint32_t prod = *fill_ring.producer;
+    ((uint64_t *)fill_ring.desc)[prod & (XDP_RING_SIZE - 1)] = addr;
+    xdp_store(fill_ring.producer, prod + 1);
+}
+
+/**
+ * @brief 从 completion 队列回收已发送的帧
+ *
+ */
+static void xdp_complete() {
+    uint32_t cons = *comp_ring.consumer;
+    uint32_t prod = xdp_load(comp_ring.producer);
+    for (; cons != prod; cons++)
+        tx_free[tx_free_count++] = ((uint64_t *)comp_ring.desc)[cons & (XDP_RING_SIZE - 1)];
+    xdp_store(comp_ring.consumer, cons);
+}
+
+/**
+ * @brief 打开网卡
+ *
+ * @return int 成功为0，失败为-1
+ */
+static int xdp_driver_open() {
+    char if_name[IF_NAMESIZE] = {0};
+    const char *env = getenv("NET_XDP_IF");
+    if (env)
+        snprintf(if_name, sizeof(if_name), "%s", env);
+    else if (xdp_find(net_if_ip, if_name) < 0) {
+        fprintf(stderr, "Error in driver find.\n");
+        return -1;
+    }
+    int ifindex = if_nametoindex(if_name);
+    env = getenv("NET_XDP_QUEUE");
+    uint32_t queue = env ? strtoul(env, NULL, 10) : 0;
+    env = getenv("NET_XDP_MODE");
+    const char *mode = env ? env : "auto";
+    if (!ifindex || queue >= XDP_MAP_ENTRIES) {
+        fprintf(stderr, "Error in driver_open: bad interface %s queue %u.\n", if_name, queue);
+        return -1;
+    }
+
+    umem = mmap(NULL, (size_t)XDP_NUM_FRAMES * XDP_FRAME_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (umem == MAP_FAILED) {
+        umem = NULL;
+        fprintf(stderr, "Error in driver_open: mmap umem: %s.\n", strerror(errno));
+        return -1;
+    }
+    xsk_fd = socket(AF_XDP, SOCK_RAW, 0);
+    if (xsk_fd < 0) {
+        fprintf(stderr, "Error in driver_open: socket(AF_XDP): %s.\n", strerror(errno));
+        goto fail;
+    }
+    struct xdp_umem_reg reg = {
+        .addr = (uintptr_t)umem,
+        .len = (uint64_t)XDP_NUM_FRAMES * XDP_FRAME_SIZE,
+        .chunk_size = XDP_FRAME_SIZE,
+        .headroom = 0,
+    };
+    int ring_size = XDP_RING_SIZE;
+    struct xdp_mmap_offsets off;
+    socklen_t optlen = sizeof(off);
+    if (setsockopt(xsk_fd, SOL_XDP, XDP_UMEM_REG, &reg, sizeof(reg)) < 0 ||
+        setsockopt(xsk_fd, SOL_XDP, XDP_UMEM_FILL_RING, &ring_size, sizeof(ring_size)) < 0 ||
+        setsockopt(xsk_fd, SOL_XDP, XDP_UMEM_COMPLETION_RING, &ring_size, sizeof(ring_size)) < 0 ||
+        setsockopt(xsk_fd, SOL_XDP, XDP_RX_RING, &ring_size, sizeof(ring_size)) < 0 ||
+        setsockopt(xsk_fd, SOL_XDP, XDP_TX_RING, &ring_size, sizeof(ring_size)) < 0 ||
+        getsockopt(xsk_fd, SOL_XDP, XDP_MMAP_OFFSETS, &off, &optlen) < 0) {
+        fprintf(stderr, "Error in driver_open: configure AF_XDP socket: %s.\n", strerror(errno));
+        goto fail;
+    }
+    if (xdp_map_ring(&rx_ring, &off.rx, sizeof(struct xdp_desc), XDP_PGOFF_RX_RING) < 0 ||
+        xdp_map_ring(&tx_ring, &off.tx, sizeof(struct xdp_desc), XDP_PGOFF_TX_RING) < 0 ||
+        xdp_map_ring(&fill_ring, &off.fr, sizeof(uint64_t), XDP_UMEM_PGOFF_FILL_RING) < 0 ||
+        xdp_map_ring(&comp_ring, &off.cr, sizeof(uint64_t), XDP_UMEM_PGOFF_COMPLETION_RING) < 0) {
+        fprintf(stderr, "Error in driver_open: mmap rings: %s.\n", strerror(errno));
+        goto fail;
+    }
+    // 前一半帧交给 fill 队列用于接收，后一半留作发送
+    for (uint64_t i = 0; i < XDP_RX_FRAMES; i++)
+        xdp_fill(i * XDP_FRAME_SIZE);
+    tx_free_count = 0;
+    for (uint64_t i = XDP_RX_FRAMES; i < XDP_NUM_FRAMES; i++)
+        tx_free[tx_free_count++] = i * XDP_FRAME_SIZE;
+    lent = 0;
+
+    // 先尝试零拷贝，网卡驱动不支持时退回拷贝模式
+    struct sockaddr_xdp sxdp = {.sxdp_family = AF_XDP, .sxdp_ifindex = ifindex, .sxdp_queue_id = queue};
+    int bound = -1;
+    const char *bound_mode = NULL;
+    if (strcmp(mode, "copy")) {
+        sxdp.sxdp_flags = XDP_ZEROCOPY | XDP_USE_NEED_WAKEUP;
+        bound = bind(xsk_fd, (struct sockaddr *)&sxdp, sizeof(sxdp));
+        bound_mode = "zero-copy";
+    }
+    if (bound < 0 && strcmp(mode, "zerocopy")) {
+        sxdp.sxdp_flags = XDP_COPY | XDP_USE_NEED_WAKEUP;
+        bound = bind(xsk_fd, (struct sockaddr *)&sxdp, sizeof(sxdp));
+        bound_mode = "copy";
+    }
+    if (bound < 0) {
+        fprintf(stderr, "Error in driver_open: bind AF_XDP to %s queue %u: %s.\n", if_name, queue, strerror(errno));
+        goto fail;
+    }
+
+    if (xdp_load_prog() < 0) {
+        fprintf(stderr, "Error in driver_open: load XDP program: %s.\n", strerror(errno));
+        goto fail;
+    }
+    const char *attach_mode = "native";
+    if (xdp_attach(ifindex, XDP_FLAGS_DRV_MODE) < 0) {
+        attach_mode = "generic";
+        if (xdp_attach(ifindex, XDP_FLAGS_SKB_MODE) < 0) {
+            fprintf(stderr, "Error in driver_open: attach XDP program to %s: %s.\n", if_name, strerror(errno));
+            goto fail;
+        }
+    }
+    union bpf_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    uint32_t fd = xsk_fd;
+    attr.map_fd = xsk_map_fd;
+    attr.key = (uintptr_t)&queue;
+    attr.value = (uintptr_t)&fd;
+    if (xdp_bpf(BPF_MAP_UPDATE_ELEM, &attr) < 0) {
+        fprintf(stderr, "Error in driver_open: update XSKMAP: %s.\n", strerror(errno));
+        goto fail;
+    }
+    printf("Using interface %s queue %u (AF_XDP %s, %s XDP), my ip is %s.\n", if_name, queue, bound_mode, attach_mode, iptos(net_if_ip));
+    return 0;
+
+fail:
+    xdp_driver_close();
+    return -1;
+}
+
+/**
+ * @brief 试图从网卡接收数据包
+ *
+ * 收到的帧不拷贝，buf 直接指向 UMEM，在下一次接收前保持有效。
+ *
+ * @param buf 收到的数据包
+ * @return int 数据包的长度，未收到为0
+ */
+static int xdp_driver_recv(buf_t *buf) {
+    if (lent) {
+        xdp_fill(lent_addr);  // 上一帧已处理完，归还给网卡
+        lent = 0;
+    }
+    uint32_t cons = *rx_ring.consumer;
+    if (cons == xdp_load(rx_ring.producer)) {
+        if (xdp_load(fill_ring.flags) & XDP_RING_NEED_WAKEUP)
+            recvfrom(xsk_fd, NULL, 0, MSG_DONTWAIT, NULL, NULL);
+        return 0;
+    }
+    struct xdp_desc *desc = &((struct xdp_desc *)rx_ring.desc)[cons & (XDP_RING_SIZE - 1)];
+    uint64_t frame = desc->addr & ~(uint64_t)(XDP_FRAME_SIZE - 1);
+    buf_attach(buf, umem + frame, XDP_FRAME_SIZE, umem + desc->addr, desc->len);
+    lent_addr = frame;
+    lent = 1;
+    xdp_store(rx_ring.consumer, cons + 1);
+    return buf->len;
+}
+
+/**
+ * @brief 使用网卡发送一个数据包
+ *
+ * @param buf 要发送的数据包
+ * @return int 成功为0，失败为-1
+ */
+static int xdp_driver_send(buf_t *buf) {
+    xdp_complete();
+    uint32_t prod = *tx_ring.producer;
+    if (!tx_free_count || buf->len > XDP_FRAME_SIZE || prod - xdp_load(tx_ring.consumer) == XDP_RING_SIZE)
+        return -1;
+    uint64_t addr = tx_free[--tx_free_count];
+    memcpy(umem + addr, buf->data, buf->len);
+    struct xdp_desc *desc = &((struct xdp_desc *)tx_ring.desc)[prod & (XDP_RING_SIZE - 1)];
+    desc->addr = addr;
+    desc->len = buf->len;
+    desc->options = 0;
+    xdp_store(tx_ring.producer, prod + 1);
+    if (xdp_load(tx_ring.flags) & XDP_RING_NEED_WAKEUP)
+        sendto(xsk_fd, NULL, 0, MSG_DONTWAIT, NULL, 0);
+    return 0;
+}
+
+/**
+ * @brief 关闭网卡，卸载 XDP 程序并释放 UMEM
+ *
+ */
+static void xdp_driver_close() {
+    xdp_ring_t *rings[] = {&rx_ring, &tx_ring, &fill_ring, &comp_ring};
+    for (size_t i = 0; i < sizeof(rings) / sizeof(rings[0]); i++) {
+        if (rings[i]->map)
+            munmap(rings[i]->map, rings[i]->map_len);
+        memset(rings[i], 0, sizeof(xdp_ring_t));
+    }
+    int *fds[] = {&xdp_link_fd, &xdp_prog_fd, &xsk_map_fd, &xsk_fd};
+    for (size_t i = 0; i < sizeof(fds) / sizeof(fds[0]); i++) {
+        if (*fds[i] >= 0)
+            close(*fds[i]);
+        *fds[i] = -1;
+    }
+    if (umem)
+        munmap(umem, (size_t)XDP_NUM_FRAMES * XDP_FRAME_SIZE);
+    umem = NULL;
+}
+
+static int xdp_driver_fd() {
+    return xsk_fd;
+}
+
+static const driver_ops_t xdp_driver = {
+    .name = "xdp",
+    .caps = DRIVER_CAP_SELECT_FD,
+    .open = xdp_driver_open,
+    .recv = xdp_driver_recv,
+    .send = xdp_driver_send,
+    .close = xdp_driver_close,
+    .fd = xdp_driver_fd,
+};
+DRIVER_REGISTER(xdp_driver)
+#endif
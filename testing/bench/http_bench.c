@@ -0,0 +1,418 @@
+/**
+ * @file http_bench.c
+ * @brief web_server 负载基准测试
+ *
+ * 用进程内的驱动替代网卡：模拟大量并发 HTTP/1.1 客户端（三次握手、GET、
+ * 确认、FIN 挥手），以以太网帧的形式交给未经修改的协议栈与 http_request_handler，
+ * 并解析协议栈发出的帧来推进各客户端。分别在文件已缓存和每次请求前丢弃页缓存
+ * （posix_fadvise DONTNEED）两种情况下报告请求速率、吞吐、每请求 CPU 时间与时延分位数。
+ *
+ * 用法: http_bench [-c 并发客户端数] [-n 每阶段请求数] [-k 每连接请求数] [路径...]
+ */
+
+#define _GNU_SOURCE  // memmem
+
+#include "arp.h"
+#include "driver.h"
+#include "ethernet.h"
+#include "http.h"
+#include "ip.h"
+#include "net.h"
+#include "tcp.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#define BENCH_MAX_CLIENTS 1024                                              // 最大并发客户端数
+#define BENCH_QUEUE_LEN 8192                                                // 客户端发往协议栈的帧队列长度
+#define BENCH_FRAME_LEN (sizeof(ether_hdr_t) + ETHERNET_MAX_TRANSPORT_UNIT)  // 最大帧长
+#define BENCH_PORT_BASE 10000                                               // 客户端端口起始值
+#define BENCH_ACK_EVERY 2                                                   // 客户端每收到几个数据段确认一次（延迟确认）
+
+typedef enum bench_state {
+    BENCH_IDLE,         // 未连接
+    BENCH_SYN_SENT,     // 已发送 SYN
+    BENCH_WAIT_RESP,    // 已发送请求，等待响应
+    BENCH_FIN_WAIT,     // 已发送 FIN，等待对端 FIN
+} bench_state_t;
+
+typedef struct bench_client {
+    bench_state_t state;
+    uint16_t port;           // 本连接使用的源端口
+    uint32_t snd_nxt;        // 下一个要发送的序号
+    uint32_t rcv_nxt;        // 期望收到的下一个序号
+    int conn_requests;       // 本连接已完成的请求数
+    int path;                // 当前请求的路径下标
+    int header_done;         // 是否已收到完整响应头
+    size_t body_left;        // 尚未收到的消息体长度
+    int unacked;             // 尚未确认的数据段数
+    uint64_t start_us;       // 当前请求的发出时刻
+} bench_client_t;
+
+typedef struct bench_frame {
+    uint16_t len;
+    uint8_t data[BENCH_FRAME_LEN];
+} bench_frame_t;
+
+static bench_frame_t queue[BENCH_QUEUE_LEN];  // 客户端 -> 协议栈
+static size_t queue_head, queue_tail;
+
+static bench_client_t clients[BENCH_MAX_CLIENTS];
+static int client_by_port[UINT16_MAX + 1];  // 端口 -> 客户端下标 + 1
+static uint16_t next_port = BENCH_PORT_BASE;
+
+static uint8_t client_ip[NET_IP_LEN] = {10, 77, 0, 2};
+static uint8_t client_mac[NET_MAC_LEN] = {0x02, 0x00, 0x00, 0x00, 0x77, 0x02};
+
+static int num_clients = 64;
+static long num_requests = 20000;
+static int conn_requests = 8;
+static const char *default_paths[] = {"/index.html", "/style.css", "/assets/img1.jpg", "/assets/img2.jpg",
+                                      "/assets/img3.jpg", "/assets/img4.jpg", "/assets/img5.jpg", "/assets/img6.jpg"};
+static const char **paths = default_paths;
+static int num_paths = sizeof(default_paths) / sizeof(default_paths[0]);
+
+/* 当前阶段的统计 */
+static int uncached;
+static long started, completed;
+static uint64_t bytes_received;
+static uint64_t *latencies;
+
+/* ========================= 进程内驱动 ========================= */
+
+static int http_driver_open() {
+    return 0;
+}
+
+static int http_driver_recv(buf_t *buf) {
+    if (queue_head == queue_tail)
+        return 0;
+    bench_frame_t *frame = &queue[queue_tail++ % BENCH_QUEUE_LEN];
+    buf_init(buf, frame->len);
+    memcpy(buf->data, frame->data, frame->len);
+    return frame->len;
+}
+
+static void bench_stack_out(uint8_t *data, size_t len);
+
+static int http_driver_send(buf_t *buf) {
+    bench_stack_out(buf->data, buf->len);
+    return 0;
+}
+
+static void http_driver_close() {
+}
+
+static const driver_ops_t http_driver = {
+    .name = "http",
+    .rank = 10,
+    .open = http_driver_open,
+    .recv = http_driver_recv,
+    .send = http_driver_send,
+    .close = http_driver_close,
+};
+DRIVER_REGISTER(http_driver)
+
+/* ========================= 客户端发包 ========================= */
+
+static uint8_t *bench_frame_alloc(size_t len) {
+    if (queue_head - queue_tail == BENCH_QUEUE_LEN) {
+        fprintf(stderr, "bench: frame queue overflow\n");
+        exit(1);
+    }
+    bench_frame_t *frame = &queue[queue_head++ % BENCH_QUEUE_LEN];
+    frame->len = len < sizeof(ether_hdr_t) + ETHERNET_MIN_TRANSPORT_UNIT ? sizeof(ether_hdr_t) + ETHERNET_MIN_TRANSPORT_UNIT : len;
+    memset(frame->data, 0, sizeof(frame->data));  // 奇数长度的校验和计算依赖其后的填充字节为0
+    ether_hdr_t *eth = (ether_hdr_t *)frame->data;
+    memcpy(eth->dst, net_if_mac, NET_MAC_LEN);
+    memcpy(eth->src, client_mac, NET_MAC_LEN);
+    return frame->data;
+}
+
+static void bench_send_tcp(bench_client_t *client, uint8_t flags, const void *payload, size_t len) {
+    size_t seg_len = sizeof(tcp_hdr_t) + len;
+    uint8_t *frame = bench_frame_alloc(sizeof(ether_hdr_t) + sizeof(ip_hdr_t) + seg_len);
+    ((ether_hdr_t *)frame)->protocol16 = swap16(NET_PROTOCOL_IP);
+    ip_hdr_t *ip = (ip_hdr_t *)(frame + sizeof(ether_hdr_t));
+    tcp_hdr_t *tcp = (tcp_hdr_t *)(ip + 1);
+
+    tcp->src_port16 = swap16(client->port);
+    tcp->dst_port16 = swap16(80);
+    tcp->seq = swap32(client->snd_nxt);
+    tcp->ack = swap32(client->rcv_nxt);
+    tcp->doff = (sizeof(tcp_hdr_t) / 4) << 4;
+    tcp->flags = flags;
+    tcp->win = swap16(UINT16_MAX);
+    memcpy(tcp + 1, payload, len);
+
+    // 伪首部暂存于 IP 首部的后12字节，计算完校验和后再填写 IP 首部
+    uint8_t *pseudo = (uint8_t *)tcp - 12;
+    memcpy(pseudo, client_ip, NET_IP_LEN);
+    memcpy(pseudo + 4, net_if_ip, NET_IP_LEN);
+    pseudo[8] = 0;
+    pseudo[9] = NET_PROTOCOL_TCP;
+    pseudo[10] = seg_len >> 8;
+    pseudo[11] = seg_len;
+    tcp->checksum16 = checksum16((uint16_t *)pseudo, (12 + seg_len + 1) / 2);  // 奇数长度时末尾的0即为填充
+
+    memset(ip, 0, sizeof(ip_hdr_t));
+    ip->version = IP_VERSION_4;
+    ip->hdr_len = sizeof(ip_hdr_t) / IP_HDR_LEN_PER_BYTE;
+    ip->total_len16 = swap16(sizeof(ip_hdr_t) + seg_len);
+    ip->ttl = IP_DEFALUT_TTL;
+    ip->protocol = NET_PROTOCOL_TCP;
+    memcpy(ip->src_ip, client_ip, NET_IP_LEN);
+    memcpy(ip->dst_ip, net_if_ip, NET_IP_LEN);
+    ip->hdr_checksum16 = checksum16((uint16_t *)ip, sizeof(ip_hdr_t) / 2);
+
+    client->snd_nxt += len + (flags & (TCP_FLG_SYN | TCP_FLG_FIN) ? 1 : 0);
+}
+
+/**
+ * @brief 以 ARP 请求宣告客户端地址，使协议栈预先学到 MAC，避免并发建连时等待解析
+ *
+ */
+static void bench_send_arp_announce() {
+    uint8_t *frame = bench_frame_alloc(sizeof(ether_hdr_t) + sizeof(arp_pkt_t));
+    ether_hdr_t *eth = (ether_hdr_t *)frame;
+    eth->protocol16 = swap16(NET_PROTOCOL_ARP);
+    arp_pkt_t *arp = (arp_pkt_t *)(eth + 1);
+    arp->hw_type16 = swap16(ARP_HW_ETHER);
+    arp->pro_type16 = swap16(NET_PROTOCOL_IP);
+    arp->hw_len = NET_MAC_LEN;
+    arp->pro_len = NET_IP_LEN;
+    arp->opcode16 = swap16(ARP_REQUEST);
+    memcpy(arp->sender_mac, client_mac, NET_MAC_LEN);
+    memcpy(arp->sender_ip, client_ip, NET_IP_LEN);
+    memcpy(arp->target_ip, net_if_ip, NET_IP_LEN);
+}
+
+static void bench_send_arp_reply(arp_pkt_t *req) {
+    uint8_t *frame = bench_frame_alloc(sizeof(ether_hdr_t) + sizeof(arp_pkt_t));
+    ether_hdr_t *eth = (ether_hdr_t *)frame;
+    eth->protocol16 = swap16(NET_PROTOCOL_ARP);
+    arp_pkt_t *arp = (arp_pkt_t *)(eth + 1);
+    *arp = *req;
+    arp->opcode16 = swap16(ARP_REPLY);
+    memcpy(arp->sender_mac, client_mac, NET_MAC_LEN);
+    memcpy(arp->sender_ip, client_ip, NET_IP_LEN);
+    memcpy(arp->target_mac, req->sender_mac, NET_MAC_LEN);
+    memcpy(arp->target_ip, req->sender_ip, NET_IP_LEN);
+}
+
+/* ========================= 客户端状态机 ========================= */
+
+static void bench_send_request(bench_client_t *client) {
+    char request[256];
+    client->path = started++ % num_paths;
+    client->header_done = 0;
+    client->body_left = 0;
+    if (uncached) {  // 丢弃页缓存，使本次请求从磁盘读取
+        char file_path[HTTP_MAX_PATH_LENGTH];
+        snprintf(file_path, sizeof(file_path), "%s%s", HTTP_RESOURCE_DIR, paths[client->path]);
+        int fd = open(file_path, O_RDONLY);
+        if (fd >= 0) {
+            posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+            close(fd);
+        }
+    }
+    int len = snprintf(request, sizeof(request), "GET %s HTTP/1.1\r\nHost: bench\r\nUser-Agent: http_bench\r\n\r\n", paths[client->path]);
+    client->start_us = net_now_us();
+    bench_send_tcp(client, TCP_FLG_ACK | TCP_FLG_PSH, request, len);
+    client->state = BENCH_WAIT_RESP;
+}
+
+static void bench_connect(bench_client_t *client) {
+    if (client->port)
+        client_by_port[client->port] = 0;
+    // 跳过仍被占用的端口
+    while (client_by_port[next_port] || next_port < BENCH_PORT_BASE)
+        next_port = next_port == UINT16_MAX ? BENCH_PORT_BASE : next_port + 1;
+    client->port = next_port++;
+    client_by_port[client->port] = client - clients + 1;
+    client->snd_nxt = rand();
+    client->rcv_nxt = 0;
+    client->conn_requests = 0;
+    client->unacked = 0;
+    client->state = BENCH_SYN_SENT;
+    bench_send_tcp(client, TCP_FLG_SYN, NULL, 0);
+}
+
+static void bench_response_done(bench_client_t *client) {
+    latencies[completed++] = net_now_us() - client->start_us;
+    client->conn_requests++;
+    if (client->conn_requests < conn_requests && started < num_requests) {
+        bench_send_request(client);
+    } else {
+        bench_send_tcp(client, TCP_FLG_FIN | TCP_FLG_ACK, NULL, 0);
+        client->state = BENCH_FIN_WAIT;
+    }
+}
+
+static void bench_tcp_in(tcp_hdr_t *tcp, uint8_t *payload, size_t len) {
+    int index = client_by_port[swap16(tcp->dst_port16)];
+    if (!index)
+        return;
+    bench_client_t *client = &clients[index - 1];
+    uint8_t flags = tcp->flags;
+
+    switch (client->state) {
+        case BENCH_SYN_SENT:
+            if (TCP_FLG_ISSET(flags, TCP_FLG_SYN) && TCP_FLG_ISSET(flags, TCP_FLG_ACK)) {
+                client->rcv_nxt = swap32(tcp->seq) + 1;
+                bench_send_tcp(client, TCP_FLG_ACK, NULL, 0);
+                if (started < num_requests) {
+                    bench_send_request(client);
+                } else {  // 握手期间其他客户端已发出本阶段的全部请求
+                    bench_send_tcp(client, TCP_FLG_FIN | TCP_FLG_ACK, NULL, 0);
+                    client->state = BENCH_FIN_WAIT;
+                }
+            }
+            break;
+        case BENCH_WAIT_RESP:
+            if (len == 0 || swap32(tcp->seq) != client->rcv_nxt)
+                break;
+            client->rcv_nxt += len;
+            bytes_received += len;
+            if (!client->header_done) {  // 响应头由一次 tcp_send 发出，完整地位于一个数据段中
+                char *cl = memmem(payload, len, "Content-Length: ", 16);
+                client->body_left = cl ? strtoul(cl + 16, NULL, 10) : 0;
+                client->header_done = 1;
+            } else {
+                client->body_left -= len < client->body_left ? len : client->body_left;
+            }
+            if (client->body_left == 0) {
+                client->unacked = 0;
+                bench_response_done(client);  // 下一个请求或 FIN 顺带确认
+            } else if (++client->unacked == BENCH_ACK_EVERY) {
+                client->unacked = 0;
+                bench_send_tcp(client, TCP_FLG_ACK, NULL, 0);
+            }
+            break;
+        case BENCH_FIN_WAIT:
+            if (TCP_FLG_ISSET(flags, TCP_FLG_FIN)) {
+                client->rcv_nxt = swap32(tcp->seq) + len + 1;
+                bench_send_tcp(client, TCP_FLG_ACK, NULL, 0);
+                client->state = BENCH_IDLE;
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+/**
+ * @brief 处理协议栈发出的一帧
+ *
+ */
+static void bench_stack_out(uint8_t *data, size_t len) {
+    ether_hdr_t *eth = (ether_hdr_t *)data;
+    if (len < sizeof(ether_hdr_t))
+        return;
+    if (swap16(eth->protocol16) == NET_PROTOCOL_ARP) {
+        arp_pkt_t *arp = (arp_pkt_t *)(eth + 1);
+        if (swap16(arp->opcode16) == ARP_REQUEST && memcmp(arp->target_ip, client_ip, NET_IP_LEN) == 0)
+            bench_send_arp_reply(arp);
+        return;
+    }
+    if (swap16(eth->protocol16) != NET_PROTOCOL_IP)
+        return;
+    ip_hdr_t *ip = (ip_hdr_t *)(eth + 1);
+    if (ip->protocol != NET_PROTOCOL_TCP)
+        return;
+    size_t ip_len = swap16(ip->total_len16);
+    size_t ip_hdr_len = ip->hdr_len * IP_HDR_LEN_PER_BYTE;
+    tcp_hdr_t *tcp = (tcp_hdr_t *)((uint8_t *)ip + ip_hdr_len);
+    size_t tcp_hdr_len = (tcp->doff >> 4) * 4;
+    bench_tcp_in(tcp, (uint8_t *)tcp + tcp_hdr_len, ip_len - ip_hdr_len - tcp_hdr_len);
+}
+
+/* ========================= 测量 ========================= */
+
+static int bench_compare(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static uint64_t bench_cpu_us() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return (uint64_t)(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000 + usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+static void bench_run(const char *name) {
+    started = completed = 0;
+    bytes_received = 0;
+    for (int i = 0; i < num_clients; i++)
+        clients[i].state = BENCH_IDLE;
+
+    bench_send_arp_announce();
+    while (queue_head != queue_tail)
+        net_poll();
+
+    uint64_t wall_start = net_now_us(), cpu_start = bench_cpu_us();
+    while (completed < num_requests) {
+        for (int i = 0; i < num_clients && started < num_requests; i++)
+            if (clients[i].state == BENCH_IDLE)
+                bench_connect(&clients[i]);
+        // 处理完客户端已发出的帧再调度一轮响应，避免确认帧在队列中堆积
+        while (queue_head != queue_tail)
+            net_poll();
+        http_schedule();
+    }
+    // 等待最后的挥手完成
+    while (queue_head != queue_tail)
+        net_poll();
+    uint64_t wall_us = net_now_us() - wall_start, cpu_us = bench_cpu_us() - cpu_start;
+
+    qsort(latencies, completed, sizeof(uint64_t), bench_compare);
+    printf("%-9s %8ld req %9.0f req/s %9.2f MB/s %8.1f us-cpu/req  latency us p50 %llu p90 %llu p99 %llu max %llu\n",
+           name, completed, completed * 1e6 / wall_us, bytes_received / (double)wall_us, (double)cpu_us / completed,
+           (unsigned long long)latencies[completed / 2], (unsigned long long)latencies[completed * 9 / 10],
+           (unsigned long long)latencies[completed * 99 / 100], (unsigned long long)latencies[completed - 1]);
+}
+
+int main(int argc, char *argv[]) {
+    int opt;
+    while ((opt = getopt(argc, argv, "c:n:k:")) != -1) {
+        switch (opt) {
+            case 'c':
+                num_clients = atoi(optarg);
+                break;
+            case 'n':
+                num_requests = atol(optarg);
+                break;
+            case 'k':
+                conn_requests = atoi(optarg);
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-c clients] [-n requests] [-k requests-per-connection] [path...]\n", argv[0]);
+                return 1;
+        }
+    }
+    if (optind < argc) {
+        paths = (const char **)argv + optind;
+        num_paths = argc - optind;
+    }
+    if (num_clients < 1 || num_clients > BENCH_MAX_CLIENTS || num_requests < 1 || conn_requests < 1) {
+        fprintf(stderr, "invalid arguments\n");
+        return 1;
+    }
+    latencies = malloc(num_requests * sizeof(uint64_t));
+
+    if (net_init() == -1 || http_server_init() == -1) {
+        fprintf(stderr, "init failed\n");
+        return 1;
+    }
+    printf("%d clients, %ld requests per phase, %d requests per connection, %d paths\n", num_clients, num_requests, conn_requests, num_paths);
+
+    uncached = 0;
+    bench_run("cached");
+    uncached = 1;
+    bench_run("uncached");
+    free(latencies);
+    return 0;
+}
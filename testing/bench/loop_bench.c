@@ -0,0 +1,238 @@
+/**
+ * @file loop_bench.c
+ * @brief 进程内端到端基准测试
+ *
+ * 两个协议栈实例（服务端与客户端）各运行在自己的线程中，经 loop.c 的内存链路相连，
+ * 不需要网卡、pcap 文件或第二台机器：
+ *   - tcp: 客户端建立连接后在对端窗口内持续发送，报告服务端收到的吞吐量；
+ *   - rr:  客户端以 UDP 逐个发送请求并等待服务端回显（类似 netperf UDP_RR），报告往返时延分位数。
+ * 每秒输出一次进度。-i 指定客户端发送方向的损伤参数（见 impair_parse），此时 rr 模式的丢包
+ * 由超时重发恢复；TCP 没有重传，丢包后吞吐会停止。
+ *
+ * 用法: loop_bench [-m tcp|rr] [-t 秒] [-l 长度] [-i 损伤参数]
+ */
+
+#include "loop.h"
+#include "tcp.h"
+#include "udp.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define LOOP_BENCH_PORT 5001            // 服务端端口
+#define LOOP_BENCH_LOCAL_PORT 40000     // 客户端端口
+#define LOOP_BENCH_SYN_RETRY_US 100000  // 握手未完成时重发 SYN 的间隔
+#define LOOP_BENCH_RR_TIMEOUT_NS 100000000ULL  // rr 请求的超时重发时间
+#define LOOP_BENCH_RR_WARMUP 100        // rr 模式丢弃的前若干个样本（含 ARP 解析）
+#define LOOP_BENCH_MAX_SAMPLES (1 << 22)
+
+typedef struct rr_msg {
+    uint64_t seq;
+    uint64_t sent_ns;
+} rr_msg_t;
+
+static net_stack_t server = {
+    .mac = {0x02, 0x00, 0x00, 0x00, 0x00, 0x01},
+    .ip = {10, 0, 0, 1},
+};
+static net_stack_t client = {
+    .mac = {0x02, 0x00, 0x00, 0x00, 0x00, 0x02},
+    .ip = {10, 0, 0, 2},
+};
+
+static int rr_mode;
+static size_t msg_len;
+static uint8_t message[TCP_MAX_WINDOW_SIZE];
+
+static atomic_uint_fast64_t bytes_received;  // 服务端收到的 TCP 数据
+static atomic_uint_fast64_t transactions;    // rr 模式完成的请求数
+static atomic_uint_fast64_t timeouts;        // rr 模式超时重发的请求数
+
+static tcp_conn_t *client_conn;  // 以下仅由客户端线程访问
+static uint64_t last_syn_us;
+static uint64_t rr_seq, rr_sent_ns;
+static int rr_outstanding;
+static uint64_t *samples;
+static size_t num_samples;
+
+static uint64_t bench_now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int bench_compare(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+/* ========================= 服务端 ========================= */
+
+static void server_tcp_handler(tcp_conn_t *tcp_conn, uint8_t *data, size_t len, uint8_t *src_ip, uint16_t src_port) {
+    atomic_fetch_add_explicit(&bytes_received, len, memory_order_relaxed);
+}
+
+static void server_udp_handler(uint8_t *data, size_t len, uint8_t *src_ip, uint16_t src_port) {
+    udp_send(data, len, LOOP_BENCH_PORT, src_ip, src_port);
+}
+
+static void server_setup(net_stack_t *stack) {
+    if (rr_mode)
+        udp_open(LOOP_BENCH_PORT, server_udp_handler);
+    else
+        tcp_open(LOOP_BENCH_PORT, server_tcp_handler);
+}
+
+/* ========================= 客户端 ========================= */
+
+static void client_tcp_handler(tcp_conn_t *tcp_conn, uint8_t *data, size_t len, uint8_t *src_ip, uint16_t src_port) {
+}
+
+static void client_udp_handler(uint8_t *data, size_t len, uint8_t *src_ip, uint16_t src_port) {
+    rr_msg_t *msg = (rr_msg_t *)data;
+    if (len < sizeof(rr_msg_t) || !rr_outstanding || msg->seq != rr_seq)
+        return;  // 超时后才到达的旧回复
+    if (rr_seq >= LOOP_BENCH_RR_WARMUP && num_samples < LOOP_BENCH_MAX_SAMPLES)
+        samples[num_samples++] = bench_now_ns() - msg->sent_ns;
+    rr_outstanding = 0;
+    rr_seq++;
+    atomic_fetch_add_explicit(&transactions, 1, memory_order_relaxed);
+}
+
+static void client_setup(net_stack_t *stack) {
+    if (rr_mode)
+        udp_open(LOOP_BENCH_LOCAL_PORT, client_udp_handler);
+    else
+        tcp_open(LOOP_BENCH_LOCAL_PORT, client_tcp_handler);
+}
+
+static void client_poll(net_stack_t *stack) {
+    if (rr_mode) {
+        uint64_t now = bench_now_ns();
+        if (rr_outstanding && now - rr_sent_ns < LOOP_BENCH_RR_TIMEOUT_NS)
+            return;
+        if (rr_outstanding)
+            atomic_fetch_add_explicit(&timeouts, 1, memory_order_relaxed);
+        rr_msg_t *msg = (rr_msg_t *)message;
+        msg->seq = rr_seq;
+        msg->sent_ns = rr_sent_ns = now;
+        rr_outstanding = 1;
+        udp_send(message, msg_len, LOOP_BENCH_LOCAL_PORT, server.ip, LOOP_BENCH_PORT);
+        return;
+    }
+    if (!client_conn || client_conn->state == TCP_STATE_SYN_SENT) {
+        uint64_t now = net_now_us();
+        if (!client_conn || now - last_syn_us >= LOOP_BENCH_SYN_RETRY_US) {
+            client_conn = tcp_connect(LOOP_BENCH_LOCAL_PORT, server.ip, LOOP_BENCH_PORT);
+            last_syn_us = now;
+        }
+        return;
+    }
+    if (client_conn->state != TCP_STATE_ESTABLISHED)
+        return;
+    uint32_t in_flight = client_conn->seq - client_conn->snd_una;
+    while (client_conn->snd_wnd > in_flight && client_conn->snd_wnd - in_flight >= msg_len) {
+        tcp_send(client_conn, message, msg_len, LOOP_BENCH_LOCAL_PORT, server.ip, LOOP_BENCH_PORT);
+        client_conn->not_send_empty_ack = 0;  // 主动发送的数据不代替对后续报文的确认
+        in_flight = client_conn->seq - client_conn->snd_una;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    int seconds = 3;
+    int opt;
+    const char *impair = NULL;
+    msg_len = 0;
+    while ((opt = getopt(argc, argv, "m:t:l:i:")) != -1) {
+        switch (opt) {
+            case 'm':
+                rr_mode = !strcmp(optarg, "rr");
+                if (!rr_mode && strcmp(optarg, "tcp")) {
+                    fprintf(stderr, "unknown mode %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 't':
+                seconds = atoi(optarg);
+                break;
+            case 'l':
+                msg_len = atoi(optarg);
+                break;
+            case 'i':
+                impair = optarg;
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-m tcp|rr] [-t seconds] [-l length] [-i impairment]\n", argv[0]);
+                return 1;
+        }
+    }
+    if (!msg_len)
+        msg_len = rr_mode ? 64 : ETHERNET_MAX_TRANSPORT_UNIT - 40;
+    if (seconds <= 0 || msg_len > ETHERNET_MAX_TRANSPORT_UNIT - 40 || (rr_mode && msg_len < sizeof(rr_msg_t))) {
+        fprintf(stderr, "invalid arguments\n");
+        return 1;
+    }
+#ifdef IMPAIR
+    client.impair_tx = impair;
+#else
+    if (impair) {
+        fprintf(stderr, "built without IMPAIR\n");
+        return 1;
+    }
+#endif
+    samples = malloc(LOOP_BENCH_MAX_SAMPLES * sizeof(uint64_t));
+    if (!samples || loop_link(&server, &client) < 0) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    server.setup = server_setup;
+    client.setup = client_setup;
+    client.poll = client_poll;
+
+    printf("%s mode, %zu-byte messages, %d seconds, ring %d frames\n", rr_mode ? "rr" : "tcp", msg_len, seconds, LOOP_RING_LEN);
+    if (loop_start(&server) < 0 || loop_start(&client) < 0) {
+        fprintf(stderr, "failed to start stack threads\n");
+        return 1;
+    }
+    uint64_t start = bench_now_ns(), last_bytes = 0, last_trans = 0;
+    for (int i = 1; i <= seconds; i++) {
+        sleep(1);
+        uint64_t bytes = atomic_load(&bytes_received), trans = atomic_load(&transactions);
+        if (rr_mode)
+            printf("[%2d s] %10llu trans/s\n", i, (unsigned long long)(trans - last_trans));
+        else
+            printf("[%2d s] %10.2f Mbit/s\n", i, (bytes - last_bytes) * 8 / 1e6);
+        last_bytes = bytes, last_trans = trans;
+    }
+    loop_stop(&client);
+    loop_stop(&server);
+    double elapsed = (bench_now_ns() - start) / 1e9;
+    if (server.ret < 0 || client.ret < 0) {
+        fprintf(stderr, "stack initialization failed\n");
+        return 1;
+    }
+
+    if (rr_mode) {
+        printf("total: %llu transactions, %.0f trans/s, %llu timeouts\n", (unsigned long long)atomic_load(&transactions),
+               atomic_load(&transactions) / elapsed, (unsigned long long)atomic_load(&timeouts));
+        if (num_samples) {
+            qsort(samples, num_samples, sizeof(uint64_t), bench_compare);
+            uint64_t sum = 0;
+            for (size_t i = 0; i < num_samples; i++)
+                sum += samples[i];
+            printf("rtt: avg %.0f ns  p50 %llu  p99 %llu  p99.9 %llu  max %llu\n", (double)sum / num_samples,
+                   (unsigned long long)samples[num_samples / 2], (unsigned long long)samples[num_samples * 99 / 100],
+                   (unsigned long long)samples[num_samples * 999 / 1000], (unsigned long long)samples[num_samples - 1]);
+        }
+    } else {
+        printf("total: %llu bytes, %.2f Mbit/s\n", (unsigned long long)atomic_load(&bytes_received),
+               atomic_load(&bytes_received) * 8 / elapsed / 1e6);
+    }
+    printf("ring drops: client->server %llu, server->client %llu\n", (unsigned long long)client.tx->dropped,
+           (unsigned long long)server.tx->dropped);
+    loop_unlink(&server, &client);
+    free(samples);
+    return 0;
+}
@@ -0,0 +1,463 @@
+/**
+ * @file micro_bench.c
+ * @brief 协议栈基础操作的微基准测试
+ *
+ * 覆盖校验和、map、buf、各层输入处理、ARP 发送与地址格式化。每项先预热，再以
+ * 校准后的批量重复采样（每批约 MICRO_SAMPLE_MS），报告每次操作纳秒数的中位数、
+ * 最小值与 p10~p90 离散度。进程固定在一个 CPU 上运行以减小迁移带来的波动。
+ *
+ * 用法: micro_bench [-c CPU] [-s 采样数] [名称子串...]
+ */
+
+#define _GNU_SOURCE  // sched_setaffinity
+
+#include "arp.h"
+#include "driver.h"
+#include "ethernet.h"
+#include "ip.h"
+#include "map.h"
+#include "net.h"
+#include "tcp.h"
+#include "udp.h"
+#include "utils.h"
+
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define MICRO_MAX_CASES 64     // 最大测试项数
+#define MICRO_WARMUP_MS 50     // 每项的预热时间
+#define MICRO_SAMPLE_MS 5      // 每个样本的目标时间
+#define MICRO_PORT 60000       // 输入处理测试使用的本地端口
+#define MICRO_REMOTE_PORT 50000
+
+typedef struct micro_case {
+    char name[48];
+    void (*setup)(long arg);              // 准备数据，不计时，可为 NULL
+    void (*run)(long arg, uint64_t iters);  // 执行 iters 次操作
+    long arg;
+} micro_case_t;
+
+static micro_case_t cases[MICRO_MAX_CASES];
+static int num_cases;
+static int num_samples = 21;
+static volatile uint64_t sink;  // 防止结果被优化掉
+
+extern _Thread_local map_t arp_table;
+extern _Thread_local map_t arp_buf;
+
+static uint8_t remote_ip[NET_IP_LEN] = {10, 77, 0, 2};
+static uint8_t remote_mac[NET_MAC_LEN] = {0x02, 0x00, 0x00, 0x00, 0x77, 0x02};
+
+static void micro_udp_handler(uint8_t *data, size_t len, uint8_t *src_ip, uint16_t src_port) {
+    sink += len;
+}
+
+static void micro_tcp_handler(tcp_conn_t *tcp_conn, uint8_t *data, size_t len, uint8_t *src_ip, uint16_t src_port) {
+}
+
+/* ========================= 空驱动 ========================= */
+
+static buf_t last_sent;
+
+static int micro_driver_open() {
+    return 0;
+}
+
+static int micro_driver_recv(buf_t *buf) {
+    return 0;
+}
+
+static int micro_driver_send(buf_t *buf) {
+    last_sent.len = buf->len;
+    last_sent.data = buf->data;
+    return 0;
+}
+
+static void micro_driver_close() {
+}
+
+static const driver_ops_t micro_driver = {
+    .name = "micro",
+    .rank = 10,
+    .open = micro_driver_open,
+    .recv = micro_driver_recv,
+    .send = micro_driver_send,
+    .close = micro_driver_close,
+};
+DRIVER_REGISTER(micro_driver)
+
+/**
+ * @brief 重新初始化协议栈，注册测试端口并将对端写入 ARP 表，使各项互不影响
+ */
+static void micro_stack_reset() {
+    net_init();
+    udp_open(MICRO_PORT, micro_udp_handler);
+    tcp_open(MICRO_PORT, micro_tcp_handler);
+    map_set(&arp_table, remote_ip, remote_mac);
+}
+
+/* ========================= 校验和 ========================= */
+
+static uint8_t data_area[2048 + 2];
+
+static void run_checksum16(long arg, uint64_t iters) {
+    size_t len = arg & 0xFFFF;
+    uint16_t *data = (uint16_t *)(data_area + (arg >> 16));  // 奇数偏移即非对齐访问
+    uint64_t acc = 0;
+    for (uint64_t i = 0; i < iters; i++)
+        acc += checksum16(data, len / 2);
+    sink = acc;
+}
+
+static buf_t canned;            // 预先构造的数据包
+static uint8_t *canned_data;    // 数据包起始位置，每次操作前恢复
+static size_t canned_len;
+
+/**
+ * @brief 构造一个发往本机的 IPv4 UDP 数据包，payload 为负载长度
+ */
+static void micro_udp_packet(size_t payload) {
+    buf_init(&canned, payload);
+    for (size_t i = 0; i < payload; i++)
+        canned.data[i] = i;
+    buf_add_header(&canned, sizeof(udp_hdr_t));
+    udp_hdr_t *udp = (udp_hdr_t *)canned.data;
+    udp->src_port16 = swap16(MICRO_REMOTE_PORT);
+    udp->dst_port16 = swap16(MICRO_PORT);
+    udp->total_len16 = swap16(canned.len);
+    udp->checksum16 = 0;
+    udp->checksum16 = transport_checksum(NET_PROTOCOL_UDP, &canned, remote_ip, net_if_ip);
+
+    buf_add_header(&canned, sizeof(ip_hdr_t));
+    ip_hdr_t *ip = (ip_hdr_t *)canned.data;
+    memset(ip, 0, sizeof(ip_hdr_t));
+    ip->version = IP_VERSION_4;
+    ip->hdr_len = sizeof(ip_hdr_t) / IP_HDR_LEN_PER_BYTE;
+    ip->total_len16 = swap16(canned.len);
+    ip->ttl = IP_DEFALUT_TTL;
+    ip->protocol = NET_PROTOCOL_UDP;
+    memcpy(ip->src_ip, remote_ip, NET_IP_LEN);
+    memcpy(ip->dst_ip, net_if_ip, NET_IP_LEN);
+    ip->hdr_checksum16 = checksum16((uint16_t *)ip, sizeof(ip_hdr_t) / 2);
+    canned_data = canned.data;
+    canned_len = canned.len;
+}
+
+static void setup_transport_checksum(long arg) {
+    micro_udp_packet(arg);
+    buf_remove_header(&canned, sizeof(ip_hdr_t));
+}
+
+static void run_transport_checksum(long arg, uint64_t iters) {
+    uint64_t acc = 0;
+    for (uint64_t i = 0; i < iters; i++)
+        acc += transport_checksum(NET_PROTOCOL_UDP, &canned, remote_ip, net_if_ip);
+    sink = acc;
+}
+
+/* ========================= map ========================= */
+
+static map_t bench_map;
+static uint32_t map_keys[8192];
+
+/**
+ * @brief 按 ARP 表的键值长度建立 map 并填入 arg 个条目；arg 为负时带超时（每次比较调用 time()）
+ */
+static void setup_map(long arg) {
+    long fill = arg < 0 ? -arg : arg;
+    map_init(&bench_map, sizeof(uint32_t), NET_MAC_LEN, 0, arg < 0 ? ARP_TIMEOUT_SEC : 0, NULL, NULL);
+    for (long i = 0; i < fill; i++) {
+        map_keys[i] = 0x0a000000 + i * 2654435761u % 0xffffff;
+        map_set(&bench_map, &map_keys[i], remote_mac);
+    }
+}
+
+static void run_map_get_hit(long arg, uint64_t iters) {
+    long fill = arg < 0 ? -arg : arg;
+    uint64_t acc = 0;
+    for (uint64_t i = 0; i < iters; i++)
+        acc += (uintptr_t)map_get(&bench_map, &map_keys[i % fill]);
+    sink = acc;
+}
+
+static void run_map_get_miss(long arg, uint64_t iters) {
+    uint32_t key = 0xffffffff;
+    uint64_t acc = 0;
+    for (uint64_t i = 0; i < iters; i++)
+        acc += (uintptr_t)map_get(&bench_map, &key);
+    sink = acc;
+}
+
+static void run_map_set_update(long arg, uint64_t iters) {
+    long fill = arg < 0 ? -arg : arg;
+    for (uint64_t i = 0; i < iters; i++)
+        map_set(&bench_map, &map_keys[i % fill], remote_mac);
+}
+
+/* ========================= buf ========================= */
+
+static buf_t bench_buf, bench_buf_copy;
+
+static void run_buf_header(long arg, uint64_t iters) {
+    buf_init(&bench_buf, 64);
+    for (uint64_t i = 0; i < iters; i++) {
+        buf_add_header(&bench_buf, sizeof(ip_hdr_t));
+        buf_remove_header(&bench_buf, sizeof(ip_hdr_t));
+    }
+    sink = bench_buf.len;
+}
+
+static void run_buf_copy(long arg, uint64_t iters) {
+    buf_init(&bench_buf, 64);
+    for (uint64_t i = 0; i < iters; i++)
+        buf_copy(&bench_buf_copy, &bench_buf, 0);
+    sink = bench_buf_copy.len;
+}
+
+/* ========================= 输入处理 ========================= */
+
+static void setup_ip_in(long arg) {
+    micro_stack_reset();
+    micro_udp_packet(arg);
+}
+
+static void run_ip_in(long arg, uint64_t iters) {
+    for (uint64_t i = 0; i < iters; i++) {
+        canned.data = canned_data;
+        canned.len = canned_len;
+        ip_in(&canned, remote_mac);
+    }
+}
+
+static void run_udp_in(long arg, uint64_t iters) {
+    for (uint64_t i = 0; i < iters; i++) {
+        canned.data = canned_data + sizeof(ip_hdr_t);
+        canned.len = canned_len - sizeof(ip_hdr_t);
+        udp_in(&canned, remote_ip);
+    }
+}
+
+static uint32_t tcp_snd_nxt, tcp_rcv_nxt;
+
+/**
+ * @brief 构造一个发往本机的 TCP 报文段（含 IP 首部）
+ */
+static void micro_tcp_segment(uint8_t flags, uint32_t seq, uint32_t ack) {
+    buf_init(&canned, sizeof(tcp_hdr_t));
+    tcp_hdr_t *tcp = (tcp_hdr_t *)canned.data;
+    memset(tcp, 0, sizeof(tcp_hdr_t));
+    tcp->src_port16 = swap16(MICRO_REMOTE_PORT);
+    tcp->dst_port16 = swap16(MICRO_PORT);
+    tcp->seq = swap32(seq);
+    tcp->ack = swap32(ack);
+    tcp->doff = (sizeof(tcp_hdr_t) / 4) << 4;
+    tcp->flags = flags;
+    tcp->win = swap16(UINT16_MAX);
+    tcp->checksum16 = transport_checksum(NET_PROTOCOL_TCP, &canned, remote_ip, net_if_ip);
+    canned_data = canned.data;
+    canned_len = canned.len;
+}
+
+/**
+ * @brief 完成三次握手，arg 为1时准备一个顺序的纯 ACK，为0时准备一个乱序报文段（触发重复 ACK）
+ */
+static void setup_tcp_in(long arg) {
+    micro_stack_reset();
+
+    tcp_rcv_nxt = 1000;
+    micro_tcp_segment(TCP_FLG_SYN, tcp_rcv_nxt, 0);
+    tcp_in(&canned, remote_ip);
+    tcp_hdr_t *syn_ack = (tcp_hdr_t *)(last_sent.data + sizeof(ether_hdr_t) + sizeof(ip_hdr_t));
+    tcp_snd_nxt = swap32(syn_ack->seq) + 1;
+    tcp_rcv_nxt++;
+    micro_tcp_segment(TCP_FLG_ACK, tcp_rcv_nxt, tcp_snd_nxt);
+    tcp_in(&canned, remote_ip);
+
+    micro_tcp_segment(TCP_FLG_ACK, arg ? tcp_rcv_nxt : tcp_rcv_nxt + 100000, tcp_snd_nxt);
+}
+
+static void run_tcp_in(long arg, uint64_t iters) {
+    for (uint64_t i = 0; i < iters; i++) {
+        canned.data = canned_data;
+        canned.len = canned_len;
+        tcp_in(&canned, remote_ip);
+    }
+}
+
+/* ========================= ARP 发送 ========================= */
+
+static void setup_arp_out(long arg) {
+    micro_stack_reset();
+}
+
+static void run_arp_out_hit(long arg, uint64_t iters) {
+    for (uint64_t i = 0; i < iters; i++) {
+        buf_init(&txbuf, 64);
+        arp_out(&txbuf, remote_ip);
+    }
+}
+
+/**
+ * @brief 未命中：arg 为1时每次都缓存数据包并发送 ARP 请求，为0时已有等待中的请求，直接丢弃
+ */
+static void run_arp_out_miss(long arg, uint64_t iters) {
+    uint8_t ip[NET_IP_LEN] = {10, 77, 0, 99};
+    for (uint64_t i = 0; i < iters; i++) {
+        buf_init(&txbuf, 64);
+        arp_out(&txbuf, ip);
+        if (arg)
+            map_delete(&arp_buf, ip);
+    }
+}
+
+/* ========================= 地址格式化 ========================= */
+
+static void run_iptos(long arg, uint64_t iters) {
+    uint64_t acc = 0;
+    for (uint64_t i = 0; i < iters; i++)
+        acc += iptos(remote_ip)[0];
+    sink = acc;
+}
+
+static void run_mactos(long arg, uint64_t iters) {
+    uint64_t acc = 0;
+    for (uint64_t i = 0; i < iters; i++)
+        acc += mactos(remote_mac)[0];
+    sink = acc;
+}
+
+/* ========================= 测量 ========================= */
+
+static void micro_add(const char *name, void (*setup)(long), void (*run)(long, uint64_t), long arg) {
+    if (num_cases == MICRO_MAX_CASES)
+        return;
+    micro_case_t *c = &cases[num_cases++];
+    snprintf(c->name, sizeof(c->name), "%s", name);
+    c->setup = setup;
+    c->run = run;
+    c->arg = arg;
+}
+
+static uint64_t micro_now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int micro_compare(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+static void micro_measure(micro_case_t *c) {
+    if (c->setup)
+        c->setup(c->arg);
+
+    // 预热并校准：批量加倍直到一批的时间达到 MICRO_SAMPLE_MS
+    uint64_t iters = 1, start = micro_now_ns(), ns;
+    while (1) {
+        uint64_t t = micro_now_ns();
+        c->run(c->arg, iters);
+        ns = micro_now_ns() - t;
+        if (ns >= MICRO_SAMPLE_MS * 1000000ull && micro_now_ns() - start >= MICRO_WARMUP_MS * 1000000ull)
+            break;
+        if (ns < MICRO_SAMPLE_MS * 1000000ull)
+            iters *= 2;
+    }
+
+    double samples[num_samples];
+    for (int i = 0; i < num_samples; i++) {
+        uint64_t t = micro_now_ns();
+        c->run(c->arg, iters);
+        samples[i] = (double)(micro_now_ns() - t) / iters;
+    }
+    qsort(samples, num_samples, sizeof(double), micro_compare);
+    double median = samples[num_samples / 2];
+    double spread = (samples[num_samples * 9 / 10] - samples[num_samples / 10]) / median * 100;
+    printf("%-40s %12.2f %12.2f %8.1f%%\n", c->name, median, samples[0], spread);
+    fflush(stdout);
+}
+
+static int micro_selected(const char *name, int argc, char *argv[]) {
+    if (optind >= argc)
+        return 1;
+    for (int i = optind; i < argc; i++)
+        if (strstr(name, argv[i]))
+            return 1;
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    int cpu = -1, opt;
+    while ((opt = getopt(argc, argv, "c:s:")) != -1) {
+        switch (opt) {
+            case 'c':
+                cpu = atoi(optarg);
+                break;
+            case 's':
+                num_samples = atoi(optarg);
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-c cpu] [-s samples] [name-filter...]\n", argv[0]);
+                return 1;
+        }
+    }
+    if (num_samples < 3) {
+        fprintf(stderr, "invalid arguments\n");
+        return 1;
+    }
+
+    // 固定在指定的（默认为当前的）CPU 上
+    if (cpu < 0)
+        cpu = sched_getcpu();
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) != 0)
+        fprintf(stderr, "warning: cannot pin to cpu %d\n", cpu);
+
+    char name[48];
+    static const int sizes[] = {20, 64, 576, 1500};
+    for (int i = 0; i < 4; i++)
+        for (int align = 0; align <= 1; align++) {
+            snprintf(name, sizeof(name), "checksum16 %d bytes%s", sizes[i], align ? " unaligned" : "");
+            micro_add(name, NULL, run_checksum16, sizes[i] | align << 16);
+        }
+    static const int udp_sizes[] = {0, 57, 512, 1472};
+    for (int i = 0; i < 4; i++) {
+        snprintf(name, sizeof(name), "transport_checksum udp+%d", udp_sizes[i]);
+        micro_add(name, setup_transport_checksum, run_transport_checksum, udp_sizes[i]);
+    }
+    static const long fills[] = {16, 256, 4096, -256};
+    for (int i = 0; i < 4; i++) {
+        const char *suffix = fills[i] < 0 ? " timeout" : "";
+        long fill = fills[i] < 0 ? -fills[i] : fills[i];
+        snprintf(name, sizeof(name), "map_get hit %ld%s", fill, suffix);
+        micro_add(name, setup_map, run_map_get_hit, fills[i]);
+        snprintf(name, sizeof(name), "map_get miss %ld%s", fill, suffix);
+        micro_add(name, setup_map, run_map_get_miss, fills[i]);
+        snprintf(name, sizeof(name), "map_set update %ld%s", fill, suffix);
+        micro_add(name, setup_map, run_map_set_update, fills[i]);
+    }
+    micro_add("buf_add_header+remove", NULL, run_buf_header, 0);
+    micro_add("buf_copy", NULL, run_buf_copy, 0);
+    micro_add("ip_in udp+64", setup_ip_in, run_ip_in, 64);
+    micro_add("ip_in udp+1472", setup_ip_in, run_ip_in, 1472);
+    micro_add("udp_in 64", setup_ip_in, run_udp_in, 64);
+    micro_add("tcp_in ack in order", setup_tcp_in, run_tcp_in, 1);
+    micro_add("tcp_in out of order (dup ack)", setup_tcp_in, run_tcp_in, 0);
+    micro_add("arp_out hit", setup_arp_out, run_arp_out_hit, 0);
+    micro_add("arp_out miss pending", setup_arp_out, run_arp_out_miss, 0);
+    micro_add("arp_out miss queue+request", setup_arp_out, run_arp_out_miss, 1);
+    micro_add("iptos", NULL, run_iptos, 0);
+    micro_add("mactos", NULL, run_mactos, 0);
+
+    printf("cpu %d, %d samples of ~%d ms per case\n", cpu, num_samples, MICRO_SAMPLE_MS);
+    printf("%-40s %12s %12s %9s\n", "case", "median ns/op", "min ns/op", "p10-p90");
+    for (int i = 0; i < num_cases; i++)
+        if (micro_selected(cases[i].name, argc, argv))
+            micro_measure(&cases[i]);
+    return 0;
+}
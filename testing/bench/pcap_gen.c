@@ -0,0 +1,729 @@
+/**
+ * @file pcap_gen.c
+ * @brief 合成流量 pcap 生成器
+ *
+ * 按场景描述生成发往协议栈的以太网帧并写成 pcap，报文头使用协议栈自身的结构体构造，
+ * 校验和使用协议栈的 checksum16 / transport_checksum 计算。相同的场景与种子生成相同的文件，
+ * 可用于回放基准（bench_replay <目录>，文件放在 <目录>/<场景>/in.pcap）与大规模正确性检查。
+ *
+ * 流量组成：
+ *   - 开头每台主机发送一个 ARP 请求，使协议栈学到主机的 MAC；之后按 arp_ratio 混入 ARP 请求
+ *   - 每台主机 tcp_flows 条 TCP 流：握手、tcp_segments 个顺序数据段、FIN，随后换源端口重新连接
+ *   - 每台主机 udp_flows 条 UDP 流与 icmp_flows 条 ping（ICMP / ICMPv6 回显请求）
+ *   - 按 ipv6_ratio 的比例把流改为 IPv6；IPv4 UDP 报文按 frag_ratio 或超过 MTU 时分片
+ *   - 最后按 loss_ratio 丢弃帧、按 reorder_ratio 把帧推迟到其后 1~reorder_depth 帧之后输出
+ *
+ * 场景文件每行一个 key = value，# 开始注释；命令行上的 key=value 覆盖场景文件中的值。
+ *
+ * 用法: pcap_gen [-f 场景文件] [-o 输出文件] [key=value...]
+ */
+
+#include "arp.h"
+#include "ethernet.h"
+#include "icmp.h"
+#include "icmpv6.h"
+#include "ip.h"
+#include "ipv6.h"
+#include "net.h"
+#include "tcp.h"
+#include "udp.h"
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define PCAP_MAGIC_US 0xa1b2c3d4   // 微秒时间戳
+#define PCAP_LINKTYPE_ETHERNET 1
+#define GEN_FRAME_MAX (sizeof(ether_hdr_t) + ETHERNET_MAX_TRANSPORT_UNIT)
+#define GEN_MAX_PAYLOAD 8192       // 单个报文的最大负载（IPv4 UDP 超过 MTU 时分片）
+#define GEN_MAX_REORDER 64         // 最大乱序深度
+#define GEN_PORT_BASE 1024         // TCP/UDP 源端口起始值
+
+typedef struct pcap_file_hdr {
+    uint32_t magic;
+    uint16_t version_major;
+    uint16_t version_minor;
+    int32_t thiszone;
+    uint32_t sigfigs;
+    uint32_t snaplen;
+    uint32_t linktype;
+} pcap_file_hdr_t;
+
+typedef struct pcap_rec_hdr {
+    uint32_t ts_sec;
+    uint32_t ts_frac;
+    uint32_t caplen;
+    uint32_t len;
+} pcap_rec_hdr_t;
+
+/**
+ * @brief 场景参数
+ *
+ */
+typedef struct gen_scenario {
+    uint64_t seed;           // 随机数种子
+    uint64_t packets;        // 生成的帧数（丢弃前）
+    uint64_t rate_pps;       // 时间戳间隔对应的包速率
+    uint32_t hosts;          // 主机数
+    uint32_t tcp_flows;      // 每台主机的 TCP 流数
+    uint32_t udp_flows;      // 每台主机的 UDP 流数
+    uint32_t icmp_flows;     // 每台主机的 ping 流数
+    uint32_t tcp_segments;   // 每个 TCP 连接的数据段数
+    uint32_t tcp_port;       // TCP 目的端口
+    uint32_t udp_port;       // UDP 目的端口
+    uint32_t size_min;       // 负载最小长度
+    uint32_t size_max;       // 负载最大长度
+    uint32_t frag_size;      // IPv4 分片负载长度（8 的倍数）
+    uint32_t reorder_depth;  // 乱序帧最多推迟的帧数
+    double arp_ratio;        // ARP 请求占帧数的比例
+    double ipv6_ratio;       // IPv6 流的比例
+    double frag_ratio;       // 主动分片的 IPv4 UDP 报文比例
+    double reorder_ratio;    // 乱序帧比例
+    double loss_ratio;       // 丢弃帧比例
+    uint8_t dst_ip[NET_IP_LEN];     // 协议栈 IPv4 地址
+    uint8_t dst_ipv6[NET_IPV6_LEN]; // 协议栈 IPv6 地址
+    uint8_t dst_mac[NET_MAC_LEN];   // 协议栈 MAC 地址
+} gen_scenario_t;
+
+typedef enum gen_flow_type {
+    GEN_FLOW_TCP,
+    GEN_FLOW_UDP,
+    GEN_FLOW_ICMP,
+} gen_flow_type_t;
+
+typedef enum gen_tcp_phase {
+    GEN_TCP_SYN,
+    GEN_TCP_ACK,
+    GEN_TCP_DATA,
+    GEN_TCP_FIN,
+    GEN_TCP_LAST_ACK,
+} gen_tcp_phase_t;
+
+/**
+ * @brief 一条流的状态
+ *
+ */
+typedef struct gen_flow {
+    uint8_t type;      // gen_flow_type_t
+    uint8_t ipv6;      // 是否为 IPv6
+    uint8_t phase;     // TCP 阶段 gen_tcp_phase_t
+    uint32_t host;     // 主机编号
+    uint16_t port;     // 源端口（ICMP 为标识符）
+    uint32_t seq;      // TCP 序号 / ICMP 序号 / UDP 计数
+    uint32_t sent;     // 本连接已发送的数据段数
+} gen_flow_t;
+
+/**
+ * @brief 各类帧的计数
+ *
+ */
+typedef struct gen_stats {
+    uint64_t frames, bytes, arp, tcp, udp, icmp, ipv6, fragments, dropped, reordered;
+} gen_stats_t;
+
+static gen_scenario_t scenario = {
+    .seed = 1,
+    .packets = 1000000,
+    .rate_pps = 100000,
+    .hosts = 16,
+    .tcp_flows = 4,
+    .udp_flows = 4,
+    .icmp_flows = 1,
+    .tcp_segments = 16,
+    .tcp_port = 60000,
+    .udp_port = 60000,
+    .size_min = 64,
+    .size_max = 1400,
+    .frag_size = 512,
+    .reorder_depth = 3,
+    .arp_ratio = 0.001,
+    .dst_ip = NET_IF_IP,
+    .dst_ipv6 = NET_IF_IPV6,
+    .dst_mac = NET_IF_MAC,
+};
+
+static uint64_t rng_state;
+static FILE *out;
+static uint64_t frame_index;  // 已生成的帧数（含丢弃的帧）
+static gen_stats_t stats;
+static buf_t gen_buf;
+
+/* 乱序队列：被推迟的帧与其剩余的推迟帧数 */
+static uint8_t held_frame[GEN_MAX_REORDER][GEN_FRAME_MAX];
+static size_t held_len[GEN_MAX_REORDER];
+static uint32_t held_delay[GEN_MAX_REORDER];
+static int held_count;
+
+/* ========================= 随机数 ========================= */
+
+/**
+ * @brief xorshift64*，结果只取决于种子，不同平台上可复现
+ */
+static uint64_t gen_rand() {
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 0x2545F4914F6CDD1DULL;
+}
+
+static double gen_uniform() {
+    return (gen_rand() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static uint32_t gen_range(uint32_t min, uint32_t max) {
+    return min + gen_rand() % (max - min + 1);
+}
+
+/* ========================= 地址 ========================= */
+
+static void gen_host_mac(uint32_t host, uint8_t *mac) {
+    uint8_t base[NET_MAC_LEN] = {0x02, 0x00, 0x00, host >> 16, host >> 8, host};
+    memcpy(mac, base, NET_MAC_LEN);
+}
+
+/**
+ * @brief 主机 IPv4 地址：与协议栈同一 /16 网段中的 x.y.(128 + h/254).(1 + h%254)
+ */
+static void gen_host_ip(uint32_t host, uint8_t *ip) {
+    ip[0] = scenario.dst_ip[0];
+    ip[1] = scenario.dst_ip[1];
+    ip[2] = 128 + host / 254;
+    ip[3] = 1 + host % 254;
+}
+
+/**
+ * @brief 主机 IPv6 地址：由 MAC 生成的链路本地地址（EUI-64）
+ */
+static void gen_host_ipv6(uint32_t host, uint8_t *ip) {
+    uint8_t mac[NET_MAC_LEN];
+    gen_host_mac(host, mac);
+    memset(ip, 0, NET_IPV6_LEN);
+    ip[0] = 0xfe;
+    ip[1] = 0x80;
+    ip[8] = mac[0] ^ 0x02;
+    ip[9] = mac[1];
+    ip[10] = mac[2];
+    ip[11] = 0xff;
+    ip[12] = 0xfe;
+    ip[13] = mac[3];
+    ip[14] = mac[4];
+    ip[15] = mac[5];
+}
+
+/* ========================= 输出 ========================= */
+
+static void gen_write(const uint8_t *frame, size_t len) {
+    pcap_rec_hdr_t rec;
+    uint64_t us = stats.frames * 1000000 / scenario.rate_pps;
+    rec.ts_sec = 1700000000 + us / 1000000;
+    rec.ts_frac = us % 1000000;
+    rec.caplen = rec.len = len;
+    fwrite(&rec, sizeof(rec), 1, out);
+    fwrite(frame, len, 1, out);
+    stats.frames++;
+    stats.bytes += len;
+}
+
+/**
+ * @brief 推进乱序队列：每输出一帧，被推迟的帧剩余帧数减一，到期后输出
+ */
+static void gen_release_held(int flush) {
+    for (int i = 0; i < held_count;) {
+        if (flush || --held_delay[i] == 0) {
+            gen_write(held_frame[i], held_len[i]);
+            held_count--;
+            memcpy(held_frame[i], held_frame[held_count], held_len[held_count]);
+            held_len[i] = held_len[held_count];
+            held_delay[i] = held_delay[held_count];
+        } else {
+            i++;
+        }
+    }
+}
+
+/**
+ * @brief 输出一帧，按场景丢弃或推迟
+ *
+ * 时间戳按写出顺序分配，与在接收端抓到的乱序到达一致。
+ */
+static void gen_emit(const uint8_t *frame, size_t len) {
+    frame_index++;
+    if (scenario.loss_ratio > 0 && gen_uniform() < scenario.loss_ratio) {
+        stats.dropped++;
+        return;
+    }
+    if (scenario.reorder_ratio > 0 && held_count < GEN_MAX_REORDER && gen_uniform() < scenario.reorder_ratio) {
+        memcpy(held_frame[held_count], frame, len);
+        held_len[held_count] = len;
+        held_delay[held_count] = gen_range(1, scenario.reorder_depth) + 1;  // 本帧也会使计数减一
+        held_count++;
+        stats.reordered++;
+    } else {
+        gen_write(frame, len);
+    }
+    gen_release_held(0);
+}
+
+/* ========================= 构造报文 ========================= */
+
+static void gen_fill_payload(uint8_t *data, size_t len, uint32_t salt) {
+    for (size_t i = 0; i < len; i++)
+        data[i] = 'a' + (i + salt) % 26;
+}
+
+/**
+ * @brief 加上以太网头部并输出
+ */
+static void gen_ethernet(buf_t *buf, const uint8_t *src_mac, const uint8_t *dst_mac, uint16_t protocol) {
+    buf_add_header(buf, sizeof(ether_hdr_t));
+    ether_hdr_t *eth = (ether_hdr_t *)buf->data;
+    memcpy(eth->dst, dst_mac, NET_MAC_LEN);
+    memcpy(eth->src, src_mac, NET_MAC_LEN);
+    eth->protocol16 = swap16(protocol);
+    if (buf->len < sizeof(ether_hdr_t) + ETHERNET_MIN_TRANSPORT_UNIT)
+        buf_add_padding(buf, sizeof(ether_hdr_t) + ETHERNET_MIN_TRANSPORT_UNIT - buf->len);
+    gen_emit(buf->data, buf->len);
+}
+
+/**
+ * @brief 加上 IPv4 头部并输出，负载超过 MTU 或 fragment 非零时按 frag_size 分片
+ */
+static void gen_ipv4(buf_t *buf, uint32_t host, uint8_t protocol, int fragment) {
+    uint8_t src_ip[NET_IP_LEN], src_mac[NET_MAC_LEN];
+    gen_host_ip(host, src_ip);
+    gen_host_mac(host, src_mac);
+    uint16_t id = gen_rand();
+    size_t mtu_payload = ETHERNET_MAX_TRANSPORT_UNIT - sizeof(ip_hdr_t);
+    size_t chunk = (fragment || buf->len > mtu_payload) ? scenario.frag_size : buf->len;
+    if (buf->len > mtu_payload && chunk > (mtu_payload & ~7u))
+        chunk = mtu_payload & ~7u;
+
+    static buf_t frag;
+    for (size_t offset = 0; offset < buf->len; offset += chunk) {
+        size_t len = buf->len - offset < chunk ? buf->len - offset : chunk;
+        int more = offset + len < buf->len;
+        buf_init(&frag, len);
+        memcpy(frag.data, buf->data + offset, len);
+        buf_add_header(&frag, sizeof(ip_hdr_t));
+        ip_hdr_t *ip = (ip_hdr_t *)frag.data;
+        memset(ip, 0, sizeof(ip_hdr_t));
+        ip->version = IP_VERSION_4;
+        ip->hdr_len = sizeof(ip_hdr_t) / IP_HDR_LEN_PER_BYTE;
+        ip->total_len16 = swap16(frag.len);
+        ip->id16 = swap16(id);
+        ip->flags_fragment16 = swap16((more ? IP_MORE_FRAGMENT : 0) | offset / IP_HDR_OFFSET_PER_BYTE);
+        ip->ttl = IP_DEFALUT_TTL;
+        ip->protocol = protocol;
+        memcpy(ip->src_ip, src_ip, NET_IP_LEN);
+        memcpy(ip->dst_ip, scenario.dst_ip, NET_IP_LEN);
+        ip->hdr_checksum16 = checksum16((uint16_t *)ip, sizeof(ip_hdr_t) / 2);
+        if (more || offset)
+            stats.fragments++;
+        gen_ethernet(&frag, src_mac, scenario.dst_mac, NET_PROTOCOL_IP);
+    }
+}
+
+/**
+ * @brief IPv6 上层协议校验和（RFC 8200 8.1 伪首部）
+ */
+static uint16_t gen_ipv6_checksum(buf_t *buf, uint8_t next_header, const uint8_t *src_ip, const uint8_t *dst_ip) {
+    uint32_t sum = 0;
+    for (int i = 0; i < NET_IPV6_LEN; i += 2) {
+        sum += (src_ip[i] << 8) | src_ip[i + 1];
+        sum += (dst_ip[i] << 8) | dst_ip[i + 1];
+    }
+    sum += buf->len >> 16;
+    sum += buf->len & 0xFFFF;
+    sum += next_header;
+    for (size_t i = 0; i + 1 < buf->len; i += 2)
+        sum += (buf->data[i] << 8) | buf->data[i + 1];
+    if (buf->len % 2)
+        sum += buf->data[buf->len - 1] << 8;
+    while (sum >> 16)
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    return swap16(~sum);
+}
+
+/**
+ * @brief 加上 IPv6 头部并输出，上层校验和字段位于 checksum_offset
+ */
+static void gen_ipv6(buf_t *buf, uint32_t host, uint8_t next_header, size_t checksum_offset) {
+    uint8_t src_ip[NET_IPV6_LEN], src_mac[NET_MAC_LEN];
+    gen_host_ipv6(host, src_ip);
+    gen_host_mac(host, src_mac);
+    uint16_t *checksum = (uint16_t *)(buf->data + checksum_offset);
+    *checksum = 0;
+    *checksum = gen_ipv6_checksum(buf, next_header, src_ip, scenario.dst_ipv6);
+
+    buf_add_header(buf, sizeof(ipv6_hdr_t));
+    ipv6_hdr_t *ip6 = (ipv6_hdr_t *)buf->data;
+    ip6->version_tc_flow = swap32(IPV6_VERSION << 28);
+    ip6->payload_len16 = swap16(buf->len - sizeof(ipv6_hdr_t));
+    ip6->next_header = next_header;
+    ip6->hop_limit = IPV6_DEFAULT_HOP_LIMIT;
+    memcpy(ip6->src_ip, src_ip, NET_IPV6_LEN);
+    memcpy(ip6->dst_ip, scenario.dst_ipv6, NET_IPV6_LEN);
+    stats.ipv6++;
+    gen_ethernet(buf, src_mac, scenario.dst_mac, NET_PROTOCOL_IPV6);
+}
+
+/**
+ * @brief 主机向协议栈发送 ARP 请求
+ */
+static void gen_arp(uint32_t host) {
+    uint8_t src_mac[NET_MAC_LEN];
+    gen_host_mac(host, src_mac);
+    buf_init(&gen_buf, sizeof(arp_pkt_t));
+    arp_pkt_t *arp = (arp_pkt_t *)gen_buf.data;
+    arp->hw_type16 = swap16(ARP_HW_ETHER);
+    arp->pro_type16 = swap16(NET_PROTOCOL_IP);
+    arp->hw_len = NET_MAC_LEN;
+    arp->pro_len = NET_IP_LEN;
+    arp->opcode16 = swap16(ARP_REQUEST);
+    memcpy(arp->sender_mac, src_mac, NET_MAC_LEN);
+    gen_host_ip(host, arp->sender_ip);
+    memset(arp->target_mac, 0, NET_MAC_LEN);
+    memcpy(arp->target_ip, scenario.dst_ip, NET_IP_LEN);
+    stats.arp++;
+    gen_ethernet(&gen_buf, src_mac, ether_broadcast_mac, NET_PROTOCOL_ARP);
+}
+
+/**
+ * @brief 按连接阶段生成 TCP 流的下一个报文段
+ */
+static void gen_tcp(gen_flow_t *flow) {
+    uint8_t flags;
+    size_t len = 0;
+    switch (flow->phase) {
+        case GEN_TCP_SYN:
+            flow->seq = gen_rand();
+            flags = TCP_FLG_SYN;
+            break;
+        case GEN_TCP_ACK:
+        case GEN_TCP_LAST_ACK:
+            flags = TCP_FLG_ACK;
+            break;
+        case GEN_TCP_DATA:
+            len = gen_range(scenario.size_min, scenario.size_max);
+            if (len > ETHERNET_MAX_TRANSPORT_UNIT - sizeof(ipv6_hdr_t) - sizeof(tcp_hdr_t))
+                len = ETHERNET_MAX_TRANSPORT_UNIT - sizeof(ipv6_hdr_t) - sizeof(tcp_hdr_t);
+            flags = TCP_FLG_ACK | TCP_FLG_PSH;
+            break;
+        default:
+            flags = TCP_FLG_FIN | TCP_FLG_ACK;
+            break;
+    }
+
+    buf_init(&gen_buf, len);
+    gen_fill_payload(gen_buf.data, len, flow->seq);
+    buf_add_header(&gen_buf, sizeof(tcp_hdr_t));
+    tcp_hdr_t *tcp = (tcp_hdr_t *)gen_buf.data;
+    memset(tcp, 0, sizeof(tcp_hdr_t));
+    tcp->src_port16 = swap16(flow->port);
+    tcp->dst_port16 = swap16(scenario.tcp_port);
+    tcp->seq = swap32(flow->seq);
+    tcp->ack = swap32(0);  // 协议栈的初始序列号是随机的，合成流量无法确认其数据
+    tcp->doff = (sizeof(tcp_hdr_t) / 4) << 4;
+    tcp->flags = flags;
+    tcp->win = swap16(TCP_MAX_WINDOW_SIZE);
+    flow->seq += len + TCP_FLG_ISSET(flags, TCP_FLG_SYN) + TCP_FLG_ISSET(flags, TCP_FLG_FIN);
+    stats.tcp++;
+
+    if (flow->ipv6) {
+        gen_ipv6(&gen_buf, flow->host, IPV6_NEXT_HEADER_TCP, offsetof(tcp_hdr_t, checksum16));
+    } else {
+        uint8_t src_ip[NET_IP_LEN];
+        gen_host_ip(flow->host, src_ip);
+        tcp->checksum16 = transport_checksum(NET_PROTOCOL_TCP, &gen_buf, src_ip, scenario.dst_ip);
+        gen_ipv4(&gen_buf, flow->host, NET_PROTOCOL_TCP, 0);
+    }
+
+    // 推进阶段：挥手完成后换一个源端口重新连接
+    if (flow->phase == GEN_TCP_DATA && ++flow->sent < scenario.tcp_segments)
+        return;
+    if (flow->phase == GEN_TCP_LAST_ACK) {
+        flow->phase = GEN_TCP_SYN;
+        flow->sent = 0;
+        flow->port = GEN_PORT_BASE + (flow->port - GEN_PORT_BASE + scenario.tcp_flows) % (65536 - GEN_PORT_BASE);
+        return;
+    }
+    flow->phase++;
+    if (flow->phase == GEN_TCP_DATA && scenario.tcp_segments == 0)
+        flow->phase = GEN_TCP_FIN;
+}
+
+static void gen_udp(gen_flow_t *flow) {
+    size_t max = flow->ipv6 ? ETHERNET_MAX_TRANSPORT_UNIT - sizeof(ipv6_hdr_t) - sizeof(udp_hdr_t) : GEN_MAX_PAYLOAD;
+    size_t len = gen_range(scenario.size_min, scenario.size_max);
+    if (len > max)
+        len = max;
+    buf_init(&gen_buf, len);
+    gen_fill_payload(gen_buf.data, len, flow->seq++);
+    buf_add_header(&gen_buf, sizeof(udp_hdr_t));
+    udp_hdr_t *udp = (udp_hdr_t *)gen_buf.data;
+    udp->src_port16 = swap16(flow->port);
+    udp->dst_port16 = swap16(scenario.udp_port);
+    udp->total_len16 = swap16(gen_buf.len);
+    udp->checksum16 = 0;
+    stats.udp++;
+
+    if (flow->ipv6) {
+        gen_ipv6(&gen_buf, flow->host, IPV6_NEXT_HEADER_UDP, offsetof(udp_hdr_t, checksum16));
+    } else {
+        uint8_t src_ip[NET_IP_LEN];
+        gen_host_ip(flow->host, src_ip);
+        udp->checksum16 = transport_checksum(NET_PROTOCOL_UDP, &gen_buf, src_ip, scenario.dst_ip);
+        int fragment = scenario.frag_ratio > 0 && gen_uniform() < scenario.frag_ratio;
+        gen_ipv4(&gen_buf, flow->host, NET_PROTOCOL_UDP, fragment);
+    }
+}
+
+static void gen_icmp(gen_flow_t *flow) {
+    size_t max = ETHERNET_MAX_TRANSPORT_UNIT - sizeof(ipv6_hdr_t) - sizeof(icmp_hdr_t);
+    size_t len = gen_range(scenario.size_min, scenario.size_max);
+    if (len > max)
+        len = max;
+    buf_init(&gen_buf, len);
+    gen_fill_payload(gen_buf.data, len, flow->seq);
+    stats.icmp++;
+
+    if (flow->ipv6) {
+        buf_add_header(&gen_buf, sizeof(icmpv6_echo_t));
+        icmpv6_echo_t *echo = (icmpv6_echo_t *)gen_buf.data;
+        echo->type = ICMPV6_TYPE_ECHO_REQUEST;
+        echo->code = 0;
+        echo->id16 = swap16(flow->port);
+        echo->seq16 = swap16(flow->seq);
+        gen_ipv6(&gen_buf, flow->host, IPV6_NEXT_HEADER_ICMPV6, offsetof(icmpv6_echo_t, checksum16));
+    } else {
+        buf_add_header(&gen_buf, sizeof(icmp_hdr_t));
+        icmp_hdr_t *icmp = (icmp_hdr_t *)gen_buf.data;
+        icmp->type = ICMP_TYPE_ECHO_REQUEST;
+        icmp->code = 0;
+        icmp->id16 = swap16(flow->port);
+        icmp->seq16 = swap16(flow->seq);
+        icmp->checksum16 = 0;
+        if (gen_buf.len % 2)
+            gen_buf.data[gen_buf.len] = 0;  // 奇数长度时补零参与校验和计算
+        icmp->checksum16 = checksum16((uint16_t *)gen_buf.data, (gen_buf.len + 1) / 2);
+        gen_ipv4(&gen_buf, flow->host, NET_PROTOCOL_ICMP, 0);
+    }
+    flow->seq++;
+}
+
+/* ========================= 场景 ========================= */
+
+static int gen_parse_ip(const char *str, uint8_t *ip) {
+    unsigned a, b, c, d;
+    if (sscanf(str, "%u.%u.%u.%u", &a, &b, &c, &d) != 4 || (a | b | c | d) > 255)
+        return -1;
+    ip[0] = a;
+    ip[1] = b;
+    ip[2] = c;
+    ip[3] = d;
+    return 0;
+}
+
+static int gen_parse_mac(const char *str, uint8_t *mac) {
+    unsigned m[NET_MAC_LEN];
+    if (sscanf(str, "%x:%x:%x:%x:%x:%x", &m[0], &m[1], &m[2], &m[3], &m[4], &m[5]) != NET_MAC_LEN)
+        return -1;
+    for (int i = 0; i < NET_MAC_LEN; i++)
+        mac[i] = m[i];
+    return 0;
+}
+
+/**
+ * @brief 设置一个场景参数
+ *
+ * @return int 成功为0，未知的键或非法的值为-1
+ */
+static int gen_set(const char *key, const char *value) {
+    struct {
+        const char *name;
+        void *field;
+        char kind;  // 'u' uint32, 'U' uint64, 'r' 比例
+    } fields[] = {
+        {"seed", &scenario.seed, 'U'},
+        {"packets", &scenario.packets, 'U'},
+        {"rate_pps", &scenario.rate_pps, 'U'},
+        {"hosts", &scenario.hosts, 'u'},
+        {"tcp_flows", &scenario.tcp_flows, 'u'},
+        {"udp_flows", &scenario.udp_flows, 'u'},
+        {"icmp_flows", &scenario.icmp_flows, 'u'},
+        {"tcp_segments", &scenario.tcp_segments, 'u'},
+        {"tcp_port", &scenario.tcp_port, 'u'},
+        {"udp_port", &scenario.udp_port, 'u'},
+        {"size_min", &scenario.size_min, 'u'},
+        {"size_max", &scenario.size_max, 'u'},
+        {"frag_size", &scenario.frag_size, 'u'},
+        {"reorder_depth", &scenario.reorder_depth, 'u'},
+        {"arp_ratio", &scenario.arp_ratio, 'r'},
+        {"ipv6_ratio", &scenario.ipv6_ratio, 'r'},
+        {"frag_ratio", &scenario.frag_ratio, 'r'},
+        {"reorder_ratio", &scenario.reorder_ratio, 'r'},
+        {"loss_ratio", &scenario.loss_ratio, 'r'},
+    };
+    char *end;
+    for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); i++) {
+        if (strcmp(key, fields[i].name) != 0)
+            continue;
+        if (fields[i].kind == 'r') {
+            double ratio = strtod(value, &end);
+            if (*end || ratio < 0 || ratio > 1)
+                return -1;
+            *(double *)fields[i].field = ratio;
+        } else {
+            unsigned long long number = strtoull(value, &end, 0);
+            if (*end || (fields[i].kind == 'u' && number > UINT32_MAX))
+                return -1;
+            if (fields[i].kind == 'u')
+                *(uint32_t *)fields[i].field = number;
+            else
+                *(uint64_t *)fields[i].field = number;
+        }
+        return 0;
+    }
+    if (strcmp(key, "dst_ip") == 0)
+        return gen_parse_ip(value, scenario.dst_ip);
+    if (strcmp(key, "dst_mac") == 0)
+        return gen_parse_mac(value, scenario.dst_mac);
+    return -1;
+}
+
+/**
+ * @brief 解析一行 key = value，忽略空行与注释
+ */
+static int gen_parse_line(char *line) {
+    char *comment = strchr(line, '#');
+    if (comment)
+        *comment = '\0';
+    char *eq = strchr(line, '=');
+    char key[64], value[64];
+    if (!eq)
+        return sscanf(line, " %63s", key) == 1 ? -1 : 0;
+    *eq = '\0';
+    if (sscanf(line, " %63s", key) != 1 || sscanf(eq + 1, " %63s", value) != 1)
+        return -1;
+    if (gen_set(key, value) != 0) {
+        fprintf(stderr, "invalid scenario setting: %s = %s\n", key, value);
+        return -1;
+    }
+    return 0;
+}
+
+static int gen_load(const char *path) {
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        perror(path);
+        return -1;
+    }
+    char line[256];
+    int line_no = 0, ret = 0;
+    while (fgets(line, sizeof(line), file)) {
+        line_no++;
+        if (gen_parse_line(line) != 0) {
+            fprintf(stderr, "%s:%d: syntax error\n", path, line_no);
+            ret = -1;
+            break;
+        }
+    }
+    fclose(file);
+    return ret;
+}
+
+/* ========================= 主程序 ========================= */
+
+int main(int argc, char *argv[]) {
+    const char *output = "in.pcap";
+    int opt;
+    while ((opt = getopt(argc, argv, "f:o:")) != -1) {
+        switch (opt) {
+            case 'f':
+                if (gen_load(optarg) != 0)
+                    return 1;
+                break;
+            case 'o':
+                output = optarg;
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-f scenario] [-o output.pcap] [key=value...]\n", argv[0]);
+                return 1;
+        }
+    }
+    for (int i = optind; i < argc; i++)
+        if (gen_parse_line(argv[i]) != 0)
+            return 1;
+
+    uint64_t num_flows = (uint64_t)scenario.hosts * (scenario.tcp_flows + scenario.udp_flows + scenario.icmp_flows);
+    if (scenario.hosts == 0 || scenario.hosts > 254 * 127 || scenario.rate_pps == 0 ||
+        scenario.size_min > scenario.size_max || scenario.size_max > GEN_MAX_PAYLOAD ||
+        scenario.frag_size < 8 || scenario.frag_size % 8 || scenario.frag_size > ETHERNET_MAX_TRANSPORT_UNIT - sizeof(ip_hdr_t) ||
+        scenario.reorder_depth < 1 || scenario.reorder_depth >= GEN_MAX_REORDER ||
+        scenario.tcp_flows + scenario.udp_flows > 65536 - GEN_PORT_BASE || scenario.tcp_port > UINT16_MAX ||
+        scenario.udp_port > UINT16_MAX || (num_flows == 0 && scenario.arp_ratio == 0)) {
+        fprintf(stderr, "invalid scenario\n");
+        return 1;
+    }
+
+    // 建立流：同一主机的 TCP 与 UDP 流使用不同的源端口
+    gen_flow_t *flows = calloc(num_flows ? num_flows : 1, sizeof(gen_flow_t));
+    if (!flows) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    rng_state = scenario.seed ? scenario.seed : 1;
+    size_t n = 0;
+    for (uint32_t h = 0; h < scenario.hosts; h++) {
+        for (uint32_t i = 0; i < scenario.tcp_flows; i++)
+            flows[n++] = (gen_flow_t){.type = GEN_FLOW_TCP, .host = h, .port = GEN_PORT_BASE + i};
+        for (uint32_t i = 0; i < scenario.udp_flows; i++)
+            flows[n++] = (gen_flow_t){.type = GEN_FLOW_UDP, .host = h, .port = 65535 - i};
+        for (uint32_t i = 0; i < scenario.icmp_flows; i++)
+            flows[n++] = (gen_flow_t){.type = GEN_FLOW_ICMP, .host = h, .port = i + 1};
+    }
+    for (size_t i = 0; i < n; i++)
+        flows[i].ipv6 = scenario.ipv6_ratio > 0 && gen_uniform() < scenario.ipv6_ratio;
+
+    out = fopen(output, "wb");
+    if (!out) {
+        perror(output);
+        return 1;
+    }
+    setvbuf(out, NULL, _IOFBF, 1 << 20);
+    pcap_file_hdr_t hdr = {PCAP_MAGIC_US, 2, 4, 0, 0, GEN_FRAME_MAX, PCAP_LINKTYPE_ETHERNET};
+    fwrite(&hdr, sizeof(hdr), 1, out);
+
+    // 每台主机先发送 ARP 请求，之后随机选择流或 ARP 生成下一帧
+    for (uint32_t h = 0; h < scenario.hosts && frame_index < scenario.packets; h++)
+        gen_arp(h);
+    while (frame_index < scenario.packets) {
+        if (n == 0 || gen_uniform() < scenario.arp_ratio) {
+            gen_arp(gen_rand() % scenario.hosts);
+            continue;
+        }
+        gen_flow_t *flow = &flows[gen_rand() % n];
+        if (flow->type == GEN_FLOW_TCP)
+            gen_tcp(flow);
+        else if (flow->type == GEN_FLOW_UDP)
+            gen_udp(flow);
+        else
+            gen_icmp(flow);
+    }
+    gen_release_held(1);
+
+    if (fclose(out) != 0) {
+        perror(output);
+        return 1;
+    }
+    free(flows);
+    fprintf(stderr,
+            "%s: %llu frames, %llu bytes (%llu generated, %llu dropped, %llu reordered)\n"
+            "  arp %llu, tcp %llu, udp %llu, icmp %llu messages; %llu ipv6, %llu ipv4 fragments; %zu flows over %u hosts\n",
+            output, (unsigned long long)stats.frames, (unsigned long long)stats.bytes, (unsigned long long)frame_index,
+            (unsigned long long)stats.dropped, (unsigned long long)stats.reordered, (unsigned long long)stats.arp,
+            (unsigned long long)stats.tcp, (unsigned long long)stats.udp, (unsigned long long)stats.icmp,
+            (unsigned long long)stats.ipv6, (unsigned long long)stats.fragments, n, scenario.hosts);
+    return 0;
+}
@@ -0,0 +1,458 @@
+/**
+ * @file replay_bench.c
+ * @brief 协议栈吞吐基准测试：回放 pcap
+ *
+ * 以 mmap 映射 testing/data/<场景>/in.pcap，驱动把映射中的帧直接交给协议栈（零拷贝），
+ * 每个场景先回放一遍预热，再计时 REPLAY_ROUNDS 轮，每轮至少回放 N 遍且不短于
+ * REPLAY_ROUND_MS，取最快的一轮报告包速率、每包纳秒数与每包周期数（TSC），
+ * 并与保存的基线比较：每包纳秒数超出基线容差的场景记为退化，此时以状态1退出。
+ * 绝对耗时只在同一台机器上可比，基线默认保存在构建目录中，不存在时以本次结果作为基线写出。
+ *
+ * 60000 端口回显 TCP/UDP（对端 FIN 时关闭本端，四次挥手完成后下一遍的 SYN 建立新连接），
+ * 80 端口由 web_server 的处理程序响应，每次 net_poll 后与其主循环一样调用 http_schedule，
+ * tcp_test 与 http_test 因此在每一遍中都经过完整的连接与请求处理。
+ *
+ * 映射为 MAP_PRIVATE 可写，可选的地址改写（-r）与协议栈的原处校验都不会写回文件。
+ * 每个场景开始前重新初始化协议栈，场景内的连接与 ARP 状态在各遍之间保留。
+ *
+ * 用法: bench_replay [-n 每轮最少遍数] [-r] [-b 基线文件] [-w 写出基线] [-t 容差百分比] [数据目录]
+ */
+
+#include "arp.h"
+#include "driver.h"
+#include "ethernet.h"
+#include "http.h"
+#include "ip.h"
+#include "net.h"
+#include "tcp.h"
+#include "udp.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#define REPLAY_MAX_SCENARIOS 64    // 最大场景数
+#define REPLAY_NAME_LENGTH 64      // 场景名最大长度
+#define REPLAY_PORT 60000          // 回显应用监听的端口，与 tcp_test/udp_test 一致
+#define REPLAY_ROUNDS 5            // 每个场景的计时轮数，取最快的一轮以减小调度与频率波动的影响
+#define REPLAY_ROUND_MS 100        // 每轮的最短时间
+
+#define PCAP_MAGIC_US 0xa1b2c3d4   // 微秒时间戳
+#define PCAP_MAGIC_NS 0xa1b23c4d   // 纳秒时间戳
+#define PCAP_LINKTYPE_ETHERNET 1
+
+typedef struct pcap_file_hdr {
+    uint32_t magic;
+    uint16_t version_major;
+    uint16_t version_minor;
+    int32_t thiszone;
+    uint32_t sigfigs;
+    uint32_t snaplen;
+    uint32_t linktype;
+} pcap_file_hdr_t;
+
+typedef struct pcap_rec_hdr {
+    uint32_t ts_sec;
+    uint32_t ts_frac;
+    uint32_t caplen;
+    uint32_t len;
+} pcap_rec_hdr_t;
+
+typedef struct replay_frame {
+    uint8_t *data;  // 映射中的帧
+    size_t len;     // 帧长（捕获长度）
+} replay_frame_t;
+
+typedef struct replay_result {
+    char name[REPLAY_NAME_LENGTH];
+    double ns_per_packet;
+} replay_result_t;
+
+static uint8_t *map_base;
+static size_t map_len;
+static replay_frame_t *frames;
+static size_t num_frames, cursor;
+static uint64_t tx_packets;
+
+static long repetitions = 100;
+static int rewrite;
+static double tolerance = 20;
+static FILE *report;
+
+static replay_result_t baseline[REPLAY_MAX_SCENARIOS];
+static int num_baseline;
+static replay_result_t results[REPLAY_MAX_SCENARIOS];
+static int num_results;
+
+/* ========================= 回放驱动 ========================= */
+
+static int replay_driver_open() {
+    return 0;
+}
+
+static int replay_driver_recv(buf_t *buf) {
+    replay_frame_t *frame = &frames[cursor];
+    if (++cursor == num_frames)
+        cursor = 0;
+    buf_attach(buf, frame->data, frame->len, frame->data, frame->len);  // 帧借给协议栈，首部增删限制在帧内
+    return frame->len;
+}
+
+static int replay_driver_send(buf_t *buf) {
+    tx_packets++;
+    return 0;
+}
+
+static void replay_driver_close() {
+}
+
+static const driver_ops_t replay_driver = {
+    .name = "replay",
+    .rank = 10,
+    .open = replay_driver_open,
+    .recv = replay_driver_recv,
+    .send = replay_driver_send,
+    .close = replay_driver_close,
+};
+DRIVER_REGISTER(replay_driver)
+
+/* ========================= 加载与地址改写 ========================= */
+
+static uint32_t replay_swap32(uint32_t x, int swapped) {
+    return swapped ? __builtin_bswap32(x) : x;
+}
+
+/**
+ * @brief 增量更新校验和（RFC 1624）：将 len 字节的 old 替换为 new
+ */
+static void replay_checksum_replace(uint8_t *checksum, const uint8_t *old, const uint8_t *new, size_t len) {
+    uint16_t word;
+    memcpy(&word, checksum, 2);
+    uint32_t sum = (uint16_t)~word;
+    for (size_t i = 0; i < len; i += 2) {
+        memcpy(&word, old + i, 2);
+        sum += (uint16_t)~word;
+        memcpy(&word, new + i, 2);
+        sum += word;
+    }
+    while (sum >> 16)
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    word = ~sum;
+    memcpy(checksum, &word, 2);
+}
+
+/**
+ * @brief 将帧的目的地址改写为本机地址，并同步更新 IP 与 TCP/UDP 校验和
+ */
+static void replay_rewrite(uint8_t *frame, size_t len) {
+    if (len < sizeof(ether_hdr_t))
+        return;
+    ether_hdr_t *eth = (ether_hdr_t *)frame;
+    if (!(eth->dst[0] & 1))  // 保留广播与组播
+        memcpy(eth->dst, net_if_mac, NET_MAC_LEN);
+
+    uint16_t protocol = swap16(eth->protocol16);
+    uint8_t *payload = frame + sizeof(ether_hdr_t);
+    len -= sizeof(ether_hdr_t);
+    if (protocol == NET_PROTOCOL_ARP && len >= sizeof(arp_pkt_t)) {
+        memcpy(((arp_pkt_t *)payload)->target_ip, net_if_ip, NET_IP_LEN);
+    } else if (protocol == NET_PROTOCOL_IP && len >= sizeof(ip_hdr_t)) {
+        ip_hdr_t *ip = (ip_hdr_t *)payload;
+        size_t ip_hdr_len = ip->hdr_len * IP_HDR_LEN_PER_BYTE;
+        if (ip_hdr_len < sizeof(ip_hdr_t) || ip_hdr_len > len || !memcmp(ip->dst_ip, net_if_ip, NET_IP_LEN))
+            return;
+        uint8_t *transport = payload + ip_hdr_len;
+        size_t transport_len = len - ip_hdr_len;
+        int first_fragment = (swap16(ip->flags_fragment16) & 0x1FFF) == 0;
+        // TCP/UDP 校验和覆盖伪首部中的目的地址，只有首个分片带有传输层首部
+        if (first_fragment && ip->protocol == NET_PROTOCOL_TCP && transport_len >= sizeof(tcp_hdr_t)) {
+            replay_checksum_replace((uint8_t *)&((tcp_hdr_t *)transport)->checksum16, ip->dst_ip, net_if_ip, NET_IP_LEN);
+        } else if (first_fragment && ip->protocol == NET_PROTOCOL_UDP && transport_len >= sizeof(udp_hdr_t) &&
+                   ((udp_hdr_t *)transport)->checksum16) {
+            replay_checksum_replace((uint8_t *)&((udp_hdr_t *)transport)->checksum16, ip->dst_ip, net_if_ip, NET_IP_LEN);
+        }
+        replay_checksum_replace((uint8_t *)&ip->hdr_checksum16, ip->dst_ip, net_if_ip, NET_IP_LEN);
+        memcpy(ip->dst_ip, net_if_ip, NET_IP_LEN);
+    }
+}
+
+static void replay_unload() {
+    if (map_base)
+        munmap(map_base, map_len);
+    map_base = NULL;
+    free(frames);
+    frames = NULL;
+    num_frames = cursor = 0;
+}
+
+/**
+ * @brief 映射 pcap 文件并建立帧索引
+ *
+ * @return int 帧数，文件无法打开或格式不支持为-1
+ */
+static int replay_load(const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return -1;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(pcap_file_hdr_t)) {
+        close(fd);
+        return -1;
+    }
+    map_len = st.st_size;
+    map_base = mmap(NULL, map_len, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map_base == MAP_FAILED) {
+        map_base = NULL;
+        return -1;
+    }
+
+    pcap_file_hdr_t *hdr = (pcap_file_hdr_t *)map_base;
+    int swapped = hdr->magic == __builtin_bswap32(PCAP_MAGIC_US) || hdr->magic == __builtin_bswap32(PCAP_MAGIC_NS);
+    if ((!swapped && hdr->magic != PCAP_MAGIC_US && hdr->magic != PCAP_MAGIC_NS) ||
+        replay_swap32(hdr->linktype, swapped) != PCAP_LINKTYPE_ETHERNET) {
+        fprintf(stderr, "%s: not an ethernet pcap file\n", path);
+        replay_unload();
+        return -1;
+    }
+
+    size_t cap = 64;
+    frames = malloc(cap * sizeof(replay_frame_t));
+    for (size_t off = sizeof(pcap_file_hdr_t); off + sizeof(pcap_rec_hdr_t) <= map_len;) {
+        pcap_rec_hdr_t *rec = (pcap_rec_hdr_t *)(map_base + off);
+        size_t caplen = replay_swap32(rec->caplen, swapped);
+        off += sizeof(pcap_rec_hdr_t);
+        if (off + caplen > map_len)
+            break;  // 截断的记录
+        if (num_frames == cap) {
+            cap *= 2;
+            frames = realloc(frames, cap * sizeof(replay_frame_t));
+        }
+        frames[num_frames].data = map_base + off;
+        frames[num_frames].len = caplen;
+        if (rewrite)
+            replay_rewrite(frames[num_frames].data, caplen);
+        num_frames++;
+        off += caplen;
+    }
+    return num_frames;
+}
+
+/* ========================= 测量 ========================= */
+
+static uint64_t replay_now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static uint64_t replay_cycles() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return 0;  // 无 TSC 的平台不报告周期数
+#endif
+}
+
+static void replay_echo_tcp(tcp_conn_t *tcp_conn, uint8_t *data, size_t len, uint8_t *src_ip, uint16_t src_port) {
+    tcp_send(tcp_conn, data, len, REPLAY_PORT, src_ip, src_port);
+}
+
+static void replay_event_tcp(tcp_conn_t *tcp_conn, tcp_event_t event, uint8_t *src_ip, uint16_t src_port) {
+    if (event == TCP_EVENT_FIN)
+        tcp_send(tcp_conn, NULL, 0, REPLAY_PORT, src_ip, src_port);
+}
+
+static void replay_echo_udp(uint8_t *data, size_t len, uint8_t *src_ip, uint16_t src_port) {
+    udp_send(data, len, REPLAY_PORT, src_ip, src_port);
+}
+
+static inline void replay_poll() {
+    net_poll();
+    http_schedule();
+}
+
+static double replay_baseline(const char *name) {
+    for (int i = 0; i < num_baseline; i++)
+        if (strcmp(baseline[i].name, name) == 0)
+            return baseline[i].ns_per_packet;
+    return 0;
+}
+
+/**
+ * @brief 回放一个场景并报告结果
+ *
+ * @return int 退化为1，否则为0
+ */
+static int replay_run(const char *dir, const char *name) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s/in.pcap", dir, name);
+    if (replay_load(path) <= 0) {
+        replay_unload();
+        return 0;
+    }
+
+    net_init();
+    tcp_open(REPLAY_PORT, replay_echo_tcp);
+    tcp_set_event_handler(REPLAY_PORT, replay_event_tcp);
+    udp_open(REPLAY_PORT, replay_echo_udp);
+    http_server_init();
+
+    for (size_t i = 0; i < num_frames; i++)  // 预热
+        replay_poll();
+
+    double ns_per_packet = 0, cycles_per_packet = 0, tx_per_packet = 0;
+    for (int round = 0; round < REPLAY_ROUNDS; round++) {
+        uint64_t packets = 0;
+        tx_packets = 0;
+        uint64_t start_ns = replay_now_ns(), start_cycles = replay_cycles(), ns;
+        do {
+            for (long pass = 0; pass < repetitions; pass++)
+                for (size_t i = 0; i < num_frames; i++)
+                    replay_poll();
+            packets += num_frames * repetitions;
+            ns = replay_now_ns() - start_ns;
+        } while (ns < REPLAY_ROUND_MS * 1000000ull);
+        uint64_t cycles = replay_cycles() - start_cycles;
+        if (round == 0 || (double)ns / packets < ns_per_packet) {
+            ns_per_packet = (double)ns / packets;
+            cycles_per_packet = (double)cycles / packets;
+            tx_per_packet = (double)tx_packets / packets;
+        }
+    }
+
+    double base = replay_baseline(name);
+    int regressed = base > 0 && ns_per_packet > base * (1 + tolerance / 100);
+    fprintf(report, "%-14s %6zu %12.0f %10.1f %12.1f %8.2f", name, num_frames,
+            1e9 / ns_per_packet, ns_per_packet, cycles_per_packet, tx_per_packet);
+    if (base > 0)
+        fprintf(report, " %10.1f %+7.1f%%%s\n", base, (ns_per_packet / base - 1) * 100, regressed ? "  REGRESSION" : "");
+    else
+        fprintf(report, " %10s\n", "-");
+
+    if (num_results < REPLAY_MAX_SCENARIOS) {
+        snprintf(results[num_results].name, REPLAY_NAME_LENGTH, "%s", name);
+        results[num_results++].ns_per_packet = ns_per_packet;
+    }
+    replay_unload();
+    return regressed;
+}
+
+/**
+ * @brief 读取基线文件，每行为 "场景名 每包纳秒数"，# 开头为注释
+ *
+ * @return int 成功为0，文件不存在为-1
+ */
+static int replay_read_baseline(const char *path) {
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        fprintf(report, "no baseline at %s, recording this run\n", path);
+        return -1;
+    }
+    char line[256];
+    while (fgets(line, sizeof(line), file) && num_baseline < REPLAY_MAX_SCENARIOS) {
+        replay_result_t *entry = &baseline[num_baseline];
+        if (line[0] != '#' && sscanf(line, "%63s %lf", entry->name, &entry->ns_per_packet) == 2)
+            num_baseline++;
+    }
+    fclose(file);
+    return 0;
+}
+
+static int replay_compare_name(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+int main(int argc, char *argv[]) {
+    const char *baseline_path = REPLAY_BASELINE;
+    const char *write_path = NULL;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:rb:w:t:")) != -1) {
+        switch (opt) {
+            case 'n':
+                repetitions = atol(optarg);
+                break;
+            case 'r':
+                rewrite = 1;
+                break;
+            case 'b':
+                baseline_path = optarg;
+                break;
+            case 'w':
+                write_path = optarg;
+                break;
+            case 't':
+                tolerance = atof(optarg);
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-n min-passes] [-r] [-b baseline] [-w new-baseline] [-t tolerance%%] [data-dir]\n", argv[0]);
+                return 1;
+        }
+    }
+    const char *dir = optind < argc ? argv[optind] : REPLAY_DATA_DIR;
+    if (repetitions < 1) {
+        fprintf(stderr, "invalid arguments\n");
+        return 1;
+    }
+
+    // 协议栈的调试输出丢弃，报告写到原来的标准输出
+    report = fdopen(dup(STDOUT_FILENO), "w");
+    if (!report || !freopen("/dev/null", "w", stdout)) {
+        fprintf(stderr, "cannot redirect stdout\n");
+        return 1;
+    }
+    if (replay_read_baseline(baseline_path) != 0 && !write_path)
+        write_path = baseline_path;
+
+    // 按名称顺序回放含 in.pcap 的场景目录
+    DIR *d = opendir(dir);
+    if (!d) {
+        fprintf(stderr, "cannot open %s\n", dir);
+        return 1;
+    }
+    char *names[REPLAY_MAX_SCENARIOS];
+    int num_names = 0;
+    struct dirent *entry;
+    while ((entry = readdir(d)) != NULL && num_names < REPLAY_MAX_SCENARIOS) {
+        char path[PATH_MAX];
+        snprintf(path, sizeof(path), "%s/%s/in.pcap", dir, entry->d_name);
+        if (entry->d_name[0] != '.' && strlen(entry->d_name) < REPLAY_NAME_LENGTH && access(path, R_OK) == 0)
+            names[num_names++] = strdup(entry->d_name);
+    }
+    closedir(d);
+    qsort(names, num_names, sizeof(char *), replay_compare_name);
+
+    fprintf(report, "best of %d rounds, at least %ld passes and %d ms each%s, tolerance %.0f%%\n", REPLAY_ROUNDS,
+            repetitions, REPLAY_ROUND_MS, rewrite ? ", addresses rewritten" : "", tolerance);
+    fprintf(report, "%-14s %6s %12s %10s %12s %8s %10s\n", "scenario", "frames", "packets/s", "ns/packet",
+            "cycles/pkt", "tx/pkt", "baseline");
+    int regressions = 0;
+    for (int i = 0; i < num_names; i++) {
+        regressions += replay_run(dir, names[i]);
+        free(names[i]);
+    }
+
+    if (write_path) {
+        FILE *file = fopen(write_path, "w");
+        if (!file) {
+            fprintf(stderr, "cannot write %s\n", write_path);
+            return 1;
+        }
+        fprintf(file, "# bench_replay baseline: scenario ns/packet\n");
+        for (int i = 0; i < num_results; i++)
+            fprintf(file, "%s %.1f\n", results[i].name, results[i].ns_per_packet);
+        fclose(file);
+    }
+    if (regressions)
+        fprintf(report, "%d scenario(s) regressed\n", regressions);
+    fclose(report);
+    return regressions ? 1 : 0;
+}
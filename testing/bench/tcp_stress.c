@@ -0,0 +1,378 @@
+/**
+ * @file tcp_stress.c
+ * @brief TCP 连接规模压力测试
+ *
+ * 用进程内的驱动替代网卡，对每个规模 N 先让 N 个模拟客户端全部完成三次握手（同时保持连接），
+ * 再各发送一个数据段，最后由客户端发起 FIN、服务端收到 FIN 事件后关闭，完成四次挥手。
+ * 每个报文段由一次 net_poll 处理并单独计时，报告各阶段的时延分位数、握手期间时延随
+ * 连接数的变化、连接表满导致的失败数与内存占用，用于估算部署规模。
+ *
+ * 连接表为线性查找的 map，容量为 TCP_MAX_CONN_NUM，超出的 SYN 被丢弃并计为失败。
+ * 大规模时每个报文段都要扫描整个连接表，100k 一档需要数分钟。
+ *
+ * 用法: tcp_stress [-d 数据段长度] [连接数...]，默认 1000 10000 100000
+ */
+
+#include "arp.h"
+#include "driver.h"
+#include "ethernet.h"
+#include "ip.h"
+#include "map.h"
+#include "net.h"
+#include "tcp.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#define STRESS_PORT 80                 // 服务端端口
+#define STRESS_PORT_BASE 1024          // 客户端端口起始值
+#define STRESS_PORTS_PER_IP 64000      // 每个客户端 IP 使用的端口数
+#define STRESS_MAX_IPS 4               // 客户端 IP 数，连接数上限为二者之积
+#define STRESS_DECILES 10              // 握手时延按连接数分成的段数
+#define STRESS_FRAME_LEN (sizeof(ether_hdr_t) + ETHERNET_MAX_TRANSPORT_UNIT)
+
+typedef enum stress_state {
+    STRESS_IDLE,         // 未连接
+    STRESS_SYN_SENT,     // 已发送 SYN
+    STRESS_ESTABLISHED,  // 已完成握手
+    STRESS_FIN_SENT,     // 已发送 FIN
+    STRESS_CLOSED,       // 已完成挥手
+    STRESS_FAILED,       // 握手失败（连接表已满）
+} stress_state_t;
+
+typedef struct stress_client {
+    uint8_t state;
+    uint8_t got_fin;   // 是否已收到服务端的 FIN
+    uint32_t snd_nxt;  // 下一个要发送的序号
+    uint32_t rcv_nxt;  // 期望收到的下一个序号
+} stress_client_t;
+
+typedef struct stress_phase {
+    const char *name;
+    uint64_t *samples;  // 每个报文段的处理时间（纳秒）
+    size_t count;
+} stress_phase_t;
+
+static stress_client_t *clients;
+static size_t num_clients;
+static uint8_t client_mac[NET_MAC_LEN] = {0x02, 0x00, 0x00, 0x00, 0x88, 0x02};
+static size_t data_len = 64;
+
+extern _Thread_local map_t arp_table;
+
+static uint8_t frame[STRESS_FRAME_LEN];  // 客户端发往协议栈的帧
+static size_t frame_len;
+
+static size_t open_conns, peak_conns;  // 服务端 ESTABLISHED 与 CLOSED 事件之差
+static uint64_t bytes_delivered, unexpected;
+
+/* ========================= 进程内驱动 ========================= */
+
+static void stress_client_ip(size_t index, uint8_t *ip) {
+    ip[0] = 10;
+    ip[1] = 88;
+    ip[2] = 0;
+    ip[3] = 1 + index / STRESS_PORTS_PER_IP;
+}
+
+static void stress_stack_out(uint8_t *data, size_t len);
+
+static int stress_driver_open() {
+    return 0;
+}
+
+static int stress_driver_recv(buf_t *buf) {
+    if (!frame_len)
+        return 0;
+    buf_init(buf, frame_len);
+    memcpy(buf->data, frame, frame_len);
+    size_t len = frame_len;
+    frame_len = 0;
+    return len;
+}
+
+static int stress_driver_send(buf_t *buf) {
+    stress_stack_out(buf->data, buf->len);
+    return 0;
+}
+
+static void stress_driver_close() {
+}
+
+static const driver_ops_t stress_driver = {
+    .name = "stress",
+    .rank = 10,
+    .open = stress_driver_open,
+    .recv = stress_driver_recv,
+    .send = stress_driver_send,
+    .close = stress_driver_close,
+};
+DRIVER_REGISTER(stress_driver)
+
+/* ========================= 模拟客户端 ========================= */
+
+/**
+ * @brief 构造客户端的一个 TCP 报文段，由下一次 net_poll 交给协议栈
+ */
+static void stress_send(size_t index, uint8_t flags, size_t len) {
+    stress_client_t *client = &clients[index];
+    size_t seg_len = sizeof(tcp_hdr_t) + len;
+    frame_len = sizeof(ether_hdr_t) + sizeof(ip_hdr_t) + seg_len;
+    memset(frame, 0, frame_len + 1);  // 奇数长度时校验和的填充字节为0
+
+    ether_hdr_t *eth = (ether_hdr_t *)frame;
+    memcpy(eth->dst, net_if_mac, NET_MAC_LEN);
+    memcpy(eth->src, client_mac, NET_MAC_LEN);
+    eth->protocol16 = swap16(NET_PROTOCOL_IP);
+
+    ip_hdr_t *ip = (ip_hdr_t *)(eth + 1);
+    tcp_hdr_t *tcp = (tcp_hdr_t *)(ip + 1);
+    tcp->src_port16 = swap16(STRESS_PORT_BASE + index % STRESS_PORTS_PER_IP);
+    tcp->dst_port16 = swap16(STRESS_PORT);
+    tcp->seq = swap32(client->snd_nxt);
+    tcp->ack = swap32(client->rcv_nxt);
+    tcp->doff = (sizeof(tcp_hdr_t) / 4) << 4;
+    tcp->flags = flags;
+    tcp->win = swap16(UINT16_MAX);
+    memset(tcp + 1, 'x', len);
+
+    ip->version = IP_VERSION_4;
+    ip->hdr_len = sizeof(ip_hdr_t) / IP_HDR_LEN_PER_BYTE;
+    ip->total_len16 = swap16(sizeof(ip_hdr_t) + seg_len);
+    ip->ttl = IP_DEFALUT_TTL;
+    ip->protocol = NET_PROTOCOL_TCP;
+    stress_client_ip(index, ip->src_ip);
+    memcpy(ip->dst_ip, net_if_ip, NET_IP_LEN);
+    ip->hdr_checksum16 = checksum16((uint16_t *)ip, sizeof(ip_hdr_t) / 2);
+
+    // 伪首部校验和
+    uint32_t sum = 0;
+    uint16_t *words = (uint16_t *)ip->src_ip;
+    for (int i = 0; i < 4; i++)
+        sum += words[i];
+    sum += swap16(NET_PROTOCOL_TCP) + swap16(seg_len);
+    sum += (uint16_t)~checksum16((uint16_t *)tcp, (seg_len + 1) / 2);
+    while (sum >> 16)
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    tcp->checksum16 = ~sum;
+
+    client->snd_nxt += len + TCP_FLG_ISSET(flags, TCP_FLG_SYN) + TCP_FLG_ISSET(flags, TCP_FLG_FIN);
+}
+
+/**
+ * @brief 处理协议栈发出的一帧，推进对应客户端的状态
+ */
+static void stress_stack_out(uint8_t *data, size_t len) {
+    ether_hdr_t *eth = (ether_hdr_t *)data;
+    if (swap16(eth->protocol16) != NET_PROTOCOL_IP)
+        return;
+    ip_hdr_t *ip = (ip_hdr_t *)(eth + 1);
+    if (ip->protocol != NET_PROTOCOL_TCP)
+        return;
+    tcp_hdr_t *tcp = (tcp_hdr_t *)((uint8_t *)ip + ip->hdr_len * IP_HDR_LEN_PER_BYTE);
+    size_t index = (size_t)(ip->dst_ip[3] - 1) * STRESS_PORTS_PER_IP + swap16(tcp->dst_port16) - STRESS_PORT_BASE;
+    if (index >= num_clients) {
+        unexpected++;
+        return;
+    }
+    stress_client_t *client = &clients[index];
+    size_t payload = swap16(ip->total_len16) - ip->hdr_len * IP_HDR_LEN_PER_BYTE - (tcp->doff >> 4) * 4;
+    uint8_t flags = tcp->flags;
+    if (TCP_FLG_ISSET(flags, TCP_FLG_SYN) && TCP_FLG_ISSET(flags, TCP_FLG_ACK) && client->state == STRESS_SYN_SENT) {
+        client->rcv_nxt = swap32(tcp->seq) + 1;
+        client->state = STRESS_ESTABLISHED;
+    } else if (TCP_FLG_ISSET(flags, TCP_FLG_FIN)) {
+        client->rcv_nxt = swap32(tcp->seq) + payload + 1;
+        client->got_fin = 1;
+    } else if (TCP_FLG_ISSET(flags, TCP_FLG_RST)) {
+        unexpected++;
+    }
+}
+
+/* ========================= 服务端应用 ========================= */
+
+static void stress_handler(tcp_conn_t *tcp_conn, uint8_t *data, size_t len, uint8_t *src_ip, uint16_t src_port) {
+    bytes_delivered += len;
+}
+
+static void stress_event_handler(tcp_conn_t *tcp_conn, tcp_event_t event, uint8_t *src_ip, uint16_t src_port) {
+    if (event == TCP_EVENT_ESTABLISHED) {
+        if (++open_conns > peak_conns)
+            peak_conns = open_conns;
+    } else if (event == TCP_EVENT_FIN) {
+        tcp_send(tcp_conn, NULL, 0, STRESS_PORT, src_ip, src_port);  // 被动关闭
+    } else if (event == TCP_EVENT_CLOSED && tcp_conn->state != TCP_STATE_LISTEN &&
+               tcp_conn->state != TCP_STATE_SYN_RECEIVED) {
+        open_conns--;
+    }
+}
+
+/* ========================= 测量 ========================= */
+
+static uint64_t stress_now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * @brief 把已构造的报文段交给协议栈，记录处理时间
+ */
+static uint64_t stress_poll(stress_phase_t *phase) {
+    uint64_t start = stress_now_ns();
+    net_poll();
+    uint64_t ns = stress_now_ns() - start;
+    phase->samples[phase->count++] = ns;
+    return ns;
+}
+
+static int stress_compare(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static void stress_report_phase(stress_phase_t *phase) {
+    if (!phase->count)
+        return;
+    uint64_t total = 0;
+    for (size_t i = 0; i < phase->count; i++)
+        total += phase->samples[i];
+    qsort(phase->samples, phase->count, sizeof(uint64_t), stress_compare);
+    printf("  %-10s %9zu segs  avg %10.0f ns  p50 %10llu  p99 %10llu  max %10llu\n", phase->name, phase->count,
+           (double)total / phase->count, (unsigned long long)phase->samples[phase->count / 2],
+           (unsigned long long)phase->samples[phase->count * 99 / 100], (unsigned long long)phase->samples[phase->count - 1]);
+}
+
+static long stress_rss_kb() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+static void stress_run(size_t n) {
+    num_clients = n;
+    clients = calloc(n, sizeof(stress_client_t));
+    stress_phase_t handshake = {"handshake", malloc(2 * n * sizeof(uint64_t)), 0};
+    stress_phase_t data = {"data", malloc(n * sizeof(uint64_t)), 0};
+    stress_phase_t teardown = {"teardown", malloc(2 * n * sizeof(uint64_t)), 0};
+    uint64_t decile_ns[STRESS_DECILES] = {0}, decile_segs[STRESS_DECILES] = {0};
+    size_t decile_conns[STRESS_DECILES] = {0};
+
+    // 每个规模从干净的协议栈开始
+    net_init();
+    tcp_open(STRESS_PORT, stress_handler);
+    tcp_set_event_handler(STRESS_PORT, stress_event_handler);
+    for (size_t i = 0; i < (n + STRESS_PORTS_PER_IP - 1) / STRESS_PORTS_PER_IP; i++) {
+        uint8_t ip[NET_IP_LEN];
+        stress_client_ip(i * STRESS_PORTS_PER_IP, ip);
+        map_set(&arp_table, ip, client_mac);
+    }
+    open_conns = peak_conns = 0;
+    bytes_delivered = unexpected = 0;
+
+    // 握手：全部连接同时保持
+    size_t failures = 0;
+    for (size_t i = 0; i < n; i++) {
+        size_t decile = i * STRESS_DECILES / n;
+        clients[i].snd_nxt = rand();
+        clients[i].state = STRESS_SYN_SENT;
+        stress_send(i, TCP_FLG_SYN, 0);
+        decile_ns[decile] += stress_poll(&handshake);
+        decile_segs[decile]++;
+        if (clients[i].state != STRESS_ESTABLISHED) {
+            clients[i].state = STRESS_FAILED;
+            failures++;
+            continue;
+        }
+        stress_send(i, TCP_FLG_ACK, 0);
+        decile_ns[decile] += stress_poll(&handshake);
+        decile_segs[decile]++;
+        decile_conns[decile] = open_conns;
+    }
+    size_t established = open_conns;
+    long rss_open = stress_rss_kb();
+
+    // 数据：每个连接一个数据段
+    for (size_t i = 0; i < n; i++) {
+        if (clients[i].state != STRESS_ESTABLISHED)
+            continue;
+        stress_send(i, TCP_FLG_ACK | TCP_FLG_PSH, data_len);
+        stress_poll(&data);
+    }
+
+    // 挥手：客户端 FIN，服务端确认并关闭，客户端确认服务端的 FIN
+    size_t closed = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (clients[i].state != STRESS_ESTABLISHED)
+            continue;
+        stress_send(i, TCP_FLG_FIN | TCP_FLG_ACK, 0);
+        clients[i].state = STRESS_FIN_SENT;
+        stress_poll(&teardown);
+        if (!clients[i].got_fin)
+            continue;
+        stress_send(i, TCP_FLG_ACK, 0);
+        stress_poll(&teardown);
+        clients[i].state = STRESS_CLOSED;
+        closed++;
+    }
+
+    printf("%zu connections: %zu established, %zu failed (table full), %zu closed, %zu left open, "
+           "%llu bytes delivered, %llu unexpected segments\n",
+           n, established, failures, closed, open_conns, (unsigned long long)bytes_delivered, (unsigned long long)unexpected);
+    printf("  memory: %zu-byte table entries, capacity %zu, %zu KB in use at peak, max RSS %ld KB\n",
+           sizeof(tcp_key_t) + sizeof(tcp_conn_t) + sizeof(time_t), (size_t)TCP_MAX_CONN_NUM,
+           peak_conns * (sizeof(tcp_key_t) + sizeof(tcp_conn_t) + sizeof(time_t)) / 1024, rss_open);
+    stress_report_phase(&handshake);
+    stress_report_phase(&data);
+    stress_report_phase(&teardown);
+    printf("  handshake latency by open connections:\n");
+    for (int d = 0; d < STRESS_DECILES; d++)
+        if (decile_segs[d])
+            printf("    up to %9zu open  %10.0f ns/seg\n", decile_conns[d], (double)decile_ns[d] / decile_segs[d]);
+    fflush(stdout);
+
+    free(handshake.samples);
+    free(data.samples);
+    free(teardown.samples);
+    free(clients);
+}
+
+int main(int argc, char *argv[]) {
+    int opt;
+    while ((opt = getopt(argc, argv, "d:")) != -1) {
+        switch (opt) {
+            case 'd':
+                data_len = atoi(optarg);
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-d data-bytes] [connections...]\n", argv[0]);
+                return 1;
+        }
+    }
+    if (data_len < 1 || data_len > ETHERNET_MAX_TRANSPORT_UNIT - sizeof(ip_hdr_t) - sizeof(tcp_hdr_t)) {
+        fprintf(stderr, "invalid arguments\n");
+        return 1;
+    }
+
+    static const size_t default_levels[] = {1000, 10000, 100000};
+    size_t levels[16];
+    int num_levels = 0;
+    for (int i = optind; i < argc && num_levels < 16; i++)
+        levels[num_levels++] = strtoul(argv[i], NULL, 10);
+    if (!num_levels)
+        for (; num_levels < 3; num_levels++)
+            levels[num_levels] = default_levels[num_levels];
+
+    printf("connection table capacity %zu, MAP_MAX_LEN %d bytes, %zu-byte data segments\n",
+           (size_t)TCP_MAX_CONN_NUM, MAP_MAX_LEN, data_len);
+    for (int i = 0; i < num_levels; i++) {
+        if (levels[i] < 1 || levels[i] > (size_t)STRESS_MAX_IPS * STRESS_PORTS_PER_IP) {
+            fprintf(stderr, "skipping %zu connections: supported range is 1..%d\n", levels[i], STRESS_MAX_IPS * STRESS_PORTS_PER_IP);
+            continue;
+        }
+        stress_run(levels[i]);
+    }
+    return 0;
+}
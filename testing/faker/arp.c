@@ -12,8 +12,8 @@ char *print_ip(uint8_t *ip);
 char *print_mac(uint8_t *mac);
 void fprint_buf(FILE *f, buf_t *buf);
 
-map_t arp_table;
-map_t arp_buf;
+_Thread_local map_t arp_table;
+_Thread_local map_t arp_buf;
 
 // void arp_update(uint8_t *ip, uint8_t *mac, arp_state_t state)
 // {
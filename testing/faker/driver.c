@@ -1,5 +1,7 @@
 #include "buf.h"
 #include "config.h"
+#include "driver.h"
+#include "net.h"
 
 #include <pcap.h>
 #include <string.h>
@@ -12,6 +14,39 @@ extern FILE *pcap_in;
 extern FILE *pcap_out;
 extern FILE *control_flow;
 
+#define FAKER_CLOCK_BASE_US 1000000  // 输入时间戳从0开始时虚拟时钟的起点，避免与 map 的空项时间戳0混淆
+
+static int held;                      // 是否有预读、尚未交给协议栈的结果
+static int held_ret;                  // 预读时 pcap_next_ex 的返回值
+static struct pcap_pkthdr *held_hdr;  // 预读的报文
+static const uint8_t *held_data;
+static uint64_t clock_first_us;  // 第一个输入报文的时间戳
+static uint64_t clock_base_us;   // 第一个输入报文对应的虚拟时间
+static uint64_t clock_now_us;    // 当前虚拟时间
+
+/**
+ * @brief 由输入报文时间戳推进的虚拟时钟
+ *
+ * @return uint64_t 当前虚拟时间（微秒）
+ */
+static uint64_t faker_clock() {
+    return clock_now_us;
+}
+
+/**
+ * @brief 读取下一个报文，先交出 driver_open 时预读的报文
+ *
+ */
+static int faker_next(struct pcap_pkthdr **pkt_hdr, const uint8_t **pkt_data) {
+    if (held) {
+        held = 0;
+        *pkt_hdr = held_hdr;
+        *pkt_data = held_data;
+        return held_ret;
+    }
+    return pcap_next_ex(pcap, pkt_hdr, pkt_data);
+}
+
 #ifdef _WIN32
 #include <tchar.h>
 BOOL LoadNpcapDlls() {
@@ -31,7 +66,7 @@ BOOL LoadNpcapDlls() {
 }
 #endif
 
-int driver_open() {
+static int faker_driver_open() {
 #ifdef _WIN32
     /* Load Npcap and its functions. */
     if (!LoadNpcapDlls()) {
@@ -51,18 +86,32 @@ int driver_open() {
         return -1;
     }
 
+    // 预读第一个报文以确定虚拟时钟的起点，使协议栈初始化时的时间也是确定的
+    held_ret = pcap_next_ex(pcap, &held_hdr, &held_data);
+    held = 1;
+    clock_first_us = 0;
+    if (held_ret == 1)
+        clock_first_us = (uint64_t)held_hdr->ts.tv_sec * 1000000 + held_hdr->ts.tv_usec;
+    clock_base_us = clock_first_us ? clock_first_us : FAKER_CLOCK_BASE_US;
+    clock_now_us = clock_base_us;
+    net_set_clock(faker_clock);
+
     fprintf(control_flow, "driver opened\n");
     return 0;
 }
 
-int driver_recv(buf_t *buf) {
+static int faker_driver_recv(buf_t *buf) {
     struct pcap_pkthdr *pkt_hdr;
     const uint8_t *pkt_data;
-    int ret = pcap_next_ex(pcap, &pkt_hdr, &pkt_data);
+    int ret = faker_next(&pkt_hdr, &pkt_data);
     if (ret == PCAP_ERROR_BREAK) {
         // printf("meet end of file\n");
         return 0;
     } else if (ret == 1) {
+        // 虚拟时间随报文时间戳推进，时间戳回退时保持不变
+        uint64_t ts = (uint64_t)pkt_hdr->ts.tv_sec * 1000000 + pkt_hdr->ts.tv_usec;
+        if (ts >= clock_first_us && clock_base_us + (ts - clock_first_us) > clock_now_us)
+            clock_now_us = clock_base_us + (ts - clock_first_us);
         buf_init(buf, pkt_hdr->len);
         memcpy(buf->data, pkt_data, pkt_hdr->len);
         return pkt_hdr->len;
@@ -72,17 +121,29 @@ int driver_recv(buf_t *buf) {
     }
 }
 
-int driver_send(buf_t *buf) {
+static int faker_driver_send(buf_t *buf) {
     struct pcap_pkthdr header;
-    memset(&header.ts, 0, sizeof(header.ts));
+    header.ts.tv_sec = clock_now_us / 1000000;
+    header.ts.tv_usec = clock_now_us % 1000000;
     header.caplen = buf->len;
     header.len = buf->len;
     pcap_dump((u_char *)pdump, &header, buf->data);
     return 0;
 }
 
-void driver_close() {
+static void faker_driver_close() {
     fprintf(control_flow, "\ndriver closed\n");
     pcap_dump_close(pdump);
     pcap_close(pcap);
+    net_set_clock(NULL);
 }
+
+static const driver_ops_t faker_driver = {
+    .name = "faker",
+    .rank = 10,
+    .open = faker_driver_open,
+    .recv = faker_driver_recv,
+    .send = faker_driver_send,
+    .close = faker_driver_close,
+};
+DRIVER_REGISTER(faker_driver)
@@ -35,8 +35,8 @@ FILE *tcp_fout;
 FILE *out_log;
 FILE *demo_log;
 
-extern map_t arp_table;
-extern map_t arp_buf;
+extern _Thread_local map_t arp_table;
+extern _Thread_local map_t arp_buf;
 
 // char* state[16] = {
 //         [ARP_PENDING] "pending",
@@ -145,7 +145,7 @@ static inline void *map_entry_get(map_t *map, size_t pos) {
 
 static inline int map_entry_valid(map_t *map, const void *entry) {
     time_t entry_time = *(time_t *)((uint8_t *)entry + map->key_len + map->value_len);
-    return entry_time && (!map->timeout || entry_time + map->timeout >= time(NULL));
+    return entry_time && (!map->timeout || entry_time + map->timeout >= net_time());
 }
 
 void log_tab_buf() {
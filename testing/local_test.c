@@ -0,0 +1,134 @@
+#include "arp.h"
+#include "driver.h"
+#include "ethernet.h"
+#include "ip.h"
+#include "tcp.h"
+#include "udp.h"
+#include "testing/log.h"
+
+#include <string.h>
+
+extern FILE *pcap_in;
+extern FILE *pcap_out;
+extern FILE *pcap_demo;
+extern FILE *control_flow;
+extern FILE *icmp_fout;
+extern FILE *demo_log;
+extern FILE *out_log;
+extern FILE *arp_log_f;
+
+char *print_ip(uint8_t *ip);
+
+int check_log();
+int check_pcap();
+FILE *open_file(char *path, char *name, char *mode);
+
+void log_tab_buf();
+
+#define LOCAL_TEST_ROUNDS 8
+
+uint8_t loopback_ip[NET_IP_LEN] = {127, 0, 0, 1};
+
+void udp_server_handler(uint8_t *data, size_t len, uint8_t *src_ip, uint16_t src_port) {
+    fprintf(control_flow, "udp 60000 <- %s:%u: %.*s\n", print_ip(src_ip), src_port, (int)len, data);
+    udp_send(data, len, 60000, src_ip, src_port);  // 原样回复
+}
+
+void udp_client_handler(uint8_t *data, size_t len, uint8_t *src_ip, uint16_t src_port) {
+    fprintf(control_flow, "udp 50000 <- %s:%u: %.*s\n", print_ip(src_ip), src_port, (int)len, data);
+}
+
+void tcp_server_handler(tcp_conn_t *tcp_conn, uint8_t *data, size_t len, uint8_t *src_ip, uint16_t src_port) {
+    fprintf(control_flow, "tcp 80 <- %s:%u: %.*s\n", print_ip(src_ip), src_port, (int)len, data);
+    tcp_send(tcp_conn, data, len, 80, src_ip, src_port);
+}
+
+void tcp_client_handler(tcp_conn_t *tcp_conn, uint8_t *data, size_t len, uint8_t *src_ip, uint16_t src_port) {
+    fprintf(control_flow, "tcp 40000 <- %s:%u: %.*s\n", print_ip(src_ip), src_port, (int)len, data);
+}
+
+void tcp_client_event_handler(tcp_conn_t *tcp_conn, tcp_event_t event, uint8_t *src_ip, uint16_t src_port) {
+    fprintf(control_flow, "tcp 40000 event %d from %s:%u\n", event, print_ip(src_ip), src_port);
+    if (event == TCP_EVENT_ESTABLISHED)
+        tcp_send(tcp_conn, (uint8_t *)"over tcp", 8, 40000, src_ip, src_port);
+}
+
+int main(int argc, char *argv[]) {
+    PRINT_INFO("Test begin.\n");
+    pcap_in = open_file(argv[1], "in.pcap", "r");
+    pcap_out = open_file(argv[1], "out.pcap", "w");
+    control_flow = open_file(argv[1], "log", "w");
+    if (pcap_in == 0 || pcap_out == 0 || control_flow == 0) {
+        if (pcap_in)
+            fclose(pcap_in);
+        else
+            PRINT_ERROR("Failed to open in.pcap\n");
+        if (pcap_out)
+            fclose(pcap_out);
+        else
+            PRINT_ERROR("Failed to open out.pcap\n");
+        if (control_flow)
+            fclose(control_flow);
+        else
+            PRINT_ERROR("Failed to open log\n");
+        return -1;
+    }
+    icmp_fout = control_flow;
+    arp_log_f = control_flow;
+
+    net_init();
+    udp_open(60000, udp_server_handler);
+    udp_open(50000, udp_client_handler);
+    tcp_open(80, tcp_server_handler);
+    tcp_open(40000, tcp_client_handler);
+    tcp_set_event_handler(40000, tcp_client_event_handler);
+    log_tab_buf();
+
+    // 发往本机地址与回环地址的数据包都应在轮询中直接投递，不产生任何输出帧与arp表项
+    PRINT_INFO("Polling round 01");
+    for (int i = 1; i <= LOCAL_TEST_ROUNDS; i++) {
+        printf("\b\b%02d", i);
+        fprintf(control_flow, "\nRound %02d -----------------------------\n", i);
+        if (i == 1) {
+            udp_send((uint8_t *)"to own ip", 9, 50000, net_if_ip, 60000);
+            udp_send((uint8_t *)"to loopback", 11, 50000, loopback_ip, 60000);
+        } else if (i == 2) {
+            tcp_connect(40000, net_if_ip, 80);
+        }
+        net_poll();
+        log_tab_buf();
+    }
+    driver_close();
+    PRINT_INFO("\nAll rounds polled, checking output\n");
+
+    fclose(control_flow);
+
+    demo_log = open_file(argv[1], "demo_log", "r");
+    out_log = open_file(argv[1], "log", "r");
+    pcap_out = open_file(argv[1], "out.pcap", "r");
+    pcap_demo = open_file(argv[1], "demo_out.pcap", "r");
+    if (demo_log == 0 || out_log == 0 || pcap_out == 0 || pcap_demo == 0) {
+        if (demo_log)
+            fclose(demo_log);
+        else
+            PRINT_ERROR("Failed to open demo_log\n");
+        if (out_log)
+            fclose(out_log);
+        else
+            PRINT_ERROR("Failed to open log\n");
+        if (pcap_demo)
+            fclose(pcap_demo);
+        else
+            PRINT_ERROR("Failed to open demo_out.pcap\n");
+        if (pcap_out)
+            fclose(pcap_out);
+        else
+            PRINT_ERROR("Failed to open out.pcap\n");
+        return -1;
+    }
+    int ret = check_log();
+    ret |= check_pcap() ? 1 : 0;
+    fclose(demo_log);
+    fclose(out_log);
+    return ret ? -1 : 0;
+}